@@ -0,0 +1,181 @@
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "CharactorTansfer.h"
+
+// Benchmark of the table driven GBK/UTF-8/UTF-16 transcoder of Video_Convert
+// (CharactorTansfer.cpp) against the code page functions it replaced, which
+// are kept below as they were. The input is the kind of text that goes
+// through them all day: ASCII device names, mixed channel titles and plate
+// numbers. For each direction it prints nanoseconds per string and MB/s of
+// input for the old function, the new std::string function and the new
+// buffer function writing into a reused buffer, and checks that all of them
+// give the same text.
+//
+//   CharsetBench [strings] [rounds]
+
+static std::string LegacyGbkToUtf8(const std::string& strGbk)
+{
+	int len = MultiByteToWideChar(CHINESE_CODE_PAGE, 0, strGbk.c_str(), -1, NULL, 0);
+	wchar_t* strUnicode = new wchar_t[len];
+	wmemset(strUnicode, 0, len);
+	MultiByteToWideChar(CHINESE_CODE_PAGE, 0, strGbk.c_str(), -1, strUnicode, len);
+
+	len = WideCharToMultiByte(CP_UTF8, 0, strUnicode, -1, NULL, 0, NULL, NULL);
+	char* strUtf8 = new char[len];
+	WideCharToMultiByte(CP_UTF8, 0, strUnicode, -1, strUtf8, len, NULL, NULL);
+
+	std::string strTemp(strUtf8);
+	delete[] strUnicode;
+	delete[] strUtf8;
+	return strTemp;
+}
+
+static std::string LegacyUtf8ToGbk(const std::string& strUtf8)
+{
+	int len = MultiByteToWideChar(CP_UTF8, 0, strUtf8.c_str(), -1, NULL, 0);
+	wchar_t* strUnicode = new wchar_t[len];
+	wmemset(strUnicode, 0, len);
+	MultiByteToWideChar(CP_UTF8, 0, strUtf8.c_str(), -1, strUnicode, len);
+
+	len = WideCharToMultiByte(CHINESE_CODE_PAGE, 0, strUnicode, -1, NULL, 0, NULL, NULL);
+	char* strGbk = new char[len];
+	memset(strGbk, 0, len);
+	WideCharToMultiByte(CHINESE_CODE_PAGE, 0, strUnicode, -1, strGbk, len, NULL, NULL);
+
+	std::string strTemp(strGbk);
+	delete[] strUnicode;
+	delete[] strGbk;
+	return strTemp;
+}
+
+static std::wstring LegacyGbkToUnicode(const std::string& strGbk)
+{
+	int len = MultiByteToWideChar(CHINESE_CODE_PAGE, 0, strGbk.c_str(), -1, NULL, 0);
+	wchar_t* strUnicode = new wchar_t[len];
+	wmemset(strUnicode, 0, len);
+	MultiByteToWideChar(CHINESE_CODE_PAGE, 0, strGbk.c_str(), -1, strUnicode, len);
+
+	std::wstring strTemp(strUnicode);
+	delete[] strUnicode;
+	return strTemp;
+}
+
+// A GB2312 level 1 hanzi, B0A1..D7F9
+static void AppendHanzi(std::string& s, uint32_t r)
+{
+	s += (char)(0xB0 + r % 40);
+	s += (char)(0xA1 + (r / 40) % 89);
+}
+
+static std::vector<std::string> MakeCorpus(int count)
+{
+	static const char* models[] = { "IPC-HFW2431S-S-S2", "DH-SD49425XB-HNR", "NVR5216-16P-I", "ITC237-PW6M-IRLZF" };
+	std::vector<std::string> corpus;
+	uint32_t seed = 1;
+	for (int i = 0; i < count; i++) {
+		seed = seed * 1103515245 + 12345;
+		uint32_t r = seed >> 8;
+		std::string s;
+		switch (i % 3) {
+		case 0:	// device name
+			s = std::string(models[r % 4]) + " 192.168." + std::to_string(r % 255) + "." + std::to_string(i % 250 + 1);
+			break;
+		case 1:	// channel title: hanzi, a number, more hanzi
+			for (uint32_t j = 0; j < 2 + r % 4; j++)
+				AppendHanzi(s, r * 31 + j * 7);
+			s += std::to_string(i % 32 + 1) + " ";
+			for (uint32_t j = 0; j < 2 + r % 3; j++)
+				AppendHanzi(s, r * 17 + j * 13);
+			s += " Camera " + std::to_string(i % 64);
+			break;
+		default:	// plate: province, letter, five letters or digits
+			AppendHanzi(s, r);
+			s += (char)('A' + r % 26);
+			for (int j = 0; j < 5; j++)
+				s += "0123456789ABCDEFGHJKLMNPQRSTUVWXYZ"[(r >> (j * 4)) % 34];
+			break;
+		}
+		corpus.push_back(s);
+	}
+	return corpus;
+}
+
+template<typename F>
+static double Time(int rounds, F f)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int i = 0; i < rounds; i++)
+		f();
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+static void Print(const char* name, double seconds, size_t strings, size_t bytes, double baseline)
+{
+	printf("  %-28s %8.1f ns/string %8.1f MB/s", name, seconds * 1e9 / strings, bytes / seconds / 1e6);
+	if (baseline > 0)
+		printf("  %5.1fx", baseline / seconds);
+	printf("\n");
+}
+
+int main(int argc, char* argv[])
+{
+	int count = argc > 1 ? atoi(argv[1]) : 30000;
+	int rounds = argc > 2 ? atoi(argv[2]) : 20;
+	if (count < 1 || rounds < 1) {
+		printf("usage: %s [strings] [rounds]\n", argv[0]);
+		return 1;
+	}
+
+	std::vector<std::string> gbk = MakeCorpus(count);
+	std::vector<std::string> utf8;
+	size_t gbkBytes = 0, utf8Bytes = 0;
+	for (const std::string& s : gbk) {
+		utf8.push_back(LegacyGbkToUtf8(s));
+		gbkBytes += s.size();
+		utf8Bytes += utf8.back().size();
+	}
+	size_t strings = (size_t)count * rounds;
+	printf("%d strings, %zu GBK bytes, %d rounds\n", count, gbkBytes, rounds);
+
+	int mismatches = 0;
+	for (int i = 0; i < count; i++) {
+		if (GbkToUtf8(gbk[i]) != utf8[i] || Utf8ToGbk(utf8[i]) != LegacyUtf8ToGbk(utf8[i])
+			|| GbkToUnicode(gbk[i]) != LegacyGbkToUnicode(gbk[i]))
+			mismatches++;
+	}
+
+	std::vector<char> buf(GBK_TO_UTF8_MAX(256));
+	std::vector<char16_t> buf16(GBK_TO_UTF16_MAX(256));
+	size_t sink = 0;
+	double base;
+
+	printf("GBK to UTF-8\n");
+	base = Time(rounds, [&] { for (const std::string& s : gbk) sink += LegacyGbkToUtf8(s).size(); });
+	Print("code page (old)", base, strings, gbkBytes * rounds, 0);
+	Print("GbkToUtf8 std::string", Time(rounds, [&] { for (const std::string& s : gbk) sink += GbkToUtf8(s).size(); }), strings, gbkBytes * rounds, base);
+	Print("GbkToUtf8 buffer", Time(rounds, [&] { for (const std::string& s : gbk) sink += GbkToUtf8(s.data(), s.size(), buf.data(), buf.size()); }), strings, gbkBytes * rounds, base);
+
+	printf("UTF-8 to GBK\n");
+	base = Time(rounds, [&] { for (const std::string& s : utf8) sink += LegacyUtf8ToGbk(s).size(); });
+	Print("code page (old)", base, strings, utf8Bytes * rounds, 0);
+	Print("Utf8ToGbk std::string", Time(rounds, [&] { for (const std::string& s : utf8) sink += Utf8ToGbk(s).size(); }), strings, utf8Bytes * rounds, base);
+	Print("Utf8ToGbk buffer", Time(rounds, [&] { for (const std::string& s : utf8) sink += Utf8ToGbk(s.data(), s.size(), buf.data(), buf.size()); }), strings, utf8Bytes * rounds, base);
+
+	printf("GBK to UTF-16\n");
+	base = Time(rounds, [&] { for (const std::string& s : gbk) sink += LegacyGbkToUnicode(s).size(); });
+	Print("code page (old)", base, strings, gbkBytes * rounds, 0);
+	Print("GbkToUnicode std::wstring", Time(rounds, [&] { for (const std::string& s : gbk) sink += GbkToUnicode(s).size(); }), strings, gbkBytes * rounds, base);
+	Print("GbkToUtf16 buffer", Time(rounds, [&] { for (const std::string& s : gbk) sink += GbkToUtf16(s.data(), s.size(), buf16.data(), buf16.size()); }), strings, gbkBytes * rounds, base);
+
+	// Keeps the optimizer from dropping the loops
+	printf("(%zu units)\n", sink);
+	if (mismatches > 0) {
+		printf("%d strings convert differently from the code page functions\n", mismatches);
+		return 1;
+	}
+	return 0;
+}
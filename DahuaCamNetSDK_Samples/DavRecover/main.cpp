@@ -0,0 +1,121 @@
+#include <stdio.h>
+#include <string.h>
+#include <filesystem>
+#include <string>
+#include <vector>
+#include "DavRecovery.h"
+
+// Command line front end of DavRecovery (Video_Convert). Checks DAV files
+// left behind by a crash or power cut during recording, cuts a partial
+// frame off the end, with -repair also drops damaged regions inside the
+// file, and prints a RecoverReport per file. Run it before recording
+// resumes; the files must not be open for writing.
+//
+//   DavRecover [-scan | -truncate | -repair] [-noindex] [-rescan] <file.dav | directory>...
+//
+// -scan only reports, -truncate is the default. -noindex writes no .idx
+// sidecar, -rescan reads files whose sidecar is up to date as well. A
+// directory is searched for *.dav below it. The exit code is 0 when every
+// file was sound or has been recovered.
+
+static const char* ErrorName(int error)
+{
+	switch (error) {
+	case RECOVER_OK:
+		return "ok";
+	case RECOVER_ERR_OPEN:
+		return "cannot open";
+	case RECOVER_ERR_NO_FRAME:
+		return "no complete frame, left untouched";
+	case RECOVER_ERR_WRITE:
+		return "write failed";
+	case RECOVER_ERR_CANCELED:
+		return "canceled";
+	default:
+		return "unknown error";
+	}
+}
+
+static const char* ActionName(int action, int mode)
+{
+	switch (action) {
+	case RECOVER_ACTION_TRUNCATED:
+		return "truncated";
+	case RECOVER_ACTION_REPAIRED:
+		return "repaired";
+	default:
+		return mode == RECOVER_MODE_SCAN ? "scanned" : "unchanged";
+	}
+}
+
+static void Print(const RecoverReport& r, int mode)
+{
+	printf("%s: %s", r.file.c_str(), ErrorName(r.error));
+	if (r.error == RECOVER_OK)
+		printf(", %s", ActionName(r.action, mode));
+	if (r.bFromIndex)
+		printf(", from index");
+	if (r.bIndexWritten)
+		printf(", index written");
+	printf("\n");
+	if (r.error != RECOVER_OK && r.error != RECOVER_ERR_WRITE)
+		return;
+	printf("  %lld of %lld bytes valid, %llu damaged; %u frames, %u key frames, %.1f s\n",
+		(long long)r.validSize, (long long)r.fileSize, (unsigned long long)r.nDamaged,
+		r.nFrames, r.nKeyFrames, (double)r.durationMs / 1000);
+}
+
+int main(int argc, char* argv[])
+{
+	RecoverOptions options;
+	std::vector<std::string> paths;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-scan") == 0)
+			options.mode = RECOVER_MODE_SCAN;
+		else if (strcmp(argv[i], "-truncate") == 0)
+			options.mode = RECOVER_MODE_TRUNCATE;
+		else if (strcmp(argv[i], "-repair") == 0)
+			options.mode = RECOVER_MODE_REPAIR;
+		else if (strcmp(argv[i], "-noindex") == 0)
+			options.bWriteIndex = false;
+		else if (strcmp(argv[i], "-rescan") == 0)
+			options.bTrustIndex = false;
+		else if (argv[i][0] != '-')
+			paths.push_back(argv[i]);
+		else {
+			paths.clear();
+			break;
+		}
+	}
+	if (paths.empty()) {
+		printf("usage: %s [-scan | -truncate | -repair] [-noindex] [-rescan] <file.dav | directory>...\n", argv[0]);
+		return 1;
+	}
+
+	std::vector<RecoverReport> reports;
+	DavRecoveryScanner scanner;
+	for (const std::string& path : paths) {
+		std::error_code ec;
+		if (std::filesystem::is_directory(path, ec)) {
+			std::vector<RecoverReport> found = scanner.RecoverDirectory(path, options);
+			if (found.empty())
+				printf("%s: no .dav files\n", path.c_str());
+			reports.insert(reports.end(), found.begin(), found.end());
+		} else {
+			RecoverReport report;
+			DavRecoverFile(path, options, &report);
+			reports.push_back(report);
+		}
+	}
+
+	int nFailed = 0;
+	uint64_t nDamaged = 0;
+	for (const RecoverReport& r : reports) {
+		Print(r, options.mode);
+		if (r.error != RECOVER_OK)
+			nFailed++;
+		nDamaged += r.nDamaged;
+	}
+	printf("%u files, %d failed, %llu damaged bytes\n", (unsigned)reports.size(), nFailed, (unsigned long long)nDamaged);
+	return nFailed == 0 ? 0 : 1;
+}
@@ -0,0 +1,156 @@
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "play.h"
+#include "DavFrame.h"
+#include "PlayFeeder.h"
+
+// How PlayFeeder (Video_Convert) pushes a DAV file into a play port in both
+// stream open modes, without a camera:
+//
+//  file      STREAME_FILE, the file read by FeedFile in pieces sized from
+//            the free source buffer, as VideoConverter does
+//  realtime  STREAME_REALTIME, one Input per DAV frame paced by the stream
+//            stamps, as the realplay data callback delivers it, waiting at
+//            most timeoutMs for space and dropping the rest
+//
+// Each mode then waits for the port to play everything, and prints the run
+// time and FeederStats: pushes and their sizes, rejected pushes, how often
+// and how long the feeder blocked, dropped bytes, stalls and the highest
+// source buffer fill.
+//
+//   FeederBench <file.dav> [bufKB] [timeoutMs] [speed]
+//
+// speed > 1 feeds the realtime mode faster than the stamps, which shows how
+// the feeder behaves when the port falls behind.
+
+struct BenchFrame
+{
+	std::vector<BYTE> data;
+	int64_t ptsMs;
+};
+
+static void OnDavFrame(const DavFrame& frame, void* pUser)
+{
+	std::vector<BenchFrame>* pFrames = (std::vector<BenchFrame>*)pUser;
+	BenchFrame copy;
+	copy.data.assign(frame.data, frame.data + frame.length);
+	copy.ptsMs = frame.ptsMs;
+	pFrames->push_back(copy);
+}
+
+// Rendered frames wake the feeder's drain wait once the source buffer is empty
+static void CALLBACK OnDisplay(LONG nPort, char* pBuf, LONG nSize, LONG nWidth, LONG nHeight, LONG nStamp, LONG nType, void* pUserData)
+{
+	((PlayFeeder*)pUserData)->Progress();
+}
+
+static void Print(const char* name, double seconds, bool bFed, bool bDrained, DWORD nBufSize, const FeederStats& s)
+{
+	printf("%-8s %7.2f s  %llu bytes in %llu pushes (%u..%u bytes), %llu rejected\n", name, seconds,
+		(unsigned long long)s.nBytes, (unsigned long long)s.nPushes, s.minChunk, s.maxChunk, (unsigned long long)s.nRejects);
+	printf("%-8s %llu waits, %.1f ms blocked, %llu bytes dropped, %llu stalls, peak buffer %u of %u bytes\n", "",
+		(unsigned long long)s.nWaits, s.waitMs, (unsigned long long)s.nDropped, (unsigned long long)s.nStalls, s.maxFill, nBufSize);
+	if (!bFed)
+		printf("%-8s feeding ended early\n", "");
+	if (!bDrained)
+		printf("%-8s the port did not finish playing\n", "");
+}
+
+// Opens a port in the given mode, feeds it with feed(feeder) and waits until
+// it has played everything
+template<typename F>
+static bool RunMode(const char* name, DWORD mode, DWORD nBufSize, F feed)
+{
+	LONG nPort = 0;
+	if (!PLAY_GetFreePort(&nPort)) {
+		printf("no free play port\n");
+		return false;
+	}
+	PLAY_SetStreamOpenMode(nPort, mode);
+	if (!PLAY_OpenStream(nPort, NULL, 0, nBufSize)) {
+		printf("PLAY_OpenStream failed\n");
+		PLAY_ReleasePort(nPort);
+		return false;
+	}
+
+	bool bOk = false;
+	{
+		// Outlives PLAY_Stop, as its callbacks need
+		PlayFeeder feeder(nPort, nBufSize);
+		PLAY_SetDisplayCallBack(nPort, OnDisplay, &feeder);
+		if (PLAY_Play(nPort, NULL)) {
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			bool bFed = feed(feeder);
+			bool bDrained = feeder.WaitDrained(FEED_STALL_MS);
+			double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			PLAY_Stop(nPort);
+			Print(name, seconds, bFed, bDrained, nBufSize, feeder.GetStats());
+			bOk = true;
+		} else {
+			printf("PLAY_Play failed\n");
+		}
+	}
+	PLAY_CloseStream(nPort);
+	PLAY_ReleasePort(nPort);
+	return bOk;
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2) {
+		printf("usage: %s <file.dav> [bufKB] [timeoutMs] [speed]\n", argv[0]);
+		return 1;
+	}
+	DWORD nBufSize = argc > 2 ? (DWORD)atoi(argv[2]) * 1024 : (SOURCE_BUF_MIN + SOURCE_BUF_MAX) / 2;
+	int timeoutMs = argc > 3 ? atoi(argv[3]) : 20;
+	double speed = argc > 4 ? atof(argv[4]) : 1;
+	if (nBufSize < SOURCE_BUF_MIN || nBufSize > SOURCE_BUF_MAX || timeoutMs < 0 || speed <= 0) {
+		printf("bufKB must be within %u..%u, timeoutMs >= 0 and speed positive\n", SOURCE_BUF_MIN / 1024, SOURCE_BUF_MAX / 1024);
+		return 1;
+	}
+
+	FILE* fp = fopen(argv[1], "rb");
+	if (fp == NULL) {
+		printf("cannot open %s\n", argv[1]);
+		return 1;
+	}
+	std::vector<BenchFrame> frames;
+	DavFrameReader reader(OnDavFrame, &frames);
+	std::vector<BYTE> buf(1024 * 1024);
+	size_t n;
+	while ((n = fread(buf.data(), 1, buf.size(), fp)) > 0)
+		reader.Input(buf.data(), n);
+	fclose(fp);
+	if (frames.empty()) {
+		printf("no DAV frames in %s\n", argv[1]);
+		return 1;
+	}
+	printf("%s: %u frames, %.1f s; source buffer %u bytes, realtime timeout %d ms at %.1fx\n", argv[1], (unsigned)frames.size(),
+		(double)(frames.back().ptsMs - frames.front().ptsMs) / 1000, nBufSize, timeoutMs, speed);
+
+	const char* path = argv[1];
+	bool bOk = RunMode("file", STREAME_FILE, nBufSize, [path](PlayFeeder& feeder) {
+		FILE* fp = fopen(path, "rb");
+		if (fp == NULL)
+			return false;
+		bool bFed = feeder.FeedFile(fp);
+		fclose(fp);
+		return bFed;
+	});
+
+	bOk = RunMode("realtime", STREAME_REALTIME, nBufSize, [&](PlayFeeder& feeder) {
+		int64_t firstMs = frames.front().ptsMs;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (const BenchFrame& frame : frames) {
+			std::this_thread::sleep_until(start + std::chrono::microseconds((int64_t)((frame.ptsMs - firstMs) * 1000 / speed)));
+			// A refused frame is counted in nDropped; the stream goes on
+			feeder.Input(frame.data.data(), (DWORD)frame.data.size(), timeoutMs);
+		}
+		return true;
+	}) && bOk;
+	return bOk ? 0 : 1;
+}
@@ -0,0 +1,137 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "FrameRing.h"
+#include "LatencyTrace.h"
+
+// Test consumer for the decoded-frame ring of RealPlayDll
+// (interface_StartFrameRing). Reads every frame it can keep up with,
+// touches all of its luma like an inference would, and prints once a second
+// how many frames it saw, lost to the producer lapping it, or had
+// overwritten under it, and how old the frames were when read. With latency
+// tracing on in the producer (interface_SetLatencyTrace) it also prints how
+// long frames took from capture and from the SDK callback to this reader.
+//
+//   FrameRingConsumer <ring name> [work ms per frame] [dump.yuv]
+//
+// A work time above the frame interval shows the producer running on
+// while the consumer falls behind.
+
+static unsigned MeanLuma(const FrameRingFrame& frame)
+{
+	uint64_t sum = 0;
+	for (int y = 0; y < frame.height; y++) {
+		const uint8_t* row = frame.plane[0] + (size_t)y * frame.stride[0];
+		for (int x = 0; x < frame.width; x++)
+			sum += row[x];
+	}
+	return (unsigned)(sum / ((uint64_t)frame.width * frame.height));
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2) {
+		printf("usage: %s <ring name> [work ms per frame] [dump.yuv]\n", argv[0]);
+		return 1;
+	}
+	const char* name = argv[1];
+	int workMs = argc > 2 ? atoi(argv[2]) : 0;
+	const char* dumpPath = argc > 3 ? argv[3] : NULL;
+
+	FrameRingReader* pReader = NULL;
+	int ret = FrameRingOpen(name, &pReader);
+	if (ret != FRAME_RING_OK) {
+		printf("FrameRingOpen(%s) failed: %d\n", name, ret);
+		return 1;
+	}
+
+	// Start at the newest frame rather than replaying the whole ring
+	uint64_t lastSeq = FrameRingWriteSeq(pReader);
+	uint64_t nFrames = 0, nLost = 0, nOverrun = 0;
+	int64_t lagSumUs = 0, lagMaxUs = 0;
+	LatencyHistogram fromCapture, fromReceive;
+	unsigned luma = 0;
+	bool bDumped = false;
+	std::vector<uint8_t> copy;
+	std::chrono::steady_clock::time_point report = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+
+	for (;;) {
+		ret = FrameRingWait(pReader, lastSeq, 1000);
+		if (ret == FRAME_RING_CLOSED) {
+			printf("producer closed the ring\n");
+			break;
+		}
+
+		FrameRingFrame frame;
+		if (ret == FRAME_RING_OK)
+			ret = FrameRingNext(pReader, lastSeq, &frame);
+		if (ret == FRAME_RING_OK) {
+			int64_t readUs = FrameRingNowUs();
+			int64_t lagUs = readUs - frame.wallUs;
+			nLost += frame.seq - lastSeq - 1;
+			lastSeq = frame.seq;
+
+			unsigned mean = MeanLuma(frame);
+			if (dumpPath != NULL && !bDumped) {
+				copy.resize(frame.size);
+				if (FrameRingCopy(pReader, &frame, copy.data(), copy.size()) == FRAME_RING_OK) {
+					FILE* fp = fopen(dumpPath, "wb");
+					if (fp != NULL) {
+						fwrite(copy.data(), 1, copy.size(), fp);
+						fclose(fp);
+						printf("frame %llu (%dx%d I420) written to %s\n", (unsigned long long)frame.seq,
+							frame.width, frame.height, dumpPath);
+					}
+					bDumped = true;
+				}
+			}
+			if (workMs > 0)
+				std::this_thread::sleep_for(std::chrono::milliseconds(workMs));
+
+			// Only now is it known whether the pixels were stable
+			if (FrameRingCheck(pReader, &frame) == FRAME_RING_OK) {
+				nFrames++;
+				luma = mean;
+				lagSumUs += lagUs;
+				if (lagUs > lagMaxUs)
+					lagMaxUs = lagUs;
+				if (frame.captureUs != 0)
+					fromCapture.Record(readUs - frame.captureUs);
+				if (frame.receiveUs != 0)
+					fromReceive.Record(readUs - frame.receiveUs);
+			}
+			else {
+				nOverrun++;
+			}
+		}
+		else if (ret == FRAME_RING_OVERRUN) {
+			nOverrun++;
+		}
+		else if (ret != FRAME_RING_NONE) {
+			printf("frame ring read failed: %d\n", ret);
+			break;
+		}
+
+		if (std::chrono::steady_clock::now() >= report) {
+			printf("seq %llu: %llu frames, %llu lost, %llu overrun, lag avg %.1f ms max %.1f ms, mean luma %u\n",
+				(unsigned long long)lastSeq, (unsigned long long)nFrames, (unsigned long long)nLost,
+				(unsigned long long)nOverrun, nFrames > 0 ? lagSumUs / 1000.0 / nFrames : 0.0, lagMaxUs / 1000.0, luma);
+			if (fromCapture.Count() > 0) {
+				char table[512];
+				int pos = LatencyFormatLine(table, sizeof(table), 0, "capture", fromCapture);
+				LatencyFormatLine(table, sizeof(table), pos, "receive", fromReceive);
+				printf("  to reader  %10s %9s %9s %9s %9s %9s %9s\n%s", "count", "mean ms", "p50", "p90", "p99", "p99.9", "max", table);
+				fromCapture.Reset();
+				fromReceive.Reset();
+			}
+			nFrames = nLost = nOverrun = 0;
+			lagSumUs = lagMaxUs = 0;
+			report = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+		}
+	}
+
+	FrameRingClose(pReader);
+	return 0;
+}
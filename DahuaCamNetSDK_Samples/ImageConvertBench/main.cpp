@@ -0,0 +1,134 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include "ImageConvert.h"
+
+// Microbenchmark for the I420 to RGB kernels of RealPlayDll
+// (ImageConvert.cpp). For every source size and output it runs each kernel
+// set the CPU has, prints milliseconds per picture and source megapixels per
+// second, and checks that every kernel set gives the same bytes as the
+// scalar one.
+//
+//   ImageConvertBench [pictures per run]
+
+struct Source
+{
+	int width;
+	int height;
+};
+
+struct Output
+{
+	const char* name;
+	int width;
+	int height;
+	int format;
+	bool bLetterbox;
+};
+
+static const Source g_sources[] = {
+	{ 704, 576 },
+	{ 1280, 720 },
+	{ 1920, 1080 },
+	{ 2560, 1440 },
+	{ 3840, 2160 },
+};
+
+static const Output g_outputs[] = {
+	{ "letterbox 640x640 rgb planar", 640, 640, IMAGE_RGB_PLANAR, true },
+	{ "letterbox 640x640 bgr", 640, 640, IMAGE_BGR, true },
+	{ "resize 416x416 rgb", 416, 416, IMAGE_RGB, false },
+};
+
+static const char* IsaName(int isa)
+{
+	switch (isa) {
+	case IMAGE_ISA_AVX2:
+		return "avx2";
+	case IMAGE_ISA_SSE41:
+		return "sse4.1";
+	default:
+		return "scalar";
+	}
+}
+
+// Gradients with some noise, so the blends see varied input
+static void FillSource(std::vector<uint8_t>& buf, int width, int height)
+{
+	uint32_t seed = 12345;
+	size_t ySize = (size_t)width * height;
+	for (size_t i = 0; i < buf.size(); i++) {
+		seed = seed * 1103515245 + 12345;
+		int x = (int)(i < ySize ? i % width : (i - ySize) % (width / 2));
+		buf[i] = (uint8_t)(x * 255 / width + (seed >> 28));
+	}
+}
+
+static int Convert(const uint8_t* const plane[3], const int stride[3], const Source& src, const Output& out, uint8_t* dst)
+{
+	if (out.bLetterbox)
+		return I420ToRgbLetterbox(plane, stride, src.width, src.height, dst, out.width, out.height, out.format, IMAGE_LETTERBOX_PAD, NULL);
+	return I420ToRgbResize(plane, stride, src.width, src.height, dst, out.width, out.height, out.format);
+}
+
+int main(int argc, char* argv[])
+{
+	int pictures = argc > 1 ? atoi(argv[1]) : 200;
+	if (pictures < 1)
+		pictures = 1;
+
+	int best = ImageConvertIsa();
+	printf("kernel sets up to %s, %d pictures per run\n\n", IsaName(best), pictures);
+	printf("%-11s %-30s %-8s %10s %10s\n", "source", "output", "kernels", "ms/pic", "src Mpx/s");
+
+	int mismatches = 0;
+	for (const Source& src : g_sources) {
+		std::vector<uint8_t> yuv((size_t)src.width * src.height * 3 / 2);
+		FillSource(yuv, src.width, src.height);
+		const uint8_t* plane[3] = {
+			yuv.data(),
+			yuv.data() + (size_t)src.width * src.height,
+			yuv.data() + (size_t)src.width * src.height * 5 / 4
+		};
+		const int stride[3] = { src.width, src.width / 2, src.width / 2 };
+		double mpx = (double)src.width * src.height / 1e6;
+		char srcName[32];
+		snprintf(srcName, sizeof(srcName), "%dx%d", src.width, src.height);
+
+		for (const Output& out : g_outputs) {
+			size_t dstSize = (size_t)out.width * out.height * 3;
+			std::vector<uint8_t> reference(dstSize), dst(dstSize);
+			for (int isa = IMAGE_ISA_SCALAR; isa <= best; isa++) {
+				if (ImageConvertSetIsa(isa) != IMAGE_OK)
+					continue;
+				uint8_t* pOut = isa == IMAGE_ISA_SCALAR ? reference.data() : dst.data();
+				// One untimed run grows the row buffers of this thread
+				if (Convert(plane, stride, src, out, pOut) != IMAGE_OK) {
+					printf("%-11s %-30s %-8s failed\n", srcName, out.name, IsaName(isa));
+					continue;
+				}
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				for (int i = 0; i < pictures; i++)
+					Convert(plane, stride, src, out, pOut);
+				double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+				const char* check = "";
+				if (isa != IMAGE_ISA_SCALAR && memcmp(reference.data(), dst.data(), dstSize) != 0) {
+					check = "  DIFFERS FROM SCALAR";
+					mismatches++;
+				}
+				printf("%-11s %-30s %-8s %10.3f %10.1f%s\n", srcName, out.name, IsaName(isa),
+					seconds * 1000 / pictures, mpx * pictures / seconds, check);
+			}
+		}
+	}
+	ImageConvertSetIsa(best);
+
+	if (mismatches > 0) {
+		printf("\n%d kernel runs differ from the scalar output\n", mismatches);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,184 @@
+#include <windows.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "LiveDecoder.h"
+
+// Decode CPU of a live stream with every frame decoded (LIVE_DECODE_ALL)
+// against key frames only (LIVE_DECODE_KEY_ONLY), without a camera. A DAV
+// recording of the camera (CLIENT_SaveRealData, or the VideoDownload
+// sample) is fed to LiveDecoder paced by its stream stamps, the way the
+// realplay data callback delivers it, and looped for the run time. Each
+// mode runs on its own with the given number of streams; the process CPU
+// time of the run is divided by the stream time fed.
+//
+//   LiveDecodeBench <file.dav> [seconds] [streams] [keyStep] [minIntervalMs] [speed]
+//
+// speed > 1 feeds faster than realtime to shorten the run; the decoder
+// must keep up, so check that the dropped count stays 0.
+
+struct BenchFrame
+{
+	std::vector<BYTE> data;
+	int64_t ptsMs;
+};
+
+struct BenchResult
+{
+	double streamSeconds;
+	double cpuSeconds;
+	uint64_t decoded;
+	uint64_t filtered;
+	uint64_t dropped;
+};
+
+class CountSink : public FrameSink
+{
+public:
+	CountSink() : m_nFrames(0) {}
+	void OnFrame(const DecodedFrame& frame) override { m_nFrames++; }
+	uint64_t Frames() const { return m_nFrames.load(); }
+
+private:
+	std::atomic<uint64_t> m_nFrames;
+};
+
+static void OnDavFrame(const DavFrame& frame, void* pUser)
+{
+	std::vector<BenchFrame>* pFrames = (std::vector<BenchFrame>*)pUser;
+	BenchFrame copy;
+	copy.data.assign(frame.data, frame.data + frame.length);
+	copy.ptsMs = frame.ptsMs;
+	pFrames->push_back(copy);
+}
+
+static double ProcessCpuSeconds()
+{
+	FILETIME created, exited, kernel, user;
+	if (!GetProcessTimes(GetCurrentProcess(), &created, &exited, &kernel, &user))
+		return 0;
+	ULARGE_INTEGER k, u;
+	k.LowPart = kernel.dwLowDateTime;
+	k.HighPart = kernel.dwHighDateTime;
+	u.LowPart = user.dwLowDateTime;
+	u.HighPart = user.dwHighDateTime;
+	return (double)(k.QuadPart + u.QuadPart) / 1e7;
+}
+
+static bool RunMode(const std::vector<BenchFrame>& frames, const LiveDecodeOptions& options, int seconds, int streams, double speed, BenchResult* pResult)
+{
+	std::vector<LiveDecoder*> decoders;
+	std::vector<CountSink*> sinks;
+	bool bOk = true;
+	for (int i = 0; i < streams && bOk; i++) {
+		LiveDecoder* pDecoder = new LiveDecoder();
+		CountSink* pSink = new CountSink();
+		pDecoder->AddSink(pSink);
+		decoders.push_back(pDecoder);
+		sinks.push_back(pSink);
+		int ret = pDecoder->Start(options);
+		if (ret != LIVE_DECODE_OK) {
+			printf("LiveDecoder::Start failed: %d\n", ret);
+			bOk = false;
+		}
+	}
+
+	// The recording loops; each pass continues the stream time one frame
+	// interval after the last frame
+	int64_t firstMs = frames.front().ptsMs;
+	int64_t passMs = frames.back().ptsMs - firstMs;
+	passMs += frames.size() > 1 ? passMs / (int64_t)(frames.size() - 1) : 40;
+	int64_t endMs = (int64_t)seconds * 1000;
+	int64_t streamMs = 0;
+	double cpuStart = ProcessCpuSeconds();
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int64_t pass = 0; bOk && streamMs < endMs; pass++) {
+		for (const BenchFrame& frame : frames) {
+			streamMs = pass * passMs + frame.ptsMs - firstMs;
+			if (streamMs >= endMs)
+				break;
+			std::this_thread::sleep_until(start + std::chrono::microseconds((int64_t)(streamMs * 1000 / speed)));
+			for (LiveDecoder* pDecoder : decoders)
+				pDecoder->Input(frame.data.data(), (DWORD)frame.data.size());
+		}
+	}
+	// Let the decoders finish what they were given
+	std::this_thread::sleep_for(std::chrono::milliseconds(500));
+	for (LiveDecoder* pDecoder : decoders)
+		pDecoder->Stop();
+	pResult->cpuSeconds = ProcessCpuSeconds() - cpuStart;
+	pResult->streamSeconds = (double)std::min(streamMs, endMs) / 1000 * streams;
+
+	pResult->decoded = 0;
+	pResult->filtered = 0;
+	pResult->dropped = 0;
+	for (size_t i = 0; i < decoders.size(); i++) {
+		pResult->decoded += sinks[i]->Frames();
+		pResult->filtered += decoders[i]->FramesFiltered();
+		pResult->dropped += decoders[i]->FramesDropped();
+		delete decoders[i];
+		delete sinks[i];
+	}
+	return bOk;
+}
+
+static void Print(const char* name, const BenchResult& r)
+{
+	printf("%-9s %8.1f s stream %9llu decoded %9llu left out %6llu dropped %8.2f s CPU %7.1f%% of a core per stream\n",
+		name, r.streamSeconds, (unsigned long long)r.decoded, (unsigned long long)r.filtered, (unsigned long long)r.dropped,
+		r.cpuSeconds, r.streamSeconds > 0 ? r.cpuSeconds * 100 / r.streamSeconds : 0);
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2) {
+		printf("usage: %s <file.dav> [seconds] [streams] [keyStep] [minIntervalMs] [speed]\n", argv[0]);
+		return 1;
+	}
+	int seconds = argc > 2 ? atoi(argv[2]) : 30;
+	int streams = argc > 3 ? atoi(argv[3]) : 1;
+	LiveDecodeOptions keyOnly;
+	keyOnly.mode = LIVE_DECODE_KEY_ONLY;
+	keyOnly.keyStep = argc > 4 ? atoi(argv[4]) : 1;
+	keyOnly.minIntervalMs = argc > 5 ? atoi(argv[5]) : 0;
+	double speed = argc > 6 ? atof(argv[6]) : 1;
+	if (seconds < 1 || streams < 1 || speed <= 0) {
+		printf("seconds, streams and speed must be positive\n");
+		return 1;
+	}
+
+	FILE* fp = fopen(argv[1], "rb");
+	if (fp == NULL) {
+		printf("cannot open %s\n", argv[1]);
+		return 1;
+	}
+	std::vector<BenchFrame> frames;
+	DavFrameReader reader(OnDavFrame, &frames);
+	std::vector<BYTE> buf(1024 * 1024);
+	size_t n;
+	while ((n = fread(buf.data(), 1, buf.size(), fp)) > 0)
+		reader.Input(buf.data(), n);
+	fclose(fp);
+	if (frames.empty()) {
+		printf("no DAV frames in %s\n", argv[1]);
+		return 1;
+	}
+	printf("%s: %u frames, %.1f s; %d stream(s) for %d s at %.1fx\n", argv[1], (unsigned)frames.size(),
+		(double)(frames.back().ptsMs - frames.front().ptsMs) / 1000, streams, seconds, speed);
+
+	BenchResult all, key;
+	if (!RunMode(frames, LiveDecodeOptions(), seconds, streams, speed, &all))
+		return 1;
+	Print("all", all);
+	if (!RunMode(frames, keyOnly, seconds, streams, speed, &key))
+		return 1;
+	Print("key only", key);
+	if (key.cpuSeconds > 0)
+		printf("key only uses %.1fx less CPU, decoding %.1fx fewer frames\n", all.cpuSeconds / key.cpuSeconds,
+			key.decoded > 0 ? (double)all.decoded / key.decoded : 0);
+	return 0;
+}
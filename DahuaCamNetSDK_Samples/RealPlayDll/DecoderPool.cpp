@@ -0,0 +1,295 @@
+#include <algorithm>
+#include <chrono>
+#include "DecoderPool.h"
+#include "FrameRing.h"
+
+// Weight of a new decode time sample in the moving average
+#define DECODE_AVG_WEIGHT		0.1
+// Cost multiplier for a port that fell behind in the last round
+#define LAGGING_WEIGHT			1.5
+
+DecoderPool& DecoderPool::Instance()
+{
+	static DecoderPool pool;
+	return pool;
+}
+
+DecoderPool::DecoderPool()
+	: m_budget(0), m_generation(0)
+{
+	SetThreadBudget(0);
+}
+
+DecoderPool::~DecoderPool()
+{
+	// Only reached with ports still attached at process exit; joining here
+	// could run under the loader lock
+	if (m_thread.joinable())
+		m_thread.detach();
+}
+
+void DecoderPool::SetThreadBudget(int nThreads)
+{
+	if (nThreads <= 0)
+		nThreads = (int)std::thread::hardware_concurrency();
+	std::lock_guard<std::mutex> play(m_playLock);
+	ThreadChanges changes;
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		m_budget = nThreads > 0 ? nThreads : 1;
+		if (!m_ports.empty())
+			RebalanceLocked(&changes);
+	}
+	ApplyChanges(changes);
+}
+
+int DecoderPool::ThreadBudget() const
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	return m_budget;
+}
+
+// Frame level threading of H.264 / H.265 stops paying off below roughly a
+// megapixel per thread
+int DecoderPool::ThreadsForResolution(int width, int height)
+{
+	int64_t pixels = (int64_t)width * height;
+	if (pixels <= 0)
+		pixels = 1920 * 1080;
+	if (pixels <= 1280 * 720)
+		return 1;
+	if (pixels <= 1920 * 1080)
+		return 2;
+	if (pixels <= 2688 * 1520)
+		return 3;
+	if (pixels <= 3840 * 2160)
+		return 4;
+	return std::min(6, DECODER_POOL_MAX_THREADS);
+}
+
+DecoderPool::PortState* DecoderPool::Find(LONG nPort)
+{
+	for (PortState& state : m_ports) {
+		if (state.port == nPort)
+			return &state;
+	}
+	return NULL;
+}
+
+void DecoderPool::Attach(LONG nPort, int widthHint, int heightHint, int fixedThreads)
+{
+	std::lock_guard<std::mutex> play(m_playLock);
+	std::unique_lock<std::mutex> lock(m_lock);
+	if (Find(nPort) != NULL)
+		return;
+	PortState state = {};
+	state.port = nPort;
+	state.fixedThreads = std::min(fixedThreads, DECODER_POOL_MAX_THREADS);
+	state.width = widthHint;
+	state.height = heightHint;
+	state.roundUs = FrameRingNowUs();
+	m_ports.push_back(state);
+
+	// Until the first round has measurements every port starts at what its
+	// resolution can use, within the budget
+	PortState* pState = &m_ports.back();
+	if (pState->fixedThreads > 0)
+		pState->threads = pState->fixedThreads;
+	else
+		pState->threads = std::max(1, std::min(ThreadsForResolution(widthHint, heightHint), m_budget / (int)m_ports.size()));
+	int threads = pState->threads;
+
+	if (!m_thread.joinable()) {
+		uint64_t generation = ++m_generation;
+		m_thread = std::thread(&DecoderPool::Run, this, generation);
+	}
+	lock.unlock();
+	PLAY_SetDecodeThreadNum(nPort, threads);
+}
+
+void DecoderPool::Detach(LONG nPort)
+{
+	std::thread retired;
+	{
+		std::lock_guard<std::mutex> play(m_playLock);
+		std::lock_guard<std::mutex> guard(m_lock);
+		m_ports.erase(std::remove_if(m_ports.begin(), m_ports.end(),
+			[nPort](const PortState& state) { return state.port == nPort; }), m_ports.end());
+		if (m_ports.empty() && m_thread.joinable()) {
+			m_generation++;
+			retired.swap(m_thread);
+		}
+	}
+	if (retired.joinable()) {
+		m_cv.notify_all();
+		retired.join();
+	}
+}
+
+void DecoderPool::OnDecoded(LONG nPort, int width, int height, int64_t decodeUs)
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	PortState* pState = Find(nPort);
+	if (pState == NULL)
+		return;
+	pState->nDecoded++;
+	pState->width = width;
+	pState->height = height;
+	if (decodeUs >= 0) {
+		if (pState->decodeUs <= 0)
+			pState->decodeUs = (double)decodeUs;
+		else
+			pState->decodeUs += (decodeUs - pState->decodeUs) * DECODE_AVG_WEIGHT;
+	}
+}
+
+void DecoderPool::OnDropped(LONG nPort)
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	PortState* pState = Find(nPort);
+	if (pState != NULL)
+		pState->nDropped++;
+}
+
+void DecoderPool::Rebalance()
+{
+	std::lock_guard<std::mutex> play(m_playLock);
+	ThreadChanges changes;
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		RebalanceLocked(&changes);
+	}
+	ApplyChanges(changes);
+}
+
+void DecoderPool::ApplyChanges(const ThreadChanges& changes)
+{
+	for (const std::pair<LONG, int>& change : changes)
+		PLAY_SetDecodeThreadNum(change.first, change.second);
+}
+
+void DecoderPool::RebalanceLocked(ThreadChanges* pChanges)
+{
+	int64_t nowUs = FrameRingNowUs();
+	int budget = m_budget;
+	std::vector<PortState*> free;
+	std::vector<double> cost;
+	double totalCost = 0;
+
+	for (PortState& state : m_ports) {
+		int64_t elapsedUs = nowUs - state.roundUs;
+		if (elapsedUs > 0) {
+			state.fps = (state.nDecoded - state.roundDecoded) * 1000000.0 / elapsedUs;
+			state.bLagging = state.nDropped > state.roundDropped
+				|| (state.fps > 0 && state.decodeUs > 2 * 1000000.0 / state.fps);
+			state.roundUs = nowUs;
+			state.roundDecoded = state.nDecoded;
+			state.roundDropped = state.nDropped;
+		}
+		if (state.fixedThreads > 0) {
+			budget -= state.fixedThreads;
+			continue;
+		}
+		double c = (double)std::max(1, state.width * state.height) * std::max(1.0, state.fps);
+		if (state.bLagging)
+			c *= LAGGING_WEIGHT;
+		free.push_back(&state);
+		cost.push_back(c);
+		totalCost += c;
+	}
+	if (free.empty())
+		return;
+
+	// One thread each, the rest in proportion to cost up to what the
+	// resolution can use, then leftovers one by one to the port that has
+	// the most cost per thread
+	int extra = std::max(0, budget - (int)free.size());
+	std::vector<int> threads(free.size(), 1);
+	int given = 0;
+	for (size_t i = 0; i < free.size(); i++) {
+		int cap = ThreadsForResolution(free[i]->width, free[i]->height);
+		int share = totalCost > 0 ? (int)(extra * cost[i] / totalCost) : 0;
+		threads[i] = std::min(cap, 1 + share);
+		given += threads[i] - 1;
+	}
+	while (given < extra) {
+		int best = -1;
+		double bestLoad = 0;
+		for (size_t i = 0; i < free.size(); i++) {
+			if (threads[i] >= ThreadsForResolution(free[i]->width, free[i]->height))
+				continue;
+			double load = cost[i] / threads[i];
+			if (best < 0 || load > bestLoad) {
+				best = (int)i;
+				bestLoad = load;
+			}
+		}
+		if (best < 0)
+			break;
+		threads[best]++;
+		given++;
+	}
+
+	for (size_t i = 0; i < free.size(); i++) {
+		if (threads[i] != free[i]->threads) {
+			free[i]->threads = threads[i];
+			pChanges->push_back(std::make_pair(free[i]->port, threads[i]));
+		}
+	}
+}
+
+int DecoderPool::GetStats(DecoderPortStats* pStats, int maxCount)
+{
+	std::lock_guard<std::mutex> play(m_playLock);
+	std::unique_lock<std::mutex> lock(m_lock);
+	int n = 0;
+	for (const PortState& state : m_ports) {
+		if (pStats == NULL || n >= maxCount)
+			break;
+		DecoderPortStats& out = pStats[n++];
+		out.port = state.port;
+		out.width = state.width;
+		out.height = state.height;
+		out.threads = state.threads;
+		out.bFixed = state.fixedThreads > 0;
+		out.bLagging = state.bLagging;
+		out.fps = state.fps;
+		out.decodeMs = state.decodeUs / 1000.0;
+		out.decoded = state.nDecoded;
+		out.dropped = state.nDropped;
+	}
+	int count = (int)m_ports.size();
+	lock.unlock();
+
+	// Ports detach under m_playLock before they stop, so these only see
+	// live ports
+	for (int i = 0; i < n; i++) {
+		pStats[i].queueBytes = PLAY_GetSourceBufferRemain(pStats[i].port);
+		pStats[i].queueFrames = PLAY_GetBufferValue(pStats[i].port, BUF_VIDEO_RENDER);
+	}
+	return count;
+}
+
+void DecoderPool::Run(uint64_t generation)
+{
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(m_lock);
+			m_cv.wait_for(lock, std::chrono::milliseconds(DECODER_POOL_REBALANCE_MS),
+				[&] { return m_generation != generation; });
+			if (m_generation != generation)
+				break;
+		}
+		// Detach joins this thread outside both locks, so taking m_playLock
+		// here cannot hold it up
+		std::lock_guard<std::mutex> play(m_playLock);
+		ThreadChanges changes;
+		{
+			std::lock_guard<std::mutex> guard(m_lock);
+			if (m_generation != generation)
+				break;
+			RebalanceLocked(&changes);
+		}
+		ApplyChanges(changes);
+	}
+}
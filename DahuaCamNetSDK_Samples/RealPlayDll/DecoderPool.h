@@ -0,0 +1,111 @@
+#pragma once
+#include <stdint.h>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "play.h"
+
+#define DECODER_POOL_REBALANCE_MS	2000
+#define DECODER_POOL_MAX_THREADS	8		// per port, whatever the resolution
+
+#pragma pack(push, 4)
+// One decoding play port, as returned by DecoderPool::GetStats
+// (interface_GetDecoderStats).
+typedef struct DecoderPortStats
+{
+	int port;
+	int width;					// last decoded picture
+	int height;
+	int threads;				// PLAY_SetDecodeThreadNum value in force
+	int bFixed;					// thread count pinned by the session
+	int bLagging;				// dropped input or decode behind the frame rate in the last round
+	double fps;					// decoded frames per second, last round
+	double decodeMs;			// input accepted -> picture out, moving average
+	uint32_t queueBytes;		// PLAY_GetSourceBufferRemain
+	uint32_t queueFrames;		// decoded pictures waiting, BUF_VIDEO_RENDER
+	uint64_t decoded;
+	uint64_t dropped;			// video frames the decoder had no room for
+} DecoderPortStats;
+#pragma pack(pop)
+
+// Shares the decode threads of the process between the live play ports.
+// play.lib runs its own decoder threads per port; what can be steered is how
+// many each port gets (PLAY_SetDecodeThreadNum). The pool holds a budget,
+// by default one thread per hardware thread, and every
+// DECODER_POOL_REBALANCE_MS splits it across the ports by measured cost:
+// decoded pixels per second, weighted up for ports that dropped input or
+// whose decode time exceeds two frame intervals. Each port gets at least one
+// thread and at most what its resolution can use (ThreadsForResolution),
+// so one 4K stream does not take threads that 1080p streams are queueing
+// for. Ports with a fixed thread count are left alone and count against the
+// budget.
+class DecoderPool
+{
+public:
+	static DecoderPool& Instance();
+
+	// 0: std::thread::hardware_concurrency.
+	void SetThreadBudget(int nThreads);
+	int ThreadBudget() const;
+
+	// LiveDecoder calls these. Attach before PLAY_Play with a resolution hint
+	// (0 when unknown) and fixedThreads > 0 to pin the count; Detach before
+	// the port is stopped.
+	void Attach(LONG nPort, int widthHint, int heightHint, int fixedThreads);
+	void Detach(LONG nPort);
+	void OnDecoded(LONG nPort, int width, int height, int64_t decodeUs);
+	void OnDropped(LONG nPort);
+
+	// Fills up to maxCount entries, returns the number of attached ports.
+	int GetStats(DecoderPortStats* pStats, int maxCount);
+
+	void Rebalance();
+
+	static int ThreadsForResolution(int width, int height);
+
+private:
+	struct PortState
+	{
+		LONG port;
+		int fixedThreads;
+		int threads;
+		int width;
+		int height;
+		uint64_t nDecoded;
+		uint64_t nDropped;
+		double decodeUs;			// moving average, 0 before the first sample
+		// Last round
+		int64_t roundUs;
+		uint64_t roundDecoded;
+		uint64_t roundDropped;
+		double fps;
+		bool bLagging;
+	};
+
+	DecoderPool();
+	~DecoderPool();
+	DecoderPool(const DecoderPool&) = delete;
+	DecoderPool& operator=(const DecoderPool&) = delete;
+
+	typedef std::vector<std::pair<LONG, int>> ThreadChanges;	// port, threads
+
+	PortState* Find(LONG nPort);
+	// Under m_lock; the caller applies pChanges after releasing it
+	void RebalanceLocked(ThreadChanges* pChanges);
+	void ApplyChanges(const ThreadChanges& changes);
+	void Run(uint64_t generation);
+
+	// PLAY_* calls on the ports are made under m_playLock only: the decode
+	// threads of the ports take m_lock in OnDecoded, and play.lib may wait for
+	// them. Detach takes m_playLock, so no call reaches a port after it.
+	// Order: m_playLock, then m_lock.
+	std::mutex m_playLock;
+	mutable std::mutex m_lock;
+	std::condition_variable m_cv;
+	std::vector<PortState> m_ports;
+	int m_budget;
+	std::thread m_thread;
+	uint64_t m_generation;			// bumped to retire the rebalance thread
+};
@@ -0,0 +1,614 @@
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <filesystem>
+#include "Fmp4Packager.h"
+
+#define MP4_TIMESCALE	90000
+
+//*********************************************************************************
+// ISO BMFF box writer
+
+class BoxWriter
+{
+public:
+	explicit BoxWriter(std::vector<uint8_t>& buf) : b(buf) {}
+
+	void Begin(const char* type) { m_stack.push_back(b.size()); U32(0); Bytes(type, 4); }
+	void BeginFull(const char* type, uint8_t version, uint32_t flags) { Begin(type); U32((uint32_t)version << 24 | flags); }
+	void End()
+	{
+		size_t pos = m_stack.back();
+		m_stack.pop_back();
+		uint32_t size = (uint32_t)(b.size() - pos);
+		b[pos] = (uint8_t)(size >> 24); b[pos + 1] = (uint8_t)(size >> 16);
+		b[pos + 2] = (uint8_t)(size >> 8); b[pos + 3] = (uint8_t)size;
+	}
+
+	void U8(uint8_t v) { b.push_back(v); }
+	void U16(uint16_t v) { U8((uint8_t)(v >> 8)); U8((uint8_t)v); }
+	void U32(uint32_t v) { U16((uint16_t)(v >> 16)); U16((uint16_t)v); }
+	void U64(uint64_t v) { U32((uint32_t)(v >> 32)); U32((uint32_t)v); }
+	void Bytes(const void* p, size_t n) { b.insert(b.end(), (const uint8_t*)p, (const uint8_t*)p + n); }
+	void Zeros(size_t n) { b.insert(b.end(), n, 0); }
+	void Matrix()
+	{
+		static const uint32_t m[9] = { 0x00010000, 0, 0, 0, 0x00010000, 0, 0, 0, 0x40000000 };
+		for (uint32_t v : m)
+			U32(v);
+	}
+
+	std::vector<uint8_t>& b;
+
+private:
+	std::vector<size_t> m_stack;
+};
+
+//*********************************************************************************
+// Annex-B helpers
+
+static void SplitAnnexB(const uint8_t* p, size_t n, std::vector<std::vector<uint8_t>>& nals)
+{
+	size_t i = 0, start = (size_t)-1;
+	while (i + 2 < n) {
+		if (p[i] == 0 && p[i + 1] == 0 && p[i + 2] == 1) {
+			if (start != (size_t)-1) {
+				size_t end = i;
+				while (end > start && p[end - 1] == 0)
+					end--;
+				nals.emplace_back(p + start, p + end);
+			}
+			i += 3;
+			start = i;
+		}
+		else {
+			i++;
+		}
+	}
+	if (start != (size_t)-1 && start < n)
+		nals.emplace_back(p + start, p + n);
+}
+
+static int NalType(const std::vector<uint8_t>& nal, bool bHevc)
+{
+	if (nal.empty())
+		return -1;
+	return bHevc ? (nal[0] >> 1) & 0x3F : nal[0] & 0x1F;
+}
+
+static bool IsParameterSetOrAud(int type, bool bHevc)
+{
+	if (bHevc)
+		return type == 32 || type == 33 || type == 34 || type == 35;
+	return type == 7 || type == 8 || type == 9;
+}
+
+static std::vector<uint8_t> Unescape(const std::vector<uint8_t>& nal)
+{
+	std::vector<uint8_t> rbsp;
+	rbsp.reserve(nal.size());
+	int zeros = 0;
+	for (uint8_t c : nal) {
+		if (zeros >= 2 && c == 3) {
+			zeros = 0;
+			continue;
+		}
+		zeros = c == 0 ? zeros + 1 : 0;
+		rbsp.push_back(c);
+	}
+	return rbsp;
+}
+
+//*********************************************************************************
+
+Fmp4Packager::Fmp4Packager(const PackagerConfig& config)
+	: m_config(config), m_bClosed(false), m_bHevc(false), m_width(0), m_height(0), m_initIndex(-1),
+	m_bHavePending(false), m_firstPts(-1), m_fragmentSeq(0), m_partDuration(0),
+	m_nextMsn(0), m_maxSegmentDuration(0), m_maxPartDuration(0)
+{
+	if (!m_config.outDir.empty()) {
+		std::error_code ec;
+		std::filesystem::create_directories(m_config.outDir, ec);
+	}
+}
+
+bool Fmp4Packager::UpdateParameterSets(const DavFrame& frame, const std::vector<std::vector<uint8_t>>& nals)
+{
+	bool bHevc = frame.videoCodec == DAV_CODEC_H265;
+	std::vector<uint8_t> vps, sps, pps;
+	for (const std::vector<uint8_t>& nal : nals) {
+		int type = NalType(nal, bHevc);
+		if (bHevc ? type == 32 : false)
+			vps = nal;
+		else if (bHevc ? type == 33 : type == 7)
+			sps = nal;
+		else if (bHevc ? type == 34 : type == 8)
+			pps = nal;
+	}
+	if (sps.empty() || pps.empty() || (bHevc && vps.empty()))
+		return false;
+
+	uint16_t width = frame.width ? frame.width : m_width;
+	uint16_t height = frame.height ? frame.height : m_height;
+	if (m_initIndex >= 0 && bHevc == m_bHevc && sps == m_sps && pps == m_pps && vps == m_vps
+		&& width == m_width && height == m_height)
+		return false;
+
+	m_bHevc = bHevc;
+	m_vps.swap(vps);
+	m_sps.swap(sps);
+	m_pps.swap(pps);
+	m_width = width;
+	m_height = height;
+	return true;
+}
+
+void Fmp4Packager::BuildInit()
+{
+	std::vector<uint8_t> buf;
+	BoxWriter w(buf);
+
+	w.Begin("ftyp");
+	w.Bytes("iso6", 4);
+	w.U32(0);
+	w.Bytes("iso6cmfcmp41", 12);
+	w.End();
+
+	w.Begin("moov");
+	w.BeginFull("mvhd", 0, 0);
+	w.U32(0); w.U32(0); w.U32(1000); w.U32(0);
+	w.U32(0x00010000); w.U16(0x0100); w.Zeros(10);
+	w.Matrix();
+	w.Zeros(24);
+	w.U32(2);
+	w.End();
+
+	w.Begin("trak");
+	w.BeginFull("tkhd", 0, 3);
+	w.U32(0); w.U32(0); w.U32(1); w.U32(0); w.U32(0);
+	w.Zeros(8); w.U16(0); w.U16(0); w.U16(0); w.U16(0);
+	w.Matrix();
+	w.U32((uint32_t)m_width << 16); w.U32((uint32_t)m_height << 16);
+	w.End();
+
+	w.Begin("mdia");
+	w.BeginFull("mdhd", 0, 0);
+	w.U32(0); w.U32(0); w.U32(MP4_TIMESCALE); w.U32(0);
+	w.U16(0x55C4); w.U16(0);	// "und"
+	w.End();
+	w.BeginFull("hdlr", 0, 0);
+	w.U32(0); w.Bytes("vide", 4); w.Zeros(12); w.Bytes("VideoHandler", 13);
+	w.End();
+
+	w.Begin("minf");
+	w.BeginFull("vmhd", 0, 1);
+	w.Zeros(8);
+	w.End();
+	w.Begin("dinf");
+	w.BeginFull("dref", 0, 0);
+	w.U32(1);
+	w.BeginFull("url ", 0, 1);
+	w.End();
+	w.End();
+	w.End();
+
+	w.Begin("stbl");
+	w.BeginFull("stsd", 0, 0);
+	w.U32(1);
+	w.Begin(m_bHevc ? "hvc1" : "avc1");
+	w.Zeros(6); w.U16(1);
+	w.Zeros(16);
+	w.U16(m_width); w.U16(m_height);
+	w.U32(0x00480000); w.U32(0x00480000);
+	w.U32(0); w.U16(1);
+	w.Zeros(32);
+	w.U16(0x0018); w.U16(0xFFFF);
+	if (m_bHevc) {
+		// profile_tier_level follows the first byte of the SPS payload
+		std::vector<uint8_t> rbsp = Unescape(m_sps);
+		uint8_t ptl[12] = { 0 };
+		if (rbsp.size() >= 15)
+			memcpy(ptl, &rbsp[3], 12);
+		w.Begin("hvcC");
+		w.U8(1);
+		w.Bytes(ptl, 12);				// profile, compatibility, constraints, level
+		w.U16(0xF000);					// min_spatial_segmentation_idc
+		w.U8(0xFC);						// parallelismType
+		w.U8(0xFD);						// chroma_format_idc 4:2:0
+		w.U8(0xF8);						// bit depth luma 8
+		w.U8(0xF8);						// bit depth chroma 8
+		w.U16(0);						// avgFrameRate
+		w.U8(0x0F);						// 1 temporal layer, nested, 4 byte lengths
+		w.U8(3);
+		const std::vector<uint8_t>* arrays[3] = { &m_vps, &m_sps, &m_pps };
+		const uint8_t types[3] = { 32, 33, 34 };
+		for (int i = 0; i < 3; i++) {
+			w.U8(0x80 | types[i]);
+			w.U16(1);
+			w.U16((uint16_t)arrays[i]->size());
+			w.Bytes(arrays[i]->data(), arrays[i]->size());
+		}
+		w.End();
+	}
+	else {
+		w.Begin("avcC");
+		w.U8(1);
+		w.U8(m_sps.size() > 3 ? m_sps[1] : 0x42);
+		w.U8(m_sps.size() > 3 ? m_sps[2] : 0);
+		w.U8(m_sps.size() > 3 ? m_sps[3] : 0x1F);
+		w.U8(0xFF);						// 4 byte lengths
+		w.U8(0xE1);
+		w.U16((uint16_t)m_sps.size());
+		w.Bytes(m_sps.data(), m_sps.size());
+		w.U8(1);
+		w.U16((uint16_t)m_pps.size());
+		w.Bytes(m_pps.data(), m_pps.size());
+		w.End();
+	}
+	w.End();	// sample entry
+	w.End();	// stsd
+	w.BeginFull("stts", 0, 0); w.U32(0); w.End();
+	w.BeginFull("stsc", 0, 0); w.U32(0); w.End();
+	w.BeginFull("stsz", 0, 0); w.U32(0); w.U32(0); w.End();
+	w.BeginFull("stco", 0, 0); w.U32(0); w.End();
+	w.End();	// stbl
+	w.End();	// minf
+	w.End();	// mdia
+	w.End();	// trak
+
+	w.Begin("mvex");
+	w.BeginFull("trex", 0, 0);
+	w.U32(1); w.U32(1); w.U32(0); w.U32(0); w.U32(0);
+	w.End();
+	w.End();
+	w.End();	// moov
+
+	m_initIndex++;
+	m_inits.emplace_back(m_initIndex, std::make_shared<const std::vector<uint8_t>>(std::move(buf)));
+	if (!m_config.outDir.empty())
+		WriteFile("init" + std::to_string(m_initIndex) + ".mp4", *m_inits.back().second);
+}
+
+void Fmp4Packager::InputFrame(const DavFrame& frame)
+{
+	if (!frame.IsVideo() || frame.payloadLen == 0)
+		return;
+
+	std::vector<std::vector<uint8_t>> nals;
+	SplitAnnexB(frame.payload, frame.payloadLen, nals);
+
+	std::lock_guard<std::mutex> guard(m_lock);
+	if (frame.IsKey() && UpdateParameterSets(frame, nals)) {
+		// Codec or resolution change: finish everything under the old init
+		if (m_bHavePending) {
+			AddSample(m_pending);
+			m_bHavePending = false;
+		}
+		ClosePart();
+		CloseSegment();
+		BuildInit();
+	}
+	if (m_initIndex < 0)
+		return;
+
+	Sample sample;
+	sample.key = frame.IsKey();
+	sample.pts = frame.ptsMs * (MP4_TIMESCALE / 1000);
+	sample.duration = 0;
+	for (const std::vector<uint8_t>& nal : nals) {
+		if (IsParameterSetOrAud(NalType(nal, m_bHevc), m_bHevc))
+			continue;
+		uint32_t len = (uint32_t)nal.size();
+		uint8_t prefix[4] = { (uint8_t)(len >> 24), (uint8_t)(len >> 16), (uint8_t)(len >> 8), (uint8_t)len };
+		sample.data.insert(sample.data.end(), prefix, prefix + 4);
+		sample.data.insert(sample.data.end(), nal.begin(), nal.end());
+	}
+
+	if (m_bHavePending) {
+		int64_t duration = sample.pts - m_pending.pts;
+		if (duration <= 0 || duration > 5 * MP4_TIMESCALE)
+			duration = MP4_TIMESCALE / (frame.frameRate ? frame.frameRate : 25);
+		m_pending.duration = (uint32_t)duration;
+		AddSample(m_pending);
+	}
+	m_pending = std::move(sample);
+	m_bHavePending = true;
+	m_cvUpdate.notify_all();
+}
+
+void Fmp4Packager::AddSample(Sample& sample)
+{
+	if (m_firstPts < 0)
+		m_firstPts = sample.pts;
+
+	if (m_segments.empty() || m_segments.back().data) {
+		Segment seg;
+		seg.msn = m_nextMsn++;
+		seg.initIndex = m_initIndex;
+		seg.duration = 0;
+		m_segments.push_back(std::move(seg));
+	}
+
+	// An empty segment is never cut, whatever the target
+	Segment& open = m_segments.back();
+	bool bEmpty = open.parts.empty() && m_partSamples.empty();
+	if (sample.key && !bEmpty && open.duration + m_partDuration >= m_config.segmentTarget) {
+		ClosePart();
+		CloseSegment();
+		AddSample(sample);
+		return;
+	}
+
+	double seconds = (double)sample.duration / MP4_TIMESCALE;
+	m_partSamples.push_back(std::move(sample));
+	m_partDuration += seconds;
+	// Close as soon as one more frame would overshoot the target, rather than
+	// waiting for that frame to arrive.
+	if (m_partDuration + seconds > m_config.partTarget)
+		ClosePart();
+}
+
+void Fmp4Packager::ClosePart()
+{
+	if (m_partSamples.empty())
+		return;
+
+	std::vector<uint8_t> buf;
+	BoxWriter w(buf);
+	uint32_t nCount = (uint32_t)m_partSamples.size();
+	size_t nPayload = 0;
+	for (const Sample& s : m_partSamples)
+		nPayload += s.data.size();
+
+	w.Begin("moof");
+	w.BeginFull("mfhd", 0, 0);
+	w.U32(++m_fragmentSeq);
+	w.End();
+	w.Begin("traf");
+	w.BeginFull("tfhd", 0, 0x020000);	// default-base-is-moof
+	w.U32(1);
+	w.End();
+	w.BeginFull("tfdt", 1, 0);
+	w.U64((uint64_t)(m_partSamples[0].pts - m_firstPts));
+	w.End();
+	w.BeginFull("trun", 0, 0x000001 | 0x000100 | 0x000200 | 0x000400);
+	w.U32(nCount);
+	size_t offsetPos = buf.size();
+	w.U32(0);
+	for (const Sample& s : m_partSamples) {
+		w.U32(s.duration);
+		w.U32((uint32_t)s.data.size());
+		w.U32(s.key ? 0x02000000 : 0x01010000);
+	}
+	w.End();
+	w.End();	// traf
+	w.End();	// moof
+
+	uint32_t dataOffset = (uint32_t)buf.size() + 8;
+	buf[offsetPos] = (uint8_t)(dataOffset >> 24); buf[offsetPos + 1] = (uint8_t)(dataOffset >> 16);
+	buf[offsetPos + 2] = (uint8_t)(dataOffset >> 8); buf[offsetPos + 3] = (uint8_t)dataOffset;
+
+	buf.reserve(buf.size() + 8 + nPayload);
+	w.Begin("mdat");
+	for (const Sample& s : m_partSamples)
+		w.Bytes(s.data.data(), s.data.size());
+	w.End();
+
+	Segment& open = m_segments.back();
+	Part part;
+	part.data = std::make_shared<const std::vector<uint8_t>>(std::move(buf));
+	part.duration = m_partDuration;
+	part.independent = m_partSamples[0].key;
+	open.parts.push_back(part);
+	open.duration += m_partDuration;
+	if (m_partDuration > m_maxPartDuration)
+		m_maxPartDuration = m_partDuration;
+
+	m_partSamples.clear();
+	m_partDuration = 0;
+
+	if (!m_config.outDir.empty()) {
+		WriteFile("seg" + std::to_string(open.msn) + "." + std::to_string(open.parts.size() - 1) + ".m4s", *part.data);
+		PublishToDisk();
+	}
+	m_cvUpdate.notify_all();
+}
+
+void Fmp4Packager::CloseSegment()
+{
+	if (m_segments.empty() || m_segments.back().data || m_segments.back().parts.empty())
+		return;
+
+	Segment& seg = m_segments.back();
+	size_t nTotal = 0;
+	for (const Part& part : seg.parts)
+		nTotal += part.data->size();
+	std::vector<uint8_t> buf;
+	buf.reserve(nTotal);
+	for (const Part& part : seg.parts)
+		buf.insert(buf.end(), part.data->begin(), part.data->end());
+	seg.data = std::make_shared<const std::vector<uint8_t>>(std::move(buf));
+	if (seg.duration > m_maxSegmentDuration)
+		m_maxSegmentDuration = seg.duration;
+	if (!m_config.outDir.empty())
+		WriteFile("seg" + std::to_string(seg.msn) + ".m4s", *seg.data);
+
+	// Slide the window; the segment just closed always stays
+	while ((int)m_segments.size() > m_config.windowSegments) {
+		const Segment& old = m_segments.front();
+		if (!m_config.outDir.empty()) {
+			std::error_code ec;
+			std::string base = m_config.outDir + "/seg" + std::to_string(old.msn);
+			std::filesystem::remove(base + ".m4s", ec);
+			for (size_t i = 0; i < old.parts.size(); i++)
+				std::filesystem::remove(base + "." + std::to_string(i) + ".m4s", ec);
+		}
+		m_segments.pop_front();
+	}
+	while (m_inits.size() > 1 && m_inits.front().first < m_segments.front().initIndex) {
+		if (!m_config.outDir.empty()) {
+			std::error_code ec;
+			std::filesystem::remove(m_config.outDir + "/init" + std::to_string(m_inits.front().first) + ".mp4", ec);
+		}
+		m_inits.pop_front();
+	}
+
+	if (!m_config.outDir.empty())
+		PublishToDisk();
+	m_cvUpdate.notify_all();
+}
+
+std::string Fmp4Packager::BuildPlaylist(bool bBlocking) const
+{
+	char line[256];
+	std::string out = "#EXTM3U\n#EXT-X-VERSION:9\n";
+
+	double partTarget = m_maxPartDuration > m_config.partTarget ? m_maxPartDuration : m_config.partTarget;
+	int targetDuration = (int)(m_maxSegmentDuration + 0.999);
+	if (targetDuration < 1)
+		targetDuration = (int)(m_config.segmentTarget + 0.999);
+	snprintf(line, sizeof(line), "#EXT-X-TARGETDURATION:%d\n", targetDuration);
+	out += line;
+	snprintf(line, sizeof(line), "#EXT-X-SERVER-CONTROL:%sPART-HOLD-BACK=%.3f\n",
+		bBlocking ? "CAN-BLOCK-RELOAD=YES," : "", partTarget * 3);
+	out += line;
+	snprintf(line, sizeof(line), "#EXT-X-PART-INF:PART-TARGET=%.3f\n", partTarget);
+	out += line;
+	snprintf(line, sizeof(line), "#EXT-X-MEDIA-SEQUENCE:%lld\n", m_segments.front().msn);
+	out += line;
+
+	// Parts are only advertised near the live edge
+	size_t nPartSegments = 3;
+	int lastInit = -1;
+	for (size_t i = 0; i < m_segments.size(); i++) {
+		const Segment& seg = m_segments[i];
+		if (seg.initIndex != lastInit) {
+			if (lastInit >= 0)
+				out += "#EXT-X-DISCONTINUITY\n";
+			snprintf(line, sizeof(line), "#EXT-X-MAP:URI=\"init%d.mp4\"\n", seg.initIndex);
+			out += line;
+			lastInit = seg.initIndex;
+		}
+		if (i + nPartSegments >= m_segments.size()) {
+			for (size_t p = 0; p < seg.parts.size(); p++) {
+				snprintf(line, sizeof(line), "#EXT-X-PART:DURATION=%.3f,URI=\"seg%lld.%d.m4s\"%s\n",
+					seg.parts[p].duration, seg.msn, (int)p, seg.parts[p].independent ? ",INDEPENDENT=YES" : "");
+				out += line;
+			}
+		}
+		if (seg.data) {
+			snprintf(line, sizeof(line), "#EXTINF:%.3f,\nseg%lld.m4s\n", seg.duration, seg.msn);
+			out += line;
+		}
+	}
+
+	// The hinted part is only worth asking for where the request can wait
+	if (!bBlocking)
+		return out;
+	const Segment& last = m_segments.back();
+	if (last.data)
+		snprintf(line, sizeof(line), "#EXT-X-PRELOAD-HINT:TYPE=PART,URI=\"seg%lld.0.m4s\"\n", m_nextMsn);
+	else
+		snprintf(line, sizeof(line), "#EXT-X-PRELOAD-HINT:TYPE=PART,URI=\"seg%lld.%d.m4s\"\n", last.msn, (int)last.parts.size());
+	out += line;
+	return out;
+}
+
+void Fmp4Packager::WriteFile(const std::string& name, const std::vector<uint8_t>& data) const
+{
+	// Write then rename so a static file server never sees a partial file
+	std::string path = m_config.outDir + "/" + name;
+	std::string tmp = path + ".tmp";
+	FILE* fp = fopen(tmp.c_str(), "wb");
+	if (fp == NULL)
+		return;
+	size_t nWritten = fwrite(data.data(), 1, data.size(), fp);
+	fclose(fp);
+	std::error_code ec;
+	if (nWritten == data.size())
+		std::filesystem::rename(tmp, path, ec);
+	else
+		std::filesystem::remove(tmp, ec);
+}
+
+void Fmp4Packager::PublishToDisk()
+{
+	std::string playlist = BuildPlaylist(false);
+	WriteFile("live.m3u8", std::vector<uint8_t>(playlist.begin(), playlist.end()));
+}
+
+bool Fmp4Packager::PlaylistReady(long long msn, int part) const
+{
+	if (m_segments.empty())
+		return false;
+	if (msn < 0)
+		return true;
+	const Segment& last = m_segments.back();
+	if (last.msn > msn)
+		return true;
+	if (last.msn < msn)
+		return false;
+	if (part < 0)
+		return last.data != nullptr;
+	return last.data != nullptr || (int)last.parts.size() > part;
+}
+
+bool Fmp4Packager::GetPlaylist(std::string* playlist, long long msn, int part, int timeoutMs)
+{
+	std::unique_lock<std::mutex> lk(m_lock);
+	if (!m_cvUpdate.wait_for(lk, std::chrono::milliseconds(timeoutMs), [&] { return m_bClosed || PlaylistReady(msn, part); }))
+		return false;
+	if (m_bClosed)
+		return false;
+	*playlist = BuildPlaylist(true);
+	return true;
+}
+
+void Fmp4Packager::Close()
+{
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		m_bClosed = true;
+	}
+	m_cvUpdate.notify_all();
+}
+
+SharedBuffer Fmp4Packager::GetResource(const std::string& name, int timeoutMs)
+{
+	int initIndex = 0;
+	long long msn = 0;
+	int part = -1;
+	char tail[8] = { 0 };
+
+	std::unique_lock<std::mutex> lk(m_lock);
+	if (sscanf(name.c_str(), "init%d.mp4", &initIndex) == 1) {
+		for (const std::pair<int, SharedBuffer>& init : m_inits) {
+			if (init.first == initIndex)
+				return init.second;
+		}
+		return nullptr;
+	}
+
+	if (sscanf(name.c_str(), "seg%lld.%d.m4%1s", &msn, &part, tail) != 3) {
+		part = -1;
+		if (sscanf(name.c_str(), "seg%lld.m4%1s", &msn, tail) != 2)
+			return nullptr;
+	}
+
+	SharedBuffer result;
+	auto find = [&]() -> bool {
+		for (const Segment& seg : m_segments) {
+			if (seg.msn != msn)
+				continue;
+			if (part < 0)
+				result = seg.data;
+			else if (part < (int)seg.parts.size())
+				result = seg.parts[part].data;
+			return result != nullptr || seg.data != nullptr;
+		}
+		// gone from the window, or too far ahead to be worth waiting for
+		return m_segments.empty() ? false : msn < m_segments.front().msn || msn > m_nextMsn;
+	};
+	m_cvUpdate.wait_for(lk, std::chrono::milliseconds(timeoutMs), [&] { return m_bClosed || find(); });
+	return result;
+}
@@ -0,0 +1,104 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "DavFrame.h"
+
+typedef std::shared_ptr<const std::vector<uint8_t>> SharedBuffer;
+
+struct PackagerConfig
+{
+	std::string outDir;				// empty: serve from memory only
+	double partTarget = 0.333;		// LL-HLS part duration, seconds, > 0
+	double segmentTarget = 1.0;		// segments are cut on the first keyframe past this, > 0
+	int windowSegments = 6;			// complete segments kept in the playlist, >= 1
+
+	bool IsValid() const { return partTarget > 0 && segmentTarget > 0 && windowSegments >= 1; }
+};
+
+// CMAF fragmented MP4 / LL-HLS packager for one camera stream. Video frames
+// from a DavFrameReader go in, init segment, partial segments, full segments
+// and the media playlist come out. All outputs are immutable shared buffers,
+// so any number of viewers can be served from one packager.
+//
+// Low latency needs the blocking accessors below behind an HTTP server; only
+// their playlist offers CAN-BLOCK-RELOAD and the preload hint. The copy in
+// outDir is for static file servers, which cannot hold a request, and is a
+// plain live playlist with parts.
+class Fmp4Packager
+{
+public:
+	explicit Fmp4Packager(const PackagerConfig& config);
+
+	void InputFrame(const DavFrame& frame);
+	// Releases blocked GetPlaylist / GetResource callers; nothing new after.
+	void Close();
+
+	// Blocking playlist reload (_HLS_msn / _HLS_part). msn < 0 returns at once.
+	bool GetPlaylist(std::string* playlist, long long msn = -1, int part = -1, int timeoutMs = 3000);
+	// "init<N>.mp4", "seg<M>.m4s" or "seg<M>.<P>.m4s". Waits up to timeoutMs for
+	// the part announced by EXT-X-PRELOAD-HINT.
+	SharedBuffer GetResource(const std::string& name, int timeoutMs = 3000);
+
+private:
+	struct Sample
+	{
+		std::vector<uint8_t> data;	// length prefixed NAL units
+		int64_t pts;				// 90 kHz
+		uint32_t duration;
+		bool key;
+	};
+
+	struct Part
+	{
+		SharedBuffer data;
+		double duration;
+		bool independent;
+	};
+
+	struct Segment
+	{
+		long long msn;
+		int initIndex;
+		double duration;
+		std::vector<Part> parts;
+		SharedBuffer data;			// set once the segment is complete
+	};
+
+	bool UpdateParameterSets(const DavFrame& frame, const std::vector<std::vector<uint8_t>>& nals);
+	void AddSample(Sample& sample);
+	void ClosePart();
+	void CloseSegment();
+	void BuildInit();
+	std::string BuildPlaylist(bool bBlocking) const;
+	void WriteFile(const std::string& name, const std::vector<uint8_t>& data) const;
+	void PublishToDisk();
+	bool PlaylistReady(long long msn, int part) const;
+
+	PackagerConfig m_config;
+	mutable std::mutex m_lock;
+	std::condition_variable m_cvUpdate;
+	bool m_bClosed;
+
+	bool m_bHevc;
+	uint16_t m_width;
+	uint16_t m_height;
+	std::vector<uint8_t> m_vps, m_sps, m_pps;
+	int m_initIndex;
+	std::deque<std::pair<int, SharedBuffer>> m_inits;
+
+	bool m_bHavePending;
+	Sample m_pending;
+	int64_t m_firstPts;
+	uint32_t m_fragmentSeq;
+
+	std::vector<Sample> m_partSamples;
+	double m_partDuration;
+	std::deque<Segment> m_segments;	// complete segments followed by the open one
+	long long m_nextMsn;
+	double m_maxSegmentDuration;
+	double m_maxPartDuration;
+};
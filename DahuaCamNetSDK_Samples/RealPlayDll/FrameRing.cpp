@@ -0,0 +1,265 @@
+#include <string.h>
+#include <chrono>
+#include <thread>
+#include "FrameRing.h"
+#include "FrameRingLayout.h"
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define FRAME_RING_POLL_MS		1
+#define FRAME_RING_READ_TRIES	4
+
+struct FrameRingReader
+{
+	FrameRingMapping map;
+	FrameRingHeader* pHeader;
+	uint32_t slotCount;
+	uint32_t slotSize;
+};
+
+bool FrameRingMap(const char* name, size_t size, bool bCreate, FrameRingMapping* pMap)
+{
+	std::string fullName = std::string(FRAME_RING_PREFIX) + name;
+#ifdef _WIN32
+	if (bCreate) {
+		pMap->hMap = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+			(DWORD)((uint64_t)size >> 32), (DWORD)size, fullName.c_str());
+		pMap->bExisted = pMap->hMap != NULL && GetLastError() == ERROR_ALREADY_EXISTS;
+	}
+	else {
+		pMap->hMap = OpenFileMappingA(FILE_MAP_READ | FILE_MAP_WRITE, FALSE, fullName.c_str());
+	}
+	if (pMap->hMap == NULL)
+		return false;
+	pMap->base = (uint8_t*)MapViewOfFile(pMap->hMap, FILE_MAP_READ | FILE_MAP_WRITE, 0, 0, bCreate ? size : 0);
+	MEMORY_BASIC_INFORMATION info;
+	if (pMap->base == NULL || VirtualQuery(pMap->base, &info, sizeof(info)) == 0) {
+		FrameRingUnmap(pMap);
+		return false;
+	}
+	// An existing section may be smaller than asked for; the view says how
+	// much is really there
+	pMap->size = info.RegionSize;
+#else
+	int fd;
+	if (bCreate) {
+		// A ring left by a previous session stays with the readers still
+		// holding it; they see it closed and reopen this one
+		shm_unlink(fullName.c_str());
+		fd = shm_open(fullName.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+		if (fd >= 0 && ftruncate(fd, (off_t)size) != 0) {
+			close(fd);
+			shm_unlink(fullName.c_str());
+			fd = -1;
+		}
+	}
+	else {
+		fd = shm_open(fullName.c_str(), O_RDWR, 0);
+		struct stat st;
+		if (fd >= 0 && fstat(fd, &st) == 0)
+			size = (size_t)st.st_size;
+	}
+	if (fd < 0)
+		return false;
+	void* p = size > 0 ? mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+	close(fd);
+	if (p == MAP_FAILED) {
+		if (bCreate)
+			shm_unlink(fullName.c_str());
+		return false;
+	}
+	pMap->base = (uint8_t*)p;
+	pMap->size = size;
+	pMap->shmName = fullName;
+	pMap->bOwner = bCreate;
+#endif
+	return true;
+}
+
+void FrameRingUnmap(FrameRingMapping* pMap)
+{
+#ifdef _WIN32
+	if (pMap->base != NULL)
+		UnmapViewOfFile(pMap->base);
+	if (pMap->hMap != NULL)
+		CloseHandle(pMap->hMap);
+	pMap->hMap = NULL;
+#else
+	if (pMap->base != NULL)
+		munmap(pMap->base, pMap->size);
+	if (pMap->bOwner)
+		shm_unlink(pMap->shmName.c_str());
+	pMap->bOwner = false;
+#endif
+	pMap->base = NULL;
+	pMap->size = 0;
+}
+
+int64_t FrameRingNowUs(void)
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+int FrameRingOpen(const char* name, FrameRingReader** ppReader)
+{
+	if (name == NULL || name[0] == '\0' || ppReader == NULL)
+		return FRAME_RING_ERR_PARAM;
+	*ppReader = NULL;
+
+	FrameRingReader* pReader = new FrameRingReader();
+	if (!FrameRingMap(name, 0, false, &pReader->map)) {
+		delete pReader;
+		return FRAME_RING_ERR_OPEN;
+	}
+
+	FrameRingHeader* pHeader = (FrameRingHeader*)pReader->map.base;
+	if (pReader->map.size < sizeof(FrameRingHeader) || pHeader->magic.load(std::memory_order_acquire) != FRAME_RING_MAGIC
+		|| pHeader->version != FRAME_RING_VERSION || pHeader->slotCount == 0
+		|| pHeader->slotSize < sizeof(FrameRingSlot) + FrameRingPictureSize(pHeader->maxWidth, pHeader->maxHeight)
+		|| pReader->map.size < sizeof(FrameRingHeader) + (size_t)pHeader->slotSize * pHeader->slotCount) {
+		FrameRingUnmap(&pReader->map);
+		delete pReader;
+		return FRAME_RING_ERR_FORMAT;
+	}
+	pReader->pHeader = pHeader;
+	pReader->slotCount = pHeader->slotCount;
+	pReader->slotSize = pHeader->slotSize;
+	*ppReader = pReader;
+	return FRAME_RING_OK;
+}
+
+void FrameRingClose(FrameRingReader* pReader)
+{
+	if (pReader == NULL)
+		return;
+	FrameRingUnmap(&pReader->map);
+	delete pReader;
+}
+
+uint64_t FrameRingWriteSeq(FrameRingReader* pReader)
+{
+	return pReader->pHeader->writeSeq.load(std::memory_order_acquire);
+}
+
+// Reads the description of frame seq out of its slot. The pixels are not
+// touched; the caller validates them later with FrameRingCheck.
+static int ReadSlot(FrameRingReader* pReader, uint64_t seq, FrameRingFrame* pFrame)
+{
+	uint32_t index = (uint32_t)((seq - 1) % pReader->slotCount);
+	FrameRingSlot* pSlot = FrameRingSlotAt(pReader->map.base, pReader->slotSize, index);
+	uint64_t lock = pSlot->lock.load(std::memory_order_acquire);
+	if (lock != seq * 2)
+		return FRAME_RING_OVERRUN;
+
+	pFrame->seq = seq;
+	pFrame->ptsMs = pSlot->ptsMs;
+	pFrame->wallUs = pSlot->wallUs;
+	pFrame->captureUs = pSlot->captureUs;
+	pFrame->receiveUs = pSlot->receiveUs;
+	pFrame->width = (int)pSlot->width;
+	pFrame->height = (int)pSlot->height;
+	pFrame->size = pSlot->dataSize;
+	pFrame->slot = index;
+	std::atomic_thread_fence(std::memory_order_acquire);
+	if (pSlot->lock.load(std::memory_order_relaxed) != lock)
+		return FRAME_RING_OVERRUN;
+
+	if (pFrame->width <= 0 || pFrame->height <= 0 || pFrame->size != FrameRingPictureSize(pFrame->width, pFrame->height)
+		|| sizeof(FrameRingSlot) + pFrame->size > pReader->slotSize)
+		return FRAME_RING_ERR_SIZE;
+
+	int chromaW = (pFrame->width + 1) / 2;
+	int chromaH = (pFrame->height + 1) / 2;
+	const uint8_t* data = (const uint8_t*)(pSlot + 1);
+	pFrame->plane[0] = data;
+	pFrame->plane[1] = data + (size_t)pFrame->width * pFrame->height;
+	pFrame->plane[2] = pFrame->plane[1] + (size_t)chromaW * chromaH;
+	pFrame->stride[0] = pFrame->width;
+	pFrame->stride[1] = chromaW;
+	pFrame->stride[2] = chromaW;
+	return FRAME_RING_OK;
+}
+
+// Reads the first frame at or after the one picked from writeSeq. A slot
+// that is being rewritten means the producer lapped the pick, so the pick is
+// redone from the newer writeSeq.
+static int ReadFrame(FrameRingReader* pReader, uint64_t afterSeq, bool bLatest, FrameRingFrame* pFrame)
+{
+	for (int i = 0; i < FRAME_RING_READ_TRIES; i++) {
+		uint64_t writeSeq = FrameRingWriteSeq(pReader);
+		if (writeSeq <= afterSeq) {
+			if (pReader->pHeader->bClosed.load(std::memory_order_acquire))
+				return FRAME_RING_CLOSED;
+			return FRAME_RING_NONE;
+		}
+
+		uint64_t seq = afterSeq + 1;
+		if (bLatest)
+			seq = writeSeq;
+		else if (writeSeq >= pReader->slotCount && seq < writeSeq - pReader->slotCount + 1)
+			seq = writeSeq - pReader->slotCount + 1;
+
+		int ret = ReadSlot(pReader, seq, pFrame);
+		if (ret != FRAME_RING_OVERRUN)
+			return ret;
+	}
+	return FRAME_RING_OVERRUN;
+}
+
+int FrameRingLatest(FrameRingReader* pReader, FrameRingFrame* pFrame)
+{
+	if (pReader == NULL || pFrame == NULL)
+		return FRAME_RING_ERR_PARAM;
+	return ReadFrame(pReader, 0, true, pFrame);
+}
+
+int FrameRingNext(FrameRingReader* pReader, uint64_t afterSeq, FrameRingFrame* pFrame)
+{
+	if (pReader == NULL || pFrame == NULL)
+		return FRAME_RING_ERR_PARAM;
+	return ReadFrame(pReader, afterSeq, false, pFrame);
+}
+
+int FrameRingWait(FrameRingReader* pReader, uint64_t afterSeq, int timeoutMs)
+{
+	if (pReader == NULL)
+		return FRAME_RING_ERR_PARAM;
+
+	// Producers never signal, so that they never have to know about
+	// readers; a 1 ms poll is well below a frame interval
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now()
+		+ std::chrono::milliseconds(timeoutMs < 0 ? 0 : timeoutMs);
+	for (;;) {
+		if (FrameRingWriteSeq(pReader) > afterSeq)
+			return FRAME_RING_OK;
+		if (pReader->pHeader->bClosed.load(std::memory_order_acquire))
+			return FRAME_RING_CLOSED;
+		if (timeoutMs >= 0 && std::chrono::steady_clock::now() >= deadline)
+			return FRAME_RING_NONE;
+		std::this_thread::sleep_for(std::chrono::milliseconds(FRAME_RING_POLL_MS));
+	}
+}
+
+int FrameRingCheck(FrameRingReader* pReader, const FrameRingFrame* pFrame)
+{
+	if (pReader == NULL || pFrame == NULL || pFrame->slot >= pReader->slotCount)
+		return FRAME_RING_ERR_PARAM;
+	FrameRingSlot* pSlot = FrameRingSlotAt(pReader->map.base, pReader->slotSize, pFrame->slot);
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return pSlot->lock.load(std::memory_order_relaxed) == pFrame->seq * 2 ? FRAME_RING_OK : FRAME_RING_OVERRUN;
+}
+
+int FrameRingCopy(FrameRingReader* pReader, const FrameRingFrame* pFrame, uint8_t* dst, size_t dstSize)
+{
+	if (pReader == NULL || pFrame == NULL || dst == NULL)
+		return FRAME_RING_ERR_PARAM;
+	if (dstSize < pFrame->size)
+		return FRAME_RING_ERR_SIZE;
+	memcpy(dst, pFrame->plane[0], pFrame->size);
+	return FrameRingCheck(pReader, pFrame);
+}
@@ -0,0 +1,77 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Reader side of the decoded-frame ring that RealPlay publishes per camera
+// (interface_StartFrameRing). Frames are I420, packed tightly: Y is
+// width x height, U and V are (width + 1) / 2 x (height + 1) / 2.
+//
+// The producer never waits for readers; it overwrites the oldest slot. A
+// reader gets pointers straight into shared memory, so it must call
+// FrameRingCheck after it is done with the pixels: FRAME_RING_OVERRUN means
+// the slot was rewritten meanwhile and the result has to be thrown away.
+// FrameRingCopy does the copy and the check in one go.
+
+// Frame ring result codes
+#define FRAME_RING_OK			0
+#define FRAME_RING_NONE			1	// nothing newer than requested yet
+#define FRAME_RING_OVERRUN		2	// frame overwritten by the producer
+#define FRAME_RING_CLOSED		3	// producer stopped, nothing more will come
+#define FRAME_RING_ERR_OPEN		4	// no ring with that name, or mapping failed
+#define FRAME_RING_ERR_FORMAT	5	// not a frame ring, or another layout version
+#define FRAME_RING_ERR_SIZE		6	// frame or buffer size mismatch
+#define FRAME_RING_ERR_PARAM	7
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct FrameRingReader FrameRingReader;
+
+typedef struct FrameRingFrame
+{
+	uint64_t seq;				// ring sequence, 1 for the first frame, no gaps on the producer side
+	int64_t ptsMs;				// stream timestamp from the decoder
+	int64_t wallUs;				// decode time, FrameRingNowUs clock
+	int64_t captureUs;			// device capture time on the same clock, 0 unless latency tracing is on
+	int64_t receiveUs;			// SDK data callback time, 0 unless latency tracing is on
+	int width;
+	int height;
+	const uint8_t* plane[3];	// Y, U, V inside shared memory
+	int stride[3];
+	size_t size;				// bytes of all three planes, contiguous from plane[0]
+	uint32_t slot;
+} FrameRingFrame;
+
+// name is the one given to interface_StartFrameRing, e.g. "cam0".
+int FrameRingOpen(const char* name, FrameRingReader** ppReader);
+void FrameRingClose(FrameRingReader* pReader);
+
+// Newest published frame.
+int FrameRingLatest(FrameRingReader* pReader, FrameRingFrame* pFrame);
+
+// Oldest frame still in the ring with seq > afterSeq. When the reader fell
+// behind by more than a ring the returned seq jumps; the gap is the number
+// of frames lost.
+int FrameRingNext(FrameRingReader* pReader, uint64_t afterSeq, FrameRingFrame* pFrame);
+
+// Polls until a frame newer than afterSeq is published, up to timeoutMs
+// (-1: forever). FRAME_RING_OK, FRAME_RING_NONE on timeout or
+// FRAME_RING_CLOSED.
+int FrameRingWait(FrameRingReader* pReader, uint64_t afterSeq, int timeoutMs);
+
+// FRAME_RING_OK when the frame's slot was not rewritten since it was read.
+int FrameRingCheck(FrameRingReader* pReader, const FrameRingFrame* pFrame);
+
+// Copies the packed I420 picture (pFrame->size bytes) and checks it.
+int FrameRingCopy(FrameRingReader* pReader, const FrameRingFrame* pFrame, uint8_t* dst, size_t dstSize);
+
+// Last published seq, 0 before the first frame.
+uint64_t FrameRingWriteSeq(FrameRingReader* pReader);
+
+// Wall clock used for wallUs, microseconds since the Unix epoch.
+int64_t FrameRingNowUs(void);
+
+#ifdef __cplusplus
+}
+#endif
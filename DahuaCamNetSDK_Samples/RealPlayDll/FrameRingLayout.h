@@ -0,0 +1,85 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+// Shared memory layout of a frame ring, used by FrameRingWriter and the
+// reader API in FrameRing.cpp only.
+//
+//   FrameRingHeader | slot 0 | slot 1 | ... | slot slotCount - 1
+//
+// Every slot is slotSize bytes: a FrameRingSlot followed by the packed I420
+// picture. A slot is guarded by a sequence lock: lock is 2 * seq once frame
+// seq is complete and odd while the producer rewrites it. Frame seq always
+// lives in slot (seq - 1) % slotCount.
+
+#define FRAME_RING_MAGIC		0x474E5246		// "FRNG"
+#define FRAME_RING_VERSION		2
+#define FRAME_RING_ALIGN		64
+#ifdef _WIN32
+#define FRAME_RING_PREFIX		"Local\\DahuaFrameRing."
+#else
+#define FRAME_RING_PREFIX		"/DahuaFrameRing."
+#endif
+
+struct FrameRingHeader
+{
+	std::atomic<uint32_t> magic;	// written last by the producer
+	uint32_t version;
+	uint32_t slotCount;
+	uint32_t slotSize;
+	uint32_t maxWidth;
+	uint32_t maxHeight;
+	std::atomic<uint32_t> bClosed;
+	uint32_t reserved;
+	std::atomic<uint64_t> writeSeq;	// last complete frame, 0 for none
+	uint8_t pad[FRAME_RING_ALIGN - 40];
+};
+
+struct FrameRingSlot
+{
+	std::atomic<uint64_t> lock;
+	uint64_t seq;
+	int64_t ptsMs;
+	int64_t wallUs;
+	uint32_t width;
+	uint32_t height;
+	uint32_t dataSize;
+	uint32_t reserved;
+	int64_t captureUs;
+	int64_t receiveUs;
+};
+
+static_assert(sizeof(FrameRingHeader) == FRAME_RING_ALIGN, "frame ring header layout");
+static_assert(sizeof(FrameRingSlot) == FRAME_RING_ALIGN, "frame ring slot layout");
+
+struct FrameRingMapping
+{
+	uint8_t* base = NULL;
+	size_t size = 0;
+	bool bExisted = false;		// create found a ring of that name already there
+#ifdef _WIN32
+	HANDLE hMap = NULL;
+#else
+	std::string shmName;
+	bool bOwner = false;		// unlink the name on unmap
+#endif
+};
+
+inline size_t FrameRingPictureSize(uint32_t width, uint32_t height)
+{
+	return (size_t)width * height + 2 * (size_t)((width + 1) / 2) * ((height + 1) / 2);
+}
+
+inline FrameRingSlot* FrameRingSlotAt(uint8_t* base, uint32_t slotSize, uint32_t index)
+{
+	return (FrameRingSlot*)(base + sizeof(FrameRingHeader) + (size_t)slotSize * index);
+}
+
+// Creates (bCreate, size bytes) or opens an existing ring mapping by ring name.
+bool FrameRingMap(const char* name, size_t size, bool bCreate, FrameRingMapping* pMap);
+void FrameRingUnmap(FrameRingMapping* pMap);
@@ -0,0 +1,111 @@
+#include <string.h>
+#include "FrameRingWriter.h"
+
+FrameRingWriter::FrameRingWriter() : m_pHeader(NULL), m_nSeq(0), m_nPublished(0), m_nOversize(0)
+{
+}
+
+FrameRingWriter::~FrameRingWriter()
+{
+	Close();
+}
+
+int FrameRingWriter::Create(const char* name, uint32_t slotCount, int maxWidth, int maxHeight)
+{
+	if (name == NULL || name[0] == '\0' || slotCount == 0 || maxWidth <= 0 || maxHeight <= 0)
+		return FRAME_RING_ERR_PARAM;
+	Close();
+
+	size_t slotSize = sizeof(FrameRingSlot) + FrameRingPictureSize(maxWidth, maxHeight);
+	slotSize = (slotSize + FRAME_RING_ALIGN - 1) / FRAME_RING_ALIGN * FRAME_RING_ALIGN;
+	if (slotSize > UINT32_MAX)
+		return FRAME_RING_ERR_SIZE;
+	size_t size = sizeof(FrameRingHeader) + slotSize * slotCount;
+	if (!FrameRingMap(name, size, true, &m_map))
+		return FRAME_RING_ERR_OPEN;
+
+	FrameRingHeader* pHeader = (FrameRingHeader*)m_map.base;
+	if (m_map.bExisted) {
+		if (m_map.size < size || pHeader->magic.load() != FRAME_RING_MAGIC || pHeader->version != FRAME_RING_VERSION
+			|| pHeader->slotCount != slotCount || pHeader->slotSize != slotSize
+			|| pHeader->maxWidth != (uint32_t)maxWidth || pHeader->maxHeight != (uint32_t)maxHeight) {
+			FrameRingUnmap(&m_map);
+			return FRAME_RING_ERR_FORMAT;
+		}
+		m_nSeq = pHeader->writeSeq.load();
+		pHeader->bClosed.store(0, std::memory_order_release);
+	}
+	else {
+		// Fresh mappings are zero filled: every slot lock is 0, which
+		// matches no frame
+		pHeader->version = FRAME_RING_VERSION;
+		pHeader->slotCount = slotCount;
+		pHeader->slotSize = (uint32_t)slotSize;
+		pHeader->maxWidth = (uint32_t)maxWidth;
+		pHeader->maxHeight = (uint32_t)maxHeight;
+		pHeader->bClosed.store(0);
+		pHeader->writeSeq.store(0);
+		pHeader->magic.store(FRAME_RING_MAGIC, std::memory_order_release);
+		m_nSeq = 0;
+	}
+	m_pHeader = pHeader;
+	return FRAME_RING_OK;
+}
+
+void FrameRingWriter::Close()
+{
+	if (m_pHeader == NULL)
+		return;
+	m_pHeader->bClosed.store(1, std::memory_order_release);
+	m_pHeader = NULL;
+	FrameRingUnmap(&m_map);
+}
+
+static void CopyPlane(uint8_t* dst, const uint8_t* src, int stride, int width, int height)
+{
+	for (int y = 0; y < height; y++) {
+		memcpy(dst, src, width);
+		dst += width;
+		src += stride;
+	}
+}
+
+void FrameRingWriter::OnFrame(const DecodedFrame& frame)
+{
+	if (m_pHeader == NULL)
+		return;
+	if ((uint32_t)frame.width > m_pHeader->maxWidth || (uint32_t)frame.height > m_pHeader->maxHeight) {
+		m_nOversize++;
+		return;
+	}
+
+	uint64_t seq = ++m_nSeq;
+	FrameRingSlot* pSlot = FrameRingSlotAt(m_map.base, m_pHeader->slotSize, (uint32_t)((seq - 1) % m_pHeader->slotCount));
+
+	// Odd lock first, so a reader still holding the previous frame of this
+	// slot sees the overrun
+	pSlot->lock.store(seq * 2 - 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	int chromaW = (frame.width + 1) / 2;
+	int chromaH = (frame.height + 1) / 2;
+	uint8_t* data = (uint8_t*)(pSlot + 1);
+	CopyPlane(data, frame.plane[0], frame.stride[0], frame.width, frame.height);
+	data += (size_t)frame.width * frame.height;
+	CopyPlane(data, frame.plane[1], frame.stride[1], chromaW, chromaH);
+	data += (size_t)chromaW * chromaH;
+	CopyPlane(data, frame.plane[2], frame.stride[2], chromaW, chromaH);
+
+	pSlot->seq = seq;
+	pSlot->ptsMs = frame.ptsMs;
+	pSlot->wallUs = frame.wallUs;
+	pSlot->captureUs = frame.captureUs;
+	pSlot->receiveUs = frame.receiveUs;
+	pSlot->width = (uint32_t)frame.width;
+	pSlot->height = (uint32_t)frame.height;
+	pSlot->dataSize = (uint32_t)FrameRingPictureSize(frame.width, frame.height);
+
+	pSlot->lock.store(seq * 2, std::memory_order_release);
+	m_pHeader->writeSeq.store(seq, std::memory_order_release);
+	m_nPublished++;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include "FrameRing.h"
+#include "FrameRingLayout.h"
+#include "LiveDecoder.h"
+
+#define FRAME_RING_DEFAULT_SLOTS	8
+#define FRAME_RING_DEFAULT_WIDTH	1920
+#define FRAME_RING_DEFAULT_HEIGHT	1080
+
+// Producer side of a frame ring: a FrameSink that copies every decoded
+// picture into the next slot of a named shared memory ring. It never waits
+// for readers. Pictures larger than the size the ring was created for are
+// dropped and counted.
+class FrameRingWriter : public FrameSink
+{
+public:
+	FrameRingWriter();
+	~FrameRingWriter();
+
+	// Returns a FRAME_RING_* code. On Windows an existing ring of the same
+	// name and geometry, still held open by readers, is reused and its
+	// sequence continues.
+	int Create(const char* name, uint32_t slotCount = FRAME_RING_DEFAULT_SLOTS,
+		int maxWidth = FRAME_RING_DEFAULT_WIDTH, int maxHeight = FRAME_RING_DEFAULT_HEIGHT);
+
+	// Marks the ring closed for the readers and unmaps it.
+	void Close();
+
+	virtual void OnFrame(const DecodedFrame& frame);
+
+	uint64_t Published() const { return m_nPublished.load(); }
+	uint64_t Oversize() const { return m_nOversize.load(); }
+
+private:
+	FrameRingMapping m_map;
+	FrameRingHeader* m_pHeader;
+	uint64_t m_nSeq;
+	std::atomic<uint64_t> m_nPublished;
+	std::atomic<uint64_t> m_nOversize;
+};
@@ -0,0 +1,509 @@
+#include <math.h>
+#include <string.h>
+#include <atomic>
+#include <vector>
+#include "ImageConvert.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define IMAGE_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_SSE41
+#define TARGET_AVX2
+#else
+#include <cpuid.h>
+#define TARGET_SSE41			__attribute__((target("sse4.1")))
+#define TARGET_AVX2				__attribute__((target("avx2")))
+#endif
+#endif
+
+// Bilinear weights are 7 bit, so (b - a) * f stays inside 16 bits
+#define BLEND_BITS				7
+#define BLEND_ONE				(1 << BLEND_BITS)
+#define ROW_SLACK				3
+
+// BT.601 limited range, Q16
+#define YUV_Y					76284		// 1.164
+#define YUV_RV					104595		// 1.596
+#define YUV_GU					25625		// 0.391
+#define YUV_GV					53281		// 0.813
+#define YUV_BU					132252		// 2.018
+#define YUV_ROUND				32768
+
+typedef void (*BlendRowFunc)(const uint8_t* a, const uint8_t* b, uint8_t* out, int n, int f);
+typedef void (*YuvToRgbRowFunc)(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* r, uint8_t* g, uint8_t* b, int n);
+typedef void (*ResampleRowFunc)(const uint8_t* row, const int* index, const uint8_t* frac, uint8_t* out, int n);
+typedef void (*InterleaveRowFunc)(const uint8_t* c0, const uint8_t* c1, const uint8_t* c2, uint8_t* dst, int n);
+
+struct ConvertKernels
+{
+	BlendRowFunc blendRow;
+	ResampleRowFunc resampleRow;
+	YuvToRgbRowFunc yuvToRgbRow;
+	InterleaveRowFunc interleaveRow;
+};
+
+static inline uint8_t Clamp255(int v)
+{
+	return (uint8_t)(v < 0 ? 0 : (v > 255 ? 255 : v));
+}
+
+static void BlendRowScalar(const uint8_t* a, const uint8_t* b, uint8_t* out, int n, int f)
+{
+	for (int i = 0; i < n; i++)
+		out[i] = (uint8_t)(a[i] + (((b[i] - a[i]) * f + BLEND_ONE / 2) >> BLEND_BITS));
+}
+
+static void ResampleRowScalar(const uint8_t* row, const int* index, const uint8_t* frac, uint8_t* out, int n)
+{
+	for (int i = 0; i < n; i++) {
+		const uint8_t* p = row + index[i];
+		out[i] = (uint8_t)(p[0] + (((p[1] - p[0]) * frac[i] + BLEND_ONE / 2) >> BLEND_BITS));
+	}
+}
+
+static void YuvToRgbRowScalar(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* r, uint8_t* g, uint8_t* b, int n)
+{
+	for (int i = 0; i < n; i++) {
+		int c = (y[i] - 16) * YUV_Y + YUV_ROUND;
+		int d = u[i] - 128;
+		int e = v[i] - 128;
+		r[i] = Clamp255((c + YUV_RV * e) >> 16);
+		g[i] = Clamp255((c - YUV_GU * d - YUV_GV * e) >> 16);
+		b[i] = Clamp255((c + YUV_BU * d) >> 16);
+	}
+}
+
+static void InterleaveRowScalar(const uint8_t* c0, const uint8_t* c1, const uint8_t* c2, uint8_t* dst, int n)
+{
+	for (int i = 0; i < n; i++) {
+		dst[0] = c0[i];
+		dst[1] = c1[i];
+		dst[2] = c2[i];
+		dst += 3;
+	}
+}
+
+#ifdef IMAGE_X86
+static TARGET_SSE41 void BlendRowSse41(const uint8_t* a, const uint8_t* b, uint8_t* out, int n, int f)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i weight = _mm_set1_epi16((short)f);
+	const __m128i round = _mm_set1_epi16(BLEND_ONE / 2);
+	int i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+		__m128i vb = _mm_loadu_si128((const __m128i*)(b + i));
+		__m128i alo = _mm_unpacklo_epi8(va, zero);
+		__m128i ahi = _mm_unpackhi_epi8(va, zero);
+		__m128i dlo = _mm_sub_epi16(_mm_unpacklo_epi8(vb, zero), alo);
+		__m128i dhi = _mm_sub_epi16(_mm_unpackhi_epi8(vb, zero), ahi);
+		__m128i lo = _mm_add_epi16(alo, _mm_srai_epi16(_mm_add_epi16(_mm_mullo_epi16(dlo, weight), round), BLEND_BITS));
+		__m128i hi = _mm_add_epi16(ahi, _mm_srai_epi16(_mm_add_epi16(_mm_mullo_epi16(dhi, weight), round), BLEND_BITS));
+		_mm_storeu_si128((__m128i*)(out + i), _mm_packus_epi16(lo, hi));
+	}
+	BlendRowScalar(a + i, b + i, out + i, n - i, f);
+}
+
+static TARGET_SSE41 void YuvToRgbRowSse41(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* r, uint8_t* g, uint8_t* b, int n)
+{
+	const __m128i k16 = _mm_set1_epi32(16);
+	const __m128i k128 = _mm_set1_epi32(128);
+	const __m128i kY = _mm_set1_epi32(YUV_Y);
+	const __m128i kRV = _mm_set1_epi32(YUV_RV);
+	const __m128i kGU = _mm_set1_epi32(YUV_GU);
+	const __m128i kGV = _mm_set1_epi32(YUV_GV);
+	const __m128i kBU = _mm_set1_epi32(YUV_BU);
+	const __m128i kRound = _mm_set1_epi32(YUV_ROUND);
+	int i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m128i vy = _mm_loadu_si128((const __m128i*)(y + i));
+		__m128i vu = _mm_loadu_si128((const __m128i*)(u + i));
+		__m128i vv = _mm_loadu_si128((const __m128i*)(v + i));
+		__m128i rr[4], gg[4], bb[4];
+		for (int k = 0; k < 4; k++) {
+			__m128i c = _mm_add_epi32(_mm_mullo_epi32(_mm_sub_epi32(_mm_cvtepu8_epi32(vy), k16), kY), kRound);
+			__m128i d = _mm_sub_epi32(_mm_cvtepu8_epi32(vu), k128);
+			__m128i e = _mm_sub_epi32(_mm_cvtepu8_epi32(vv), k128);
+			rr[k] = _mm_srai_epi32(_mm_add_epi32(c, _mm_mullo_epi32(e, kRV)), 16);
+			gg[k] = _mm_srai_epi32(_mm_sub_epi32(_mm_sub_epi32(c, _mm_mullo_epi32(d, kGU)), _mm_mullo_epi32(e, kGV)), 16);
+			bb[k] = _mm_srai_epi32(_mm_add_epi32(c, _mm_mullo_epi32(d, kBU)), 16);
+			vy = _mm_srli_si128(vy, 4);
+			vu = _mm_srli_si128(vu, 4);
+			vv = _mm_srli_si128(vv, 4);
+		}
+		_mm_storeu_si128((__m128i*)(r + i), _mm_packus_epi16(_mm_packs_epi32(rr[0], rr[1]), _mm_packs_epi32(rr[2], rr[3])));
+		_mm_storeu_si128((__m128i*)(g + i), _mm_packus_epi16(_mm_packs_epi32(gg[0], gg[1]), _mm_packs_epi32(gg[2], gg[3])));
+		_mm_storeu_si128((__m128i*)(b + i), _mm_packus_epi16(_mm_packs_epi32(bb[0], bb[1]), _mm_packs_epi32(bb[2], bb[3])));
+	}
+	YuvToRgbRowScalar(y + i, u + i, v + i, r + i, g + i, b + i, n - i);
+}
+
+// 16 pixels of three planes into 48 interleaved bytes with byte shuffles
+static TARGET_SSE41 void InterleaveRowSse41(const uint8_t* c0, const uint8_t* c1, const uint8_t* c2, uint8_t* dst, int n)
+{
+	const __m128i m00 = _mm_setr_epi8(0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1, 5);
+	const __m128i m01 = _mm_setr_epi8(-1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1, -1);
+	const __m128i m02 = _mm_setr_epi8(-1, -1, 0, -1, -1, 1, -1, -1, 2, -1, -1, 3, -1, -1, 4, -1);
+	const __m128i m10 = _mm_setr_epi8(-1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10, -1);
+	const __m128i m11 = _mm_setr_epi8(5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1, 10);
+	const __m128i m12 = _mm_setr_epi8(-1, 5, -1, -1, 6, -1, -1, 7, -1, -1, 8, -1, -1, 9, -1, -1);
+	const __m128i m20 = _mm_setr_epi8(-1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1, -1);
+	const __m128i m21 = _mm_setr_epi8(-1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15, -1);
+	const __m128i m22 = _mm_setr_epi8(10, -1, -1, 11, -1, -1, 12, -1, -1, 13, -1, -1, 14, -1, -1, 15);
+	int i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m128i a = _mm_loadu_si128((const __m128i*)(c0 + i));
+		__m128i b = _mm_loadu_si128((const __m128i*)(c1 + i));
+		__m128i c = _mm_loadu_si128((const __m128i*)(c2 + i));
+		__m128i o0 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, m00), _mm_shuffle_epi8(b, m01)), _mm_shuffle_epi8(c, m02));
+		__m128i o1 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, m10), _mm_shuffle_epi8(b, m11)), _mm_shuffle_epi8(c, m12));
+		__m128i o2 = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(a, m20), _mm_shuffle_epi8(b, m21)), _mm_shuffle_epi8(c, m22));
+		_mm_storeu_si128((__m128i*)(dst + i * 3), o0);
+		_mm_storeu_si128((__m128i*)(dst + i * 3 + 16), o1);
+		_mm_storeu_si128((__m128i*)(dst + i * 3 + 32), o2);
+	}
+	InterleaveRowScalar(c0 + i, c1 + i, c2 + i, dst + i * 3, n - i);
+}
+
+// unpack and pack both work within 128 bit lanes, so the byte order comes
+// out right without a permute
+static TARGET_AVX2 void BlendRowAvx2(const uint8_t* a, const uint8_t* b, uint8_t* out, int n, int f)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i weight = _mm256_set1_epi16((short)f);
+	const __m256i round = _mm256_set1_epi16(BLEND_ONE / 2);
+	int i = 0;
+	for (; i + 32 <= n; i += 32) {
+		__m256i va = _mm256_loadu_si256((const __m256i*)(a + i));
+		__m256i vb = _mm256_loadu_si256((const __m256i*)(b + i));
+		__m256i alo = _mm256_unpacklo_epi8(va, zero);
+		__m256i ahi = _mm256_unpackhi_epi8(va, zero);
+		__m256i dlo = _mm256_sub_epi16(_mm256_unpacklo_epi8(vb, zero), alo);
+		__m256i dhi = _mm256_sub_epi16(_mm256_unpackhi_epi8(vb, zero), ahi);
+		__m256i lo = _mm256_add_epi16(alo, _mm256_srai_epi16(_mm256_add_epi16(_mm256_mullo_epi16(dlo, weight), round), BLEND_BITS));
+		__m256i hi = _mm256_add_epi16(ahi, _mm256_srai_epi16(_mm256_add_epi16(_mm256_mullo_epi16(dhi, weight), round), BLEND_BITS));
+		_mm256_storeu_si256((__m256i*)(out + i), _mm256_packus_epi16(lo, hi));
+	}
+	BlendRowSse41(a + i, b + i, out + i, n - i, f);
+}
+
+// Each dword gather fetches the pixel pair at index, index + 1 (plus two
+// bytes of slack, see BlendSource)
+static TARGET_AVX2 void ResampleRowAvx2(const uint8_t* row, const int* index, const uint8_t* frac, uint8_t* out, int n)
+{
+	const __m256i lowByte = _mm256_set1_epi32(0xFF);
+	const __m256i round = _mm256_set1_epi32(BLEND_ONE / 2);
+	int i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m256i v[2];
+		for (int k = 0; k < 2; k++) {
+			__m256i idx = _mm256_loadu_si256((const __m256i*)(index + i + k * 8));
+			__m256i pair = _mm256_i32gather_epi32((const int*)row, idx, 1);
+			__m256i a = _mm256_and_si256(pair, lowByte);
+			__m256i b = _mm256_and_si256(_mm256_srli_epi32(pair, 8), lowByte);
+			__m256i f = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(frac + i + k * 8)));
+			v[k] = _mm256_add_epi32(a, _mm256_srai_epi32(_mm256_add_epi32(_mm256_mullo_epi32(_mm256_sub_epi32(b, a), f), round), BLEND_BITS));
+		}
+		__m256i p = _mm256_permute4x64_epi64(_mm256_packs_epi32(v[0], v[1]), 0xD8);
+		_mm_storeu_si128((__m128i*)(out + i), _mm_packus_epi16(_mm256_castsi256_si128(p), _mm256_extracti128_si256(p, 1)));
+	}
+	ResampleRowScalar(row, index + i, frac + i, out + i, n - i);
+}
+
+static TARGET_AVX2 inline __m128i PackChannelAvx2(__m256i lo, __m256i hi)
+{
+	__m256i p = _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), 0xD8);
+	return _mm_packus_epi16(_mm256_castsi256_si128(p), _mm256_extracti128_si256(p, 1));
+}
+
+static TARGET_AVX2 void YuvToRgbRowAvx2(const uint8_t* y, const uint8_t* u, const uint8_t* v, uint8_t* r, uint8_t* g, uint8_t* b, int n)
+{
+	const __m256i k16 = _mm256_set1_epi32(16);
+	const __m256i k128 = _mm256_set1_epi32(128);
+	const __m256i kY = _mm256_set1_epi32(YUV_Y);
+	const __m256i kRV = _mm256_set1_epi32(YUV_RV);
+	const __m256i kGU = _mm256_set1_epi32(YUV_GU);
+	const __m256i kGV = _mm256_set1_epi32(YUV_GV);
+	const __m256i kBU = _mm256_set1_epi32(YUV_BU);
+	const __m256i kRound = _mm256_set1_epi32(YUV_ROUND);
+	int i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m128i vy = _mm_loadu_si128((const __m128i*)(y + i));
+		__m128i vu = _mm_loadu_si128((const __m128i*)(u + i));
+		__m128i vv = _mm_loadu_si128((const __m128i*)(v + i));
+		__m256i rr[2], gg[2], bb[2];
+		for (int k = 0; k < 2; k++) {
+			__m256i c = _mm256_add_epi32(_mm256_mullo_epi32(_mm256_sub_epi32(_mm256_cvtepu8_epi32(vy), k16), kY), kRound);
+			__m256i d = _mm256_sub_epi32(_mm256_cvtepu8_epi32(vu), k128);
+			__m256i e = _mm256_sub_epi32(_mm256_cvtepu8_epi32(vv), k128);
+			rr[k] = _mm256_srai_epi32(_mm256_add_epi32(c, _mm256_mullo_epi32(e, kRV)), 16);
+			gg[k] = _mm256_srai_epi32(_mm256_sub_epi32(_mm256_sub_epi32(c, _mm256_mullo_epi32(d, kGU)), _mm256_mullo_epi32(e, kGV)), 16);
+			bb[k] = _mm256_srai_epi32(_mm256_add_epi32(c, _mm256_mullo_epi32(d, kBU)), 16);
+			vy = _mm_srli_si128(vy, 8);
+			vu = _mm_srli_si128(vu, 8);
+			vv = _mm_srli_si128(vv, 8);
+		}
+		_mm_storeu_si128((__m128i*)(r + i), PackChannelAvx2(rr[0], rr[1]));
+		_mm_storeu_si128((__m128i*)(g + i), PackChannelAvx2(gg[0], gg[1]));
+		_mm_storeu_si128((__m128i*)(b + i), PackChannelAvx2(bb[0], bb[1]));
+	}
+	YuvToRgbRowScalar(y + i, u + i, v + i, r + i, g + i, b + i, n - i);
+}
+
+static void Cpuid(int info[4], int leaf, int subLeaf)
+{
+#ifdef _MSC_VER
+	__cpuidex(info, leaf, subLeaf);
+#else
+	unsigned int a, b, c, d;
+	__cpuid_count(leaf, subLeaf, a, b, c, d);
+	info[0] = (int)a;
+	info[1] = (int)b;
+	info[2] = (int)c;
+	info[3] = (int)d;
+#endif
+}
+
+static unsigned long long Xgetbv0()
+{
+#ifdef _MSC_VER
+	return _xgetbv(0);
+#else
+	unsigned int eax, edx;
+	__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+	return ((unsigned long long)edx << 32) | eax;
+#endif
+}
+#endif
+
+static const ConvertKernels g_kernels[3] = {
+	{ BlendRowScalar, ResampleRowScalar, YuvToRgbRowScalar, InterleaveRowScalar },
+#ifdef IMAGE_X86
+	{ BlendRowSse41, ResampleRowScalar, YuvToRgbRowSse41, InterleaveRowSse41 },
+	{ BlendRowAvx2, ResampleRowAvx2, YuvToRgbRowAvx2, InterleaveRowSse41 },
+#else
+	{ BlendRowScalar, ResampleRowScalar, YuvToRgbRowScalar, InterleaveRowScalar },
+	{ BlendRowScalar, ResampleRowScalar, YuvToRgbRowScalar, InterleaveRowScalar },
+#endif
+};
+
+static std::atomic<int> g_isa(-1);
+
+static int DetectIsa()
+{
+#ifdef IMAGE_X86
+	int info[4];
+	Cpuid(info, 0, 0);
+	int maxLeaf = info[0];
+	if (maxLeaf < 1)
+		return IMAGE_ISA_SCALAR;
+	Cpuid(info, 1, 0);
+	bool bSse41 = (info[2] & (1 << 19)) != 0;
+	// AVX state has to be enabled by the OS too (OSXSAVE, XCR0 bits 1 and 2)
+	bool bAvx = (info[2] & (1 << 27)) != 0 && (info[2] & (1 << 28)) != 0 && (Xgetbv0() & 6) == 6;
+	bool bAvx2 = false;
+	if (bAvx && maxLeaf >= 7) {
+		Cpuid(info, 7, 0);
+		bAvx2 = (info[1] & (1 << 5)) != 0;
+	}
+	if (bAvx2)
+		return IMAGE_ISA_AVX2;
+	if (bSse41)
+		return IMAGE_ISA_SSE41;
+#endif
+	return IMAGE_ISA_SCALAR;
+}
+
+int ImageConvertIsa(void)
+{
+	int isa = g_isa.load(std::memory_order_relaxed);
+	if (isa < 0) {
+		isa = DetectIsa();
+		g_isa.store(isa, std::memory_order_relaxed);
+	}
+	return isa;
+}
+
+int ImageConvertSetIsa(int isa)
+{
+	if (isa < IMAGE_ISA_SCALAR || isa > IMAGE_ISA_AVX2)
+		return IMAGE_ERR_PARAM;
+	if (isa > DetectIsa())
+		return IMAGE_ERR_ISA;
+	g_isa.store(isa, std::memory_order_relaxed);
+	return IMAGE_OK;
+}
+
+// Source position of destination sample dst in Q7, with pixel centres
+// aligned; div is 2 for the half resolution chroma planes.
+static void SamplePos(int dst, int dstLen, int srcLen, int div, int planeLen, int* pIndex, int* pFrac)
+{
+	int64_t pos = (int64_t)(2 * dst + 1) * srcLen * BLEND_ONE / ((int64_t)2 * dstLen * div) - BLEND_ONE / 2;
+	int64_t maxPos = (int64_t)(planeLen - 1) * BLEND_ONE;
+	if (pos < 0)
+		pos = 0;
+	if (pos > maxPos)
+		pos = maxPos;
+	*pIndex = (int)(pos >> BLEND_BITS);
+	*pFrac = (int)(pos & (BLEND_ONE - 1));
+}
+
+struct ConvertScratch
+{
+	std::vector<int> xLuma;
+	std::vector<int> xChroma;
+	std::vector<uint8_t> fLuma;
+	std::vector<uint8_t> fChroma;
+	std::vector<uint8_t> rowY, rowU, rowV;		// vertically blended source rows
+	std::vector<uint8_t> lineY, lineU, lineV;	// resampled to the output width
+	std::vector<uint8_t> r, g, b;
+};
+
+static thread_local ConvertScratch t_scratch;
+
+static void BuildColumnMap(int dstLen, int srcLen, int div, int planeLen, std::vector<int>* index, std::vector<uint8_t>* frac)
+{
+	index->resize(dstLen);
+	frac->resize(dstLen);
+	for (int i = 0; i < dstLen; i++) {
+		int f;
+		SamplePos(i, dstLen, srcLen, div, planeLen, &(*index)[i], &f);
+		(*frac)[i] = (uint8_t)f;
+	}
+}
+
+// Blends source rows index and index + 1. Copies of the last pixel past the
+// end let the column pass read index + 1 (and the gather index + 3)
+// unchecked.
+static void BlendSource(const ConvertKernels& k, const uint8_t* plane, int stride, int index, int frac, int width, uint8_t* out)
+{
+	const uint8_t* row = plane + (size_t)index * stride;
+	if (frac == 0)
+		memcpy(out, row, width);
+	else
+		k.blendRow(row, row + stride, out, width, frac);
+	memset(out + width, out[width - 1], ROW_SLACK);
+}
+
+static void FillBorders(uint8_t* dst, int dstW, int dstH, bool bPlanar, int boxX, int boxY, int boxW, int boxH, uint8_t value)
+{
+	int nPlanes = bPlanar ? 3 : 1;
+	size_t pixelBytes = bPlanar ? 1 : 3;
+	size_t rowBytes = dstW * pixelBytes;
+	for (int p = 0; p < nPlanes; p++) {
+		uint8_t* base = dst + (size_t)p * rowBytes * dstH;
+		memset(base, value, rowBytes * boxY);
+		memset(base + rowBytes * (boxY + boxH), value, rowBytes * (dstH - boxY - boxH));
+		for (int y = boxY; y < boxY + boxH; y++) {
+			uint8_t* row = base + rowBytes * y;
+			memset(row, value, boxX * pixelBytes);
+			memset(row + (boxX + boxW) * pixelBytes, value, (dstW - boxX - boxW) * pixelBytes);
+		}
+	}
+}
+
+static bool CheckArgs(const uint8_t* const plane[3], const int stride[3], int srcW, int srcH,
+	const uint8_t* dst, int dstW, int dstH, int format)
+{
+	if (plane == NULL || stride == NULL || dst == NULL || srcW < 1 || srcH < 1 || dstW < 1 || dstH < 1)
+		return false;
+	if (format < IMAGE_RGB || format > IMAGE_BGR_PLANAR)
+		return false;
+	if (plane[0] == NULL || plane[1] == NULL || plane[2] == NULL)
+		return false;
+	return stride[0] >= srcW && stride[1] >= (srcW + 1) / 2 && stride[2] >= (srcW + 1) / 2;
+}
+
+// Converts the picture into the box (boxX, boxY, boxW, boxH) of the
+// destination, one output row at a time.
+static void ConvertToBox(const uint8_t* const plane[3], const int stride[3], int srcW, int srcH,
+	uint8_t* dst, int dstW, int dstH, int format, int boxX, int boxY, int boxW, int boxH)
+{
+	const ConvertKernels& k = g_kernels[ImageConvertIsa()];
+	ConvertScratch& s = t_scratch;
+	int chromaW = (srcW + 1) / 2;
+	int chromaH = (srcH + 1) / 2;
+	bool bPlanar = format == IMAGE_RGB_PLANAR || format == IMAGE_BGR_PLANAR;
+	bool bBgr = format == IMAGE_BGR || format == IMAGE_BGR_PLANAR;
+	size_t planeSize = (size_t)dstW * dstH;
+
+	BuildColumnMap(boxW, srcW, 1, srcW, &s.xLuma, &s.fLuma);
+	BuildColumnMap(boxW, srcW, 2, chromaW, &s.xChroma, &s.fChroma);
+	s.rowY.resize(srcW + ROW_SLACK);
+	s.rowU.resize(chromaW + ROW_SLACK);
+	s.rowV.resize(chromaW + ROW_SLACK);
+	s.lineY.resize(boxW);
+	s.lineU.resize(boxW);
+	s.lineV.resize(boxW);
+	s.r.resize(boxW);
+	s.g.resize(boxW);
+	s.b.resize(boxW);
+
+	for (int dy = 0; dy < boxH; dy++) {
+		int index, frac;
+		SamplePos(dy, boxH, srcH, 1, srcH, &index, &frac);
+		BlendSource(k, plane[0], stride[0], index, frac, srcW, s.rowY.data());
+		SamplePos(dy, boxH, srcH, 2, chromaH, &index, &frac);
+		BlendSource(k, plane[1], stride[1], index, frac, chromaW, s.rowU.data());
+		BlendSource(k, plane[2], stride[2], index, frac, chromaW, s.rowV.data());
+
+		k.resampleRow(s.rowY.data(), s.xLuma.data(), s.fLuma.data(), s.lineY.data(), boxW);
+		k.resampleRow(s.rowU.data(), s.xChroma.data(), s.fChroma.data(), s.lineU.data(), boxW);
+		k.resampleRow(s.rowV.data(), s.xChroma.data(), s.fChroma.data(), s.lineV.data(), boxW);
+
+		if (bPlanar) {
+			// Planar output is written in place, no interleave pass
+			uint8_t* base = dst + (size_t)(boxY + dy) * dstW + boxX;
+			uint8_t* r = base + (bBgr ? 2 : 0) * planeSize;
+			uint8_t* b = base + (bBgr ? 0 : 2) * planeSize;
+			k.yuvToRgbRow(s.lineY.data(), s.lineU.data(), s.lineV.data(), r, base + planeSize, b, boxW);
+		}
+		else {
+			k.yuvToRgbRow(s.lineY.data(), s.lineU.data(), s.lineV.data(), s.r.data(), s.g.data(), s.b.data(), boxW);
+			uint8_t* out = dst + ((size_t)(boxY + dy) * dstW + boxX) * 3;
+			if (bBgr)
+				k.interleaveRow(s.b.data(), s.g.data(), s.r.data(), out, boxW);
+			else
+				k.interleaveRow(s.r.data(), s.g.data(), s.b.data(), out, boxW);
+		}
+	}
+}
+
+int I420ToRgbLetterbox(const uint8_t* const plane[3], const int stride[3], int srcW, int srcH,
+	uint8_t* dst, int dstW, int dstH, int format, uint8_t padValue, ImageLetterbox* pBox)
+{
+	if (!CheckArgs(plane, stride, srcW, srcH, dst, dstW, dstH, format))
+		return IMAGE_ERR_PARAM;
+
+	double scale = (double)dstW / srcW;
+	if ((double)dstH / srcH < scale)
+		scale = (double)dstH / srcH;
+	int boxW = (int)lround(srcW * scale);
+	int boxH = (int)lround(srcH * scale);
+	boxW = boxW < 1 ? 1 : (boxW > dstW ? dstW : boxW);
+	boxH = boxH < 1 ? 1 : (boxH > dstH ? dstH : boxH);
+	int boxX = (dstW - boxW) / 2;
+	int boxY = (dstH - boxH) / 2;
+
+	FillBorders(dst, dstW, dstH, format == IMAGE_RGB_PLANAR || format == IMAGE_BGR_PLANAR, boxX, boxY, boxW, boxH, padValue);
+	ConvertToBox(plane, stride, srcW, srcH, dst, dstW, dstH, format, boxX, boxY, boxW, boxH);
+	if (pBox != NULL) {
+		pBox->x = boxX;
+		pBox->y = boxY;
+		pBox->width = boxW;
+		pBox->height = boxH;
+		pBox->scale = (float)scale;
+	}
+	return IMAGE_OK;
+}
+
+int I420ToRgbResize(const uint8_t* const plane[3], const int stride[3], int srcW, int srcH,
+	uint8_t* dst, int dstW, int dstH, int format)
+{
+	if (!CheckArgs(plane, stride, srcW, srcH, dst, dstW, dstH, format))
+		return IMAGE_ERR_PARAM;
+	ConvertToBox(plane, stride, srcW, srcH, dst, dstW, dstH, format, 0, 0, dstW, dstH);
+	return IMAGE_OK;
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <stdint.h>
+
+// I420 (T_IYUV) to RGB conversion fused with bilinear resize, for detector
+// input. Each output row is produced from two blended source rows and
+// converted right away, so no full size intermediate picture is made.
+// Colour is BT.601 limited range, as the cameras encode it. SSE4.1 and AVX2
+// kernels are picked at run time; every kernel gives the same bytes as the
+// scalar one.
+
+// Output layouts
+#define IMAGE_RGB				0	// interleaved, dstW * 3 bytes per row
+#define IMAGE_BGR				1
+#define IMAGE_RGB_PLANAR		2	// three dstW x dstH planes, R first (CHW)
+#define IMAGE_BGR_PLANAR		3
+
+// Kernel sets
+#define IMAGE_ISA_SCALAR		0
+#define IMAGE_ISA_SSE41			1
+#define IMAGE_ISA_AVX2			2
+
+// Image convert result codes
+#define IMAGE_OK				0
+#define IMAGE_ERR_PARAM			1
+#define IMAGE_ERR_ISA			2	// kernel set not supported by this CPU
+
+#define IMAGE_LETTERBOX_PAD		114	// grey used by the YOLO family
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// Where the picture landed inside the destination; maps detections back:
+// srcX = (dstX - x) / scale.
+typedef struct ImageLetterbox
+{
+	int x;
+	int y;
+	int width;
+	int height;
+	float scale;
+} ImageLetterbox;
+
+// Scales the picture to fit dstW x dstH keeping its aspect ratio, centres it
+// and fills the borders with padValue.
+int I420ToRgbLetterbox(const uint8_t* const plane[3], const int stride[3], int srcW, int srcH,
+	uint8_t* dst, int dstW, int dstH, int format, uint8_t padValue, ImageLetterbox* pBox);
+
+// Stretches the picture to dstW x dstH.
+int I420ToRgbResize(const uint8_t* const plane[3], const int stride[3], int srcW, int srcH,
+	uint8_t* dst, int dstW, int dstH, int format);
+
+// Kernel set in use, and a way to force one (e.g. to compare them).
+int ImageConvertIsa(void);
+int ImageConvertSetIsa(int isa);
+
+#ifdef __cplusplus
+}
+#endif
@@ -1,5 +1,6 @@
 #include "RealPlayDll.h"
 #include "DataFormat.h"
+#include "ImageConvert.h"
 
 dlgParameters enDlgParameters;
 RealPlay rp;
@@ -26,6 +27,11 @@ int _stdcall interface_Logout() {
 	return status;
 }
 
+extern "C" _declspec(dllexport) int _stdcall interface_SetSubStream(int subStream);
+int _stdcall interface_SetSubStream(int subStream) {
+	return rp.SetSubStream(subStream);
+}
+
 extern "C" _declspec(dllexport) void _stdcall interface_OpenRealPlay();
 void _stdcall interface_OpenRealPlay() {
 	rp.PlayVideo();
@@ -44,4 +50,166 @@ int _stdcall interface_StartRecord() {
 extern "C" _declspec(dllexport) int _stdcall interface_StopRecord();
 int _stdcall interface_StopRecord() {
 	return rp.StopRecord();
-}
\ No newline at end of file
+}
+
+extern "C" _declspec(dllexport) int _stdcall interface_StartLivePackage(const char* outDir);
+int _stdcall interface_StartLivePackage(const char* outDir) {
+	return rp.StartLivePackage(outDir);
+}
+
+extern "C" _declspec(dllexport) int _stdcall interface_StartLivePackageEx(const char* outDir, int partMs, int segmentMs, int windowSegments);
+int _stdcall interface_StartLivePackageEx(const char* outDir, int partMs, int segmentMs, int windowSegments) {
+	return rp.StartLivePackageEx(outDir, partMs, segmentMs, windowSegments);
+}
+
+extern "C" _declspec(dllexport) int _stdcall interface_StopLivePackage();
+int _stdcall interface_StopLivePackage() {
+	return rp.StopLivePackage();
+}
+
+extern "C" _declspec(dllexport) int _stdcall interface_LiveGetPlaylist(long long msn, int part, int timeoutMs, char* buf, int bufSize, int* pSize);
+int _stdcall interface_LiveGetPlaylist(long long msn, int part, int timeoutMs, char* buf, int bufSize, int* pSize) {
+	return rp.LiveGetPlaylist(msn, part, timeoutMs, buf, bufSize, pSize);
+}
+
+extern "C" _declspec(dllexport) int _stdcall interface_LiveGetResource(const char* name, int timeoutMs, unsigned char* buf, int bufSize, int* pSize);
+int _stdcall interface_LiveGetResource(const char* name, int timeoutMs, unsigned char* buf, int bufSize, int* pSize) {
+	return rp.LiveGetResource(name, timeoutMs, buf, bufSize, pSize);
+}
+
+extern "C" _declspec(dllexport) int _stdcall interface_SetFrameRingDecode(int mode, int keyStep, int minIntervalMs);
+int _stdcall interface_SetFrameRingDecode(int mode, int keyStep, int minIntervalMs) {
+	return rp.SetFrameRingDecode(mode, keyStep, minIntervalMs);
+}
+
+extern "C" _declspec(dllexport) int _stdcall interface_SetFrameRingMotion(int enable, int threshold, int holdMs);
+int _stdcall interface_SetFrameRingMotion(int enable, int threshold, int holdMs) {
+	return rp.SetFrameRingMotion(enable, threshold, holdMs);
+}
+
+extern "C" _declspec(dllexport) int _stdcall interface_StartFrameRing(const char* name, int slotCount, int maxWidth, int maxHeight);
+int _stdcall interface_StartFrameRing(const char* name, int slotCount, int maxWidth, int maxHeight) {
+	return rp.StartFrameRing(name, slotCount, maxWidth, maxHeight);
+}
+
+extern "C" _declspec(dllexport) int _stdcall interface_StopFrameRing();
+int _stdcall interface_StopFrameRing() {
+	return rp.StopFrameRing();
+}
+
+extern "C" _declspec(dllexport) int _stdcall interface_StartSnapshotCache(int keyOnly, int minIntervalMs, int quality);
+int _stdcall interface_StartSnapshotCache(int keyOnly, int minIntervalMs, int quality) {
+	return rp.StartSnapshotCache(keyOnly, minIntervalMs, quality);
+}
+
+extern "C" _declspec(dllexport) int _stdcall interface_StopSnapshotCache();
+int _stdcall interface_StopSnapshotCache() {
+	return rp.StopSnapshotCache();
+}
+
+extern "C" _declspec(dllexport) int _stdcall interface_GetSnapshot(unsigned char* buf, int bufSize, int* pSize, int maxAgeMs, int* pAgeMs);
+int _stdcall interface_GetSnapshot(unsigned char* buf, int bufSize, int* pSize, int maxAgeMs, int* pAgeMs) {
+	return rp.GetSnapshot(buf, bufSize, pSize, maxAgeMs, pAgeMs);
+}
+
+extern "C" _declspec(dllexport) int _stdcall interface_SetLatencyTrace(int enable);
+int _stdcall interface_SetLatencyTrace(int enable) {
+	return rp.SetLatencyTrace(enable);
+}
+
+extern "C" _declspec(dllexport) int _stdcall interface_GetLatencyReport(char* buf, int size, int fleet);
+int _stdcall interface_GetLatencyReport(char* buf, int size, int fleet) {
+	return rp.GetLatencyReport(buf, size, fleet);
+}
+
+extern "C" _declspec(dllexport) int _stdcall interface_SetDecoderPool(int threadBudget, int sessionThreads);
+int _stdcall interface_SetDecoderPool(int threadBudget, int sessionThreads) {
+	return rp.SetDecoderPool(threadBudget, sessionThreads);
+}
+
+extern "C" _declspec(dllexport) int _stdcall interface_GetDecoderStats(DecoderPortStats* pStats, int maxCount);
+int _stdcall interface_GetDecoderStats(DecoderPortStats* pStats, int maxCount) {
+	return rp.GetDecoderStats(pStats, maxCount);
+}
+
+extern "C" _declspec(dllexport) int _stdcall interface_StartStreamHub(int stream, int packets);
+int _stdcall interface_StartStreamHub(int stream, int packets) {
+	return rp.StartStreamHub(stream, packets);
+}
+
+extern "C" _declspec(dllexport) int _stdcall interface_StopStreamHub(int stream);
+int _stdcall interface_StopStreamHub(int stream) {
+	return rp.StopStreamHub(stream);
+}
+
+extern "C" _declspec(dllexport) int _stdcall interface_HubSubscribe(int stream, int* pId);
+int _stdcall interface_HubSubscribe(int stream, int* pId) {
+	return rp.HubSubscribe(stream, pId);
+}
+
+extern "C" _declspec(dllexport) int _stdcall interface_HubUnsubscribe(int stream, int id);
+int _stdcall interface_HubUnsubscribe(int stream, int id) {
+	return rp.HubUnsubscribe(stream, id);
+}
+
+extern "C" _declspec(dllexport) int _stdcall interface_HubRead(int stream, int id, unsigned char* buf, int bufSize, int* pSize, int* pCount, int timeoutMs);
+int _stdcall interface_HubRead(int stream, int id, unsigned char* buf, int bufSize, int* pSize, int* pCount, int timeoutMs) {
+	return rp.HubRead(stream, id, buf, bufSize, pSize, pCount, timeoutMs);
+}
+
+extern "C" _declspec(dllexport) int _stdcall interface_GetHubStats(int stream, StreamHubStats* pHub, int id, StreamSubscriberStats* pSubscriber);
+int _stdcall interface_GetHubStats(int stream, StreamHubStats* pHub, int id, StreamSubscriberStats* pSubscriber) {
+	return rp.GetHubStats(stream, pHub, id, pSubscriber);
+}
+
+extern "C" _declspec(dllexport) int _stdcall interface_StartRtspServer(const char* address, int port);
+int _stdcall interface_StartRtspServer(const char* address, int port) {
+	return rp.StartRtspServer(address, port);
+}
+
+extern "C" _declspec(dllexport) int _stdcall interface_StopRtspServer();
+int _stdcall interface_StopRtspServer() {
+	return rp.StopRtspServer();
+}
+
+extern "C" _declspec(dllexport) int _stdcall interface_RtspPublish(int stream, const char* name);
+int _stdcall interface_RtspPublish(int stream, const char* name) {
+	return rp.RtspPublish(stream, name);
+}
+
+extern "C" _declspec(dllexport) int _stdcall interface_RtspUnpublish(int stream);
+int _stdcall interface_RtspUnpublish(int stream) {
+	return rp.RtspUnpublish(stream);
+}
+
+extern "C" _declspec(dllexport) int _stdcall interface_GetRtspStats(RtspServerStats* pStats);
+int _stdcall interface_GetRtspStats(RtspServerStats* pStats) {
+	return rp.GetRtspStats(pStats);
+}
+
+// Detector input from a decoded I420 picture (e.g. a frame ring frame)
+extern "C" _declspec(dllexport) int _stdcall interface_I420ToRgbLetterbox(const unsigned char* y, const unsigned char* u, const unsigned char* v, int strideY, int strideUV, int srcW, int srcH, unsigned char* dst, int dstW, int dstH, int format, int padValue, ImageLetterbox* pBox);
+int _stdcall interface_I420ToRgbLetterbox(const unsigned char* y, const unsigned char* u, const unsigned char* v, int strideY, int strideUV, int srcW, int srcH, unsigned char* dst, int dstW, int dstH, int format, int padValue, ImageLetterbox* pBox) {
+	const uint8_t* plane[3] = { y, u, v };
+	int stride[3] = { strideY, strideUV, strideUV };
+	if (padValue < 0 || padValue > 255)
+		return IMAGE_ERR_PARAM;
+	return I420ToRgbLetterbox(plane, stride, srcW, srcH, dst, dstW, dstH, format, (uint8_t)padValue, pBox);
+}
+
+extern "C" _declspec(dllexport) int _stdcall interface_I420ToRgbResize(const unsigned char* y, const unsigned char* u, const unsigned char* v, int strideY, int strideUV, int srcW, int srcH, unsigned char* dst, int dstW, int dstH, int format);
+int _stdcall interface_I420ToRgbResize(const unsigned char* y, const unsigned char* u, const unsigned char* v, int strideY, int strideUV, int srcW, int srcH, unsigned char* dst, int dstW, int dstH, int format) {
+	const uint8_t* plane[3] = { y, u, v };
+	int stride[3] = { strideY, strideUV, strideUV };
+	return I420ToRgbResize(plane, stride, srcW, srcH, dst, dstW, dstH, format);
+}
+
+extern "C" _declspec(dllexport) int _stdcall interface_ImageConvertIsa();
+int _stdcall interface_ImageConvertIsa() {
+	return ImageConvertIsa();
+}
+
+extern "C" _declspec(dllexport) int _stdcall interface_ImageConvertSetIsa(int isa);
+int _stdcall interface_ImageConvertSetIsa(int isa) {
+	return ImageConvertSetIsa(isa);
+}
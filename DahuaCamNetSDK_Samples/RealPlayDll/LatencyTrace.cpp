@@ -0,0 +1,268 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <mutex>
+#include <vector>
+#include "LatencyTrace.h"
+
+#define LATENCY_SUB_COUNT		(1 << LATENCY_SUB_BITS)
+
+static const char* g_stageNames[LATENCY_STAGES] = {
+	"receive", "feed", "decode", "deliver", "package", "total"
+};
+
+const char* LatencyStageName(int stage)
+{
+	return stage >= 0 && stage < LATENCY_STAGES ? g_stageNames[stage] : "?";
+}
+
+static int HighBit(uint64_t v)
+{
+	int n = 0;
+	for (int step = 32; step > 0; step >>= 1) {
+		if (v >> step) {
+			v >>= step;
+			n += step;
+		}
+	}
+	return n;
+}
+
+LatencyHistogram::LatencyHistogram()
+{
+	Reset();
+}
+
+int LatencyHistogram::BucketOf(int64_t us)
+{
+	if (us < 0)
+		us = 0;
+	if (us < 2 * LATENCY_SUB_COUNT)
+		return (int)us;
+	if (us >= (1LL << LATENCY_MAX_BITS))
+		return LATENCY_BUCKETS - 1;
+	int shift = HighBit((uint64_t)us) - LATENCY_SUB_BITS;
+	return ((shift + 1) << LATENCY_SUB_BITS) + (int)(us >> shift) - LATENCY_SUB_COUNT;
+}
+
+int64_t LatencyHistogram::BucketHigh(int bucket)
+{
+	if (bucket < 2 * LATENCY_SUB_COUNT)
+		return bucket;
+	int shift = (bucket >> LATENCY_SUB_BITS) - 1;
+	int64_t sub = LATENCY_SUB_COUNT + (bucket & (LATENCY_SUB_COUNT - 1));
+	return ((sub + 1) << shift) - 1;
+}
+
+void LatencyHistogram::Record(int64_t us)
+{
+	if (us < 0)
+		us = 0;
+	m_counts[BucketOf(us)].fetch_add(1, std::memory_order_relaxed);
+	m_nCount.fetch_add(1, std::memory_order_relaxed);
+	m_sum.fetch_add(us, std::memory_order_relaxed);
+	int64_t max = m_max.load(std::memory_order_relaxed);
+	while (us > max && !m_max.compare_exchange_weak(max, us, std::memory_order_relaxed)) {
+	}
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram& other)
+{
+	for (int i = 0; i < LATENCY_BUCKETS; i++) {
+		uint64_t n = other.m_counts[i].load(std::memory_order_relaxed);
+		if (n != 0)
+			m_counts[i].fetch_add(n, std::memory_order_relaxed);
+	}
+	m_nCount.fetch_add(other.Count(), std::memory_order_relaxed);
+	m_sum.fetch_add(other.m_sum.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	int64_t otherMax = other.Max();
+	int64_t max = m_max.load(std::memory_order_relaxed);
+	while (otherMax > max && !m_max.compare_exchange_weak(max, otherMax, std::memory_order_relaxed)) {
+	}
+}
+
+void LatencyHistogram::Reset()
+{
+	for (int i = 0; i < LATENCY_BUCKETS; i++)
+		m_counts[i].store(0, std::memory_order_relaxed);
+	m_nCount.store(0, std::memory_order_relaxed);
+	m_sum.store(0, std::memory_order_relaxed);
+	m_max.store(0, std::memory_order_relaxed);
+}
+
+double LatencyHistogram::Mean() const
+{
+	uint64_t n = Count();
+	return n > 0 ? (double)m_sum.load(std::memory_order_relaxed) / n : 0.0;
+}
+
+int64_t LatencyHistogram::Percentile(double quantile) const
+{
+	// Bucket counts are summed again rather than trusting m_nCount, which
+	// may be a record ahead of them while writers run
+	uint64_t total = 0;
+	for (int i = 0; i < LATENCY_BUCKETS; i++)
+		total += m_counts[i].load(std::memory_order_relaxed);
+	if (total == 0)
+		return 0;
+	uint64_t rank = (uint64_t)(quantile * total + 0.5);
+	if (rank < 1)
+		rank = 1;
+	if (rank > total)
+		rank = total;
+	uint64_t seen = 0;
+	for (int i = 0; i < LATENCY_BUCKETS; i++) {
+		seen += m_counts[i].load(std::memory_order_relaxed);
+		if (seen >= rank)
+			return std::min(BucketHigh(i), Max());
+	}
+	return Max();
+}
+
+ClockOffsetEstimator::ClockOffsetEstimator(int64_t windowUs)
+	: m_windowUs(windowUs)
+{
+	Reset();
+}
+
+void ClockOffsetEstimator::Reset()
+{
+	m_windowStartUs = 0;
+	m_curMin = INT64_MAX;
+	m_prevMin = INT64_MAX;
+	m_bValid = false;
+}
+
+int64_t ClockOffsetEstimator::Update(int64_t deviceUs, int64_t localUs)
+{
+	int64_t sample = localUs - deviceUs;
+	if (m_bValid) {
+		int64_t diff = sample - OffsetUs();
+		if (diff > LATENCY_CLOCK_JUMP_US || diff < -LATENCY_CLOCK_JUMP_US)
+			Reset();
+	}
+	if (!m_bValid) {
+		m_windowStartUs = localUs;
+		m_curMin = sample;
+		m_bValid = true;
+	}
+	else if (localUs - m_windowStartUs >= m_windowUs) {
+		m_prevMin = m_curMin;
+		m_curMin = sample;
+		m_windowStartUs = localUs;
+	}
+	else if (sample < m_curMin) {
+		m_curMin = sample;
+	}
+	return ToLocal(deviceUs);
+}
+
+// Registry behind FleetReport. Function local so tracers that are globals
+// of other translation units can register during static initialisation.
+struct LatencyRegistry
+{
+	std::mutex lock;
+	std::vector<LatencyTracer*> tracers;
+};
+
+static LatencyRegistry& Registry()
+{
+	static LatencyRegistry registry;
+	return registry;
+}
+
+LatencyTracer::LatencyTracer(const char* name)
+	: m_name(name != NULL ? name : "")
+{
+	LatencyRegistry& registry = Registry();
+	std::lock_guard<std::mutex> guard(registry.lock);
+	registry.tracers.push_back(this);
+}
+
+LatencyTracer::~LatencyTracer()
+{
+	LatencyRegistry& registry = Registry();
+	std::lock_guard<std::mutex> guard(registry.lock);
+	registry.tracers.erase(std::remove(registry.tracers.begin(), registry.tracers.end(), this), registry.tracers.end());
+}
+
+void LatencyTracer::SetName(const char* name)
+{
+	m_name = name != NULL ? name : "";
+}
+
+void LatencyTracer::Record(int stage, int64_t us)
+{
+	if (stage >= 0 && stage < LATENCY_STAGES)
+		m_stages[stage].Record(us);
+}
+
+void LatencyTracer::Reset()
+{
+	for (int i = 0; i < LATENCY_STAGES; i++)
+		m_stages[i].Reset();
+}
+
+int LatencyFormatLine(char* buf, size_t size, int pos, const char* label, const LatencyHistogram& histogram)
+{
+	if (buf == NULL || pos < 0 || (size_t)pos >= size)
+		return pos;
+	int n = snprintf(buf + pos, size - pos, "%-10s %10llu %9.2f %9.2f %9.2f %9.2f %9.2f %9.2f\n", label,
+		(unsigned long long)histogram.Count(), histogram.Mean() / 1000.0,
+		histogram.Percentile(0.5) / 1000.0, histogram.Percentile(0.9) / 1000.0,
+		histogram.Percentile(0.99) / 1000.0, histogram.Percentile(0.999) / 1000.0, histogram.Max() / 1000.0);
+	if (n < 0)
+		return pos;
+	return (size_t)(pos + n) < size ? pos + n : (int)size - 1;
+}
+
+static int FormatHeader(char* buf, size_t size, int pos, const char* name)
+{
+	if (buf == NULL || pos < 0 || (size_t)pos >= size)
+		return pos;
+	int n = snprintf(buf + pos, size - pos, "%s\n%-10s %10s %9s %9s %9s %9s %9s %9s\n", name,
+		"stage", "count", "mean ms", "p50", "p90", "p99", "p99.9", "max");
+	if (n < 0)
+		return pos;
+	return (size_t)(pos + n) < size ? pos + n : (int)size - 1;
+}
+
+int LatencyTracer::Report(char* buf, size_t size) const
+{
+	if (buf == NULL || size == 0)
+		return 0;
+	buf[0] = '\0';
+	int pos = FormatHeader(buf, size, 0, m_name.c_str());
+	for (int i = 0; i < LATENCY_STAGES; i++) {
+		if (m_stages[i].Count() > 0)
+			pos = LatencyFormatLine(buf, size, pos, g_stageNames[i], m_stages[i]);
+	}
+	return pos;
+}
+
+int LatencyTracer::FleetReport(char* buf, size_t size)
+{
+	if (buf == NULL || size == 0)
+		return 0;
+	buf[0] = '\0';
+	// Merged into a scratch histogram per stage; 8 KB each, so off the stack
+	std::vector<LatencyHistogram> merged(LATENCY_STAGES);
+	size_t nTracers;
+	{
+		LatencyRegistry& registry = Registry();
+		std::lock_guard<std::mutex> guard(registry.lock);
+		nTracers = registry.tracers.size();
+		for (LatencyTracer* pTracer : registry.tracers) {
+			for (int i = 0; i < LATENCY_STAGES; i++)
+				merged[i].Merge(pTracer->m_stages[i]);
+		}
+	}
+	char name[64];
+	snprintf(name, sizeof(name), "fleet (%u cameras)", (unsigned)nTracers);
+	int pos = FormatHeader(buf, size, 0, name);
+	for (int i = 0; i < LATENCY_STAGES; i++) {
+		if (merged[i].Count() > 0)
+			pos = LatencyFormatLine(buf, size, pos, g_stageNames[i], merged[i]);
+	}
+	return pos;
+}
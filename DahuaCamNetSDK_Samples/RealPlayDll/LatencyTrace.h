@@ -0,0 +1,113 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <string>
+
+// Latency stages of a live session, all in microseconds on the
+// FrameRingNowUs clock. Capture is the device timestamp of the frame mapped
+// to that clock by ClockOffsetEstimator.
+#define LATENCY_RECEIVE			0	// capture -> SDK data callback
+#define LATENCY_FEED			1	// data callback -> accepted by the decoder input
+#define LATENCY_DECODE			2	// accepted -> decoded picture out of the play SDK
+#define LATENCY_DELIVER			3	// decoded -> every sink done (frame ring published)
+#define LATENCY_PACKAGE			4	// data callback -> live packager done
+#define LATENCY_TOTAL			5	// capture -> every sink done
+#define LATENCY_STAGES			6
+
+// Log-linear buckets as in HdrHistogram: exact below 64 us, then 32 buckets
+// per power of two (3% resolution) up to 2^36 us. Record is lock free and
+// may run on any thread.
+#define LATENCY_SUB_BITS		5
+#define LATENCY_MAX_BITS		36
+#define LATENCY_BUCKETS			((LATENCY_MAX_BITS - LATENCY_SUB_BITS + 1) << LATENCY_SUB_BITS)
+
+class LatencyHistogram
+{
+public:
+	LatencyHistogram();
+
+	void Record(int64_t us);
+	void Merge(const LatencyHistogram& other);
+	void Reset();
+
+	uint64_t Count() const { return m_nCount.load(std::memory_order_relaxed); }
+	int64_t Max() const { return m_max.load(std::memory_order_relaxed); }
+	double Mean() const;
+	// Upper bound of the bucket holding the given quantile (0..1).
+	int64_t Percentile(double quantile) const;
+
+	static int BucketOf(int64_t us);
+	static int64_t BucketHigh(int bucket);
+
+private:
+	std::atomic<uint64_t> m_counts[LATENCY_BUCKETS];
+	std::atomic<uint64_t> m_nCount;
+	std::atomic<int64_t> m_sum;
+	std::atomic<int64_t> m_max;
+};
+
+// Maps a device clock (the stream timestamp) onto the local clock.
+// Transport and buffering only ever add delay, so the smallest
+// local - device difference seen is the best estimate of the offset; it is
+// kept over two rolling windows so clock drift is followed. The fixed part
+// of the delay (encoding, the fastest network path) is inside the offset,
+// so LATENCY_RECEIVE shows the delay above the best frame of the window,
+// not the absolute glass-to-callback time. A jump of the device clock
+// (stream restart, timestamp reset) restarts the estimate.
+#define LATENCY_CLOCK_WINDOW_US		(30 * 1000000LL)
+#define LATENCY_CLOCK_JUMP_US		(5 * 1000000LL)
+
+class ClockOffsetEstimator
+{
+public:
+	explicit ClockOffsetEstimator(int64_t windowUs = LATENCY_CLOCK_WINDOW_US);
+
+	// Device time deviceUs arrived at local time localUs. Returns the device
+	// time on the local clock.
+	int64_t Update(int64_t deviceUs, int64_t localUs);
+	int64_t ToLocal(int64_t deviceUs) const { return deviceUs + OffsetUs(); }
+	int64_t OffsetUs() const { return m_curMin < m_prevMin ? m_curMin : m_prevMin; }
+	bool IsValid() const { return m_bValid; }
+	void Reset();
+
+private:
+	int64_t m_windowUs;
+	int64_t m_windowStartUs;
+	int64_t m_curMin;
+	int64_t m_prevMin;
+	bool m_bValid;
+};
+
+// Per camera latency histograms. Every tracer alive is also part of the
+// fleet view, see FleetReport.
+class LatencyTracer
+{
+public:
+	explicit LatencyTracer(const char* name = "");
+	~LatencyTracer();
+
+	void SetName(const char* name);
+	void Record(int stage, int64_t us);
+	const LatencyHistogram& Stage(int stage) const { return m_stages[stage]; }
+	void Reset();
+
+	// Text table, one line per stage with samples: count, mean, p50, p90,
+	// p99, p99.9 and max in ms. Returns the length written (truncated to
+	// size - 1).
+	int Report(char* buf, size_t size) const;
+	// The same over all tracers merged.
+	static int FleetReport(char* buf, size_t size);
+
+private:
+	LatencyTracer(const LatencyTracer&) = delete;
+	LatencyTracer& operator=(const LatencyTracer&) = delete;
+
+	std::string m_name;
+	LatencyHistogram m_stages[LATENCY_STAGES];
+};
+
+const char* LatencyStageName(int stage);
+
+// Appends one report line for the histogram to buf at pos.
+int LatencyFormatLine(char* buf, size_t size, int pos, const char* label, const LatencyHistogram& histogram);
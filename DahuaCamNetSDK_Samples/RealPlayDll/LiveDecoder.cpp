@@ -0,0 +1,224 @@
+#include <algorithm>
+#include "LiveDecoder.h"
+#include "FrameRing.h"
+#include "DecoderPool.h"
+
+LiveDecoder::LiveDecoder()
+	: m_nPort(0), m_bRunning(false), m_pFeeder(NULL), m_pReader(NULL), m_nKeySeen(0), m_lastKeyMs(0),
+	m_nFed(0), m_nFiltered(0), m_nDropped(0), m_nSeq(0), m_pTracer(NULL), m_inputUs(0), m_nPending(0)
+{
+}
+
+LiveDecoder::~LiveDecoder()
+{
+	Stop();
+}
+
+int LiveDecoder::Start(const LiveDecodeOptions& options, DWORD nBufPoolSize)
+{
+	if (m_bRunning)
+		return LIVE_DECODE_OK;
+	if (!PLAY_GetFreePort(&m_nPort))
+		return LIVE_DECODE_ERR_PORT;
+
+	PLAY_SetStreamOpenMode(m_nPort, STREAME_REALTIME);
+	if (!PLAY_OpenStream(m_nPort, NULL, 0, nBufPoolSize)) {
+		PLAY_ReleasePort(m_nPort);
+		return LIVE_DECODE_ERR_STREAM;
+	}
+	m_pFeeder = new PlayFeeder(m_nPort, nBufPoolSize);
+
+	// Decode only: the callback replaces rendering and is not paced
+	PLAY_SetDecCBStream(m_nPort, 1);
+	PLAY_SetDecodeCallBack(m_nPort, DecodeCallBack, this);
+
+	m_options = options;
+	if (m_options.keyStep < 1)
+		m_options.keyStep = 1;
+	if (m_options.mode == LIVE_DECODE_KEY_ONLY) {
+		// The SDK's own I frame only strategy stands behind the filter
+		PLAY_EnableLargePicAdjustment(m_nPort, PLAY_THROW_FRAME_FLAG_ALL);
+	}
+	m_pReader = new DavFrameReader(OnDavFrame, this);
+	m_nKeySeen = 0;
+	m_nFed = 0;
+	m_nFiltered = 0;
+	m_nDropped = 0;
+	m_nPending = 0;
+	m_clock.Reset();
+
+	DecoderPool::Instance().Attach(m_nPort, 0, 0, m_options.decodeThreads);
+	if (!PLAY_Play(m_nPort, NULL)) {
+		DecoderPool::Instance().Detach(m_nPort);
+		PLAY_CloseStream(m_nPort);
+		PLAY_ReleasePort(m_nPort);
+		delete m_pReader;
+		delete m_pFeeder;
+		m_pReader = NULL;
+		m_pFeeder = NULL;
+		return LIVE_DECODE_ERR_STREAM;
+	}
+	m_bRunning = true;
+	return LIVE_DECODE_OK;
+}
+
+void LiveDecoder::Stop()
+{
+	if (!m_bRunning)
+		return;
+	DecoderPool::Instance().Detach(m_nPort);
+	m_pFeeder->Abort();
+	PLAY_Stop(m_nPort);
+	PLAY_CloseStream(m_nPort);
+	PLAY_ReleasePort(m_nPort);
+	delete m_pReader;
+	delete m_pFeeder;
+	m_pReader = NULL;
+	m_pFeeder = NULL;
+	m_bRunning = false;
+}
+
+void LiveDecoder::Input(const BYTE* p, DWORD n)
+{
+	if (!m_bRunning)
+		return;
+	m_inputUs = FrameRingNowUs();
+	m_pReader->Input(p, n);
+}
+
+void LiveDecoder::OnDavFrame(const DavFrame& frame, void* pUser)
+{
+	LiveDecoder* self = (LiveDecoder*)pUser;
+	bool bFeed = self->m_options.mode != LIVE_DECODE_KEY_ONLY;
+	if (!bFeed && frame.IsKey()) {
+		bool bFirst = self->m_nKeySeen == 0;
+		bool bStep = self->m_nKeySeen % self->m_options.keyStep == 0;
+		bool bSpaced = bFirst || frame.ptsMs - self->m_lastKeyMs >= self->m_options.minIntervalMs
+			|| frame.ptsMs < self->m_lastKeyMs;
+		self->m_nKeySeen++;
+		if (bStep && bSpaced) {
+			self->m_lastKeyMs = frame.ptsMs;
+			bFeed = true;
+		}
+	}
+	if (!bFeed) {
+		self->m_nFiltered++;
+		return;
+	}
+
+	// Video frame times are always kept for the decode time the pool
+	// balances on; the device clock mapping only matters when traced
+	bool bVideo = frame.IsVideo();
+	uint64_t nPending = 0;
+	int64_t receiveUs = self->m_inputUs;
+	if (bVideo) {
+		// Registered before the input: the decode thread may be done with
+		// the frame before PLAY_InputData returns
+		PendingTimes times;
+		times.stampMs = frame.stampMs;
+		times.receiveUs = receiveUs;
+		times.captureUs = 0;
+		times.enqueueUs = 0;
+		if (self->m_pTracer != NULL) {
+			times.captureUs = self->m_clock.Update(frame.ptsMs * 1000, receiveUs);
+			self->m_pTracer->Record(LATENCY_RECEIVE, receiveUs - times.captureUs);
+		}
+		std::lock_guard<std::mutex> guard(self->m_pendingLock);
+		nPending = self->m_nPending++;
+		self->m_pending[nPending % PENDING_COUNT] = times;
+	}
+	bool bAccepted = self->m_pFeeder->Input(frame.data, frame.length, LIVE_FEED_TIMEOUT_MS);
+	self->m_nFed++;
+	if (!bVideo)
+		return;
+	if (!bAccepted) {
+		self->m_nDropped++;
+		DecoderPool::Instance().OnDropped(self->m_nPort);
+		return;
+	}
+	int64_t enqueueUs = FrameRingNowUs();
+	if (self->m_pTracer != NULL)
+		self->m_pTracer->Record(LATENCY_FEED, enqueueUs - receiveUs);
+	std::lock_guard<std::mutex> guard(self->m_pendingLock);
+	if (self->m_nPending - nPending <= PENDING_COUNT)
+		self->m_pending[nPending % PENDING_COUNT].enqueueUs = enqueueUs;
+}
+
+void LiveDecoder::AddSink(FrameSink* pSink)
+{
+	std::lock_guard<std::mutex> guard(m_sinkLock);
+	if (std::find(m_sinks.begin(), m_sinks.end(), pSink) == m_sinks.end())
+		m_sinks.push_back(pSink);
+}
+
+void LiveDecoder::RemoveSink(FrameSink* pSink)
+{
+	std::lock_guard<std::mutex> guard(m_sinkLock);
+	m_sinks.erase(std::remove(m_sinks.begin(), m_sinks.end(), pSink), m_sinks.end());
+}
+
+FeederStats LiveDecoder::GetFeederStats() const
+{
+	return m_pFeeder != NULL ? m_pFeeder->GetStats() : FeederStats();
+}
+
+void CALLBACK LiveDecoder::DecodeCallBack(LONG nPort, FRAME_DECODE_INFO* pFrameDecodeInfo, FRAME_INFO_EX* pFrameInfo, void* pUserData)
+{
+	LiveDecoder* self = (LiveDecoder*)pUserData;
+	if (pFrameDecodeInfo == NULL || pFrameDecodeInfo->nType != T_IYUV || pFrameDecodeInfo->pVideoData[0] == NULL)
+		return;
+	if (pFrameDecodeInfo->nWidth[0] <= 0 || pFrameDecodeInfo->nHeight[0] <= 0)
+		return;
+
+	DecodedFrame frame;
+	for (int i = 0; i < 3; i++) {
+		frame.plane[i] = (const uint8_t*)pFrameDecodeInfo->pVideoData[i];
+		frame.stride[i] = pFrameDecodeInfo->nStride[i];
+	}
+	frame.width = pFrameDecodeInfo->nWidth[0];
+	frame.height = pFrameDecodeInfo->nHeight[0];
+	frame.ptsMs = pFrameInfo != NULL ? pFrameInfo->nStamp : pFrameDecodeInfo->nTimeStamp;
+	frame.seq = ++self->m_nSeq;
+	frame.wallUs = FrameRingNowUs();
+	if (pFrameInfo != NULL)
+		frame.bKey = pFrameInfo->nFrameSubType == FRAME_SUB_TYPE_VIDEO_I_FRAME
+			|| pFrameInfo->nFrameSubType == FRAME_SUB_TYPE_VIDEO_SMART_I_FRAME;
+	else
+		frame.bKey = self->m_options.mode == LIVE_DECODE_KEY_ONLY;
+	frame.captureUs = 0;
+	frame.receiveUs = 0;
+	frame.enqueueUs = 0;
+
+	{
+		uint16_t stampMs = (uint16_t)frame.ptsMs;
+		std::lock_guard<std::mutex> guard(self->m_pendingLock);
+		uint64_t nSearch = std::min<uint64_t>(self->m_nPending, PENDING_COUNT);
+		for (uint64_t i = 1; i <= nSearch; i++) {
+			const PendingTimes& times = self->m_pending[(self->m_nPending - i) % PENDING_COUNT];
+			if (times.stampMs == stampMs) {
+				frame.captureUs = times.captureUs;
+				frame.receiveUs = times.receiveUs;
+				frame.enqueueUs = times.enqueueUs;
+				break;
+			}
+		}
+	}
+	LatencyTracer* pTracer = self->m_pTracer;
+	int64_t decodeUs = frame.enqueueUs != 0 ? frame.wallUs - frame.enqueueUs : -1;
+	DecoderPool::Instance().OnDecoded(nPort, frame.width, frame.height, decodeUs);
+	if (pTracer != NULL && decodeUs >= 0)
+		pTracer->Record(LATENCY_DECODE, decodeUs);
+
+	{
+		std::lock_guard<std::mutex> guard(self->m_sinkLock);
+		for (FrameSink* pSink : self->m_sinks)
+			pSink->OnFrame(frame);
+	}
+
+	if (pTracer != NULL) {
+		int64_t doneUs = FrameRingNowUs();
+		pTracer->Record(LATENCY_DELIVER, doneUs - frame.wallUs);
+		if (frame.captureUs != 0)
+			pTracer->Record(LATENCY_TOTAL, doneUs - frame.captureUs);
+	}
+}
@@ -0,0 +1,134 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include "DavFrame.h"
+#include "PlayFeeder.h"
+#include "LatencyTrace.h"
+
+#pragma comment(lib , "play.lib")
+
+// Live decoder result codes
+#define LIVE_DECODE_OK			0
+#define LIVE_DECODE_ERR_PORT	1	// no free play port
+#define LIVE_DECODE_ERR_STREAM	2	// PLAY_OpenStream / PLAY_Play failed
+
+// Decode modes
+#define LIVE_DECODE_ALL			0	// every frame
+#define LIVE_DECODE_KEY_ONLY	1	// I frames only; P frames never reach the decoder
+
+#define LIVE_DECODE_POOL		(SOURCE_BUF_MIN * 2)
+#define LIVE_FEED_TIMEOUT_MS	20	// longest the network thread waits for the decoder
+
+// A decoded I420 picture. The planes belong to the decoder and are only
+// valid inside FrameSink::OnFrame.
+struct DecodedFrame
+{
+	const uint8_t* plane[3];
+	int stride[3];
+	int width;
+	int height;
+	int64_t ptsMs;		// stream timestamp
+	uint64_t seq;		// decoder output counter, from 1
+	int64_t wallUs;		// decode time, FrameRingNowUs clock
+	bool bKey;			// decoded from an I frame
+	// FrameRingNowUs clock, 0 when unknown
+	int64_t captureUs;	// device timestamp mapped to the local clock, latency tracing only
+	int64_t receiveUs;	// SDK data callback
+	int64_t enqueueUs;	// accepted by the decoder input
+};
+
+struct LiveDecodeOptions
+{
+	int mode = LIVE_DECODE_ALL;
+	int keyStep = 1;			// key only: decode every keyStep-th I frame
+	int minIntervalMs = 0;		// key only: skip I frames closer than this (stream time)
+	int decodeThreads = 0;		// PLAY_SetDecodeThreadNum; 0 leaves it to DecoderPool
+};
+
+// Receives every decoded picture on the decode thread. Keep the work short
+// or hand it off; a slow sink holds up decoding of the live stream.
+class FrameSink
+{
+public:
+	virtual ~FrameSink() {}
+	virtual void OnFrame(const DecodedFrame& frame) = 0;
+};
+
+// Decodes the raw DAV stream of a live session with a play port in realtime
+// mode and hands the pictures to the registered sinks. Input comes from the
+// NetSDK data callback and never blocks it for more than
+// LIVE_FEED_TIMEOUT_MS; data the decoder has no room for is dropped.
+//
+// The stream is split into DAV frames here and pushed frame by frame, so
+// each video frame's input time is known when its picture comes out; that
+// decode time, the decoded size and the frames dropped for lack of room are
+// reported to DecoderPool, which sets the port's decode thread count.
+//
+// Analytics sessions that need a picture or two per second use
+// LIVE_DECODE_KEY_ONLY: only the selected I frames are pushed, so the
+// decoder neither demuxes nor decodes the P frames in between. I frames
+// decode on their own, which is why "every Nth frame" is offered in whole
+// GOPs (keyStep, minIntervalMs).
+class LiveDecoder
+{
+public:
+	LiveDecoder();
+	~LiveDecoder();
+
+	int Start(const LiveDecodeOptions& options = LiveDecodeOptions(), DWORD nBufPoolSize = LIVE_DECODE_POOL);
+	void Stop();
+
+	// Raw DAV bytes as delivered by CLIENT_SetRealDataCallBackEx2.
+	void Input(const BYTE* p, DWORD n);
+
+	void AddSink(FrameSink* pSink);
+	void RemoveSink(FrameSink* pSink);
+
+	// Before Start. Each frame's times follow it through the decoder into
+	// DecodedFrame and the tracer's histograms.
+	void SetTracer(LatencyTracer* pTracer) { m_pTracer = pTracer; }
+
+	uint64_t DecodedFrames() const { return m_nSeq.load(); }
+	uint64_t FramesFed() const { return m_nFed; }			// DAV frames pushed
+	uint64_t FramesFiltered() const { return m_nFiltered; }	// key only: DAV frames left out
+	uint64_t FramesDropped() const { return m_nDropped; }	// video frames the decoder had no room for
+	FeederStats GetFeederStats() const;
+
+private:
+	// Times of a frame between input and decode output, matched on the low
+	// 16 bits of the stream stamp
+	struct PendingTimes
+	{
+		uint16_t stampMs;
+		int64_t captureUs;
+		int64_t receiveUs;
+		int64_t enqueueUs;
+	};
+	enum { PENDING_COUNT = 64 };
+
+	static void OnDavFrame(const DavFrame& frame, void* pUser);
+	static void CALLBACK DecodeCallBack(LONG nPort, FRAME_DECODE_INFO* pFrameDecodeInfo, FRAME_INFO_EX* pFrameInfo, void* pUserData);
+
+	LONG m_nPort;
+	bool m_bRunning;
+	PlayFeeder* m_pFeeder;
+	LiveDecodeOptions m_options;
+	DavFrameReader* m_pReader;
+	uint64_t m_nKeySeen;
+	int64_t m_lastKeyMs;
+	uint64_t m_nFed;
+	uint64_t m_nFiltered;
+	uint64_t m_nDropped;
+	std::mutex m_sinkLock;
+	std::vector<FrameSink*> m_sinks;
+	std::atomic<uint64_t> m_nSeq;
+
+	LatencyTracer* m_pTracer;
+	ClockOffsetEstimator m_clock;
+	int64_t m_inputUs;				// entry of the Input call being split
+	std::mutex m_pendingLock;
+	PendingTimes m_pending[PENDING_COUNT];
+	uint64_t m_nPending;
+};
@@ -0,0 +1,385 @@
+#include <string.h>
+#include <algorithm>
+#include "MotionDetector.h"
+#include "ImageConvert.h"
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define MOTION_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#define TARGET_SSE41
+#define TARGET_AVX2
+#else
+#define TARGET_SSE41			__attribute__((target("sse4.1")))
+#define TARGET_AVX2				__attribute__((target("avx2")))
+#endif
+#endif
+
+// Background is kept in Q7 so that cur << 7 and the update step fit 16 bits
+#define BG_BITS					7
+
+typedef void (*SumBlocksFunc)(const uint8_t* row, int nBlocks, uint32_t* sums);
+typedef int (*UpdateCellsFunc)(const uint8_t* cur, int16_t* bg, const uint8_t* roi, uint8_t* motion, int n,
+	int threshold, int learnShift, int movingShift);
+
+struct MotionKernels
+{
+	SumBlocksFunc sumBlocks;
+	UpdateCellsFunc updateCells;
+};
+
+static inline int BitCount(unsigned int v)
+{
+	v = v - ((v >> 1) & 0x55555555);
+	v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
+	return (int)((((v + (v >> 4)) & 0x0F0F0F0F) * 0x01010101) >> 24);
+}
+
+// Adds the sum of every 8 pixel block of the row to sums
+static void SumBlocksScalar(const uint8_t* row, int nBlocks, uint32_t* sums)
+{
+	for (int i = 0; i < nBlocks; i++) {
+		const uint8_t* p = row + i * 8;
+		sums[i] += p[0] + p[1] + p[2] + p[3] + p[4] + p[5] + p[6] + p[7];
+	}
+}
+
+// Marks the ROI cells that differ from the background by more than the
+// threshold, moves the background towards the frame and returns the
+// number of marked cells.
+static int UpdateCellsScalar(const uint8_t* cur, int16_t* bg, const uint8_t* roi, uint8_t* motion, int n,
+	int threshold, int learnShift, int movingShift)
+{
+	int nActive = 0;
+	for (int i = 0; i < n; i++) {
+		int diff = cur[i] - ((bg[i] + (1 << (BG_BITS - 1))) >> BG_BITS);
+		if (diff < 0)
+			diff = -diff;
+		bool bActive = diff > threshold && roi[i] != 0;
+		motion[i] = bActive ? 0xFF : 0;
+		nActive += bActive ? 1 : 0;
+		int delta = (cur[i] << BG_BITS) - bg[i];
+		bg[i] = (int16_t)(bg[i] + (delta >> (bActive ? movingShift : learnShift)));
+	}
+	return nActive;
+}
+
+#ifdef MOTION_X86
+static TARGET_SSE41 void SumBlocksSse41(const uint8_t* row, int nBlocks, uint32_t* sums)
+{
+	const __m128i zero = _mm_setzero_si128();
+	int i = 0;
+	for (; i + 2 <= nBlocks; i += 2) {
+		// psadbw against zero sums each 8 byte half into a 64 bit lane
+		__m128i s = _mm_sad_epu8(_mm_loadu_si128((const __m128i*)(row + i * 8)), zero);
+		s = _mm_shuffle_epi32(s, _MM_SHUFFLE(3, 3, 2, 0));
+		__m128i acc = _mm_loadl_epi64((const __m128i*)(sums + i));
+		_mm_storel_epi64((__m128i*)(sums + i), _mm_add_epi32(acc, s));
+	}
+	SumBlocksScalar(row + i * 8, nBlocks - i, sums + i);
+}
+
+static TARGET_SSE41 int UpdateCellsSse41(const uint8_t* cur, int16_t* bg, const uint8_t* roi, uint8_t* motion, int n,
+	int threshold, int learnShift, int movingShift)
+{
+	const __m128i thr = _mm_set1_epi16((short)threshold);
+	const __m128i round = _mm_set1_epi16(1 << (BG_BITS - 1));
+	const __m128i learn = _mm_cvtsi32_si128(learnShift);
+	const __m128i moving = _mm_cvtsi32_si128(movingShift);
+	int nActive = 0;
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m128i c = _mm_cvtepu8_epi16(_mm_loadl_epi64((const __m128i*)(cur + i)));
+		__m128i b = _mm_loadu_si128((const __m128i*)(bg + i));
+		__m128i diff = _mm_abs_epi16(_mm_sub_epi16(c, _mm_srai_epi16(_mm_add_epi16(b, round), BG_BITS)));
+		__m128i r = _mm_cvtepi8_epi16(_mm_loadl_epi64((const __m128i*)(roi + i)));
+		__m128i active = _mm_and_si128(_mm_cmpgt_epi16(diff, thr), r);
+		__m128i delta = _mm_sub_epi16(_mm_slli_epi16(c, BG_BITS), b);
+		__m128i step = _mm_blendv_epi8(_mm_sra_epi16(delta, learn), _mm_sra_epi16(delta, moving), active);
+		_mm_storeu_si128((__m128i*)(bg + i), _mm_add_epi16(b, step));
+		__m128i m8 = _mm_packs_epi16(active, active);
+		_mm_storel_epi64((__m128i*)(motion + i), m8);
+		nActive += BitCount(_mm_movemask_epi8(m8) & 0xFF);
+	}
+	return nActive + UpdateCellsScalar(cur + i, bg + i, roi + i, motion + i, n - i, threshold, learnShift, movingShift);
+}
+
+static TARGET_AVX2 void SumBlocksAvx2(const uint8_t* row, int nBlocks, uint32_t* sums)
+{
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i lowDwords = _mm256_setr_epi32(0, 2, 4, 6, 0, 0, 0, 0);
+	int i = 0;
+	for (; i + 4 <= nBlocks; i += 4) {
+		__m256i s = _mm256_sad_epu8(_mm256_loadu_si256((const __m256i*)(row + i * 8)), zero);
+		__m128i packed = _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(s, lowDwords));
+		__m128i acc = _mm_loadu_si128((const __m128i*)(sums + i));
+		_mm_storeu_si128((__m128i*)(sums + i), _mm_add_epi32(acc, packed));
+	}
+	SumBlocksSse41(row + i * 8, nBlocks - i, sums + i);
+}
+
+static TARGET_AVX2 int UpdateCellsAvx2(const uint8_t* cur, int16_t* bg, const uint8_t* roi, uint8_t* motion, int n,
+	int threshold, int learnShift, int movingShift)
+{
+	const __m256i thr = _mm256_set1_epi16((short)threshold);
+	const __m256i round = _mm256_set1_epi16(1 << (BG_BITS - 1));
+	const __m128i learn = _mm_cvtsi32_si128(learnShift);
+	const __m128i moving = _mm_cvtsi32_si128(movingShift);
+	int nActive = 0;
+	int i = 0;
+	for (; i + 16 <= n; i += 16) {
+		__m256i c = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(cur + i)));
+		__m256i b = _mm256_loadu_si256((const __m256i*)(bg + i));
+		__m256i diff = _mm256_abs_epi16(_mm256_sub_epi16(c, _mm256_srai_epi16(_mm256_add_epi16(b, round), BG_BITS)));
+		__m256i r = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)(roi + i)));
+		__m256i active = _mm256_and_si256(_mm256_cmpgt_epi16(diff, thr), r);
+		__m256i delta = _mm256_sub_epi16(_mm256_slli_epi16(c, BG_BITS), b);
+		__m256i step = _mm256_blendv_epi8(_mm256_sra_epi16(delta, learn), _mm256_sra_epi16(delta, moving), active);
+		_mm256_storeu_si256((__m256i*)(bg + i), _mm256_add_epi16(b, step));
+		__m128i m8 = _mm256_castsi256_si128(_mm256_permute4x64_epi64(_mm256_packs_epi16(active, active), 0xD8));
+		_mm_storeu_si128((__m128i*)(motion + i), m8);
+		nActive += BitCount((unsigned int)_mm_movemask_epi8(m8));
+	}
+	return nActive + UpdateCellsSse41(cur + i, bg + i, roi + i, motion + i, n - i, threshold, learnShift, movingShift);
+}
+#endif
+
+static const MotionKernels g_motionKernels[3] = {
+	{ SumBlocksScalar, UpdateCellsScalar },
+#ifdef MOTION_X86
+	{ SumBlocksSse41, UpdateCellsSse41 },
+	{ SumBlocksAvx2, UpdateCellsAvx2 },
+#else
+	{ SumBlocksScalar, UpdateCellsScalar },
+	{ SumBlocksScalar, UpdateCellsScalar },
+#endif
+};
+
+MotionDetector::MotionDetector(const MotionOptions& options)
+	: m_options(options), m_roiMaskW(0), m_roiMaskH(0), m_bRoiDirty(true),
+	m_width(0), m_height(0), m_gridW(0), m_gridH(0), m_nRoiCells(0)
+{
+	m_options.cellSize = (m_options.cellSize + 7) / 8 * 8;
+	if (m_options.cellSize < 8)
+		m_options.cellSize = 8;
+}
+
+void MotionDetector::AddRoiRect(float x, float y, float width, float height)
+{
+	RoiRect rect = { x, y, width, height };
+	m_roiRects.push_back(rect);
+	m_bRoiDirty = true;
+}
+
+void MotionDetector::SetRoiMask(const uint8_t* mask, int width, int height)
+{
+	if (mask == NULL || width <= 0 || height <= 0) {
+		m_roiMask.clear();
+		m_roiMaskW = m_roiMaskH = 0;
+	}
+	else {
+		m_roiMask.assign(mask, mask + (size_t)width * height);
+		m_roiMaskW = width;
+		m_roiMaskH = height;
+	}
+	m_bRoiDirty = true;
+}
+
+void MotionDetector::ClearRoi()
+{
+	m_roiRects.clear();
+	m_roiMask.clear();
+	m_roiMaskW = m_roiMaskH = 0;
+	m_bRoiDirty = true;
+}
+
+void MotionDetector::Reset()
+{
+	m_width = m_height = 0;
+}
+
+void MotionDetector::Init(int width, int height)
+{
+	m_width = width;
+	m_height = height;
+	m_gridW = width / m_options.cellSize;
+	m_gridH = height / m_options.cellSize;
+	size_t nCells = (size_t)m_gridW * m_gridH;
+	m_sums.resize((size_t)m_gridW * (m_options.cellSize / 8));
+	m_cells.resize(nCells);
+	m_background.resize(nCells);
+	m_motion.resize(nCells);
+	m_bRoiDirty = true;
+}
+
+void MotionDetector::BuildRoi()
+{
+	m_roi.assign((size_t)m_gridW * m_gridH, 0);
+	bool bAll = m_roiRects.empty() && m_roiMask.empty();
+	m_nRoiCells = 0;
+	for (int gy = 0; gy < m_gridH; gy++) {
+		float cy = (gy + 0.5f) / m_gridH;
+		for (int gx = 0; gx < m_gridW; gx++) {
+			float cx = (gx + 0.5f) / m_gridW;
+			bool bIn = bAll;
+			for (size_t i = 0; i < m_roiRects.size() && !bIn; i++) {
+				const RoiRect& r = m_roiRects[i];
+				bIn = cx >= r.x && cx < r.x + r.width && cy >= r.y && cy < r.y + r.height;
+			}
+			if (!bIn && !m_roiMask.empty())
+				bIn = m_roiMask[(size_t)(cy * m_roiMaskH) * m_roiMaskW + (size_t)(cx * m_roiMaskW)] != 0;
+			if (bIn) {
+				m_roi[(size_t)gy * m_gridW + gx] = 0xFF;
+				m_nRoiCells++;
+			}
+		}
+	}
+	m_bRoiDirty = false;
+}
+
+// 8-connected groups of active cells. Visited cells are turned from 0xFF to
+// 1 so the motion grid doubles as the visited map.
+void MotionDetector::FindBoxes(MotionResult* pResult)
+{
+	int cell = m_options.cellSize;
+	for (int start = 0; start < m_gridW * m_gridH; start++) {
+		if (m_motion[start] != 0xFF)
+			continue;
+		int x0 = m_gridW, y0 = m_gridH, x1 = -1, y1 = -1, nCells = 0;
+		m_stack.clear();
+		m_stack.push_back(start);
+		m_motion[start] = 1;
+		while (!m_stack.empty()) {
+			int c = m_stack.back();
+			m_stack.pop_back();
+			int cx = c % m_gridW;
+			int cy = c / m_gridW;
+			x0 = std::min(x0, cx);
+			x1 = std::max(x1, cx);
+			y0 = std::min(y0, cy);
+			y1 = std::max(y1, cy);
+			nCells++;
+			for (int dy = -1; dy <= 1; dy++) {
+				for (int dx = -1; dx <= 1; dx++) {
+					int nx = cx + dx;
+					int ny = cy + dy;
+					if (nx < 0 || ny < 0 || nx >= m_gridW || ny >= m_gridH)
+						continue;
+					int n = ny * m_gridW + nx;
+					if (m_motion[n] == 0xFF) {
+						m_motion[n] = 1;
+						m_stack.push_back(n);
+					}
+				}
+			}
+		}
+		if (nCells < m_options.minBoxCells)
+			continue;
+		MotionBox box;
+		box.x = x0 * cell;
+		box.y = y0 * cell;
+		box.width = (x1 - x0 + 1) * cell;
+		box.height = (y1 - y0 + 1) * cell;
+		box.cells = nCells;
+		pResult->boxes.push_back(box);
+	}
+	std::sort(pResult->boxes.begin(), pResult->boxes.end(),
+		[](const MotionBox& a, const MotionBox& b) { return a.cells > b.cells; });
+}
+
+bool MotionDetector::Process(const DecodedFrame& frame, MotionResult* pResult)
+{
+	pResult->seq = frame.seq;
+	pResult->ptsMs = frame.ptsMs;
+	pResult->score = 0;
+	pResult->bMotion = false;
+	pResult->bReset = false;
+	pResult->boxes.clear();
+
+	int cell = m_options.cellSize;
+	if (frame.width < cell || frame.height < cell)
+		return false;
+	bool bLearn = false;
+	if (frame.width != m_width || frame.height != m_height) {
+		Init(frame.width, frame.height);
+		bLearn = true;
+	}
+	if (m_bRoiDirty)
+		BuildRoi();
+
+	// Block averages: each grid row is the sum of cellSize picture rows
+	const MotionKernels& k = g_motionKernels[ImageConvertIsa()];
+	int blocksPerCell = cell / 8;
+	int nBlocks = m_gridW * blocksPerCell;
+	uint32_t area = (uint32_t)(cell * cell);
+	for (int gy = 0; gy < m_gridH; gy++) {
+		std::fill(m_sums.begin(), m_sums.end(), 0);
+		const uint8_t* row = frame.plane[0] + (size_t)gy * cell * frame.stride[0];
+		for (int r = 0; r < cell; r++, row += frame.stride[0])
+			k.sumBlocks(row, nBlocks, m_sums.data());
+		uint8_t* out = m_cells.data() + (size_t)gy * m_gridW;
+		for (int gx = 0; gx < m_gridW; gx++) {
+			uint32_t sum = 0;
+			for (int b = 0; b < blocksPerCell; b++)
+				sum += m_sums[gx * blocksPerCell + b];
+			out[gx] = (uint8_t)((sum + area / 2) / area);
+		}
+	}
+
+	int nCells = m_gridW * m_gridH;
+	if (!bLearn) {
+		int nActive = k.updateCells(m_cells.data(), m_background.data(), m_roi.data(), m_motion.data(), nCells,
+			m_options.threshold, m_options.learnShift, m_options.movingLearnShift);
+		pResult->score = m_nRoiCells > 0 ? (float)nActive / m_nRoiCells : 0;
+		// Most of the picture changing at once is light (IR switch, clouds,
+		// auto exposure), not something moving
+		if (pResult->score > m_options.resetScore)
+			bLearn = true;
+	}
+	if (bLearn) {
+		for (int i = 0; i < nCells; i++)
+			m_background[i] = (int16_t)(m_cells[i] << BG_BITS);
+		pResult->bReset = true;
+		pResult->score = 0;
+		return false;
+	}
+
+	FindBoxes(pResult);
+	pResult->bMotion = pResult->score >= m_options.minScore && !pResult->boxes.empty();
+	return pResult->bMotion;
+}
+
+MotionGate::MotionGate(MotionDetector* pDetector, FrameSink* pNext, int holdMs)
+	: m_pDetector(pDetector), m_pNext(pNext), m_holdMs(holdMs), m_cb(NULL), m_pUser(NULL),
+	m_bActive(false), m_lastMotionMs(0), m_nPassed(0), m_nBlocked(0)
+{
+}
+
+void MotionGate::SetCallBack(MotionCallBack cb, void* pUser)
+{
+	m_cb = cb;
+	m_pUser = pUser;
+}
+
+void MotionGate::OnFrame(const DecodedFrame& frame)
+{
+	bool bMotion = m_pDetector->Process(frame, &m_result);
+	if (m_cb != NULL)
+		m_cb(m_result, m_pUser);
+
+	if (bMotion) {
+		m_bActive = true;
+		m_lastMotionMs = frame.ptsMs;
+	}
+	else if (m_bActive && (frame.ptsMs - m_lastMotionMs > m_holdMs || frame.ptsMs < m_lastMotionMs)) {
+		m_bActive = false;
+	}
+
+	if (m_bActive) {
+		m_nPassed++;
+		m_pNext->OnFrame(frame);
+	}
+	else {
+		m_nBlocked++;
+	}
+}
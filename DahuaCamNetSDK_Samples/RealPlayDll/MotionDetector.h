@@ -0,0 +1,116 @@
+#pragma once
+#include <stdint.h>
+#include <vector>
+#include "LiveDecoder.h"
+
+// Motion detection on the luma plane, used to keep frames without activity
+// away from inference. The Y plane is averaged down to a grid of
+// cellSize x cellSize blocks, every cell is compared with an adaptive
+// background, and the cells that differ (inside the ROI) are grouped into
+// boxes. The per pixel work (block sums) and the per cell work run on
+// SSE4.1 / AVX2 kernels when the CPU has them, see ImageConvertIsa.
+
+struct MotionOptions
+{
+	int cellSize = 8;				// block edge in pixels, a multiple of 8
+	int threshold = 18;				// luma difference that makes a cell active
+	int learnShift = 5;				// background follows still cells by 1 / 2^learnShift per frame
+	int movingLearnShift = 8;		// and active cells much slower, so objects are not absorbed
+	int minBoxCells = 2;			// smaller groups of active cells are noise
+	float minScore = 0.002f;		// active share of the ROI needed to report motion
+	float resetScore = 0.7f;		// above this it is a lighting change: relearn, no motion
+};
+
+struct MotionBox
+{
+	int x;							// source pixels
+	int y;
+	int width;
+	int height;
+	int cells;						// active cells in the group
+};
+
+struct MotionResult
+{
+	uint64_t seq;
+	int64_t ptsMs;
+	float score;					// active cells / ROI cells
+	bool bMotion;
+	bool bReset;					// background was (re)learnt from this frame
+	std::vector<MotionBox> boxes;	// largest first
+};
+
+class MotionDetector
+{
+public:
+	explicit MotionDetector(const MotionOptions& options = MotionOptions());
+
+	// ROI is the union of the rectangles and the mask; with neither set the
+	// whole picture is watched. Rectangles are in 0..1 picture coordinates,
+	// the mask is any size (nonzero = watched) and is sampled at cell
+	// centres. Changes apply from the next frame.
+	void AddRoiRect(float x, float y, float width, float height);
+	void SetRoiMask(const uint8_t* mask, int width, int height);
+	void ClearRoi();
+
+	// Returns pResult->bMotion. The first frame, and any frame with a new
+	// size, only learns the background.
+	bool Process(const DecodedFrame& frame, MotionResult* pResult);
+
+	void Reset();
+
+private:
+	struct RoiRect { float x, y, width, height; };
+
+	void Init(int width, int height);
+	void BuildRoi();
+	void FindBoxes(MotionResult* pResult);
+
+	MotionOptions m_options;
+	std::vector<RoiRect> m_roiRects;
+	std::vector<uint8_t> m_roiMask;
+	int m_roiMaskW;
+	int m_roiMaskH;
+	bool m_bRoiDirty;
+
+	int m_width;					// picture the state was built for
+	int m_height;
+	int m_gridW;
+	int m_gridH;
+	int m_nRoiCells;
+	std::vector<uint32_t> m_sums;	// 8 pixel block sums of the current grid row
+	std::vector<uint8_t> m_cells;	// current frame, averaged
+	std::vector<int16_t> m_background;	// Q7
+	std::vector<uint8_t> m_roi;		// 0 or 0xFF per cell
+	std::vector<uint8_t> m_motion;	// 0 or 0xFF per cell
+	std::vector<int> m_stack;
+};
+
+// FrameSink in front of another sink that only lets frames with motion
+// through, plus holdMs of stream time after the motion stops so trackers
+// see objects leave. Every result is also reported to the callback.
+class MotionGate : public FrameSink
+{
+public:
+	typedef void (*MotionCallBack)(const MotionResult& result, void* pUser);
+
+	MotionGate(MotionDetector* pDetector, FrameSink* pNext, int holdMs = 1000);
+
+	void SetCallBack(MotionCallBack cb, void* pUser);
+	virtual void OnFrame(const DecodedFrame& frame);
+
+	uint64_t Passed() const { return m_nPassed; }
+	uint64_t Blocked() const { return m_nBlocked; }
+
+private:
+	MotionDetector* m_pDetector;
+	FrameSink* m_pNext;
+	int m_holdMs;
+	MotionCallBack m_cb;
+	void* m_pUser;
+	bool m_bActive;
+	int64_t m_lastMotionMs;
+	MotionResult m_result;
+	uint64_t m_nPassed;
+	uint64_t m_nBlocked;
+};
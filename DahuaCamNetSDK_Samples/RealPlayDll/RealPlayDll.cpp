@@ -16,7 +16,9 @@ int RealPlay::getDlgParameters(const dlgParameters src_Info) {
 	g_bNetSDKInitFlag = FALSE;
 	g_lLoginHandle = 0L;
 	g_lRealHandle = 0;
+	g_lSubRealHandle = 0;
 	g_saveData = FALSE;
+	latency.SetName(src_Info.loginIP);
 
 	pfnGetConsoleWindow = GetConsoleWindow;
 
@@ -58,13 +60,48 @@ int RealPlay::Initial() {
 	return 0;
 }
 
+// 0 plays the main stream only. 1..3 also open that sub stream
+// (DH_RType_Realplay_1..3) next to the main stream at the next PlayVideo:
+// the window and the frame ring use the sub stream, recording and live
+// packaging stay on the main stream. Both share the login.
+int RealPlay::SetSubStream(int stream) {
+	if (stream < 0 || stream > 3)
+		return 1;
+	subStream = stream;
+	return 0;
+}
+
 void RealPlay::PlayVideo() {
 	int nChannelID = 0; // Ԥͨ
 	DH_RealPlayType emRealPlayType = DH_RType_Realplay; // ʵʱԤ
-	g_lRealHandle = CLIENT_RealPlayEx(g_lLoginHandle, nChannelID, hwnd, emRealPlayType);
+	if (0 != subStream)
+	{
+		DH_RealPlayType emSubType = (DH_RealPlayType)(DH_RType_Realplay_0 + subStream);
+		g_lSubRealHandle = CLIENT_RealPlayEx(g_lLoginHandle, nChannelID, hwnd, emSubType);
+		if (0 == g_lSubRealHandle)
+			printf("Sub stream %d not available, Last Error[%x]; main stream only\n", subStream, CLIENT_GetLastError());
+	}
+	// With the sub stream on screen the main stream is received without rendering
+	g_lRealHandle = CLIENT_RealPlayEx(g_lLoginHandle, nChannelID, 0 != g_lSubRealHandle ? NULL : hwnd, emRealPlayType);
+	if (0 == g_lRealHandle && 0 != g_lSubRealHandle)
+	{
+		CLIENT_StopRealPlayEx(g_lSubRealHandle);
+		g_lSubRealHandle = 0;
+	}
 }
 
 void RealPlay::StopPlay() {
+	StopLivePackage();
+	StopFrameRing();
+	StopSnapshotCache();
+	StopStreamHub(STREAM_HUB_MAIN);
+	StopStreamHub(STREAM_HUB_SUB);
+	if (0 != g_lSubRealHandle)
+	{
+		if (FALSE == CLIENT_StopRealPlayEx(g_lSubRealHandle))
+			printf("CLIENT_StopRealPlayEx (sub stream) Failed!Last Error[%x]\n", CLIENT_GetLastError());
+		g_lSubRealHandle = 0;
+	}
 	if (0 != g_lRealHandle)
 	{
 		if (FALSE == CLIENT_StopRealPlayEx(g_lRealHandle))
@@ -135,6 +172,594 @@ int RealPlay::StopRecord() {
 	}
 }
 
+int RealPlay::StartLivePackage(const char* outDir) {
+	std::string dir = (NULL != outDir && outDir[0] != '\0') ? outDir : path + "hls";
+	return StartLivePackageEx(dir.c_str(), 0, 0, 0);
+}
+
+// outDir NULL or "" serves from memory only, through LiveGetPlaylist and
+// LiveGetResource; partMs, segmentMs and windowSegments 0 take the defaults.
+int RealPlay::StartLivePackageEx(const char* outDir, int partMs, int segmentMs, int windowSegments) {
+	if (partMs < 0 || segmentMs < 0 || windowSegments < 0)
+		return 4;
+	if (0 == g_lRealHandle)
+		return 2;
+	if (NULL != packager)
+		return 3;
+
+	PackagerConfig config;
+	if (NULL != outDir)
+		config.outDir = outDir;
+	if (partMs > 0)
+		config.partTarget = partMs / 1000.0;
+	if (segmentMs > 0)
+		config.segmentTarget = segmentMs / 1000.0;
+	if (windowSegments > 0)
+		config.windowSegments = windowSegments;
+	if (!config.IsValid())
+		return 4;
+	{
+		std::lock_guard<std::mutex> guard(packageLock);
+		packager = std::make_shared<Fmp4Packager>(config);
+		davReader = new DavFrameReader(OnDavFrame, this);
+	}
+
+	// Raw DAV data arrives alongside the window rendering and CLIENT_SaveRealData
+	if (!UpdateDataCallBack())
+	{
+		StopLivePackage();
+		return 1;
+	}
+	return 0;
+}
+
+int RealPlay::StopLivePackage() {
+	if (NULL == packager)
+		return 1;
+	std::shared_ptr<Fmp4Packager> stopped;
+	{
+		std::lock_guard<std::mutex> guard(packageLock);
+		delete davReader;
+		davReader = NULL;
+		stopped.swap(packager);
+	}
+	UpdateDataCallBack();
+	// Readers blocked in LiveGetPlaylist / LiveGetResource return 1
+	stopped->Close();
+	return 0;
+}
+
+// Blocking playlist reload for an HTTP server in front of the packager:
+// msn and part are the _HLS_msn and _HLS_part of the request, -1 when
+// absent. Returns 0 with the playlist in buf, 1 when not packaging, 2 when
+// it was not there within timeoutMs, 3 when buf is too small (*pSize gets
+// the size needed), 4 on bad parameters.
+int RealPlay::LiveGetPlaylist(long long msn, int part, int timeoutMs, char* buf, int bufSize, int* pSize) {
+	if (NULL != pSize)
+		*pSize = 0;
+	if (NULL == buf || bufSize <= 0)
+		return 4;
+	std::shared_ptr<Fmp4Packager> live;
+	{
+		std::lock_guard<std::mutex> guard(packageLock);
+		live = packager;
+	}
+	if (NULL == live)
+		return 1;
+	std::string playlist;
+	if (!live->GetPlaylist(&playlist, msn, part, timeoutMs))
+	{
+		std::lock_guard<std::mutex> guard(packageLock);
+		return live == packager ? 2 : 1;
+	}
+	if (NULL != pSize)
+		*pSize = (int)playlist.size();
+	if (playlist.size() >= (size_t)bufSize)
+		return 3;
+	memcpy(buf, playlist.c_str(), playlist.size() + 1);
+	return 0;
+}
+
+// "init<N>.mp4", "seg<M>.m4s" or "seg<M>.<P>.m4s" as named in the playlist;
+// waits up to timeoutMs for the part of the preload hint. Same results as
+// LiveGetPlaylist, 2 also for a name that is not in the window.
+int RealPlay::LiveGetResource(const char* name, int timeoutMs, unsigned char* buf, int bufSize, int* pSize) {
+	if (NULL != pSize)
+		*pSize = 0;
+	if (NULL == name || NULL == buf || bufSize <= 0)
+		return 4;
+	std::shared_ptr<Fmp4Packager> live;
+	{
+		std::lock_guard<std::mutex> guard(packageLock);
+		live = packager;
+	}
+	if (NULL == live)
+		return 1;
+	SharedBuffer data = live->GetResource(name, timeoutMs);
+	if (NULL == data)
+	{
+		std::lock_guard<std::mutex> guard(packageLock);
+		return live == packager ? 2 : 1;
+	}
+	if (NULL != pSize)
+		*pSize = (int)data->size();
+	if (data->size() > (size_t)bufSize)
+		return 3;
+	memcpy(buf, data->data(), data->size());
+	return 0;
+}
+
+// The raw data callback is shared by packaging (main stream), the decoder
+// (analytics stream) and the stream hubs; a stream keeps it while anything
+// still reads it.
+bool RealPlay::UpdateDataCallBack() {
+	bool bOk = true;
+	LLONG lAnalytics = AnalyticsHandle();
+	if (0 != g_lRealHandle)
+	{
+		bool bNeed = NULL != packager || (NULL != decoder && lAnalytics == g_lRealHandle) || NULL != hubs[STREAM_HUB_MAIN];
+		if (FALSE == CLIENT_SetRealDataCallBackEx2(g_lRealHandle, bNeed ? RealDataCallBack : NULL,
+			bNeed ? (LDWORD)this : 0, REALDATA_FLAG_RAW_DATA) && bNeed)
+			bOk = false;
+	}
+	if (0 != g_lSubRealHandle)
+	{
+		bool bNeed = NULL != decoder || NULL != hubs[STREAM_HUB_SUB];
+		if (FALSE == CLIENT_SetRealDataCallBackEx2(g_lSubRealHandle, bNeed ? RealDataCallBack : NULL,
+			bNeed ? (LDWORD)this : 0, REALDATA_FLAG_RAW_DATA) && bNeed)
+			bOk = false;
+	}
+	return bOk;
+}
+
+// Packaging is timed at once, the decoder stages from the next decoder
+// start. Enabling clears the histograms.
+int RealPlay::SetLatencyTrace(int enable) {
+	if (0 != enable && !latencyEnable)
+		latency.Reset();
+	latencyEnable = 0 != enable;
+	return 0;
+}
+
+// Per stage latency table of this camera, or of every camera in the process
+// (fleet != 0). Returns the text length.
+int RealPlay::GetLatencyReport(char* buf, int size, int fleet) {
+	if (NULL == buf || size <= 0)
+		return 0;
+	return 0 != fleet ? LatencyTracer::FleetReport(buf, size) : latency.Report(buf, size);
+}
+
+// threadBudget is shared by every decoding port in the process (0: one per
+// hardware thread). sessionThreads > 0 pins this session's decoder to that
+// many threads from its next start; 0 lets the pool decide.
+int RealPlay::SetDecoderPool(int threadBudget, int sessionThreads) {
+	if (threadBudget < 0 || sessionThreads < 0)
+		return 1;
+	DecoderPool::Instance().SetThreadBudget(threadBudget);
+	decodeOptions.decodeThreads = sessionThreads;
+	return 0;
+}
+
+// Every decoding port of the process. Returns the number of ports, which
+// may exceed maxCount.
+int RealPlay::GetDecoderStats(DecoderPortStats* pStats, int maxCount) {
+	return DecoderPool::Instance().GetStats(pStats, maxCount);
+}
+
+// Takes effect when the decoder next starts
+int RealPlay::SetFrameRingDecode(int mode, int keyStep, int minIntervalMs) {
+	if (mode != LIVE_DECODE_ALL && mode != LIVE_DECODE_KEY_ONLY)
+		return 1;
+	decodeOptions.mode = mode;
+	decodeOptions.keyStep = keyStep > 0 ? keyStep : 1;
+	decodeOptions.minIntervalMs = minIntervalMs > 0 ? minIntervalMs : 0;
+	return 0;
+}
+
+// Takes effect at the next StartFrameRing. With motion enabled only frames
+// with motion (plus holdMs after it) reach the ring.
+int RealPlay::SetFrameRingMotion(int enable, int threshold, int holdMs) {
+	motionEnable = 0 != enable;
+	if (threshold > 0)
+		motionOptions.threshold = threshold;
+	if (holdMs >= 0)
+		motionHoldMs = holdMs;
+	return 0;
+}
+
+// One decoder per session, shared by the frame ring and the snapshot cache
+int RealPlay::StartDecoder() {
+	if (NULL != decoder)
+		return LIVE_DECODE_OK;
+	LiveDecoder* liveDecoder = new LiveDecoder();
+	if (latencyEnable)
+		liveDecoder->SetTracer(&latency);
+	int ret = liveDecoder->Start(decodeOptions);
+	if (LIVE_DECODE_OK != ret)
+	{
+		delete liveDecoder;
+		return ret;
+	}
+	std::lock_guard<std::mutex> guard(dataLock);
+	decoder = liveDecoder;
+	return LIVE_DECODE_OK;
+}
+
+void RealPlay::StopDecoder() {
+	if (NULL == decoder || NULL != frameRing || NULL != snapshot)
+		return;
+	LiveDecoder* liveDecoder;
+	{
+		std::lock_guard<std::mutex> guard(dataLock);
+		liveDecoder = decoder;
+		decoder = NULL;
+	}
+	UpdateDataCallBack();
+	liveDecoder->Stop();
+	if (0 != liveDecoder->FramesDropped())
+		printf("Decoder: %llu video frames dropped, decoder behind\n", (unsigned long long)liveDecoder->FramesDropped());
+	if (LIVE_DECODE_KEY_ONLY == decodeOptions.mode)
+		printf("Key frame decode: %llu frames fed, %llu filtered\n",
+			(unsigned long long)liveDecoder->FramesFed(), (unsigned long long)liveDecoder->FramesFiltered());
+	delete liveDecoder;
+}
+
+int RealPlay::StartFrameRing(const char* name, int slotCount, int maxWidth, int maxHeight) {
+	if (0 == AnalyticsHandle())
+		return 2;
+	if (NULL != frameRing)
+		return 3;
+	if (NULL == name || name[0] == '\0')
+		return 4;
+
+	FrameRingWriter* writer = new FrameRingWriter();
+	if (FRAME_RING_OK != writer->Create(name, slotCount > 0 ? slotCount : FRAME_RING_DEFAULT_SLOTS,
+		maxWidth > 0 ? maxWidth : FRAME_RING_DEFAULT_WIDTH, maxHeight > 0 ? maxHeight : FRAME_RING_DEFAULT_HEIGHT))
+	{
+		delete writer;
+		return 5;
+	}
+	if (LIVE_DECODE_OK != StartDecoder())
+	{
+		delete writer;
+		return 6;
+	}
+	MotionDetector* detector = NULL;
+	MotionGate* gate = NULL;
+	if (motionEnable)
+	{
+		detector = new MotionDetector(motionOptions);
+		gate = new MotionGate(detector, writer, motionHoldMs);
+	}
+	{
+		std::lock_guard<std::mutex> guard(dataLock);
+		frameRing = writer;
+		motion = detector;
+		motionGate = gate;
+	}
+	decoder->AddSink(NULL != gate ? (FrameSink*)gate : writer);
+
+	if (!UpdateDataCallBack())
+	{
+		StopFrameRing();
+		return 1;
+	}
+	return 0;
+}
+
+int RealPlay::StopFrameRing() {
+	if (NULL == frameRing)
+		return 1;
+	// RemoveSink waits for a frame in progress, so none reaches the ring after this
+	decoder->RemoveSink(NULL != motionGate ? (FrameSink*)motionGate : frameRing);
+
+	FrameRingWriter* writer;
+	MotionDetector* detector;
+	MotionGate* gate;
+	{
+		std::lock_guard<std::mutex> guard(dataLock);
+		writer = frameRing;
+		detector = motion;
+		gate = motionGate;
+		frameRing = NULL;
+		motion = NULL;
+		motionGate = NULL;
+	}
+	StopDecoder();
+	printf("Frame ring: %llu frames published, %llu too large\n",
+		(unsigned long long)writer->Published(), (unsigned long long)writer->Oversize());
+	if (NULL != gate)
+		printf("Motion gate: %llu frames passed, %llu blocked\n",
+			(unsigned long long)gate->Passed(), (unsigned long long)gate->Blocked());
+	delete gate;
+	delete detector;
+	delete writer;
+	return 0;
+}
+
+// keyOnly keeps I frames only; otherwise the latest frame, copied at most
+// every minIntervalMs. quality is the JPEG quality (0, 100].
+int RealPlay::StartSnapshotCache(int keyOnly, int minIntervalMs, int quality) {
+	if (0 == AnalyticsHandle())
+		return 2;
+	if (NULL != snapshot)
+		return 3;
+	SnapshotOptions options;
+	options.bKeyOnly = 0 != keyOnly;
+	options.minIntervalMs = minIntervalMs > 0 ? minIntervalMs : 0;
+	if (quality > 0 && quality <= 100)
+		options.quality = quality;
+	if (LIVE_DECODE_OK != StartDecoder())
+		return 6;
+	SnapshotCache* cache = new SnapshotCache(options);
+	{
+		std::lock_guard<std::mutex> guard(snapshotLock);
+		snapshot = cache;
+	}
+	decoder->AddSink(cache);
+
+	if (!UpdateDataCallBack())
+	{
+		StopSnapshotCache();
+		return 1;
+	}
+	return 0;
+}
+
+int RealPlay::StopSnapshotCache() {
+	if (NULL == snapshot)
+		return 1;
+	decoder->RemoveSink(snapshot);
+	SnapshotCache* cache;
+	{
+		// Waits for a GetSnapshot in progress
+		std::lock_guard<std::mutex> guard(snapshotLock);
+		cache = snapshot;
+		snapshot = NULL;
+	}
+	StopDecoder();
+	printf("Snapshot cache: %llu pictures kept, %llu requests, %llu JPEG encodes\n",
+		(unsigned long long)cache->Pictures(), (unsigned long long)cache->Requests(), (unsigned long long)cache->Encodes());
+	delete cache;
+	return 0;
+}
+
+// Serves the cached picture as JPEG without touching the camera. Returns the
+// SNAPSHOT_* codes; *pSize is the JPEG size (also on SNAPSHOT_ERR_SIZE) and
+// *pAgeMs how old the picture is. maxAgeMs <= 0 accepts any age.
+int RealPlay::GetSnapshot(unsigned char* buf, int bufSize, int* pSize, int maxAgeMs, int* pAgeMs) {
+	std::lock_guard<std::mutex> guard(snapshotLock);
+	if (NULL == snapshot)
+		return SNAPSHOT_NONE;
+	size_t size = 0;
+	SnapshotInfo info;
+	info.ageMs = 0;
+	int ret = snapshot->GetJpeg(buf, bufSize > 0 ? (size_t)bufSize : 0, &size, maxAgeMs, &info);
+	if (NULL != pSize)
+		*pSize = (int)size;
+	if (NULL != pAgeMs)
+		*pAgeMs = info.ageMs;
+	return ret;
+}
+
+// Publishes a stream of this session (STREAM_HUB_MAIN, or STREAM_HUB_SUB
+// when SetSubStream opened one) to any number of readers over the session's
+// one connection. packets is the ring size in frames (0: default); a reader
+// that falls that far behind resumes at an I frame.
+int RealPlay::StartStreamHub(int stream, int packets) {
+	if (stream < 0 || stream >= STREAM_HUB_STREAMS)
+		return 4;
+	if (0 == StreamHandle(stream))
+		return 2;
+	if (NULL != hubs[stream])
+		return 3;
+	std::shared_ptr<StreamHub> hub = std::make_shared<StreamHub>(packets > 0 ? packets : STREAM_HUB_DEFAULT_PACKETS);
+	{
+		std::lock_guard<std::mutex> guard(dataLock);
+		std::lock_guard<std::mutex> hubGuard(hubLock);
+		hubs[stream] = hub;
+	}
+
+	if (!UpdateDataCallBack())
+	{
+		StopStreamHub(stream);
+		return 1;
+	}
+	return 0;
+}
+
+// Readers blocked in HubRead return STREAM_HUB_CLOSED; the hub goes away
+// when the last of them has left
+int RealPlay::StopStreamHub(int stream) {
+	if (stream < 0 || stream >= STREAM_HUB_STREAMS || NULL == hubs[stream])
+		return 1;
+	std::shared_ptr<StreamHub> hub;
+	{
+		std::lock_guard<std::mutex> guard(dataLock);
+		std::lock_guard<std::mutex> hubGuard(hubLock);
+		hub.swap(hubs[stream]);
+	}
+	RtspUnpublish(stream);
+	UpdateDataCallBack();
+	hub->Close();
+	StreamHubStats stats;
+	hub->GetStats(&stats);
+	printf("Stream hub %d: %llu frames, %llu bytes published, %u readers left\n", stream,
+		(unsigned long long)stats.published, (unsigned long long)stats.bytes, stats.subscribers);
+	return 0;
+}
+
+std::shared_ptr<StreamHub> RealPlay::GetHub(int stream) {
+	if (stream < 0 || stream >= STREAM_HUB_STREAMS)
+		return NULL;
+	std::lock_guard<std::mutex> guard(hubLock);
+	return hubs[stream];
+}
+
+// A new reader starts at the newest I frame the hub holds, or waits for the
+// next one
+int RealPlay::HubSubscribe(int stream, int* pId) {
+	if (NULL == pId)
+		return STREAM_HUB_ERR_PARAM;
+	*pId = 0;
+	std::shared_ptr<StreamHub> hub = GetHub(stream);
+	if (NULL == hub)
+		return STREAM_HUB_CLOSED;
+	*pId = hub->Subscribe();
+	return 0 != *pId ? STREAM_HUB_OK : STREAM_HUB_CLOSED;
+}
+
+int RealPlay::HubUnsubscribe(int stream, int id) {
+	std::shared_ptr<StreamHub> hub = GetHub(stream);
+	if (NULL == hub)
+		return STREAM_HUB_CLOSED;
+	hub->Unsubscribe(id);
+	return STREAM_HUB_OK;
+}
+
+// Copies whole DAV frames back to back into buf, as many as fit, waiting up
+// to timeoutMs (< 0: no limit) for the first. *pSize is the bytes copied,
+// or on STREAM_HUB_ERR_SIZE the size of the frame that did not fit.
+int RealPlay::HubRead(int stream, int id, unsigned char* buf, int bufSize, int* pSize, int* pCount, int timeoutMs) {
+	if (NULL != pSize)
+		*pSize = 0;
+	if (NULL != pCount)
+		*pCount = 0;
+	if (NULL == buf || bufSize <= 0)
+		return STREAM_HUB_ERR_PARAM;
+	std::shared_ptr<StreamHub> hub = GetHub(stream);
+	if (NULL == hub)
+		return STREAM_HUB_CLOSED;
+	StreamPacketRef packets[STREAM_HUB_READ_BATCH];
+	int count = 0;
+	int ret = hub->Read(id, packets, STREAM_HUB_READ_BATCH, (size_t)bufSize, timeoutMs, &count);
+	if (STREAM_HUB_ERR_SIZE == ret && NULL != pSize)
+		*pSize = (int)packets[0]->data.size();
+	if (STREAM_HUB_OK != ret)
+		return ret;
+	size_t size = 0;
+	for (int i = 0; i < count; i++)
+	{
+		memcpy(buf + size, packets[i]->data.data(), packets[i]->data.size());
+		size += packets[i]->data.size();
+	}
+	if (NULL != pSize)
+		*pSize = (int)size;
+	if (NULL != pCount)
+		*pCount = count;
+	return STREAM_HUB_OK;
+}
+
+// Either pointer may be NULL; pSubscriber is filled for reader id
+int RealPlay::GetHubStats(int stream, StreamHubStats* pHub, int id, StreamSubscriberStats* pSubscriber) {
+	std::shared_ptr<StreamHub> hub = GetHub(stream);
+	if (NULL == hub)
+		return STREAM_HUB_CLOSED;
+	if (NULL != pHub)
+		hub->GetStats(pHub);
+	if (NULL != pSubscriber)
+		return hub->GetSubscriberStats(id, pSubscriber);
+	return STREAM_HUB_OK;
+}
+
+// Serves the published streams as rtsp://address:port/<name>; address NULL
+// keeps it on 127.0.0.1, port 0 is 8554. The server is one per process and
+// outlives the session, so players see a stream end rather than a refused
+// connection while it reconnects.
+int RealPlay::StartRtspServer(const char* address, int port) {
+	return RtspServer::Instance().Start(address, port > 0 ? port : RTSP_DEFAULT_PORT);
+}
+
+int RealPlay::StopRtspServer() {
+	RtspServerStats stats;
+	RtspServer::Instance().GetStats(&stats);
+	RtspServer::Instance().Stop();
+	// Stop drops every published stream, so they can be published again
+	for (int i = 0; i < STREAM_HUB_STREAMS; i++)
+		rtspNames[i].clear();
+	printf("RTSP server: %llu connections, %llu frames, %llu bytes sent, %llu packets dropped\n",
+		(unsigned long long)stats.accepted, (unsigned long long)stats.frames,
+		(unsigned long long)stats.bytesSent, (unsigned long long)stats.dropped);
+	return RTSP_OK;
+}
+
+// Re-serves a stream of this session under a stable name, e.g. "cam1/main",
+// starting its hub when nothing else has. Every RTSP player reads the hub,
+// so the camera keeps one connection however many play.
+int RealPlay::RtspPublish(int stream, const char* name) {
+	if (stream < 0 || stream >= STREAM_HUB_STREAMS || NULL == name)
+		return RTSP_ERR_PARAM;
+	if (!rtspNames[stream].empty())
+		return RTSP_ERR_RUNNING;
+	bool bStarted = false;
+	if (NULL == hubs[stream])
+	{
+		int ret = StartStreamHub(stream, 0);
+		if (0 != ret)
+			return 2 == ret ? RTSP_ERR_STOPPED : RTSP_ERR_PARAM;
+		bStarted = true;
+	}
+	int ret = RtspServer::Instance().Publish(name, GetHub(stream));
+	if (RTSP_OK == ret)
+		rtspNames[stream] = name;
+	else if (bStarted)
+		StopStreamHub(stream);
+	return ret;
+}
+
+int RealPlay::RtspUnpublish(int stream) {
+	if (stream < 0 || stream >= STREAM_HUB_STREAMS || rtspNames[stream].empty())
+		return RTSP_ERR_PARAM;
+	RtspServer::Instance().Unpublish(rtspNames[stream].c_str());
+	rtspNames[stream].clear();
+	return RTSP_OK;
+}
+
+int RealPlay::GetRtspStats(RtspServerStats* pStats) {
+	if (NULL == pStats)
+		return RTSP_ERR_PARAM;
+	RtspServer::Instance().GetStats(pStats);
+	return RTSP_OK;
+}
+
+void CALLBACK RealPlay::RealDataCallBack(LLONG lRealHandle, DWORD dwDataType, BYTE* pBuffer, DWORD dwBufSize, LLONG param, LDWORD dwUser) {
+	RealPlay* self = (RealPlay*)dwUser;
+	if (NULL == self || 0 != dwDataType)
+		return;
+	// The decoder takes the analytics stream, the hubs their own stream.
+	// They go first, under a lock that packaging never holds, so a slow
+	// segment write on the main stream cannot hold up either stream's
+	// analytics or hub input.
+	{
+		std::lock_guard<std::mutex> guard(self->dataLock);
+		if (NULL != self->decoder && lRealHandle == self->AnalyticsHandle())
+			self->decoder->Input(pBuffer, dwBufSize);
+		for (int i = 0; i < STREAM_HUB_STREAMS; i++)
+		{
+			if (NULL != self->hubs[i] && lRealHandle == self->StreamHandle(i))
+				self->hubs[i]->Input(pBuffer, dwBufSize);
+		}
+	}
+	// Packaging takes the main stream
+	if (lRealHandle == self->g_lRealHandle)
+	{
+		std::lock_guard<std::mutex> guard(self->packageLock);
+		if (NULL != self->davReader)
+		{
+			if (self->latencyEnable)
+				self->dataRecvUs = FrameRingNowUs();
+			self->davReader->Input(pBuffer, dwBufSize);
+		}
+	}
+}
+
+void RealPlay::OnDavFrame(const DavFrame& frame, void* pUser) {
+	RealPlay* self = (RealPlay*)pUser;
+	self->packager->InputFrame(frame);
+	if (self->latencyEnable && frame.IsVideo())
+		self->latency.Record(LATENCY_PACKAGE, FrameRingNowUs() - self->dataRecvUs);
+}
+
 void CALLBACK RealPlay::DisConnectFunc(LLONG lLoginID, char* pchDVRIP, LONG nDVRPort, LDWORD dwUser) {
 
 }
@@ -8,6 +8,17 @@
 #include <fstream>
 #include <filesystem>
 #include <iostream>
+#include <mutex>
+#include <atomic>
+#include "DavFrame.h"
+#include "Fmp4Packager.h"
+#include "LiveDecoder.h"
+#include "FrameRingWriter.h"
+#include "MotionDetector.h"
+#include "SnapshotCache.h"
+#include "DecoderPool.h"
+#include "StreamHub.h"
+#include "RtspServer.h"
 
 #pragma comment(lib , "dhnetsdk.lib")
 
@@ -19,14 +30,53 @@ public:
 
 	int Initial();
 	int Exit();
+	int SetSubStream(int stream);
 	void PlayVideo();
 	void StopPlay();
 	int StartRecord();
 	int StopRecord();
+	int StartLivePackage(const char* outDir);
+	int StartLivePackageEx(const char* outDir, int partMs, int segmentMs, int windowSegments);
+	int StopLivePackage();
+	int LiveGetPlaylist(long long msn, int part, int timeoutMs, char* buf, int bufSize, int* pSize);
+	int LiveGetResource(const char* name, int timeoutMs, unsigned char* buf, int bufSize, int* pSize);
+	int SetFrameRingDecode(int mode, int keyStep, int minIntervalMs);
+	int SetFrameRingMotion(int enable, int threshold, int holdMs);
+	int StartFrameRing(const char* name, int slotCount, int maxWidth, int maxHeight);
+	int StopFrameRing();
+	int StartSnapshotCache(int keyOnly, int minIntervalMs, int quality);
+	int StopSnapshotCache();
+	int GetSnapshot(unsigned char* buf, int bufSize, int* pSize, int maxAgeMs, int* pAgeMs);
+	int SetDecoderPool(int threadBudget, int sessionThreads);
+	int GetDecoderStats(DecoderPortStats* pStats, int maxCount);
+	int SetLatencyTrace(int enable);
+	int GetLatencyReport(char* buf, int size, int fleet);
+	int StartStreamHub(int stream, int packets);
+	int StopStreamHub(int stream);
+	int HubSubscribe(int stream, int* pId);
+	int HubUnsubscribe(int stream, int id);
+	int HubRead(int stream, int id, unsigned char* buf, int bufSize, int* pSize, int* pCount, int timeoutMs);
+	int GetHubStats(int stream, StreamHubStats* pHub, int id, StreamSubscriberStats* pSubscriber);
+	int StartRtspServer(const char* address, int port);
+	int StopRtspServer();
+	int RtspPublish(int stream, const char* name);
+	int RtspUnpublish(int stream);
+	int GetRtspStats(RtspServerStats* pStats);
+	int StartDecoder();
+	void StopDecoder();
+	bool UpdateDataCallBack();
+
+	LLONG StreamHandle(int stream) const { return STREAM_HUB_SUB == stream ? g_lSubRealHandle : g_lRealHandle; }
+	std::shared_ptr<StreamHub> GetHub(int stream);
+
+	// Stream that feeds decode / analytics: the sub stream when it is open
+	LLONG AnalyticsHandle() const { return 0 != g_lSubRealHandle ? g_lSubRealHandle : g_lRealHandle; }
 
 	static void CALLBACK DisConnectFunc(LLONG lLoginID, char* pchDVRIP, LONG nDVRPort, LDWORD dwUser);
 	static void CALLBACK HaveReConnect(LLONG lLoginID, char* pchDVRIP, LONG nDVRPort, LDWORD dwUser);
 	static LRESULT CALLBACK WindowProcedure(HWND hwnd, UINT msg, WPARAM wp, LPARAM lp);
+	static void CALLBACK RealDataCallBack(LLONG lRealHandle, DWORD dwDataType, BYTE* pBuffer, DWORD dwBufSize, LLONG param, LDWORD dwUser);
+	static void OnDavFrame(const DavFrame& frame, void* pUser);
 
 	typedef HWND(WINAPI* PROCGETCONSOLEWINDOW)();
 	PROCGETCONSOLEWINDOW pfnGetConsoleWindow;
@@ -36,7 +86,30 @@ public:
 	BOOL g_bNetSDKInitFlag;
 	LLONG g_lLoginHandle;
 	LLONG g_lRealHandle;
+	LLONG g_lSubRealHandle;
 	BOOL g_saveData;
 	HWND hwnd;
 	std::string path = "D:/DahuaRecord/";
+	int subStream = 0;
+
+	DavFrameReader* davReader = NULL;
+	std::shared_ptr<Fmp4Packager> packager;	// written under packageLock
+	LiveDecoder* decoder = NULL;
+	FrameRingWriter* frameRing = NULL;
+	LiveDecodeOptions decodeOptions;
+	MotionDetector* motion = NULL;
+	MotionGate* motionGate = NULL;
+	bool motionEnable = false;
+	MotionOptions motionOptions;
+	int motionHoldMs = 1000;
+	SnapshotCache* snapshot = NULL;
+	std::mutex snapshotLock;
+	LatencyTracer latency;
+	std::atomic<bool> latencyEnable{ false };
+	std::shared_ptr<StreamHub> hubs[STREAM_HUB_STREAMS];	// written under dataLock and hubLock
+	std::mutex hubLock;
+	std::string rtspNames[STREAM_HUB_STREAMS];
+	int64_t dataRecvUs = 0;		// main stream data callback in progress, for LATENCY_PACKAGE
+	std::mutex dataLock;		// decoder, frame ring and hubs against the data callback
+	std::mutex packageLock;		// davReader, packager and dataRecvUs; held through segment writes
 };
\ No newline at end of file
@@ -0,0 +1,1209 @@
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include "RtspServer.h"
+
+#ifdef _WIN32
+#pragma comment(lib , "ws2_32.lib")
+#else
+typedef int SOCKET;
+#define INVALID_SOCKET	(-1)
+#define closesocket		close
+#endif
+
+#define RTSP_POLL_MS	100
+#define RTSP_ACCEPT_BACKOFF_MS	1000
+
+struct PollEvent
+{
+	SOCKET s;
+	bool bRead;
+	bool bWrite;
+	bool bError;
+};
+
+// Socket readiness for the loop thread: epoll, WSAPoll on Windows
+#ifdef _WIN32
+class RtspPoller
+{
+public:
+	bool Open() { return true; }
+
+	void Add(SOCKET s)
+	{
+		WSAPOLLFD fd;
+		fd.fd = s;
+		fd.events = POLLRDNORM;
+		fd.revents = 0;
+		m_index[s] = m_fds.size();
+		m_fds.push_back(fd);
+	}
+
+	void SetWrite(SOCKET s, bool bWrite)
+	{
+		std::unordered_map<SOCKET, size_t>::iterator it = m_index.find(s);
+		if (it != m_index.end())
+			m_fds[it->second].events = POLLRDNORM | (bWrite ? POLLWRNORM : 0);
+	}
+
+	void Remove(SOCKET s)
+	{
+		std::unordered_map<SOCKET, size_t>::iterator it = m_index.find(s);
+		if (it == m_index.end())
+			return;
+		size_t index = it->second;
+		m_index.erase(it);
+		if (index != m_fds.size() - 1) {
+			m_fds[index] = m_fds.back();
+			m_index[m_fds[index].fd] = index;
+		}
+		m_fds.pop_back();
+	}
+
+	void Wait(int timeoutMs, std::vector<PollEvent>* pEvents)
+	{
+		pEvents->clear();
+		if (WSAPoll(m_fds.data(), (ULONG)m_fds.size(), timeoutMs) <= 0)
+			return;
+		for (const WSAPOLLFD& fd : m_fds) {
+			if (fd.revents == 0)
+				continue;
+			PollEvent event;
+			event.s = fd.fd;
+			event.bRead = 0 != (fd.revents & (POLLRDNORM | POLLHUP));
+			event.bWrite = 0 != (fd.revents & POLLWRNORM);
+			event.bError = 0 != (fd.revents & (POLLERR | POLLNVAL));
+			pEvents->push_back(event);
+		}
+	}
+
+private:
+	std::vector<WSAPOLLFD> m_fds;
+	std::unordered_map<SOCKET, size_t> m_index;
+};
+#else
+class RtspPoller
+{
+public:
+	RtspPoller() : m_fd(-1) {}
+	~RtspPoller()
+	{
+		if (m_fd >= 0)
+			close(m_fd);
+	}
+
+	bool Open()
+	{
+		m_fd = epoll_create1(EPOLL_CLOEXEC);
+		return m_fd >= 0;
+	}
+
+	void Add(SOCKET s)
+	{
+		epoll_event event;
+		event.events = EPOLLIN;
+		event.data.fd = s;
+		epoll_ctl(m_fd, EPOLL_CTL_ADD, s, &event);
+	}
+
+	void SetWrite(SOCKET s, bool bWrite)
+	{
+		epoll_event event;
+		event.events = bWrite ? EPOLLIN | EPOLLOUT : EPOLLIN;
+		event.data.fd = s;
+		epoll_ctl(m_fd, EPOLL_CTL_MOD, s, &event);
+	}
+
+	void Remove(SOCKET s)
+	{
+		epoll_ctl(m_fd, EPOLL_CTL_DEL, s, NULL);
+	}
+
+	void Wait(int timeoutMs, std::vector<PollEvent>* pEvents)
+	{
+		pEvents->clear();
+		epoll_event events[256];
+		int n = epoll_wait(m_fd, events, 256, timeoutMs);
+		for (int i = 0; i < n; i++) {
+			PollEvent event;
+			event.s = events[i].data.fd;
+			event.bRead = 0 != (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLRDHUP));
+			event.bWrite = 0 != (events[i].events & EPOLLOUT);
+			event.bError = 0 != (events[i].events & EPOLLERR);
+			pEvents->push_back(event);
+		}
+	}
+
+private:
+	int m_fd;
+};
+#endif
+
+static void SetNonBlocking(SOCKET s)
+{
+#ifdef _WIN32
+	u_long mode = 1;
+	ioctlsocket(s, FIONBIO, &mode);
+#else
+	fcntl(s, F_SETFL, fcntl(s, F_GETFL, 0) | O_NONBLOCK);
+#endif
+}
+
+static bool WouldBlock()
+{
+#ifdef _WIN32
+	return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+	return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+}
+
+// The connection was reset while it waited in the backlog; the next one
+// may be fine
+static bool AcceptAborted()
+{
+#ifdef _WIN32
+	return WSAGetLastError() == WSAECONNRESET;
+#else
+	return errno == ECONNABORTED || errno == EPROTO;
+#endif
+}
+
+struct SendChunk
+{
+	const uint8_t* p;
+	size_t n;
+};
+
+// Bytes sent, 0 when the socket buffer is full, -1 when the peer is gone
+static int64_t SendGather(SOCKET s, const SendChunk* pChunks, int nChunks)
+{
+#ifdef _WIN32
+	WSABUF bufs[2 * RTSP_SEND_BATCH + 1];
+	for (int i = 0; i < nChunks; i++) {
+		bufs[i].buf = (CHAR*)pChunks[i].p;
+		bufs[i].len = (ULONG)pChunks[i].n;
+	}
+	DWORD sent = 0;
+	if (0 != WSASend(s, bufs, (DWORD)nChunks, &sent, 0, NULL, NULL))
+		return WouldBlock() ? 0 : -1;
+	return sent;
+#else
+	iovec iov[2 * RTSP_SEND_BATCH + 1];
+	for (int i = 0; i < nChunks; i++) {
+		iov[i].iov_base = (void*)pChunks[i].p;
+		iov[i].iov_len = pChunks[i].n;
+	}
+	msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iov;
+	msg.msg_iovlen = nChunks;
+	ssize_t sent = sendmsg(s, &msg, MSG_NOSIGNAL);
+	if (sent < 0)
+		return WouldBlock() ? 0 : -1;
+	return sent;
+#endif
+}
+
+static int64_t NowMs()
+{
+	return std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static uint32_t Random32()
+{
+	static thread_local std::mt19937 rng(std::random_device{}());
+	return rng();
+}
+
+static std::string Base64(const std::string& in)
+{
+	static const char* const TABLE = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	std::string out;
+	size_t i = 0;
+	for (; i + 2 < in.size(); i += 3) {
+		uint32_t v = ((uint8_t)in[i] << 16) | ((uint8_t)in[i + 1] << 8) | (uint8_t)in[i + 2];
+		out += TABLE[v >> 18];
+		out += TABLE[(v >> 12) & 63];
+		out += TABLE[(v >> 6) & 63];
+		out += TABLE[v & 63];
+	}
+	if (i < in.size()) {
+		uint32_t v = (uint8_t)in[i] << 16;
+		if (i + 1 < in.size())
+			v |= (uint8_t)in[i + 1] << 8;
+		out += TABLE[v >> 18];
+		out += TABLE[(v >> 12) & 63];
+		out += i + 1 < in.size() ? TABLE[(v >> 6) & 63] : '=';
+		out += '=';
+	}
+	return out;
+}
+
+// Value of a request header, case-insensitive name, "" when absent
+static std::string HeaderValue(const std::string& request, const char* name)
+{
+	size_t nameLen = strlen(name);
+	size_t pos = request.find("\r\n");
+	while (pos != std::string::npos && pos + 2 < request.size()) {
+		size_t line = pos + 2;
+		size_t end = request.find("\r\n", line);
+		if (end == std::string::npos || end == line)
+			break;
+		if (end - line > nameLen && request[line + nameLen] == ':'
+			&& std::equal(name, name + nameLen, request.begin() + line,
+				[](char a, char b) { return tolower((uint8_t)a) == tolower((uint8_t)b); })) {
+			size_t value = line + nameLen + 1;
+			while (value < end && request[value] == ' ')
+				value++;
+			return request.substr(value, end - value);
+		}
+		pos = end;
+	}
+	return std::string();
+}
+
+// Stream name from a request URL: rtsp://host:port/name[/track0][?query]
+static std::string UrlPath(const std::string& url, bool bTrack)
+{
+	size_t start = 0;
+	size_t scheme = url.find("://");
+	if (scheme != std::string::npos) {
+		start = url.find('/', scheme + 3);
+		if (start == std::string::npos)
+			return std::string();
+	}
+	size_t query = url.find('?', start);
+	std::string path = url.substr(start, query == std::string::npos ? std::string::npos : query - start);
+	while (!path.empty() && path[0] == '/')
+		path.erase(0, 1);
+	while (!path.empty() && path.back() == '/')
+		path.pop_back();
+	if (bTrack && path.size() >= 7 && 0 == path.compare(path.size() - 7, 7, "/track0"))
+		path.resize(path.size() - 7);
+	return path;
+}
+
+// Splits an Annex B byte stream into NAL units, start codes removed
+static void SplitNals(const uint8_t* p, size_t n, std::vector<std::pair<const uint8_t*, size_t>>* pNals)
+{
+	pNals->clear();
+	size_t start = n;
+	size_t i = 0;
+	while (i + 3 <= n) {
+		if (p[i] == 0 && p[i + 1] == 0 && p[i + 2] == 1) {
+			if (start < n) {
+				size_t end = i;
+				while (end > start && p[end - 1] == 0)
+					end--;
+				if (end > start)
+					pNals->push_back(std::make_pair(p + start, end - start));
+			}
+			i += 3;
+			start = i;
+			continue;
+		}
+		i++;
+	}
+	if (start < n)
+		pNals->push_back(std::make_pair(p + start, n - start));
+}
+
+RtspServer& RtspServer::Instance()
+{
+	static RtspServer server;
+	return server;
+}
+
+RtspServer::RtspServer()
+	: m_bRunning(false), m_listen((uintptr_t)INVALID_SOCKET), m_wake((uintptr_t)INVALID_SOCKET),
+	m_wakeSend((uintptr_t)INVALID_SOCKET), m_bWakePending(false), m_bWsa(false), m_nSessions(0), m_acceptPausedMs(0),
+	m_nAccepted(0), m_nFrames(0), m_nPackets(0), m_nBytesSent(0), m_nDropped(0), m_nResyncs(0), m_nClients(0), m_nPlaying(0)
+{
+}
+
+RtspServer::~RtspServer()
+{
+	Stop();
+}
+
+int RtspServer::Start(const char* address, int port)
+{
+	std::lock_guard<std::mutex> control(m_controlLock);
+	if (m_thread.joinable())
+		return RTSP_ERR_RUNNING;
+	if (port <= 0 || port > 65535)
+		port = RTSP_DEFAULT_PORT;
+#ifdef _WIN32
+	WSADATA wsa;
+	m_bWsa = 0 == WSAStartup(MAKEWORD(2, 2), &wsa);
+#endif
+
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons((uint16_t)port);
+	if (1 != inet_pton(AF_INET, address != NULL && address[0] != '\0' ? address : "127.0.0.1", &addr.sin_addr))
+		return RTSP_ERR_PARAM;
+
+	SOCKET listenSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	SOCKET wake = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	SOCKET wakeSend = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	m_listen = (uintptr_t)listenSocket;
+	m_wake = (uintptr_t)wake;
+	m_wakeSend = (uintptr_t)wakeSend;
+	bool bOk = listenSocket != INVALID_SOCKET && wake != INVALID_SOCKET && wakeSend != INVALID_SOCKET;
+	if (bOk) {
+#ifndef _WIN32
+		int on = 1;
+		setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, (const char*)&on, sizeof(on));
+#endif
+		bOk = 0 == bind(listenSocket, (sockaddr*)&addr, sizeof(addr)) && 0 == listen(listenSocket, SOMAXCONN);
+	}
+	if (bOk) {
+		// Pumps wake the loop with a datagram to this socket
+		sockaddr_in wakeAddr;
+		memset(&wakeAddr, 0, sizeof(wakeAddr));
+		wakeAddr.sin_family = AF_INET;
+		wakeAddr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		socklen_t len = sizeof(wakeAddr);
+		bOk = 0 == bind(wake, (sockaddr*)&wakeAddr, sizeof(wakeAddr)) && 0 == getsockname(wake, (sockaddr*)&wakeAddr, &len)
+			&& 0 == connect(wakeSend, (sockaddr*)&wakeAddr, sizeof(wakeAddr));
+	}
+	m_pPoller.reset(new RtspPoller());
+	if (bOk)
+		bOk = m_pPoller->Open();
+	if (!bOk) {
+		printf("RTSP server: cannot listen on %s:%d\n", address != NULL && address[0] != '\0' ? address : "127.0.0.1", port);
+		if (listenSocket != INVALID_SOCKET)
+			closesocket(listenSocket);
+		if (wake != INVALID_SOCKET)
+			closesocket(wake);
+		if (wakeSend != INVALID_SOCKET)
+			closesocket(wakeSend);
+		m_listen = m_wake = m_wakeSend = (uintptr_t)INVALID_SOCKET;
+		m_pPoller.reset();
+#ifdef _WIN32
+		if (m_bWsa)
+			WSACleanup();
+		m_bWsa = false;
+#endif
+		return RTSP_ERR_SOCKET;
+	}
+	SetNonBlocking(listenSocket);
+	SetNonBlocking(wake);
+	SetNonBlocking(wakeSend);
+	m_pPoller->Add(listenSocket);
+	m_pPoller->Add(wake);
+	m_acceptPausedMs = 0;
+
+	m_bRunning = true;
+	m_thread = std::thread(&RtspServer::Run, this);
+	return RTSP_OK;
+}
+
+void RtspServer::Stop()
+{
+	std::lock_guard<std::mutex> control(m_controlLock);
+	if (!m_thread.joinable())
+		return;
+	std::map<std::string, std::shared_ptr<Stream>> streams;
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		streams.swap(m_streams);
+	}
+	for (std::map<std::string, std::shared_ptr<Stream>>::iterator it = streams.begin(); it != streams.end(); ++it) {
+		it->second->hub->Unsubscribe(it->second->subscriber);
+		it->second->pump.join();
+	}
+	m_bRunning = false;
+	Wake();
+	m_thread.join();
+
+	closesocket((SOCKET)m_listen);
+	closesocket((SOCKET)m_wake);
+	closesocket((SOCKET)m_wakeSend);
+	m_listen = m_wake = m_wakeSend = (uintptr_t)INVALID_SOCKET;
+	m_pPoller.reset();
+#ifdef _WIN32
+	if (m_bWsa)
+		WSACleanup();
+	m_bWsa = false;
+#endif
+}
+
+int RtspServer::Publish(const char* name, const std::shared_ptr<StreamHub>& hub)
+{
+	if (name == NULL || name[0] == '\0' || name[0] == '/' || !hub)
+		return RTSP_ERR_PARAM;
+	for (const char* p = name; *p != '\0'; p++) {
+		if (!isalnum((uint8_t)*p) && strchr("_.-/", *p) == NULL)
+			return RTSP_ERR_PARAM;
+	}
+	std::lock_guard<std::mutex> control(m_controlLock);
+	if (!m_thread.joinable())
+		return RTSP_ERR_STOPPED;
+	std::shared_ptr<Stream> old;
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		std::map<std::string, std::shared_ptr<Stream>>::iterator it = m_streams.find(name);
+		if (it != m_streams.end()) {
+			// A stream whose hub closed gives its name to the next one
+			if (!it->second->bEnded)
+				return RTSP_ERR_RUNNING;
+			old = it->second;
+			m_streams.erase(it);
+		}
+	}
+	if (old)
+		old->pump.join();
+
+	std::shared_ptr<Stream> stream = std::make_shared<Stream>();
+	stream->subscriber = hub->Subscribe();
+	if (0 == stream->subscriber)
+		return RTSP_ERR_PARAM;
+	stream->name = name;
+	stream->hub = hub;
+	stream->ssrc = Random32();
+	stream->rtpSeq = (uint16_t)Random32();
+	stream->nextPacket = 1;
+	stream->codec = 0;
+	stream->bEnded = false;
+	stream->ring.resize(RTSP_RING_PACKETS);
+	stream->next = 1;
+	stream->lastKey = 0;
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		m_streams[name] = stream;
+	}
+	stream->pump = std::thread(&RtspServer::Pump, this, stream);
+	Wake();
+	return RTSP_OK;
+}
+
+void RtspServer::Unpublish(const char* name)
+{
+	if (name == NULL)
+		return;
+	std::lock_guard<std::mutex> control(m_controlLock);
+	std::shared_ptr<Stream> stream;
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		std::map<std::string, std::shared_ptr<Stream>>::iterator it = m_streams.find(name);
+		if (it == m_streams.end())
+			return;
+		stream = it->second;
+		m_streams.erase(it);
+	}
+	// The pump's Read returns STREAM_HUB_CLOSED
+	stream->hub->Unsubscribe(stream->subscriber);
+	stream->pump.join();
+	Wake();
+}
+
+void RtspServer::Wake()
+{
+	if (!m_bWakePending.exchange(true))
+		send((SOCKET)m_wakeSend, "w", 1, 0);
+}
+
+void RtspServer::Pump(std::shared_ptr<Stream> stream)
+{
+	StreamPacketRef frames[16];
+	std::vector<RtpPacketRef> packets;
+	for (;;) {
+		int n = 0;
+		int ret = stream->hub->Read(stream->subscriber, frames, 16, SIZE_MAX, RTSP_POLL_MS, &n);
+		if (STREAM_HUB_CLOSED == ret)
+			break;
+		for (int i = 0; i < n; i++) {
+			if (frames[i]->IsVideo())
+				Packetize(stream.get(), *frames[i], &packets);
+			frames[i].reset();
+		}
+		if (packets.empty())
+			continue;
+		{
+			std::lock_guard<std::mutex> guard(m_lock);
+			stream->pending.insert(stream->pending.end(), packets.begin(), packets.end());
+		}
+		packets.clear();
+		Wake();
+	}
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		stream->bEnded = true;
+	}
+	Wake();
+}
+
+void RtspServer::Packetize(Stream* pStream, const StreamPacket& frame, std::vector<RtpPacketRef>* pOut)
+{
+	bool bH265 = DAV_CODEC_H265 == frame.videoCodec;
+	if (!bH265 && DAV_CODEC_H264 != frame.videoCodec && DAV_CODEC_H264_STD != frame.videoCodec)
+		return;
+	std::vector<std::pair<const uint8_t*, size_t>> nals;
+	SplitNals(frame.data.data() + frame.payloadOffset, frame.payloadLen, &nals);
+	if (nals.empty())
+		return;
+
+	if (frame.IsKey()) {
+		std::lock_guard<std::mutex> guard(m_lock);
+		pStream->codec = frame.videoCodec;
+		int spsType = bH265 ? 33 : 7;
+		int ppsType = bH265 ? 34 : 8;
+		for (size_t i = 0; i < nals.size(); i++) {
+			int type = bH265 ? (nals[i].first[0] >> 1) & 0x3F : nals[i].first[0] & 0x1F;
+			std::string nal((const char*)nals[i].first, nals[i].second);
+			if (bH265 && 32 == type)
+				pStream->vps = nal;
+			else if (spsType == type)
+				pStream->sps = nal;
+			else if (ppsType == type)
+				pStream->pps = nal;
+		}
+	}
+
+	uint32_t timestamp = (uint32_t)(frame.ptsMs * 90);
+	size_t headerLen = bH265 ? 2 : 1;
+	bool bFirst = true;
+	for (size_t i = 0; i < nals.size(); i++) {
+		const uint8_t* nal = nals[i].first;
+		size_t size = nals[i].second;
+		if (size <= headerLen)
+			continue;
+		bool bLastNal = i + 1 == nals.size();
+		// One NAL per packet when it fits, fragmentation units otherwise
+		size_t offset = size <= RTSP_MAX_PAYLOAD ? 0 : headerLen;
+		while (offset < size) {
+			bool bFragment = 0 != offset || size > RTSP_MAX_PAYLOAD;
+			size_t fuLen = bFragment ? headerLen + 1 : 0;
+			size_t chunk = std::min(size - offset, (size_t)RTSP_MAX_PAYLOAD - fuLen);
+			bool bEnd = offset + chunk == size;
+
+			std::shared_ptr<RtpPacket> packet = std::make_shared<RtpPacket>();
+			packet->seq = pStream->nextPacket++;
+			packet->bKeyStart = bFirst && frame.IsKey();
+			bFirst = false;
+			packet->data.resize(12 + fuLen + chunk);
+			uint8_t* p = packet->data.data();
+			p[0] = 0x80;
+			p[1] = (uint8_t)(((bEnd && bLastNal) ? 0x80 : 0) | RTSP_PAYLOAD_TYPE);
+			p[2] = (uint8_t)(pStream->rtpSeq >> 8);
+			p[3] = (uint8_t)pStream->rtpSeq;
+			pStream->rtpSeq++;
+			p[4] = (uint8_t)(timestamp >> 24);
+			p[5] = (uint8_t)(timestamp >> 16);
+			p[6] = (uint8_t)(timestamp >> 8);
+			p[7] = (uint8_t)timestamp;
+			p[8] = (uint8_t)(pStream->ssrc >> 24);
+			p[9] = (uint8_t)(pStream->ssrc >> 16);
+			p[10] = (uint8_t)(pStream->ssrc >> 8);
+			p[11] = (uint8_t)pStream->ssrc;
+			if (bFragment) {
+				uint8_t flags = (uint8_t)((offset == headerLen ? 0x80 : 0) | (bEnd ? 0x40 : 0));
+				if (bH265) {
+					p[12] = (uint8_t)((nal[0] & 0x81) | (49 << 1));
+					p[13] = nal[1];
+					p[14] = (uint8_t)(flags | ((nal[0] >> 1) & 0x3F));
+				} else {
+					p[12] = (uint8_t)((nal[0] & 0xE0) | 28);
+					p[13] = (uint8_t)(flags | (nal[0] & 0x1F));
+				}
+			}
+			memcpy(p + 12 + fuLen, nal + offset, chunk);
+			offset += chunk;
+			pOut->push_back(packet);
+			m_nPackets++;
+		}
+	}
+	m_nFrames++;
+}
+
+void RtspServer::Run()
+{
+	std::vector<PollEvent> events;
+	int64_t lastSweepMs = NowMs();
+	while (m_bRunning) {
+		m_pPoller->Wait(RTSP_POLL_MS, &events);
+		for (const PollEvent& event : events) {
+			if ((uintptr_t)event.s == m_listen) {
+				Accept();
+				continue;
+			}
+			if ((uintptr_t)event.s == m_wake) {
+				m_bWakePending = false;
+				char buf[64];
+				while (recv(event.s, buf, sizeof(buf), 0) > 0)
+					;
+				continue;
+			}
+			std::unordered_map<uintptr_t, Client*>::iterator it = m_clients.find((uintptr_t)event.s);
+			if (it == m_clients.end())
+				continue;
+			Client* pClient = it->second;
+			if (event.bError && !event.bRead) {
+				CloseClient(pClient);
+				continue;
+			}
+			if (event.bRead) {
+				OnReadable(pClient);
+				if (m_clients.find((uintptr_t)event.s) == m_clients.end())
+					continue;
+			}
+			if (event.bWrite && !Flush(pClient))
+				CloseClient(pClient);
+		}
+		TakePending();
+
+		int64_t nowMs = NowMs();
+		if (m_acceptPausedMs != 0 && nowMs - m_acceptPausedMs >= RTSP_ACCEPT_BACKOFF_MS)
+			ResumeAccept();
+		if (nowMs - lastSweepMs >= 1000) {
+			lastSweepMs = nowMs;
+			std::vector<Client*> idle;
+			for (std::unordered_map<uintptr_t, Client*>::iterator it = m_clients.begin(); it != m_clients.end(); ++it) {
+				if (!it->second->bPlaying && nowMs - it->second->lastActiveMs > RTSP_SESSION_TIMEOUT_S * 1000)
+					idle.push_back(it->second);
+			}
+			for (Client* pClient : idle)
+				CloseClient(pClient);
+		}
+	}
+
+	std::vector<Client*> clients;
+	for (std::unordered_map<uintptr_t, Client*>::iterator it = m_clients.begin(); it != m_clients.end(); ++it)
+		clients.push_back(it->second);
+	for (Client* pClient : clients)
+		CloseClient(pClient);
+	m_loopStreams.clear();
+}
+
+void RtspServer::Accept()
+{
+	for (;;) {
+		SOCKET s = accept((SOCKET)m_listen, NULL, NULL);
+		if (s == INVALID_SOCKET) {
+			if (AcceptAborted())
+				continue;
+			// Out of descriptors or buffers (EMFILE, ENFILE, ENOBUFS): the
+			// connection stays in the backlog and the listen socket stays
+			// readable, so stop watching it until a client closes or the
+			// back-off ends rather than spin on it
+			if (!WouldBlock()) {
+				m_pPoller->Remove((SOCKET)m_listen);
+				m_acceptPausedMs = NowMs();
+			}
+			break;
+		}
+		SetNonBlocking(s);
+		int on = 1;
+		setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*)&on, sizeof(on));
+		Client* pClient = new Client();
+		pClient->socket = (uintptr_t)s;
+		pClient->replySent = 0;
+		pClient->bCloseAfterReply = false;
+		pClient->bWantWrite = false;
+		pClient->lastActiveMs = NowMs();
+		pClient->channel = 0;
+		pClient->bPlaying = false;
+		pClient->cursor = 0;
+		pClient->bWaitKey = false;
+		pClient->inFlightSent = 0;
+		m_clients[pClient->socket] = pClient;
+		m_pPoller->Add(s);
+		m_nAccepted++;
+		m_nClients++;
+	}
+}
+
+void RtspServer::OnReadable(Client* pClient)
+{
+	char buf[4096];
+	for (;;) {
+		int n = recv((SOCKET)pClient->socket, buf, sizeof(buf), 0);
+		if (n > 0) {
+			pClient->in.append(buf, n);
+			if (n < (int)sizeof(buf))
+				break;
+			continue;
+		}
+		if (n < 0 && WouldBlock())
+			break;
+		CloseClient(pClient);
+		return;
+	}
+	pClient->lastActiveMs = NowMs();
+
+	std::string& in = pClient->in;
+	size_t pos = 0;
+	while (pos < in.size()) {
+		// RTCP the player sends back on its interleaved channel
+		if (in[pos] == '$') {
+			if (in.size() - pos < 4)
+				break;
+			size_t len = ((uint8_t)in[pos + 2] << 8) | (uint8_t)in[pos + 3];
+			if (in.size() - pos < 4 + len)
+				break;
+			pos += 4 + len;
+			continue;
+		}
+		size_t end = in.find("\r\n\r\n", pos);
+		if (end == std::string::npos)
+			break;
+		end += 4;
+		std::string request = in.substr(pos, end - pos);
+		size_t body = (size_t)atoi(HeaderValue(request, "Content-Length").c_str());
+		if (in.size() - end < body)
+			break;
+		pos = end + body;
+		if (!HandleRequest(pClient, request)) {
+			CloseClient(pClient);
+			return;
+		}
+	}
+	in.erase(0, pos);
+	if (in.size() > RTSP_MAX_REQUEST || !Flush(pClient))
+		CloseClient(pClient);
+}
+
+void RtspServer::Reply(Client* pClient, int status, const char* reason, int cseq, const std::string& headers, const std::string& body)
+{
+	char line[128];
+	snprintf(line, sizeof(line), "RTSP/1.0 %d %s\r\nCSeq: %d\r\nServer: RealPlayDll\r\n", status, reason, cseq);
+	pClient->reply += line;
+	pClient->reply += headers;
+	if (!body.empty()) {
+		snprintf(line, sizeof(line), "Content-Length: %u\r\n", (unsigned)body.size());
+		pClient->reply += line;
+	}
+	pClient->reply += "\r\n";
+	pClient->reply += body;
+}
+
+bool RtspServer::HandleRequest(Client* pClient, const std::string& request)
+{
+	char method[32];
+	char url[1024];
+	char version[16];
+	if (3 != sscanf(request.c_str(), "%31s %1023s %15s", method, url, version) || 0 != strncmp(version, "RTSP/", 5))
+		return false;
+	int cseq = atoi(HeaderValue(request, "CSeq").c_str());
+	std::string sessionHeader;
+	if (!pClient->session.empty())
+		sessionHeader = "Session: " + pClient->session + "\r\n";
+
+	if (0 == strcmp(method, "OPTIONS")) {
+		Reply(pClient, 200, "OK", cseq, "Public: OPTIONS, DESCRIBE, SETUP, PLAY, PAUSE, TEARDOWN, GET_PARAMETER\r\n", "");
+		return true;
+	}
+	if (0 == strcmp(method, "GET_PARAMETER") || 0 == strcmp(method, "SET_PARAMETER")) {
+		Reply(pClient, 200, "OK", cseq, sessionHeader, "");
+		return true;
+	}
+
+	if (0 == strcmp(method, "DESCRIBE")) {
+		std::shared_ptr<Stream> stream = FindStream(UrlPath(url, false));
+		if (!stream) {
+			Reply(pClient, 404, "Not Found", cseq, "", "");
+			return true;
+		}
+		uint8_t codec;
+		std::string vps, sps, pps;
+		{
+			std::lock_guard<std::mutex> guard(m_lock);
+			codec = stream->codec;
+			vps = stream->vps;
+			sps = stream->sps;
+			pps = stream->pps;
+		}
+		// Nothing to describe before the first key frame
+		if (0 == codec) {
+			Reply(pClient, 503, "Service Unavailable", cseq, "Retry-After: 1\r\n", "");
+			return true;
+		}
+		std::string fmtp;
+		char buf[64];
+		if (DAV_CODEC_H265 == codec) {
+			fmtp = "a=rtpmap:96 H265/90000\r\na=fmtp:96 ";
+			if (!vps.empty() && !sps.empty() && !pps.empty())
+				fmtp += "sprop-vps=" + Base64(vps) + ";sprop-sps=" + Base64(sps) + ";sprop-pps=" + Base64(pps);
+		} else {
+			fmtp = "a=rtpmap:96 H264/90000\r\na=fmtp:96 packetization-mode=1";
+			if (sps.size() >= 4) {
+				snprintf(buf, sizeof(buf), ";profile-level-id=%02X%02X%02X", (uint8_t)sps[1], (uint8_t)sps[2], (uint8_t)sps[3]);
+				fmtp += buf;
+			}
+			if (!sps.empty() && !pps.empty())
+				fmtp += ";sprop-parameter-sets=" + Base64(sps) + "," + Base64(pps);
+		}
+		snprintf(buf, sizeof(buf), "o=- %u 1 IN IP4 0.0.0.0\r\n", stream->ssrc);
+		std::string sdp = "v=0\r\n";
+		sdp += buf;
+		sdp += "s=" + stream->name + "\r\nc=IN IP4 0.0.0.0\r\nt=0 0\r\na=control:*\r\na=range:npt=0-\r\n"
+			"m=video 0 RTP/AVP 96\r\n" + fmtp + "\r\na=control:track0\r\n";
+		std::string base = url;
+		if (base.empty() || base.back() != '/')
+			base += '/';
+		Reply(pClient, 200, "OK", cseq, "Content-Base: " + base + "\r\nContent-Type: application/sdp\r\n", sdp);
+		return true;
+	}
+
+	if (0 == strcmp(method, "SETUP")) {
+		std::shared_ptr<Stream> stream = FindStream(UrlPath(url, true));
+		if (!stream) {
+			Reply(pClient, 404, "Not Found", cseq, "", "");
+			return true;
+		}
+		std::string transport = HeaderValue(request, "Transport");
+		size_t interleaved = transport.find("interleaved=");
+		if (interleaved == std::string::npos && transport.find("RTP/AVP/TCP") == std::string::npos) {
+			Reply(pClient, 461, "Unsupported Transport", cseq, "", "");
+			return true;
+		}
+		int channel = interleaved != std::string::npos ? atoi(transport.c_str() + interleaved + 12) : 0;
+		if (pClient->bPlaying)
+			StopPlaying(pClient);
+		pClient->stream = stream;
+		pClient->channel = (uint8_t)std::min(std::max(channel, 0), 254);
+		if (pClient->session.empty()) {
+			char session[32];
+			snprintf(session, sizeof(session), "%08X%04X", Random32(), ++m_nSessions & 0xFFFF);
+			pClient->session = session;
+		}
+		char headers[256];
+		snprintf(headers, sizeof(headers), "Transport: RTP/AVP/TCP;unicast;interleaved=%d-%d;ssrc=%08X\r\nSession: %s;timeout=%d\r\n",
+			pClient->channel, pClient->channel + 1, stream->ssrc, pClient->session.c_str(), RTSP_SESSION_TIMEOUT_S);
+		Reply(pClient, 200, "OK", cseq, headers, "");
+		return true;
+	}
+
+	// The rest act on the session
+	std::string session = HeaderValue(request, "Session");
+	session = session.substr(0, session.find(';'));
+	bool bSession = !pClient->session.empty() && session == pClient->session;
+
+	if (0 == strcmp(method, "PLAY")) {
+		if (!bSession || !pClient->stream) {
+			Reply(pClient, 454, "Session Not Found", cseq, "", "");
+			return true;
+		}
+		if (FindStream(pClient->stream->name) != pClient->stream) {
+			Reply(pClient, 404, "Not Found", cseq, "", "");
+			return true;
+		}
+		std::string rtpInfo;
+		StartPlaying(pClient, &rtpInfo);
+		std::string headers = sessionHeader + "Range: npt=0.000-\r\n";
+		if (!rtpInfo.empty()) {
+			std::string base = url;
+			if (!base.empty() && base.back() == '/')
+				base.pop_back();
+			headers += "RTP-Info: url=" + base + "/track0;" + rtpInfo + "\r\n";
+		}
+		Reply(pClient, 200, "OK", cseq, headers, "");
+		return true;
+	}
+	if (0 == strcmp(method, "PAUSE") || 0 == strcmp(method, "TEARDOWN")) {
+		if (!bSession) {
+			Reply(pClient, 454, "Session Not Found", cseq, "", "");
+			return true;
+		}
+		StopPlaying(pClient);
+		Reply(pClient, 200, "OK", cseq, sessionHeader, "");
+		if (0 == strcmp(method, "TEARDOWN"))
+			pClient->bCloseAfterReply = true;
+		return true;
+	}
+	Reply(pClient, 501, "Not Implemented", cseq, "", "");
+	return true;
+}
+
+std::shared_ptr<RtspServer::Stream> RtspServer::FindStream(const std::string& path)
+{
+	std::map<std::string, std::shared_ptr<Stream>>::iterator it = m_loopStreams.find(path);
+	return it != m_loopStreams.end() ? it->second : NULL;
+}
+
+void RtspServer::Resync(Client* pClient)
+{
+	Stream* pStream = pClient->stream.get();
+	uint64_t oldest = pStream->next > pStream->ring.size() ? pStream->next - pStream->ring.size() : 1;
+	uint64_t target;
+	if (0 != pStream->lastKey && pStream->lastKey >= oldest) {
+		target = pStream->lastKey;
+		pClient->bWaitKey = false;
+	} else {
+		target = pStream->next;
+		pClient->bWaitKey = true;
+	}
+	if (target > pClient->cursor)
+		m_nDropped += target - pClient->cursor;
+	pClient->cursor = target;
+}
+
+// Players start at the newest key frame in the ring, or wait for the next
+void RtspServer::StartPlaying(Client* pClient, std::string* pRtpInfo)
+{
+	Stream* pStream = pClient->stream.get();
+	if (!pClient->bPlaying) {
+		pClient->bPlaying = true;
+		pClient->cursor = pStream->next;
+		Resync(pClient);
+		pStream->players.push_back(pClient);
+		m_nPlaying++;
+	}
+	if (!pClient->bWaitKey && pClient->cursor < pStream->next) {
+		const uint8_t* p = pStream->ring[pClient->cursor % pStream->ring.size()]->data.data();
+		char info[64];
+		snprintf(info, sizeof(info), "seq=%u;rtptime=%u", (p[2] << 8) | p[3],
+			((uint32_t)p[4] << 24) | ((uint32_t)p[5] << 16) | ((uint32_t)p[6] << 8) | p[7]);
+		*pRtpInfo = info;
+	}
+}
+
+void RtspServer::StopPlaying(Client* pClient)
+{
+	if (!pClient->bPlaying)
+		return;
+	std::vector<Client*>& players = pClient->stream->players;
+	std::vector<Client*>::iterator it = std::find(players.begin(), players.end(), pClient);
+	if (it != players.end()) {
+		*it = players.back();
+		players.pop_back();
+	}
+	pClient->bPlaying = false;
+	m_nPlaying--;
+}
+
+bool RtspServer::Flush(Client* pClient)
+{
+	SOCKET s = (SOCKET)pClient->socket;
+	uint8_t prefixes[RTSP_SEND_BATCH][4];
+	SendChunk chunks[2 * RTSP_SEND_BATCH + 1];
+	const RtpPacket* packets[RTSP_SEND_BATCH];
+	for (;;) {
+		// A packet once started is finished first, or the framing breaks
+		if (pClient->inFlight) {
+			const RtpPacket& packet = *pClient->inFlight;
+			prefixes[0][0] = '$';
+			prefixes[0][1] = pClient->channel;
+			prefixes[0][2] = (uint8_t)(packet.data.size() >> 8);
+			prefixes[0][3] = (uint8_t)packet.data.size();
+			int n = 0;
+			size_t sent = pClient->inFlightSent;
+			if (sent < 4) {
+				chunks[n].p = prefixes[0] + sent;
+				chunks[n++].n = 4 - sent;
+			}
+			size_t bodySent = sent > 4 ? sent - 4 : 0;
+			chunks[n].p = packet.data.data() + bodySent;
+			chunks[n++].n = packet.data.size() - bodySent;
+			int64_t ret = SendGather(s, chunks, n);
+			if (ret < 0)
+				return false;
+			if (ret == 0)
+				break;
+			m_nBytesSent += ret;
+			pClient->inFlightSent += (size_t)ret;
+			if (pClient->inFlightSent == 4 + packet.data.size())
+				pClient->inFlight.reset();
+			continue;
+		}
+
+		if (pClient->replySent < pClient->reply.size()) {
+			chunks[0].p = (const uint8_t*)pClient->reply.data() + pClient->replySent;
+			chunks[0].n = pClient->reply.size() - pClient->replySent;
+			int64_t ret = SendGather(s, chunks, 1);
+			if (ret < 0)
+				return false;
+			if (ret == 0)
+				break;
+			pClient->replySent += (size_t)ret;
+			if (pClient->replySent == pClient->reply.size()) {
+				pClient->reply.clear();
+				pClient->replySent = 0;
+				if (pClient->bCloseAfterReply)
+					return false;
+			}
+			continue;
+		}
+
+		if (!pClient->bPlaying)
+			break;
+		Stream* pStream = pClient->stream.get();
+		uint64_t oldest = pStream->next > pStream->ring.size() ? pStream->next - pStream->ring.size() : 1;
+		if (pClient->cursor < oldest) {
+			Resync(pClient);
+			m_nResyncs++;
+		}
+		// Without a key frame in the ring, what comes before the next one
+		// cannot be decoded
+		while (pClient->bWaitKey && pClient->cursor < pStream->next) {
+			if (pStream->ring[pClient->cursor % pStream->ring.size()]->bKeyStart) {
+				pClient->bWaitKey = false;
+				break;
+			}
+			pClient->cursor++;
+			m_nDropped++;
+		}
+		if (pClient->cursor >= pStream->next)
+			break;
+
+		int count = 0;
+		int n = 0;
+		size_t total = 0;
+		for (uint64_t seq = pClient->cursor; seq < pStream->next && count < RTSP_SEND_BATCH; seq++, count++) {
+			const RtpPacket* pPacket = pStream->ring[seq % pStream->ring.size()].get();
+			uint8_t* prefix = prefixes[count];
+			prefix[0] = '$';
+			prefix[1] = pClient->channel;
+			prefix[2] = (uint8_t)(pPacket->data.size() >> 8);
+			prefix[3] = (uint8_t)pPacket->data.size();
+			chunks[n].p = prefix;
+			chunks[n++].n = 4;
+			chunks[n].p = pPacket->data.data();
+			chunks[n++].n = pPacket->data.size();
+			packets[count] = pPacket;
+			total += 4 + pPacket->data.size();
+		}
+		int64_t ret = SendGather(s, chunks, n);
+		if (ret < 0)
+			return false;
+		if (ret == 0)
+			break;
+		m_nBytesSent += ret;
+		size_t sent = (size_t)ret;
+		for (int i = 0; i < count && sent > 0; i++) {
+			size_t size = 4 + packets[i]->data.size();
+			if (sent < size) {
+				pClient->inFlight = pStream->ring[pClient->cursor % pStream->ring.size()];
+				pClient->inFlightSent = sent;
+			}
+			sent -= std::min(sent, size);
+			pClient->cursor++;
+		}
+		if ((size_t)ret < total) {
+			// Socket buffer full
+			if (!pClient->bWantWrite) {
+				pClient->bWantWrite = true;
+				m_pPoller->SetWrite(s, true);
+			}
+			return true;
+		}
+	}
+
+	bool bPending = pClient->inFlight || pClient->replySent < pClient->reply.size()
+		|| (pClient->bPlaying && pClient->cursor < pClient->stream->next);
+	if (bPending != pClient->bWantWrite) {
+		pClient->bWantWrite = bPending;
+		m_pPoller->SetWrite(s, bPending);
+	}
+	return true;
+}
+
+void RtspServer::CloseClient(Client* pClient)
+{
+	StopPlaying(pClient);
+	m_pPoller->Remove((SOCKET)pClient->socket);
+	closesocket((SOCKET)pClient->socket);
+	m_clients.erase(pClient->socket);
+	m_nClients--;
+	delete pClient;
+	if (m_acceptPausedMs != 0 && m_bRunning)
+		ResumeAccept();
+}
+
+void RtspServer::ResumeAccept()
+{
+	m_acceptPausedMs = 0;
+	m_pPoller->Add((SOCKET)m_listen);
+}
+
+// Moves what the pumps packetized into the rings and sends it on; drops
+// the players of streams that went away
+void RtspServer::TakePending()
+{
+	std::vector<std::pair<std::shared_ptr<Stream>, std::vector<RtpPacketRef>>> batches;
+	std::vector<std::shared_ptr<Stream>> gone;
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		for (std::map<std::string, std::shared_ptr<Stream>>::iterator it = m_loopStreams.begin(); it != m_loopStreams.end(); ++it) {
+			std::map<std::string, std::shared_ptr<Stream>>::iterator found = m_streams.find(it->first);
+			if (found == m_streams.end() || found->second != it->second || it->second->bEnded)
+				gone.push_back(it->second);
+		}
+		if (m_loopStreams.size() != m_streams.size() || !gone.empty()) {
+			m_loopStreams.clear();
+			for (std::map<std::string, std::shared_ptr<Stream>>::iterator it = m_streams.begin(); it != m_streams.end(); ++it) {
+				if (!it->second->bEnded)
+					m_loopStreams.insert(*it);
+			}
+		}
+		for (std::map<std::string, std::shared_ptr<Stream>>::iterator it = m_loopStreams.begin(); it != m_loopStreams.end(); ++it) {
+			if (!it->second->pending.empty()) {
+				batches.push_back(std::make_pair(it->second, std::vector<RtpPacketRef>()));
+				batches.back().second.swap(it->second->pending);
+			}
+		}
+	}
+
+	for (const std::shared_ptr<Stream>& stream : gone) {
+		std::vector<Client*> players = stream->players;
+		for (Client* pClient : players)
+			CloseClient(pClient);
+	}
+	for (size_t i = 0; i < batches.size(); i++) {
+		Stream* pStream = batches[i].first.get();
+		for (const RtpPacketRef& packet : batches[i].second) {
+			pStream->ring[packet->seq % pStream->ring.size()] = packet;
+			pStream->next = packet->seq + 1;
+			if (packet->bKeyStart)
+				pStream->lastKey = packet->seq;
+		}
+		std::vector<Client*> closed;
+		for (Client* pClient : pStream->players) {
+			if (!pClient->bWantWrite && !Flush(pClient))
+				closed.push_back(pClient);
+		}
+		for (Client* pClient : closed)
+			CloseClient(pClient);
+	}
+}
+
+void RtspServer::GetStats(RtspServerStats* pStats)
+{
+	if (pStats == NULL)
+		return;
+	memset(pStats, 0, sizeof(*pStats));
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		pStats->streams = (uint32_t)m_streams.size();
+	}
+	pStats->clients = m_nClients.load();
+	pStats->playing = m_nPlaying.load();
+	pStats->accepted = m_nAccepted.load();
+	pStats->frames = m_nFrames.load();
+	pStats->packets = m_nPackets.load();
+	pStats->bytesSent = m_nBytesSent.load();
+	pStats->dropped = m_nDropped.load();
+	pStats->resyncs = m_nResyncs.load();
+}
@@ -0,0 +1,186 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "StreamHub.h"
+
+class RtspPoller;
+
+// RTSP server result codes
+#define RTSP_OK					0
+#define RTSP_ERR_SOCKET			1	// cannot listen on the address
+#define RTSP_ERR_RUNNING		2	// already started, or name already published
+#define RTSP_ERR_STOPPED		3	// server not running
+#define RTSP_ERR_PARAM			4
+
+#define RTSP_DEFAULT_PORT		8554
+#define RTSP_RING_PACKETS		4096	// RTP packets kept per stream, a few seconds of 4K
+#define RTSP_MAX_PAYLOAD		1400	// RTP payload, FU fragments above this
+#define RTSP_SEND_BATCH			32		// RTP packets per send call
+#define RTSP_MAX_REQUEST		16384	// unparsed request bytes before the client is dropped
+#define RTSP_SESSION_TIMEOUT_S	60		// idle connection that is not playing
+#define RTSP_PAYLOAD_TYPE		96
+
+#pragma pack(push, 4)
+typedef struct RtspServerStats
+{
+	uint32_t streams;
+	uint32_t clients;			// connections open
+	uint32_t playing;
+	uint32_t reserved;
+	uint64_t accepted;			// connections since Start
+	uint64_t frames;			// video frames packetized, all streams
+	uint64_t packets;			// RTP packets built; each is sent to every player
+	uint64_t bytesSent;			// all clients, interleave framing included
+	uint64_t dropped;			// RTP packets players skipped after falling a ring behind
+	uint64_t resyncs;
+} RtspServerStats;
+#pragma pack(pop)
+
+// Serves the streams of the process's hubs to local RTSP clients as
+// rtsp://<address>:<port>/<name>, so players, recorders and server.js read
+// the cameras over one SDK connection each.
+//
+// One thread per published stream reads its hub and packetizes every video
+// frame once (RFC 6184 H.264, RFC 7798 H.265) into shared RTP packets, kept
+// in a ring per stream. All connections are served by one event loop thread
+// on epoll (WSAPoll on Windows): a playing client is only a cursor into the
+// ring of its stream, and sending is a gather write of the packets it has
+// not had yet behind its own interleave headers, so a thousand players cost
+// a thousand cursors and no copies. A player that falls a whole ring behind
+// resumes at the newest key frame, like a hub reader. New players start at
+// the newest key frame in the ring, so the picture comes up at once.
+//
+// Media goes interleaved on the RTSP connection (RTP/AVP/TCP); UDP
+// transport is answered with 461.
+class RtspServer
+{
+public:
+	static RtspServer& Instance();
+
+	// address NULL or "" listens on 127.0.0.1 only
+	int Start(const char* address, int port);
+	void Stop();
+
+	// Serves the hub under name ([A-Za-z0-9_.-/], no leading slash) until
+	// Unpublish or until the hub closes.
+	int Publish(const char* name, const std::shared_ptr<StreamHub>& hub);
+	void Unpublish(const char* name);
+
+	void GetStats(RtspServerStats* pStats);
+
+private:
+	struct RtpPacket
+	{
+		uint64_t seq;			// ring sequence
+		bool bKeyStart;			// first packet of a key frame
+		std::vector<uint8_t> data;	// RTP header and payload
+	};
+	typedef std::shared_ptr<const RtpPacket> RtpPacketRef;
+
+	struct Client;
+
+	struct Stream
+	{
+		std::string name;
+		std::shared_ptr<StreamHub> hub;
+		int subscriber;
+		uint32_t ssrc;
+		std::thread pump;
+
+		// Pump thread only
+		uint16_t rtpSeq;
+		uint64_t nextPacket;
+
+		// Under m_lock
+		std::vector<RtpPacketRef> pending;
+		uint8_t codec;			// DAV_CODEC_*, 0 until the first key frame
+		std::string vps;		// H.265 only
+		std::string sps;
+		std::string pps;
+		bool bEnded;
+
+		// Loop thread only
+		std::vector<RtpPacketRef> ring;	// seq % size
+		uint64_t next;
+		uint64_t lastKey;		// seq of the newest key frame start, 0 for none
+		std::vector<Client*> players;
+	};
+
+	struct Client
+	{
+		uintptr_t socket;
+		std::string in;
+		std::string reply;		// RTSP responses not yet sent
+		size_t replySent;
+		bool bCloseAfterReply;
+		bool bWantWrite;
+		int64_t lastActiveMs;
+		std::string session;
+		std::shared_ptr<Stream> stream;	// after SETUP
+		uint8_t channel;		// interleaved RTP channel
+		bool bPlaying;
+		uint64_t cursor;
+		bool bWaitKey;
+		RtpPacketRef inFlight;	// packet partly sent
+		size_t inFlightSent;	// of 4 + size
+	};
+
+	RtspServer();
+	~RtspServer();
+	RtspServer(const RtspServer&) = delete;
+	RtspServer& operator=(const RtspServer&) = delete;
+
+	void Pump(std::shared_ptr<Stream> stream);
+	void Packetize(Stream* pStream, const StreamPacket& frame, std::vector<RtpPacketRef>* pOut);
+	void Wake();
+
+	void Run();
+	void Accept();
+	void ResumeAccept();
+	void OnReadable(Client* pClient);
+	bool HandleRequest(Client* pClient, const std::string& request);
+	void Reply(Client* pClient, int status, const char* reason, int cseq, const std::string& headers, const std::string& body);
+	void StartPlaying(Client* pClient, std::string* pRtpInfo);
+	void StopPlaying(Client* pClient);
+	void Resync(Client* pClient);
+	// Sends what the client can take without blocking; false when it is gone.
+	bool Flush(Client* pClient);
+	void CloseClient(Client* pClient);
+	void TakePending();
+	std::shared_ptr<Stream> FindStream(const std::string& path);
+
+	std::mutex m_controlLock;		// Start, Stop, Publish, Unpublish
+	std::thread m_thread;
+	std::atomic<bool> m_bRunning;
+	uintptr_t m_listen;
+	uintptr_t m_wake;				// loopback datagram socket the loop watches
+	uintptr_t m_wakeSend;
+	std::atomic<bool> m_bWakePending;
+	bool m_bWsa;
+	uint32_t m_nSessions;			// loop thread only
+	int64_t m_acceptPausedMs;		// loop thread only; when accept ran out of descriptors, 0 while listening
+
+	std::mutex m_lock;				// the Stream fields so marked, m_streams
+	std::map<std::string, std::shared_ptr<Stream>> m_streams;
+
+	// Loop thread only
+	std::unordered_map<uintptr_t, Client*> m_clients;
+	std::map<std::string, std::shared_ptr<Stream>> m_loopStreams;
+	std::unique_ptr<RtspPoller> m_pPoller;
+
+	std::atomic<uint64_t> m_nAccepted;
+	std::atomic<uint64_t> m_nFrames;
+	std::atomic<uint64_t> m_nPackets;
+	std::atomic<uint64_t> m_nBytesSent;
+	std::atomic<uint64_t> m_nDropped;
+	std::atomic<uint64_t> m_nResyncs;
+	std::atomic<uint32_t> m_nClients;
+	std::atomic<uint32_t> m_nPlaying;
+};
@@ -0,0 +1,124 @@
+#include <string.h>
+#include "SnapshotCache.h"
+#include "FrameRing.h"
+
+SnapshotCache::SnapshotCache(const SnapshotOptions& options)
+	: m_options(options), m_lastPtsMs(0), m_nPictures(0), m_nEncodes(0), m_nRequests(0)
+{
+}
+
+void SnapshotCache::OnFrame(const DecodedFrame& frame)
+{
+	if (m_options.bKeyOnly && !frame.bKey)
+		return;
+	if (m_nPictures > 0 && m_options.minIntervalMs > 0 && frame.ptsMs >= m_lastPtsMs
+		&& frame.ptsMs - m_lastPtsMs < m_options.minIntervalMs)
+		return;
+
+	// The previous picture comes back as the spare once no request holds it
+	std::shared_ptr<Picture> picture = m_spare;
+	m_spare.reset();
+	if (!picture || picture.use_count() != 1)
+		picture = std::make_shared<Picture>();
+
+	int w = frame.width;
+	int h = frame.height;
+	int cw = (w + 1) / 2;
+	int ch = (h + 1) / 2;
+	picture->yuv.resize((size_t)w * h + (size_t)cw * ch * 2);
+	uint8_t* dst = picture->yuv.data();
+	for (int i = 0; i < 3; i++) {
+		int pw = i == 0 ? w : cw;
+		int ph = i == 0 ? h : ch;
+		const uint8_t* src = frame.plane[i];
+		for (int y = 0; y < ph; y++, dst += pw, src += frame.stride[i])
+			memcpy(dst, src, pw);
+	}
+	picture->seq = frame.seq;
+	picture->ptsMs = frame.ptsMs;
+	picture->wallUs = frame.wallUs;
+	picture->width = w;
+	picture->height = h;
+	picture->jpeg.clear();
+
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		m_latest.swap(picture);
+	}
+	m_spare = picture;
+	m_lastPtsMs = frame.ptsMs;
+	m_nPictures++;
+}
+
+bool SnapshotCache::Encode(Picture* pPicture)
+{
+	tPicFormats format = PicFormat_JPEG_10;
+	if (m_options.quality >= 85)
+		format = PicFormat_JPEG;
+	else if (m_options.quality >= 60)
+		format = PicFormat_JPEG_70;
+	else if (m_options.quality >= 40)
+		format = PicFormat_JPEG_50;
+	else if (m_options.quality >= 20)
+		format = PicFormat_JPEG_30;
+
+	// JPEG of a camera picture stays well below the I420 size
+	std::vector<uint8_t> out(pPicture->yuv.size() + 4096);
+	ImageConvertInfo info;
+	memset(&info, 0, sizeof(info));
+	info.datatype = T_IYUV;
+	info.inbuf = pPicture->yuv.data();
+	info.inbuf_len = (unsigned int)pPicture->yuv.size();
+	info.width = pPicture->width;
+	info.height = pPicture->height;
+	info.to_formats = format;
+	info.outbuf = out.data();
+	info.outbuf_len = (unsigned int)out.size();
+	if (!PLAY_ConvertToImageData(&info) || info.outbuf_len == 0 || info.outbuf_len > out.size())
+		return false;
+	out.resize(info.outbuf_len);
+	pPicture->jpeg.swap(out);
+	m_nEncodes++;
+	return true;
+}
+
+int SnapshotCache::GetJpeg(uint8_t* buf, size_t bufSize, size_t* pSize, int maxAgeMs, SnapshotInfo* pInfo)
+{
+	m_nRequests++;
+	std::shared_ptr<Picture> picture;
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		picture = m_latest;
+	}
+	if (!picture)
+		return SNAPSHOT_NONE;
+
+	int64_t ageMs = (FrameRingNowUs() - picture->wallUs) / 1000;
+	if (pInfo != NULL) {
+		pInfo->seq = picture->seq;
+		pInfo->ptsMs = picture->ptsMs;
+		pInfo->wallUs = picture->wallUs;
+		pInfo->ageMs = (int)ageMs;
+		pInfo->width = picture->width;
+		pInfo->height = picture->height;
+		pInfo->bCached = false;
+	}
+	if (maxAgeMs > 0 && ageMs > maxAgeMs)
+		return SNAPSHOT_STALE;
+
+	// Concurrent first requests wait for one encode instead of each doing it
+	std::lock_guard<std::mutex> guard(picture->jpegLock);
+	if (picture->jpeg.empty()) {
+		if (!Encode(picture.get()))
+			return SNAPSHOT_ERR_ENCODE;
+	}
+	else if (pInfo != NULL) {
+		pInfo->bCached = true;
+	}
+	if (pSize != NULL)
+		*pSize = picture->jpeg.size();
+	if (buf == NULL || bufSize < picture->jpeg.size())
+		return SNAPSHOT_ERR_SIZE;
+	memcpy(buf, picture->jpeg.data(), picture->jpeg.size());
+	return SNAPSHOT_OK;
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "LiveDecoder.h"
+
+// Snapshot cache result codes
+#define SNAPSHOT_OK				0
+#define SNAPSHOT_NONE			1	// nothing decoded yet
+#define SNAPSHOT_STALE			2	// latest picture is older than the caller allows
+#define SNAPSHOT_ERR_SIZE		3	// buffer too small, *pSize has the size needed
+#define SNAPSHOT_ERR_ENCODE		4	// PLAY_ConvertToImageData failed
+
+struct SnapshotOptions
+{
+	bool bKeyOnly = true;		// keep I frames only (every frame in key only decode)
+	int minIntervalMs = 0;		// copy the picture at most this often (stream time)
+	int quality = 70;			// JPEG quality (0, 100], mapped to the play SDK presets
+};
+
+struct SnapshotInfo
+{
+	uint64_t seq;
+	int64_t ptsMs;
+	int64_t wallUs;				// decode time, FrameRingNowUs clock
+	int ageMs;					// at the time of the request
+	int width;
+	int height;
+	bool bCached;				// JPEG was already encoded for an earlier request
+};
+
+// Keeps the latest decoded picture of a live session so snapshots are served
+// from memory instead of asking the camera. The decode thread only copies the
+// I420 planes; the JPEG is encoded on the first request for that picture and
+// reused by every later one until a newer picture arrives.
+class SnapshotCache : public FrameSink
+{
+public:
+	explicit SnapshotCache(const SnapshotOptions& options = SnapshotOptions());
+
+	virtual void OnFrame(const DecodedFrame& frame);
+
+	// JPEG of the latest picture if it is at most maxAgeMs old (maxAgeMs <= 0
+	// accepts any age). pInfo may be NULL.
+	int GetJpeg(uint8_t* buf, size_t bufSize, size_t* pSize, int maxAgeMs, SnapshotInfo* pInfo);
+
+	uint64_t Pictures() const { return m_nPictures; }	// copies taken
+	uint64_t Encodes() const { return m_nEncodes; }
+	uint64_t Requests() const { return m_nRequests; }
+
+private:
+	struct Picture
+	{
+		uint64_t seq;
+		int64_t ptsMs;
+		int64_t wallUs;
+		int width;
+		int height;
+		std::vector<uint8_t> yuv;		// packed I420
+		std::mutex jpegLock;
+		std::vector<uint8_t> jpeg;		// empty until first requested
+	};
+
+	bool Encode(Picture* pPicture);
+
+	SnapshotOptions m_options;
+	std::mutex m_lock;
+	std::shared_ptr<Picture> m_latest;
+	std::shared_ptr<Picture> m_spare;	// decode thread only
+	int64_t m_lastPtsMs;
+	std::atomic<uint64_t> m_nPictures;
+	std::atomic<uint64_t> m_nEncodes;
+	std::atomic<uint64_t> m_nRequests;
+};
@@ -0,0 +1,227 @@
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include "StreamHub.h"
+#include "FrameRing.h"
+
+StreamHub::StreamHub(int packets)
+	: m_reader(OnDavFrame, this), m_recvUs(0), m_videoCodec(0), m_width(0), m_height(0),
+	m_ring(std::max(packets, STREAM_HUB_MIN_PACKETS)), m_next(1), m_lastKey(0), m_bClosed(false), m_nWaiting(0), m_nextId(1)
+{
+	memset(&m_stats, 0, sizeof(m_stats));
+	m_stats.packets = (uint32_t)m_ring.size();
+}
+
+StreamHub::~StreamHub()
+{
+	Close();
+}
+
+void StreamHub::Input(const uint8_t* p, size_t n)
+{
+	m_recvUs = FrameRingNowUs();
+	m_reader.Input(p, n);
+}
+
+void StreamHub::OnDavFrame(const DavFrame& frame, void* pUser)
+{
+	StreamHub* self = (StreamHub*)pUser;
+	self->Publish(frame, self->m_recvUs);
+}
+
+void StreamHub::Publish(const DavFrame& frame, int64_t recvUs)
+{
+	// The packet evicted last time is reused once no subscriber holds it
+	std::shared_ptr<StreamPacket> packet = m_spare;
+	m_spare.reset();
+	if (!packet || packet.use_count() != 1)
+		packet = std::make_shared<StreamPacket>();
+	else
+		std::atomic_thread_fence(std::memory_order_acquire);
+
+	if (frame.IsKey()) {
+		if (frame.videoCodec != 0)
+			m_videoCodec = frame.videoCodec;
+		if (frame.width != 0 && frame.height != 0) {
+			m_width = frame.width;
+			m_height = frame.height;
+		}
+	}
+	packet->data.assign(frame.data, frame.data + frame.length);
+	packet->ptsMs = frame.ptsMs;
+	packet->recvUs = recvUs;
+	packet->type = frame.type;
+	packet->videoCodec = m_videoCodec;
+	packet->width = m_width;
+	packet->height = m_height;
+	packet->payloadOffset = (uint32_t)(frame.payload - frame.data);
+	packet->payloadLen = frame.payloadLen;
+
+	StreamPacketRef evicted;
+	bool bNotify;
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		if (m_bClosed)
+			return;
+		packet->seq = m_next;
+		StreamPacketRef& slot = m_ring[m_next % m_ring.size()];
+		evicted.swap(slot);
+		slot = packet;
+		if (packet->IsKey())
+			m_lastKey = m_next;
+		m_next++;
+		m_stats.published++;
+		m_stats.bytes += frame.length;
+		m_stats.lastKey = m_lastKey;
+		bNotify = m_nWaiting > 0;
+	}
+	if (bNotify)
+		m_cv.notify_all();
+	m_spare = std::const_pointer_cast<StreamPacket>(evicted);
+}
+
+void StreamHub::Close()
+{
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		m_bClosed = true;
+	}
+	m_cv.notify_all();
+}
+
+int StreamHub::Subscribe()
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	if (m_bClosed)
+		return 0;
+	std::shared_ptr<Subscriber> pSub = std::make_shared<Subscriber>();
+	memset(&pSub->stats, 0, sizeof(pSub->stats));
+	pSub->cursor = m_next;
+	pSub->bWaitKey = false;
+	pSub->bClosed = false;
+	Resync(pSub.get());
+	// Starting at an I frame already in the ring is not a loss
+	pSub->stats.dropped = 0;
+	int id = m_nextId++;
+	m_subscribers[id] = pSub;
+	m_stats.subscribers = (uint32_t)m_subscribers.size();
+	return id;
+}
+
+void StreamHub::Unsubscribe(int id)
+{
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		std::map<int, std::shared_ptr<Subscriber>>::iterator it = m_subscribers.find(id);
+		if (it == m_subscribers.end())
+			return;
+		it->second->bClosed = true;
+		m_subscribers.erase(it);
+		m_stats.subscribers = (uint32_t)m_subscribers.size();
+	}
+	m_cv.notify_all();
+}
+
+void StreamHub::Resync(Subscriber* pSub)
+{
+	uint64_t oldest = m_next > m_ring.size() ? m_next - m_ring.size() : 1;
+	uint64_t target;
+	if (m_lastKey != 0 && m_lastKey >= oldest) {
+		target = m_lastKey;
+		pSub->bWaitKey = false;
+	} else {
+		target = m_next;
+		pSub->bWaitKey = true;
+	}
+	if (target > pSub->cursor)
+		pSub->stats.dropped += target - pSub->cursor;
+	pSub->cursor = target;
+}
+
+int StreamHub::Read(int id, StreamPacketRef* pPackets, int maxCount, size_t maxBytes, int timeoutMs, int* pCount)
+{
+	if (pCount != NULL)
+		*pCount = 0;
+	if (pPackets == NULL || maxCount <= 0)
+		return STREAM_HUB_ERR_PARAM;
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(std::max(timeoutMs, 0));
+
+	std::unique_lock<std::mutex> lock(m_lock);
+	std::map<int, std::shared_ptr<Subscriber>>::iterator it = m_subscribers.find(id);
+	if (it == m_subscribers.end())
+		return STREAM_HUB_CLOSED;
+	std::shared_ptr<Subscriber> pSub = it->second;
+	for (;;) {
+		if (m_bClosed || pSub->bClosed)
+			return STREAM_HUB_CLOSED;
+		uint64_t oldest = m_next > m_ring.size() ? m_next - m_ring.size() : 1;
+		if (pSub->cursor < oldest) {
+			Resync(pSub.get());
+			pSub->stats.resyncs++;
+		}
+		// After a resync with no I frame in the ring, what comes before the
+		// next one cannot be decoded
+		while (pSub->bWaitKey && pSub->cursor < m_next) {
+			if (m_ring[pSub->cursor % m_ring.size()]->IsKey()) {
+				pSub->bWaitKey = false;
+				break;
+			}
+			pSub->cursor++;
+			pSub->stats.dropped++;
+		}
+		if (pSub->cursor < m_next)
+			break;
+		if (timeoutMs == 0 || (timeoutMs > 0 && std::chrono::steady_clock::now() >= deadline))
+			return STREAM_HUB_TIMEOUT;
+		m_nWaiting++;
+		if (timeoutMs < 0)
+			m_cv.wait(lock);
+		else
+			m_cv.wait_until(lock, deadline);
+		m_nWaiting--;
+	}
+
+	int n = 0;
+	size_t bytes = 0;
+	while (n < maxCount && pSub->cursor < m_next) {
+		const StreamPacketRef& packet = m_ring[pSub->cursor % m_ring.size()];
+		if (bytes + packet->data.size() > maxBytes) {
+			if (n == 0) {
+				pPackets[0] = packet;
+				return STREAM_HUB_ERR_SIZE;
+			}
+			break;
+		}
+		pPackets[n++] = packet;
+		bytes += packet->data.size();
+		pSub->cursor++;
+	}
+	pSub->stats.delivered += n;
+	if (pCount != NULL)
+		*pCount = n;
+	return STREAM_HUB_OK;
+}
+
+void StreamHub::GetStats(StreamHubStats* pStats)
+{
+	if (pStats == NULL)
+		return;
+	std::lock_guard<std::mutex> guard(m_lock);
+	*pStats = m_stats;
+}
+
+int StreamHub::GetSubscriberStats(int id, StreamSubscriberStats* pStats)
+{
+	if (pStats == NULL)
+		return STREAM_HUB_ERR_PARAM;
+	std::lock_guard<std::mutex> guard(m_lock);
+	std::map<int, std::shared_ptr<Subscriber>>::iterator it = m_subscribers.find(id);
+	if (it == m_subscribers.end())
+		return STREAM_HUB_CLOSED;
+	const Subscriber& sub = *it->second;
+	*pStats = sub.stats;
+	pStats->lag = (uint32_t)(m_next - std::min(sub.cursor, m_next));
+	pStats->bWaitKey = sub.bWaitKey ? 1 : 0;
+	return STREAM_HUB_OK;
+}
@@ -0,0 +1,135 @@
+#pragma once
+#include <stdint.h>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "DavFrame.h"
+
+// Stream hub result codes
+#define STREAM_HUB_OK			0
+#define STREAM_HUB_TIMEOUT		1	// nothing new within the wait
+#define STREAM_HUB_CLOSED		2	// hub stopped or subscriber removed
+#define STREAM_HUB_ERR_SIZE		3	// next frame larger than the buffer, it stays unread
+#define STREAM_HUB_ERR_PARAM	4
+
+// Streams a session can publish
+#define STREAM_HUB_MAIN			0
+#define STREAM_HUB_SUB			1
+#define STREAM_HUB_STREAMS		2
+
+#define STREAM_HUB_DEFAULT_PACKETS	512		// about 20 s of 25 fps video with audio
+#define STREAM_HUB_MIN_PACKETS		64
+#define STREAM_HUB_READ_BATCH		64		// frames per HubRead
+
+// One DAV frame as received, header to tail. Shared read only by every
+// subscriber that reads it; the buffer goes back to the hub once the last
+// reference is gone.
+struct StreamPacket
+{
+	uint64_t seq;				// hub sequence, from 1
+	int64_t ptsMs;				// unwrapped stream stamp
+	int64_t recvUs;				// data callback, FrameRingNowUs clock
+	uint8_t type;				// DAV_FRAME_*
+	uint8_t videoCodec;			// from the last I frame
+	uint16_t width;
+	uint16_t height;
+	uint32_t payloadOffset;		// elementary stream data inside data
+	uint32_t payloadLen;
+	std::vector<uint8_t> data;
+
+	bool IsVideo() const { return type == DAV_FRAME_I || type == DAV_FRAME_P; }
+	bool IsKey() const { return type == DAV_FRAME_I; }
+};
+
+typedef std::shared_ptr<const StreamPacket> StreamPacketRef;
+
+#pragma pack(push, 4)
+typedef struct StreamHubStats
+{
+	uint64_t published;			// frames
+	uint64_t bytes;
+	uint64_t lastKey;			// seq of the newest I frame, 0 before the first
+	uint32_t subscribers;
+	uint32_t packets;			// ring size
+} StreamHubStats;
+
+typedef struct StreamSubscriberStats
+{
+	uint64_t delivered;			// frames read
+	uint64_t dropped;			// frames skipped by resyncs
+	uint64_t resyncs;			// times the subscriber fell a whole ring behind
+	uint32_t lag;				// frames published but not read yet
+	uint32_t bWaitKey;			// skipping to the next I frame
+} StreamSubscriberStats;
+#pragma pack(pop)
+
+// Fans one live stream out to any number of readers, so the camera serves
+// one connection however many viewers, recorders and analytics read it. The
+// data callback of the session feeds Input; every DAV frame is copied once
+// into a pooled packet and put in a ring of the last `packets` frames.
+//
+// Subscribers share the packets by reference and each keeps its own read
+// cursor, so a slow one costs the others nothing. New subscribers start at
+// the newest I frame in the ring; one that falls a whole ring behind skips
+// to the newest I frame still in the ring, or when there is none to the
+// next one, and carries on from there.
+class StreamHub
+{
+public:
+	explicit StreamHub(int packets = STREAM_HUB_DEFAULT_PACKETS);
+	~StreamHub();
+
+	// Raw DAV data from the session's data callback, in any split
+	void Input(const uint8_t* p, size_t n);
+	void Publish(const DavFrame& frame, int64_t recvUs);
+
+	// Wakes every reader with STREAM_HUB_CLOSED; nothing is published after.
+	void Close();
+
+	// Id > 0, or 0 when the hub is closed.
+	int Subscribe();
+	void Unsubscribe(int id);
+
+	// Up to maxCount frames of at most maxBytes together, waiting up to
+	// timeoutMs (0: no wait, < 0: no limit) when there is none. *pCount gets
+	// the number of frames. STREAM_HUB_ERR_SIZE returns the frame that does
+	// not fit in pPackets[0] without reading it.
+	int Read(int id, StreamPacketRef* pPackets, int maxCount, size_t maxBytes, int timeoutMs, int* pCount);
+
+	void GetStats(StreamHubStats* pStats);
+	int GetSubscriberStats(int id, StreamSubscriberStats* pStats);
+
+private:
+	struct Subscriber
+	{
+		uint64_t cursor;		// seq of the next frame to read
+		bool bWaitKey;
+		bool bClosed;
+		StreamSubscriberStats stats;
+	};
+
+	static void OnDavFrame(const DavFrame& frame, void* pUser);
+	// Moves a subscriber that fell behind, or a new one, to an I frame.
+	void Resync(Subscriber* pSub);
+
+	DavFrameReader m_reader;	// data callback thread only
+	int64_t m_recvUs;
+	uint8_t m_videoCodec;
+	uint16_t m_width;
+	uint16_t m_height;
+	std::shared_ptr<StreamPacket> m_spare;
+
+	// m_lock guards everything below
+	std::mutex m_lock;
+	std::condition_variable m_cv;
+	std::vector<StreamPacketRef> m_ring;	// seq % size
+	uint64_t m_next;			// seq the next frame gets
+	uint64_t m_lastKey;
+	bool m_bClosed;
+	int m_nWaiting;
+	int m_nextId;
+	std::map<int, std::shared_ptr<Subscriber>> m_subscribers;
+	StreamHubStats m_stats;
+};
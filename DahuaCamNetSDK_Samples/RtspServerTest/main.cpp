@@ -0,0 +1,462 @@
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib , "ws2_32.lib")
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "RtspServer.h"
+#include "StreamHub.h"
+
+#ifndef _WIN32
+typedef int SOCKET;
+#define INVALID_SOCKET	(-1)
+#define closesocket		close
+#endif
+
+// Test harness for the RTSP server of RealPlayDll (RtspServer.cpp), without
+// a camera. A mock device writes a synthetic H.264 DAV stream into a stream
+// hub, the way the realplay data callback does, and the server publishes it
+// as rtsp://127.0.0.1:<port>/cam1/main. Client threads play it with a
+// minimal RTSP client (OPTIONS, DESCRIBE, SETUP interleaved, PLAY) and
+// check that
+//   - DESCRIBE carries the SPS and PPS of the stream,
+//   - the first frame a player gets is a key frame,
+//   - RTP sequence numbers have no gaps,
+//   - every slice reassembled from the FU-A fragments has the bytes the
+//     device wrote.
+// Then the server is stopped and started again and the stream published
+// again. Exit code 0 when everything passed.
+//
+//   RtspServerTest [clients] [seconds] [port]
+//
+// Other players can watch while it runs, e.g.
+//   ffplay -rtsp_transport tcp rtsp://127.0.0.1:<port>/cam1/main
+
+#define TEST_FPS			25
+#define TEST_KEY_INTERVAL	25
+#define TEST_STREAM			"cam1/main"
+
+static const uint8_t g_sps[] = { 0x67, 0x42, 0xC0, 0x1F, 0xDA, 0x01, 0x40, 0x16, 0xE8 };
+static const uint8_t g_pps[] = { 0x68, 0xCE, 0x3C, 0x80 };
+
+static void Put32(std::vector<uint8_t>& v, uint32_t x)
+{
+	for (int i = 0; i < 4; i++)
+		v.push_back((uint8_t)(x >> (8 * i)));
+}
+
+// Slice body: "<frame>|" then a pattern of that frame, never zero so no
+// start code appears inside
+static uint8_t PatternByte(int frame, size_t i)
+{
+	return (uint8_t)(0x11 + (frame * 7 + i) % 200);
+}
+
+static void AppendSlice(std::vector<uint8_t>& es, uint8_t header, int frame, size_t size)
+{
+	static const uint8_t startCode[] = { 0, 0, 0, 1 };
+	es.insert(es.end(), startCode, startCode + 4);
+	es.push_back(header);
+	char prefix[16];
+	int n = snprintf(prefix, sizeof(prefix), "%d|", frame);
+	es.insert(es.end(), prefix, prefix + n);
+	for (size_t i = 0; i < size; i++)
+		es.push_back(PatternByte(frame, i));
+}
+
+// One DAV frame as the camera sends it, see DavFrame.h for the layout
+static std::vector<uint8_t> MakeDavFrame(uint8_t type, uint32_t seq, uint16_t stamp, const std::vector<uint8_t>& payload)
+{
+	std::vector<uint8_t> ext;
+	if (type == DAV_FRAME_I) {
+		const uint8_t info[] = { 0x80, 0, 1920 / 8, 1080 / 8, 0x81, 0, DAV_CODEC_H264, TEST_FPS };
+		ext.assign(info, info + sizeof(info));
+	}
+	uint32_t length = (uint32_t)(DAV_HEADER_LEN + ext.size() + payload.size() + DAV_TAIL_LEN);
+	std::vector<uint8_t> frame = { 'D', 'H', 'A', 'V', type, 0, 0, 0 };
+	Put32(frame, seq);
+	Put32(frame, length);
+	Put32(frame, DavUnixToDate(time(NULL)));
+	frame.push_back((uint8_t)stamp);
+	frame.push_back((uint8_t)(stamp >> 8));
+	frame.push_back((uint8_t)ext.size());
+	uint8_t sum = 0;
+	for (uint8_t c : frame)
+		sum += c;
+	frame.push_back(sum);
+	frame.insert(frame.end(), ext.begin(), ext.end());
+	frame.insert(frame.end(), payload.begin(), payload.end());
+	const uint8_t tail[] = { 'd', 'h', 'a', 'v' };
+	frame.insert(frame.end(), tail, tail + 4);
+	Put32(frame, length);
+	return frame;
+}
+
+// Stands in for the camera: a 25 fps H.264 stream with a large key frame
+// every second, so key frames go out as many FU-A fragments
+static void RunDevice(std::shared_ptr<StreamHub> hub, std::atomic<bool>* pbRunning, std::atomic<int>* pnFrames)
+{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (int i = 0; *pbRunning; i++) {
+		bool bKey = i % TEST_KEY_INTERVAL == 0;
+		std::vector<uint8_t> es;
+		if (bKey) {
+			static const uint8_t startCode[] = { 0, 0, 0, 1 };
+			es.insert(es.end(), startCode, startCode + 4);
+			es.insert(es.end(), g_sps, g_sps + sizeof(g_sps));
+			es.insert(es.end(), startCode, startCode + 4);
+			es.insert(es.end(), g_pps, g_pps + sizeof(g_pps));
+			AppendSlice(es, 0x65, i, 60000);
+		}
+		else {
+			AppendSlice(es, 0x41, i, 300 + (i % 5) * 900);
+		}
+		std::vector<uint8_t> frame = MakeDavFrame(bKey ? DAV_FRAME_I : DAV_FRAME_P, i, (uint16_t)(i * 1000 / TEST_FPS), es);
+		hub->Input(frame.data(), frame.size());
+		(*pnFrames)++;
+		std::this_thread::sleep_until(start + std::chrono::microseconds((int64_t)(i + 1) * 1000000 / TEST_FPS));
+	}
+}
+
+struct ClientResult
+{
+	std::string error;
+	int frames = 0;
+	int slices = 0;
+	int badSlices = 0;
+	int seqGaps = 0;
+	bool bKeyFirst = false;
+	uint64_t bytes = 0;
+};
+
+class TestClient
+{
+public:
+	TestClient() : m_s(INVALID_SOCKET), m_cseq(0) {}
+	~TestClient()
+	{
+		if (m_s != INVALID_SOCKET)
+			closesocket(m_s);
+	}
+
+	bool Connect(int port)
+	{
+		m_s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+		if (m_s == INVALID_SOCKET)
+			return false;
+#ifdef _WIN32
+		DWORD timeout = 5000;
+#else
+		timeval timeout = { 5, 0 };
+#endif
+		setsockopt(m_s, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+		sockaddr_in addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons((uint16_t)port);
+		inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+		return 0 == connect(m_s, (const sockaddr*)&addr, sizeof(addr));
+	}
+
+	// Status code of the response, 0 when the connection failed
+	int Request(const char* method, const std::string& url, const std::string& headers, std::string* pHeaders, std::string* pBody)
+	{
+		char line[64];
+		snprintf(line, sizeof(line), "CSeq: %d\r\n", ++m_cseq);
+		std::string request = std::string(method) + " " + url + " RTSP/1.0\r\n" + line + headers + "\r\n";
+		if (send(m_s, request.data(), (int)request.size(), 0) != (int)request.size())
+			return 0;
+		size_t end;
+		while ((end = m_in.find("\r\n\r\n")) == std::string::npos) {
+			if (!Fill())
+				return 0;
+		}
+		std::string head = m_in.substr(0, end + 4);
+		m_in.erase(0, end + 4);
+		size_t length = atoi(Header(head, "Content-Length").c_str());
+		while (m_in.size() < length) {
+			if (!Fill())
+				return 0;
+		}
+		if (pBody != NULL)
+			*pBody = m_in.substr(0, length);
+		m_in.erase(0, length);
+		if (pHeaders != NULL)
+			*pHeaders = head;
+		return head.compare(0, 9, "RTSP/1.0 ") == 0 ? atoi(head.c_str() + 9) : 0;
+	}
+
+	// Next interleaved packet; false when the connection failed
+	bool ReadPacket(int* pChannel, std::string* pPacket)
+	{
+		while (m_in.size() < 4) {
+			if (!Fill())
+				return false;
+		}
+		if (m_in[0] != '$')
+			return false;
+		*pChannel = (uint8_t)m_in[1];
+		size_t length = ((size_t)(uint8_t)m_in[2] << 8) | (uint8_t)m_in[3];
+		while (m_in.size() < 4 + length) {
+			if (!Fill())
+				return false;
+		}
+		pPacket->assign(m_in, 4, length);
+		m_in.erase(0, 4 + length);
+		return true;
+	}
+
+	static std::string Header(const std::string& head, const char* name)
+	{
+		std::string key = std::string("\r\n") + name + ":";
+		size_t pos = head.find(key);
+		if (pos == std::string::npos)
+			return "";
+		pos += key.size();
+		while (pos < head.size() && head[pos] == ' ')
+			pos++;
+		return head.substr(pos, head.find("\r\n", pos) - pos);
+	}
+
+private:
+	bool Fill()
+	{
+		char buf[16384];
+		int n = recv(m_s, buf, sizeof(buf), 0);
+		if (n <= 0)
+			return false;
+		m_in.append(buf, n);
+		return true;
+	}
+
+	SOCKET m_s;
+	int m_cseq;
+	std::string m_in;
+};
+
+static std::string Base64(const uint8_t* p, size_t n)
+{
+	static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+	std::string out;
+	for (size_t i = 0; i < n; i += 3) {
+		uint32_t v = (uint32_t)p[i] << 16;
+		if (i + 1 < n)
+			v |= (uint32_t)p[i + 1] << 8;
+		if (i + 2 < n)
+			v |= p[i + 2];
+		out += table[(v >> 18) & 63];
+		out += table[(v >> 12) & 63];
+		out += i + 1 < n ? table[(v >> 6) & 63] : '=';
+		out += i + 2 < n ? table[v & 63] : '=';
+	}
+	return out;
+}
+
+static bool CheckSlice(const std::string& nal)
+{
+	size_t bar = nal.find('|');
+	if (bar == std::string::npos || bar < 2 || bar + 1 == nal.size())
+		return false;
+	int frame = atoi(nal.c_str() + 1);
+	for (size_t i = bar + 1; i < nal.size(); i++) {
+		if ((uint8_t)nal[i] != PatternByte(frame, i - bar - 1))
+			return false;
+	}
+	return true;
+}
+
+static void RunClient(int port, int seconds, ClientResult* pResult)
+{
+	std::string url = "rtsp://127.0.0.1:" + std::to_string(port) + "/" TEST_STREAM;
+	TestClient client;
+	if (!client.Connect(port)) {
+		pResult->error = "connect failed";
+		return;
+	}
+	std::string head, sdp;
+	if (client.Request("OPTIONS", url, "", &head, NULL) != 200) {
+		pResult->error = "OPTIONS failed";
+		return;
+	}
+	// 503 until the device sent its first key frame
+	int status = 0;
+	for (int i = 0; i < 50; i++) {
+		status = client.Request("DESCRIBE", url, "Accept: application/sdp\r\n", &head, &sdp);
+		if (status != 503)
+			break;
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	}
+	if (status != 200) {
+		pResult->error = "DESCRIBE answered " + std::to_string(status);
+		return;
+	}
+	if (sdp.find("sprop-parameter-sets=" + Base64(g_sps, sizeof(g_sps)) + "," + Base64(g_pps, sizeof(g_pps))) == std::string::npos) {
+		pResult->error = "SDP without the stream's SPS/PPS";
+		return;
+	}
+	std::string base = TestClient::Header(head, "Content-Base");
+	if (client.Request("SETUP", base + "track0", "Transport: RTP/AVP/TCP;unicast;interleaved=2-3\r\n", &head, NULL) != 200
+		|| TestClient::Header(head, "Transport").find("interleaved=2-3") == std::string::npos) {
+		pResult->error = "SETUP failed";
+		return;
+	}
+	std::string session = TestClient::Header(head, "Session");
+	session = session.substr(0, session.find(';'));
+	if (client.Request("PLAY", url, "Session: " + session + "\r\nRange: npt=0.000-\r\n", &head, NULL) != 200) {
+		pResult->error = "PLAY failed";
+		return;
+	}
+
+	std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now() + std::chrono::seconds(seconds);
+	int lastSeq = -1;
+	std::string fu;
+	bool bInFu = false;
+	std::vector<std::string> nals;
+	while (std::chrono::steady_clock::now() < end) {
+		int channel;
+		std::string packet;
+		if (!client.ReadPacket(&channel, &packet)) {
+			pResult->error = "stream broke off";
+			return;
+		}
+		pResult->bytes += packet.size() + 4;
+		if (channel != 2 || packet.size() < 13) {
+			pResult->error = "unexpected packet on channel " + std::to_string(channel);
+			return;
+		}
+		int seq = ((uint8_t)packet[2] << 8) | (uint8_t)packet[3];
+		if (lastSeq >= 0 && seq != ((lastSeq + 1) & 0xFFFF)) {
+			pResult->seqGaps++;
+			bInFu = false;
+			nals.clear();
+		}
+		lastSeq = seq;
+		bool bMarker = ((uint8_t)packet[1] & 0x80) != 0;
+		std::string payload = packet.substr(12);
+		uint8_t nalType = (uint8_t)payload[0] & 0x1F;
+		if (nalType == 28 && payload.size() > 2) {
+			uint8_t fuHeader = (uint8_t)payload[1];
+			if (fuHeader & 0x80) {
+				fu.assign(1, (char)(((uint8_t)payload[0] & 0xE0) | (fuHeader & 0x1F)));
+				bInFu = true;
+			}
+			if (bInFu)
+				fu.append(payload, 2, std::string::npos);
+			if ((fuHeader & 0x40) && bInFu) {
+				nals.push_back(fu);
+				bInFu = false;
+			}
+		}
+		else {
+			nals.push_back(payload);
+		}
+		if (!bMarker)
+			continue;
+
+		if (pResult->frames == 0)
+			pResult->bKeyFirst = !nals.empty() && ((uint8_t)nals[0][0] & 0x1F) == 7;
+		for (const std::string& nal : nals) {
+			uint8_t type = (uint8_t)nal[0] & 0x1F;
+			if (type == 1 || type == 5) {
+				pResult->slices++;
+				if (!CheckSlice(nal))
+					pResult->badSlices++;
+			}
+		}
+		pResult->frames++;
+		nals.clear();
+	}
+	client.Request("TEARDOWN", url, "Session: " + session + "\r\n", NULL, NULL);
+}
+
+int main(int argc, char* argv[])
+{
+	int clients = argc > 1 ? atoi(argv[1]) : 20;
+	int seconds = argc > 2 ? atoi(argv[2]) : 5;
+	int port = argc > 3 ? atoi(argv[3]) : RTSP_DEFAULT_PORT;
+	if (clients < 1 || seconds < 1) {
+		printf("usage: %s [clients] [seconds] [port]\n", argv[0]);
+		return 1;
+	}
+#ifdef _WIN32
+	WSADATA wsa;
+	WSAStartup(MAKEWORD(2, 2), &wsa);
+#endif
+
+	RtspServer& server = RtspServer::Instance();
+	if (server.Start("127.0.0.1", port) != RTSP_OK) {
+		printf("cannot listen on 127.0.0.1:%d\n", port);
+		return 1;
+	}
+	std::shared_ptr<StreamHub> hub = std::make_shared<StreamHub>(STREAM_HUB_DEFAULT_PACKETS);
+	int ret = server.Publish(TEST_STREAM, hub);
+	if (ret != RTSP_OK) {
+		printf("Publish failed: %d\n", ret);
+		return 1;
+	}
+	printf("serving rtsp://127.0.0.1:%d/%s to %d clients for %d s\n", port, TEST_STREAM, clients, seconds);
+
+	std::atomic<bool> bRunning(true);
+	std::atomic<int> nDeviceFrames(0);
+	std::thread device(RunDevice, hub, &bRunning, &nDeviceFrames);
+	std::vector<ClientResult> results(clients);
+	std::vector<std::thread> threads;
+	for (int i = 0; i < clients; i++)
+		threads.push_back(std::thread(RunClient, port, seconds, &results[i]));
+	for (std::thread& thread : threads)
+		thread.join();
+
+	RtspServerStats stats;
+	server.GetStats(&stats);
+	bRunning = false;
+	device.join();
+
+	int failed = 0;
+	for (int i = 0; i < clients; i++) {
+		const ClientResult& r = results[i];
+		bool bOk = r.error.empty() && r.bKeyFirst && r.frames > 0 && r.badSlices == 0 && r.seqGaps == 0;
+		if (!bOk) {
+			failed++;
+			printf("client %d: %s, %d frames, key first %d, %d of %d slices bad, %d sequence gaps\n", i,
+				r.error.empty() ? "failed" : r.error.c_str(), r.frames, r.bKeyFirst ? 1 : 0, r.badSlices, r.slices, r.seqGaps);
+		}
+	}
+	uint64_t frames = 0, bytes = 0;
+	for (const ClientResult& r : results) {
+		frames += r.frames;
+		bytes += r.bytes;
+	}
+	printf("device %d frames; clients %llu frames, %llu bytes; server %llu connections, %llu frames, %llu RTP packets, %llu bytes, %llu dropped\n",
+		nDeviceFrames.load(), (unsigned long long)frames, (unsigned long long)bytes,
+		(unsigned long long)stats.accepted, (unsigned long long)stats.frames, (unsigned long long)stats.packets,
+		(unsigned long long)stats.bytesSent, (unsigned long long)stats.dropped);
+
+	// A stopped server forgets its streams, so they can be published again
+	server.Stop();
+	if (server.Start("127.0.0.1", port) != RTSP_OK || server.Publish(TEST_STREAM, hub) != RTSP_OK) {
+		printf("restart failed\n");
+		failed++;
+	}
+	server.Stop();
+	hub->Close();
+
+	printf("%s: %d of %d clients failed\n", failed == 0 ? "PASS" : "FAIL", failed, clients);
+#ifdef _WIN32
+	WSACleanup();
+#endif
+	return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,205 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "BatchSink.h"
+
+BatchSink::BatchSink(BatchTarget* pTarget, const BatchSinkOptions& options)
+	: m_pTarget(pTarget), m_options(options), m_bSpilling(false), m_bRunning(false)
+{
+	m_options.batchSize = std::max(1, m_options.batchSize);
+	m_options.maxDelayMs = std::max(0, m_options.maxDelayMs);
+	m_options.maxPending = std::max(m_options.batchSize, m_options.maxPending);
+	m_options.retryMs = std::max(10, m_options.retryMs);
+	memset(&m_stats, 0, sizeof(m_stats));
+}
+
+BatchSink::~BatchSink()
+{
+	Stop();
+}
+
+bool BatchSink::Start()
+{
+	if (m_thread.joinable())
+		return true;
+	if (!m_options.spillDir.empty()) {
+		if (!m_spill.Open(m_options.spillDir.c_str()))
+			return false;
+		// A previous run's backlog goes out before anything new
+		if (m_spill.Count() > 0) {
+			printf("BatchSink: %llu spilled records left from the last run\n", (unsigned long long)m_spill.Count());
+			m_bSpilling = true;
+		}
+	}
+	m_bRunning = true;
+	m_thread = std::thread(&BatchSink::Run, this);
+	return true;
+}
+
+void BatchSink::Stop()
+{
+	if (m_thread.joinable()) {
+		{
+			std::lock_guard<std::mutex> guard(m_lock);
+			m_bRunning = false;
+			m_cv.notify_all();
+		}
+		m_thread.join();
+	}
+	m_spill.Close();
+	m_bSpilling = false;
+}
+
+// Runs on the engine's dispatcher thread: never waits for the target. The
+// spill is appended under m_lock so the writer sees it and the memory queue
+// change together.
+void BatchSink::OnTrafficEvents(const TrafficRecord* pRecords, int nCount)
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	bool bWasEmpty = m_pending.empty();
+	int nMemory = 0;
+	if (!m_bSpilling)
+		nMemory = std::min(nCount, std::max(0, m_options.maxPending - (int)m_pending.size()));
+	m_pending.insert(m_pending.end(), pRecords, pRecords + nMemory);
+	m_arrival.insert(m_arrival.end(), nMemory, std::chrono::steady_clock::now());
+	int nRest = nCount - nMemory;
+	if (nRest > 0) {
+		if (m_spill.IsOpen() && m_spill.Append(pRecords + nMemory, nRest)) {
+			m_bSpilling = true;
+			m_stats.spilled += nRest;
+		} else {
+			m_stats.dropped += nRest;
+		}
+	}
+	m_stats.accepted += nCount;
+	if (bWasEmpty || nRest > 0 || (int)m_pending.size() >= m_options.batchSize)
+		m_cv.notify_one();
+}
+
+bool BatchSink::TakeBatch(bool bMemoryOnly)
+{
+	m_batch.clear();
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		if (!m_pending.empty()) {
+			int n = std::min((int)m_pending.size(), m_options.batchSize);
+			m_batch.assign(m_pending.begin(), m_pending.begin() + n);
+			m_pending.erase(m_pending.begin(), m_pending.begin() + n);
+			m_arrival.erase(m_arrival.begin(), m_arrival.begin() + n);
+			return true;
+		}
+	}
+	if (bMemoryOnly || !m_spill.IsOpen())
+		return false;
+
+	// Memory is empty, so whatever is on disk is the oldest left
+	m_batch.resize(m_options.batchSize);
+	int n = m_spill.Read(m_batch.data(), m_options.batchSize);
+	m_batch.resize(n);
+	std::lock_guard<std::mutex> guard(m_lock);
+	m_stats.unspilled += n;
+	if (m_spill.Count() == 0)
+		m_bSpilling = false;
+	return n > 0;
+}
+
+bool BatchSink::WriteBatch()
+{
+	auto start = std::chrono::steady_clock::now();
+	bool bOk = m_pTarget->Write(m_batch.data(), (int)m_batch.size());
+	double writeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	std::lock_guard<std::mutex> guard(m_lock);
+	if (!bOk) {
+		m_stats.failedWrites++;
+		return false;
+	}
+	uint32_t n = (uint32_t)m_batch.size();
+	double lagMs = (TrafficNowUs() - m_batch.front().recvUs) / 1000.0;
+	m_stats.written += n;
+	m_stats.batches++;
+	m_stats.lastBatch = n;
+	m_stats.maxBatch = std::max(m_stats.maxBatch, n);
+	m_stats.avgBatch = (double)m_stats.written / m_stats.batches;
+	m_stats.lagMs = lagMs;
+	m_stats.maxLagMs = std::max(m_stats.maxLagMs, lagMs);
+	m_stats.writeMs = writeMs;
+	if (m_stats.batches == 1) {
+		m_stats.avgLagMs = lagMs;
+		m_stats.avgWriteMs = writeMs;
+	} else {
+		m_stats.avgLagMs += (lagMs - m_stats.avgLagMs) * BATCH_AVG_WEIGHT;
+		m_stats.avgWriteMs += (writeMs - m_stats.avgWriteMs) * BATCH_AVG_WEIGHT;
+	}
+	m_batch.clear();
+	return true;
+}
+
+// The batch could not be written before Stop; it goes after what is on
+// disk already
+void BatchSink::SpillBatch()
+{
+	if (m_batch.empty())
+		return;
+	std::lock_guard<std::mutex> guard(m_lock);
+	if (m_spill.IsOpen() && m_spill.Append(m_batch.data(), (int)m_batch.size()))
+		m_stats.spilled += m_batch.size();
+	else
+		m_stats.dropped += m_batch.size();
+	m_batch.clear();
+}
+
+void BatchSink::Run()
+{
+	for (;;) {
+		{
+			// Due: a full batch, the oldest record at maxDelayMs, memory
+			// held back behind the spill, or spilled records to catch up on
+			std::unique_lock<std::mutex> lock(m_lock);
+			while (m_bRunning) {
+				if ((int)m_pending.size() >= m_options.batchSize || (!m_pending.empty() && m_bSpilling))
+					break;
+				if (!m_pending.empty()) {
+					std::chrono::steady_clock::time_point due = m_arrival.front() + std::chrono::milliseconds(m_options.maxDelayMs);
+					if (std::chrono::steady_clock::now() >= due)
+						break;
+					m_cv.wait_until(lock, due);
+				} else if (m_spill.IsOpen() && m_spill.Count() > 0) {
+					break;
+				} else {
+					m_cv.wait(lock);
+				}
+			}
+			if (!m_bRunning)
+				break;
+		}
+		if (!TakeBatch(false))
+			continue;
+		while (!WriteBatch()) {
+			std::unique_lock<std::mutex> lock(m_lock);
+			if (m_cv.wait_for(lock, std::chrono::milliseconds(m_options.retryMs), [this] { return !m_bRunning; }))
+				break;
+		}
+		if (!m_batch.empty())
+			break;
+	}
+
+	// Stopping: one more attempt for each batch in memory, then whatever is
+	// left goes to disk
+	bool bFailed = false;
+	if (!m_batch.empty())
+		bFailed = !WriteBatch();
+	while (!bFailed && TakeBatch(true))
+		bFailed = !WriteBatch();
+	SpillBatch();
+	while (TakeBatch(true))
+		SpillBatch();
+}
+
+void BatchSink::GetStats(BatchSinkStats* pStats)
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	*pStats = m_stats;
+	pStats->pending = m_pending.size();
+	pStats->spillPending = m_spill.IsOpen() ? m_spill.Count() : 0;
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include <stdint.h>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "BatchTarget.h"
+#include "SpillQueue.h"
+#include "TrafficEventEngine.h"
+
+#define BATCH_AVG_WEIGHT		0.1	// moving averages in BatchSinkStats
+
+typedef struct BatchSinkOptions
+{
+	int batchSize = 500;			// records per write
+	int maxDelayMs = 1000;			// a partial batch is written once its oldest record waited this long
+	int maxPending = 50000;			// records held in memory before spilling to disk
+	int retryMs = 1000;				// wait after a failed write
+	std::string spillDir;			// empty: records past maxPending are dropped
+} BatchSinkOptions;
+
+#pragma pack(push, 4)
+typedef struct BatchSinkStats
+{
+	uint64_t accepted;			// records handed over by the engine
+	uint64_t written;
+	uint64_t batches;
+	uint64_t failedWrites;		// batches the target refused; each is retried
+	uint64_t spilled;			// records sent to the disk queue
+	uint64_t unspilled;			// records read back from it
+	uint64_t dropped;			// memory full and no spill directory, or the spill failed
+	uint64_t pending;			// in memory now
+	uint64_t spillPending;		// on disk now
+	uint32_t lastBatch;
+	uint32_t maxBatch;
+	double avgBatch;
+	double lagMs;				// receive -> written, oldest record of the last batch
+	double maxLagMs;
+	double avgLagMs;			// moving average over batches
+	double writeMs;				// Write call of the last batch
+	double avgWriteMs;
+} BatchSinkStats;
+#pragma pack(pop)
+
+// Collects records from the engine and writes them to a BatchTarget in
+// batches of up to batchSize, or sooner once the oldest has waited
+// maxDelayMs, on a thread of its own. While the target is slow or down
+// records pile up in memory up to maxPending; past that they go to a
+// SpillQueue on disk and keep going there, so they stay in order, until
+// the writer has caught up with it.
+//
+// Records are written at least once: a batch the target refused is offered
+// again, and Stop leaves what could not be written in the spill directory
+// for the next run to pick up, after anything it writes first. Use seq to
+// tell repeats.
+class BatchSink : public TrafficSink
+{
+public:
+	// Takes ownership of pTarget.
+	BatchSink(BatchTarget* pTarget, const BatchSinkOptions& options);
+	~BatchSink();
+
+	// False when the spill directory cannot be used.
+	bool Start();
+	// Writes what is in memory, one attempt per batch, and spills the rest.
+	void Stop();
+
+	void OnTrafficEvents(const TrafficRecord* pRecords, int nCount) override;
+
+	void GetStats(BatchSinkStats* pStats);
+
+private:
+	void Run();
+	// Fills m_batch from memory, else from the spill; false when both are empty.
+	bool TakeBatch(bool bMemoryOnly);
+	bool WriteBatch();
+	void SpillBatch();
+
+	std::unique_ptr<BatchTarget> m_pTarget;
+	BatchSinkOptions m_options;
+	SpillQueue m_spill;
+
+	std::mutex m_lock;
+	std::condition_variable m_cv;
+	std::deque<TrafficRecord> m_pending;
+	// Steady clock arrival of each record in m_pending, for maxDelayMs;
+	// recvUs is wall clock and jumps with the system time
+	std::deque<std::chrono::steady_clock::time_point> m_arrival;
+	bool m_bSpilling;				// new records go to the spill until it is drained
+	bool m_bRunning;
+	alignas(8) BatchSinkStats m_stats;	// packed for export; aligned for the doubles
+
+	// Writer thread only
+	std::vector<TrafficRecord> m_batch;
+	std::thread m_thread;
+};
@@ -0,0 +1,223 @@
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <stdlib.h>
+#include <string.h>
+#include "BatchTarget.h"
+
+#pragma comment(lib , "ws2_32.lib")
+
+BatchTarget* CreateBatchTarget(int type, const char* target)
+{
+	if (target == NULL || target[0] == '\0')
+		return NULL;
+	if (BATCH_TARGET_CSV == type || BATCH_TARGET_SQL == type)
+		return new FileBatchTarget(target, BATCH_TARGET_SQL == type);
+	if (BATCH_TARGET_SOCKET == type) {
+		const char* colon = strrchr(target, ':');
+		if (colon == NULL || atoi(colon + 1) <= 0)
+			return NULL;
+		std::string host(target, colon - target);
+		return new SocketBatchTarget(host.c_str(), atoi(colon + 1));
+	}
+	return NULL;
+}
+
+FileBatchTarget::FileBatchTarget(const char* path, bool bSql)
+	: m_path(path), m_bSql(bSql), m_fp(NULL)
+{
+}
+
+FileBatchTarget::~FileBatchTarget()
+{
+	if (m_fp != NULL)
+		fclose(m_fp);
+}
+
+// Text fields go out as they came from the device; only what would break
+// the format is replaced. In SQL a backslash is doubled as well: MySQL reads
+// it as an escape, and 0x5C is also a GBK trail byte, so a plate or brand
+// ending in such a character would otherwise escape the closing quote.
+static void AppendText(std::string& buf, const char* text, size_t size, char quote, bool bBackslash)
+{
+	for (size_t i = 0; i < size && text[i] != '\0'; i++) {
+		char c = text[i];
+		if (c == quote || (c == '\\' && bBackslash))
+			buf += c;
+		else if (c == '\r' || c == '\n')
+			c = ' ';
+		buf += c;
+	}
+}
+
+static void AppendField(std::string& buf, const char* text, size_t size, char quote)
+{
+	buf += quote;
+	AppendText(buf, text, size, quote, quote == '\'');
+	buf += quote;
+}
+
+void FileBatchTarget::FormatCsv(const TrafficRecord* pRecords, int nCount)
+{
+	char num[256];
+	for (int i = 0; i < nCount; i++) {
+		const TrafficRecord& r = pRecords[i];
+		snprintf(num, sizeof(num), "%llu,%lld,%lld,%d,%d,%u,%u,%d,%d,%u,%u,%s,%s,%u,",
+			(unsigned long long)r.seq, (long long)r.eventMs, (long long)r.recvUs, r.camera, r.channel,
+			r.eventId, r.groupId, r.lane, r.speed, r.action, r.triggerType,
+			TrafficColorName(r.plateColor), TrafficColorName(r.vehicleColor), r.listHit);
+		m_buf += num;
+		AppendField(m_buf, r.plate, sizeof(r.plate), '"');
+		m_buf += ',';
+		AppendField(m_buf, r.plateType, sizeof(r.plateType), '"');
+		m_buf += ',';
+		AppendField(m_buf, r.vehicleType, sizeof(r.vehicleType), '"');
+		m_buf += ',';
+		AppendField(m_buf, r.brand, sizeof(r.brand), '"');
+		m_buf += ',';
+		AppendField(m_buf, r.picture, sizeof(r.picture), '"');
+		m_buf += '\n';
+	}
+}
+
+void FileBatchTarget::FormatSql(const TrafficRecord* pRecords, int nCount)
+{
+	char num[256];
+	m_buf += "INSERT INTO traffic (seq, event_ms, recv_us, camera, channel, event_id, group_id, lane, speed, "
+		"action, trigger_type, plate_color, vehicle_color, list_hit, plate, plate_type, vehicle_type, brand, picture) VALUES\n";
+	for (int i = 0; i < nCount; i++) {
+		const TrafficRecord& r = pRecords[i];
+		snprintf(num, sizeof(num), "(%llu, %lld, %lld, %d, %d, %u, %u, %d, %d, %u, %u, '%s', '%s', %u, ",
+			(unsigned long long)r.seq, (long long)r.eventMs, (long long)r.recvUs, r.camera, r.channel,
+			r.eventId, r.groupId, r.lane, r.speed, r.action, r.triggerType,
+			TrafficColorName(r.plateColor), TrafficColorName(r.vehicleColor), r.listHit);
+		m_buf += num;
+		AppendField(m_buf, r.plate, sizeof(r.plate), '\'');
+		m_buf += ", ";
+		AppendField(m_buf, r.plateType, sizeof(r.plateType), '\'');
+		m_buf += ", ";
+		AppendField(m_buf, r.vehicleType, sizeof(r.vehicleType), '\'');
+		m_buf += ", ";
+		AppendField(m_buf, r.brand, sizeof(r.brand), '\'');
+		m_buf += ", ";
+		AppendField(m_buf, r.picture, sizeof(r.picture), '\'');
+		m_buf += i + 1 < nCount ? "),\n" : ");\n";
+	}
+}
+
+bool FileBatchTarget::Write(const TrafficRecord* pRecords, int nCount)
+{
+	if (m_fp == NULL) {
+		m_fp = fopen(m_path.c_str(), "ab");
+		if (m_fp == NULL)
+			return false;
+	}
+	m_buf.clear();
+	if (m_bSql)
+		FormatSql(pRecords, nCount);
+	else
+		FormatCsv(pRecords, nCount);
+	if (fwrite(m_buf.data(), 1, m_buf.size(), m_fp) != m_buf.size() || fflush(m_fp) != 0) {
+		// A short write leaves a partial batch behind; reopen so the retry
+		// at least starts at the end of it
+		fclose(m_fp);
+		m_fp = NULL;
+		return false;
+	}
+	return true;
+}
+
+SocketBatchTarget::SocketBatchTarget(const char* host, int port)
+	: m_host(host), m_port(port), m_socket(INVALID_SOCKET), m_bWsa(false)
+{
+	m_name = m_host + ":" + std::to_string(port);
+	WSADATA wsa;
+	m_bWsa = 0 == WSAStartup(MAKEWORD(2, 2), &wsa);
+}
+
+SocketBatchTarget::~SocketBatchTarget()
+{
+	Disconnect();
+	if (m_bWsa)
+		WSACleanup();
+}
+
+bool SocketBatchTarget::Connect()
+{
+	if (m_socket != INVALID_SOCKET)
+		return true;
+	addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	hints.ai_protocol = IPPROTO_TCP;
+	addrinfo* pList = NULL;
+	if (0 != getaddrinfo(m_host.c_str(), std::to_string(m_port).c_str(), &hints, &pList))
+		return false;
+	for (addrinfo* p = pList; p != NULL && m_socket == INVALID_SOCKET; p = p->ai_next) {
+		SOCKET s = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
+		if (s == INVALID_SOCKET)
+			continue;
+		if (0 != connect(s, p->ai_addr, (int)p->ai_addrlen)) {
+			closesocket(s);
+			continue;
+		}
+		DWORD timeout = BATCH_SOCKET_TIMEOUT_MS;
+		setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, (const char*)&timeout, sizeof(timeout));
+		setsockopt(s, SOL_SOCKET, SO_SNDTIMEO, (const char*)&timeout, sizeof(timeout));
+		int noDelay = 1;
+		setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*)&noDelay, sizeof(noDelay));
+		m_socket = (uintptr_t)s;
+	}
+	freeaddrinfo(pList);
+	return m_socket != INVALID_SOCKET;
+}
+
+void SocketBatchTarget::Disconnect()
+{
+	if (m_socket != INVALID_SOCKET) {
+		closesocket((SOCKET)m_socket);
+		m_socket = INVALID_SOCKET;
+	}
+}
+
+static bool SendAll(SOCKET s, const char* p, size_t n)
+{
+	while (n > 0) {
+		int sent = send(s, p, (int)(n < 0x40000000 ? n : 0x40000000), 0);
+		if (sent <= 0)
+			return false;
+		p += sent;
+		n -= sent;
+	}
+	return true;
+}
+
+bool SocketBatchTarget::Write(const TrafficRecord* pRecords, int nCount)
+{
+	if (!m_bWsa || !Connect())
+		return false;
+	SOCKET s = (SOCKET)m_socket;
+	BatchWireHeader header;
+	header.magic = BATCH_WIRE_MAGIC;
+	header.count = (uint32_t)nCount;
+	header.recordSize = sizeof(TrafficRecord);
+	header.reserved = 0;
+	header.firstSeq = nCount > 0 ? pRecords[0].seq : 0;
+	uint32_t ack = 0;
+	int got = 0;
+	if (SendAll(s, (const char*)&header, sizeof(header))
+		&& SendAll(s, (const char*)pRecords, sizeof(TrafficRecord) * (size_t)nCount)) {
+		while (got < (int)sizeof(ack)) {
+			int n = recv(s, (char*)&ack + got, sizeof(ack) - got, 0);
+			if (n <= 0)
+				break;
+			got += n;
+		}
+	}
+	if (got != (int)sizeof(ack) || ack != (uint32_t)nCount) {
+		// The stream position is unknown now; start over on a new connection
+		Disconnect();
+		return false;
+	}
+	return true;
+}
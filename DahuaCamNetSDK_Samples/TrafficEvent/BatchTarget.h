@@ -0,0 +1,87 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include "TrafficRecord.h"
+
+// Where BatchSink writes. Each Write is one bulk operation for the whole
+// batch; false means nothing of it can be counted as stored and the batch
+// will be offered again.
+#define BATCH_TARGET_CSV		0	// one line per record, appended to a file
+#define BATCH_TARGET_SQL		1	// one multi row INSERT per batch, appended to a .sql file
+#define BATCH_TARGET_SOCKET		2	// binary batches to a local TCP listener, "host:port"
+
+class BatchTarget
+{
+public:
+	virtual ~BatchTarget() {}
+	virtual bool Write(const TrafficRecord* pRecords, int nCount) = 0;
+	virtual const char* Describe() const = 0;
+};
+
+// NULL for an unknown type or an unusable target string.
+BatchTarget* CreateBatchTarget(int type, const char* target);
+
+// CSV and SQL text in one buffer per batch, then a single fwrite and flush.
+// The SQL form is what a bulk load of the traffic table would run; the
+// stand-in for the database until a real connection is plugged in. Text is
+// written byte for byte with quotes and backslashes doubled, so the file is
+// meant to be read with a byte oriented client character set (mysql
+// --default-character-set=binary) into GBK columns.
+class FileBatchTarget : public BatchTarget
+{
+public:
+	FileBatchTarget(const char* path, bool bSql);
+	~FileBatchTarget();
+
+	bool Write(const TrafficRecord* pRecords, int nCount) override;
+	const char* Describe() const override { return m_path.c_str(); }
+
+private:
+	void FormatCsv(const TrafficRecord* pRecords, int nCount);
+	void FormatSql(const TrafficRecord* pRecords, int nCount);
+
+	std::string m_path;
+	bool m_bSql;
+	FILE* m_fp;
+	std::string m_buf;
+};
+
+// Wire format of BATCH_TARGET_SOCKET, little endian: the header, then
+// count records of recordSize bytes. The listener answers with the count
+// as a uint32 once the batch is stored; a batch is written only when that
+// answer arrives.
+#define BATCH_WIRE_MAGIC		0x31425254	// "TRB1"
+
+#pragma pack(push, 4)
+typedef struct BatchWireHeader
+{
+	uint32_t magic;
+	uint32_t count;
+	uint32_t recordSize;			// sizeof(TrafficRecord)
+	uint32_t reserved;
+	uint64_t firstSeq;
+} BatchWireHeader;
+#pragma pack(pop)
+
+#define BATCH_SOCKET_TIMEOUT_MS	5000
+
+class SocketBatchTarget : public BatchTarget
+{
+public:
+	SocketBatchTarget(const char* host, int port);
+	~SocketBatchTarget();
+
+	bool Write(const TrafficRecord* pRecords, int nCount) override;
+	const char* Describe() const override { return m_name.c_str(); }
+
+private:
+	bool Connect();
+	void Disconnect();
+
+	std::string m_host;
+	int m_port;
+	std::string m_name;
+	uintptr_t m_socket;				// SOCKET, INVALID_SOCKET when not connected
+	bool m_bWsa;
+};
@@ -0,0 +1,524 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include "EventLog.h"
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+static uint64_t AlignUp(uint64_t value)
+{
+	return (value + EVENT_LOG_ALIGN - 1) / EVENT_LOG_ALIGN * EVENT_LOG_ALIGN;
+}
+
+EventLogSegment::EventLogSegment()
+	: m_segment(0), m_base(NULL), m_size(0), m_pHeader(NULL)
+#ifdef _WIN32
+	, m_hFile(INVALID_HANDLE_VALUE), m_hMap(NULL)
+#else
+	, m_fd(-1)
+#endif
+{
+}
+
+EventLogSegment::~EventLogSegment()
+{
+#ifdef _WIN32
+	if (m_base != NULL)
+		UnmapViewOfFile(m_base);
+	if (m_hMap != NULL)
+		CloseHandle(m_hMap);
+	if (m_hFile != INVALID_HANDLE_VALUE)
+		CloseHandle(m_hFile);
+#else
+	if (m_base != NULL)
+		munmap(m_base, m_size);
+	if (m_fd >= 0)
+		close(m_fd);
+#endif
+}
+
+std::string EventLogSegment::PathOf(const std::string& dir, uint64_t segment)
+{
+	char name[64];
+	snprintf(name, sizeof(name), "events_%08llu.trl", (unsigned long long)segment);
+	return (fs::path(dir) / name).string();
+}
+
+std::vector<uint64_t> EventLogSegment::List(const std::string& dir)
+{
+	std::vector<uint64_t> segments;
+	std::error_code ec;
+	for (const fs::directory_entry& entry : fs::directory_iterator(dir, ec)) {
+		std::string name = entry.path().filename().string();
+		unsigned long long segment;
+		if (sscanf(name.c_str(), "events_%llu.trl", &segment) == 1 && segment > 0)
+			segments.push_back(segment);
+	}
+	std::sort(segments.begin(), segments.end());
+	return segments;
+}
+
+std::shared_ptr<EventLogSegment> EventLogSegment::Map(const std::string& path, uint64_t segment, bool bWrite, bool bCreate)
+{
+	uint64_t indexBytes = (uint64_t)EVENT_LOG_SEGMENT_RECORDS / EVENT_LOG_INDEX_STRIDE * sizeof(int64_t);
+	uint64_t recordOffset = EVENT_LOG_ALIGN + AlignUp(indexBytes);
+	uint64_t fileSize = recordOffset + (uint64_t)EVENT_LOG_SEGMENT_RECORDS * sizeof(TrafficRecord);
+
+	std::shared_ptr<EventLogSegment> pSegment(new EventLogSegment());
+	pSegment->m_segment = segment;
+	uint64_t size = 0;
+#ifdef _WIN32
+	pSegment->m_hFile = CreateFileA(path.c_str(), GENERIC_READ | (bWrite ? GENERIC_WRITE : 0),
+		FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, bCreate ? CREATE_NEW : OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL, NULL);
+	if (pSegment->m_hFile == INVALID_HANDLE_VALUE)
+		return NULL;
+	LARGE_INTEGER li;
+	if (bCreate) {
+		li.QuadPart = (LONGLONG)fileSize;
+		if (!SetFilePointerEx(pSegment->m_hFile, li, NULL, FILE_BEGIN) || !SetEndOfFile(pSegment->m_hFile)) {
+			CloseHandle(pSegment->m_hFile);
+			pSegment->m_hFile = INVALID_HANDLE_VALUE;
+			DeleteFileA(path.c_str());
+			return NULL;
+		}
+	}
+	if (!GetFileSizeEx(pSegment->m_hFile, &li) || li.QuadPart < (LONGLONG)sizeof(EventLogHeader))
+		return NULL;
+	size = (uint64_t)li.QuadPart;
+	pSegment->m_hMap = CreateFileMappingA(pSegment->m_hFile, NULL, bWrite ? PAGE_READWRITE : PAGE_READONLY, 0, 0, NULL);
+	if (pSegment->m_hMap == NULL)
+		return NULL;
+	pSegment->m_base = (uint8_t*)MapViewOfFile(pSegment->m_hMap, bWrite ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0);
+#else
+	pSegment->m_fd = open(path.c_str(), (bWrite ? O_RDWR : O_RDONLY) | (bCreate ? O_CREAT | O_EXCL : 0), 0644);
+	if (pSegment->m_fd < 0)
+		return NULL;
+	if (bCreate && ftruncate(pSegment->m_fd, (off_t)fileSize) != 0) {
+		unlink(path.c_str());
+		return NULL;
+	}
+	struct stat st;
+	if (fstat(pSegment->m_fd, &st) != 0 || st.st_size < (off_t)sizeof(EventLogHeader))
+		return NULL;
+	size = (uint64_t)st.st_size;
+	void* p = mmap(NULL, size, PROT_READ | (bWrite ? PROT_WRITE : 0), MAP_SHARED, pSegment->m_fd, 0);
+	pSegment->m_base = p != MAP_FAILED ? (uint8_t*)p : NULL;
+#endif
+	if (pSegment->m_base == NULL)
+		return NULL;
+	pSegment->m_size = (size_t)size;
+	EventLogHeader* pHeader = (EventLogHeader*)pSegment->m_base;
+	pSegment->m_pHeader = pHeader;
+
+	if (bCreate) {
+		pHeader->version = EVENT_LOG_VERSION;
+		pHeader->recordSize = sizeof(TrafficRecord);
+		pHeader->indexStride = EVENT_LOG_INDEX_STRIDE;
+		pHeader->segment = segment;
+		pHeader->capacity = EVENT_LOG_SEGMENT_RECORDS;
+		pHeader->indexOffset = EVENT_LOG_ALIGN;
+		pHeader->recordOffset = recordOffset;
+		pHeader->count.store(0);
+		pHeader->bFull.store(0);
+		pHeader->magic.store(EVENT_LOG_MAGIC, std::memory_order_release);
+		return pSegment;
+	}
+	// A segment still being created reads as not there yet
+	if (pHeader->magic.load(std::memory_order_acquire) != EVENT_LOG_MAGIC || pHeader->version != EVENT_LOG_VERSION
+		|| pHeader->recordSize != sizeof(TrafficRecord) || pHeader->indexStride != EVENT_LOG_INDEX_STRIDE
+		|| pHeader->capacity != EVENT_LOG_SEGMENT_RECORDS || pHeader->recordOffset + pHeader->capacity * sizeof(TrafficRecord) > size
+		|| pHeader->indexOffset + indexBytes > pHeader->recordOffset || pHeader->count.load() > pHeader->capacity)
+		return NULL;
+	return pSegment;
+}
+
+bool EventLogSegment::Sync(uint64_t from, uint64_t to)
+{
+	uint64_t begin = m_pHeader->recordOffset + from * sizeof(TrafficRecord);
+	uint64_t end = m_pHeader->recordOffset + to * sizeof(TrafficRecord);
+#ifdef _WIN32
+	bool bOk = FlushViewOfFile(m_base, (SIZE_T)m_pHeader->recordOffset) != FALSE;
+	if (end > begin)
+		bOk = FlushViewOfFile(m_base + begin, (SIZE_T)(end - begin)) != FALSE && bOk;
+	return FlushFileBuffers(m_hFile) != FALSE && bOk;
+#else
+	uint64_t page = (uint64_t)sysconf(_SC_PAGESIZE);
+	bool bOk = msync(m_base, (size_t)m_pHeader->recordOffset, MS_SYNC) == 0;
+	begin = begin / page * page;
+	if (end > begin)
+		bOk = msync(m_base + begin, (size_t)(end - begin), MS_SYNC) == 0 && bOk;
+	return bOk;
+#endif
+}
+
+uint64_t EventLogSegment::Find(int64_t recvUs) const
+{
+	uint64_t count = Count();
+	const int64_t* pIndex = Index();
+	const TrafficRecord* pRecords = Records();
+	// First block whose running maximum reaches recvUs; every record before
+	// it is older
+	uint64_t lo = 0;
+	uint64_t hi = (count + EVENT_LOG_INDEX_STRIDE - 1) / EVENT_LOG_INDEX_STRIDE;
+	while (lo < hi) {
+		uint64_t mid = (lo + hi) / 2;
+		if (pIndex[mid] < recvUs)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	for (uint64_t i = lo * EVENT_LOG_INDEX_STRIDE; i < count; i++) {
+		if (pRecords[i].recvUs >= recvUs)
+			return i;
+	}
+	return count;
+}
+
+EventLogWriter::EventLogWriter()
+	: m_synced(0), m_maxRecvUs(INT64_MIN), m_bRunning(false)
+{
+	memset(&m_stats, 0, sizeof(m_stats));
+}
+
+EventLogWriter::~EventLogWriter()
+{
+	Close();
+}
+
+bool EventLogWriter::Open(const char* dir)
+{
+	if (dir == NULL || dir[0] == '\0')
+		return false;
+	std::lock_guard<std::mutex> guard(m_lock);
+	if (m_segment)
+		return true;
+	std::error_code ec;
+	fs::create_directories(dir, ec);
+	if (!fs::is_directory(dir, ec))
+		return false;
+	m_dir = dir;
+	m_maxRecvUs = INT64_MIN;
+
+	std::vector<uint64_t> segments = EventLogSegment::List(m_dir);
+	if (!segments.empty()) {
+		std::shared_ptr<EventLogSegment> pLast = EventLogSegment::Map(EventLogSegment::PathOf(m_dir, segments.back()), segments.back(), true, false);
+		if (pLast && !pLast->Header()->bFull.load()) {
+			// After a power loss count may be ahead of the pages that made it
+			// to disk; those read back as zeros
+			uint64_t count = pLast->Count();
+			while (count > 0 && pLast->Records()[count - 1].seq == 0)
+				count--;
+			// The index pages may have reached disk apart from the records, so
+			// it is rebuilt from them, going on from the segment before
+			if (segments.size() > 1) {
+				uint64_t previous = segments[segments.size() - 2];
+				std::shared_ptr<EventLogSegment> pPrevious = EventLogSegment::Map(EventLogSegment::PathOf(m_dir, previous), previous, false, false);
+				uint64_t previousCount = pPrevious ? pPrevious->Count() : 0;
+				if (previousCount > 0)
+					m_maxRecvUs = pPrevious->Index()[(previousCount - 1) / EVENT_LOG_INDEX_STRIDE];
+			}
+			const TrafficRecord* pRecords = pLast->Records();
+			int64_t* pIndex = pLast->Index();
+			for (uint64_t i = 0; i < count; i++) {
+				m_maxRecvUs = std::max(m_maxRecvUs, pRecords[i].recvUs);
+				pIndex[i / EVENT_LOG_INDEX_STRIDE] = m_maxRecvUs;
+			}
+			pLast->Header()->count.store(count, std::memory_order_release);
+			m_segment = pLast;
+			m_synced = count;
+			m_stats.segment = pLast->Number();
+			m_stats.position = (pLast->Number() - 1) * EVENT_LOG_SEGMENT_RECORDS + count;
+		}
+	}
+	if (!m_segment && !NextSegment())
+		return false;
+
+	m_bRunning = true;
+	m_thread = std::thread(&EventLogWriter::Run, this);
+	return true;
+}
+
+void EventLogWriter::Close()
+{
+	if (m_thread.joinable()) {
+		{
+			std::lock_guard<std::mutex> guard(m_waitLock);
+			m_bRunning = false;
+			m_cv.notify_one();
+		}
+		m_thread.join();
+	}
+	Sync();
+	std::lock_guard<std::mutex> guard(m_lock);
+	m_segment.reset();
+	m_full.clear();
+}
+
+// Numbers keep going from the last segment on disk, so positions only grow
+bool EventLogWriter::NextSegment()
+{
+	uint64_t number = m_segment ? m_segment->Number() + 1 : 1;
+	std::vector<uint64_t> segments = EventLogSegment::List(m_dir);
+	if (!segments.empty())
+		number = std::max(number, segments.back() + 1);
+	std::shared_ptr<EventLogSegment> pSegment = EventLogSegment::Map(EventLogSegment::PathOf(m_dir, number), number, true, true);
+	if (!pSegment) {
+		printf("EventLog: cannot create %s\n", EventLogSegment::PathOf(m_dir, number).c_str());
+		return false;
+	}
+	if (m_segment) {
+		m_segment->Header()->bFull.store(1, std::memory_order_release);
+		m_full.push_back(m_segment);
+	}
+	m_segment = pSegment;
+	m_synced = 0;
+	m_stats.segment = number;
+	m_stats.position = (number - 1) * EVENT_LOG_SEGMENT_RECORDS;
+	return true;
+}
+
+bool EventLogWriter::Append(const TrafficRecord* pRecords, int nCount)
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	while (nCount > 0) {
+		if (!m_segment || (m_segment->Count() >= EVENT_LOG_SEGMENT_RECORDS && !NextSegment())) {
+			m_stats.failed += nCount;
+			return false;
+		}
+		uint64_t count = m_segment->Count();
+		int n = (int)std::min<uint64_t>(nCount, EVENT_LOG_SEGMENT_RECORDS - count);
+		memcpy(m_segment->Records() + count, pRecords, sizeof(TrafficRecord) * n);
+		int64_t* pIndex = m_segment->Index();
+		for (int i = 0; i < n; i++) {
+			m_maxRecvUs = std::max(m_maxRecvUs, pRecords[i].recvUs);
+			pIndex[(count + i) / EVENT_LOG_INDEX_STRIDE] = m_maxRecvUs;
+		}
+		// Readers take count as the promise that the records before it are whole
+		m_segment->Header()->count.store(count + n, std::memory_order_release);
+		m_stats.appended += n;
+		m_stats.position = (m_segment->Number() - 1) * EVENT_LOG_SEGMENT_RECORDS + count + n;
+		pRecords += n;
+		nCount -= n;
+	}
+	return true;
+}
+
+// Writes to disk what was appended since the last call, outside m_lock so
+// appends go on meanwhile
+void EventLogWriter::Sync()
+{
+	std::vector<std::shared_ptr<EventLogSegment>> full;
+	std::shared_ptr<EventLogSegment> pSegment;
+	uint64_t from;
+	uint64_t to;
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		full.swap(m_full);
+		pSegment = m_segment;
+		from = m_synced;
+		to = pSegment ? pSegment->Count() : 0;
+	}
+	if (!pSegment && full.empty())
+		return;
+	auto start = std::chrono::steady_clock::now();
+	bool bOk = true;
+	for (const std::shared_ptr<EventLogSegment>& pFull : full)
+		bOk = pFull->Sync(0, EVENT_LOG_SEGMENT_RECORDS) && bOk;
+	if (pSegment && to > from)
+		bOk = pSegment->Sync(from, to) && bOk;
+	if (!bOk)
+		printf("EventLog: flush to disk failed\n");
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	std::lock_guard<std::mutex> guard(m_lock);
+	if (pSegment && pSegment == m_segment)
+		m_synced = std::max(m_synced, to);
+	m_stats.syncs++;
+	m_stats.lastSyncMs = ms;
+}
+
+void EventLogWriter::Run()
+{
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(m_waitLock);
+			if (m_bRunning)
+				m_cv.wait_for(lock, std::chrono::milliseconds(EVENT_LOG_SYNC_MS));
+			if (!m_bRunning)
+				break;
+		}
+		Sync();
+	}
+}
+
+void EventLogWriter::GetStats(EventLogStats* pStats)
+{
+	if (pStats == NULL)
+		return;
+	std::lock_guard<std::mutex> guard(m_lock);
+	*pStats = m_stats;
+}
+
+EventLogReader::EventLogReader()
+	: m_checked(0)
+{
+}
+
+bool EventLogReader::Open(const char* dir)
+{
+	Close();
+	std::error_code ec;
+	if (dir == NULL || !fs::is_directory(dir, ec))
+		return false;
+	m_dir = dir;
+	Refresh();
+	return true;
+}
+
+void EventLogReader::Close()
+{
+	m_mapped.clear();
+	m_segments.clear();
+	m_checked = 0;
+	m_dir.clear();
+}
+
+void EventLogReader::Refresh()
+{
+	std::vector<uint64_t> segments = EventLogSegment::List(m_dir);
+	for (size_t i = 0; i < segments.size(); i++) {
+		if (segments[i] <= m_checked)
+			continue;
+		SegmentInfo info = { segments[i], 0, INT64_MIN, false };
+		if (!Acquire(&info)) {
+			// The newest segment is not written yet; the next call tries
+			// again. One with others after it never will be, its header did
+			// not reach disk before a crash.
+			if (i + 1 == segments.size())
+				break;
+			printf("EventLog: skipping unreadable %s\n", EventLogSegment::PathOf(m_dir, segments[i]).c_str());
+			m_checked = segments[i];
+			continue;
+		}
+		m_segments.push_back(info);
+		m_checked = segments[i];
+	}
+}
+
+std::shared_ptr<EventLogSegment> EventLogReader::Acquire(SegmentInfo* pInfo)
+{
+	std::shared_ptr<EventLogSegment> pSegment;
+	for (size_t i = 0; i < m_mapped.size(); i++) {
+		if (m_mapped[i]->Number() == pInfo->number) {
+			pSegment = m_mapped[i];
+			m_mapped.erase(m_mapped.begin() + i);
+			break;
+		}
+	}
+	if (!pSegment) {
+		pSegment = EventLogSegment::Map(EventLogSegment::PathOf(m_dir, pInfo->number), pInfo->number, false, false);
+		if (!pSegment)
+			return NULL;
+	}
+	m_mapped.insert(m_mapped.begin(), pSegment);
+	if (m_mapped.size() > EVENT_LOG_READER_MAPS)
+		m_mapped.pop_back();
+
+	// bFull first: once it is set, count and the index are final
+	pInfo->bFull = pSegment->Header()->bFull.load(std::memory_order_acquire) != 0;
+	pInfo->count = pSegment->Count();
+	pInfo->maxRecvUs = pInfo->count > 0 ? pSegment->Index()[(pInfo->count - 1) / EVENT_LOG_INDEX_STRIDE] : INT64_MIN;
+	return pSegment;
+}
+
+int EventLogReader::Locate(uint64_t position)
+{
+	uint64_t number = position / EVENT_LOG_SEGMENT_RECORDS + 1;
+	std::vector<SegmentInfo>::iterator it = std::lower_bound(m_segments.begin(), m_segments.end(), number,
+		[](const SegmentInfo& info, uint64_t n) { return info.number < n; });
+	return it != m_segments.end() ? (int)(it - m_segments.begin()) : -1;
+}
+
+uint64_t EventLogReader::Seek(int64_t recvUs)
+{
+	Refresh();
+	for (size_t i = 0; i < m_segments.size(); i++) {
+		SegmentInfo& info = m_segments[i];
+		// Full segments that end before the time are passed over unmapped
+		if (info.bFull && (info.count == 0 || info.maxRecvUs < recvUs))
+			continue;
+		std::shared_ptr<EventLogSegment> pSegment = Acquire(&info);
+		if (!pSegment || info.count == 0 || info.maxRecvUs < recvUs)
+			continue;
+		uint64_t index = pSegment->Find(recvUs);
+		if (index < info.count)
+			return (info.number - 1) * EVENT_LOG_SEGMENT_RECORDS + index;
+	}
+	return EVENT_LOG_END;
+}
+
+uint64_t EventLogReader::End()
+{
+	Refresh();
+	while (!m_segments.empty()) {
+		SegmentInfo& info = m_segments.back();
+		if (info.bFull || Acquire(&info))
+			return (info.number - 1) * EVENT_LOG_SEGMENT_RECORDS + info.count;
+		m_segments.pop_back();
+	}
+	return 0;
+}
+
+int EventLogReader::Read(uint64_t* pPosition, const TrafficRecord** ppRecords, int maxCount)
+{
+	if (pPosition == NULL || ppRecords == NULL || maxCount <= 0 || *pPosition == EVENT_LOG_END)
+		return 0;
+	// The last segment filled up: its successor is on the way
+	if (m_segments.empty() || m_segments.back().bFull || (Acquire(&m_segments.back()) && m_segments.back().bFull))
+		Refresh();
+	for (;;) {
+		int i = Locate(*pPosition);
+		if (i < 0)
+			return 0;
+		SegmentInfo& info = m_segments[i];
+		// A segment missing from the directory is skipped
+		if (info.number != *pPosition / EVENT_LOG_SEGMENT_RECORDS + 1)
+			*pPosition = (info.number - 1) * EVENT_LOG_SEGMENT_RECORDS;
+		std::shared_ptr<EventLogSegment> pSegment = Acquire(&info);
+		if (!pSegment) {
+			// Deleted since it was found
+			m_segments.erase(m_segments.begin() + i);
+			continue;
+		}
+		uint64_t index = *pPosition % EVENT_LOG_SEGMENT_RECORDS;
+		if (index < info.count) {
+			int n = (int)std::min<uint64_t>(maxCount, info.count - index);
+			*ppRecords = pSegment->Records() + index;
+			*pPosition += n;
+			return n;
+		}
+		if (i + 1 == (int)m_segments.size() && !info.bFull)
+			return 0;
+		*pPosition = info.number * EVENT_LOG_SEGMENT_RECORDS;
+		if (i + 1 == (int)m_segments.size())
+			Refresh();
+	}
+}
+bool EventLogReader::Find(int64_t recvUs, TrafficRecord* pRecord)
+{
+	uint64_t position = Seek(recvUs);
+	const TrafficRecord* pFound = NULL;
+	if (pRecord == NULL || Read(&position, &pFound, 1) != 1)
+		return false;
+	*pRecord = *pFound;
+	return true;
+}
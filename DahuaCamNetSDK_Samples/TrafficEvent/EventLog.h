@@ -0,0 +1,196 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include "TrafficRecord.h"
+
+// Append only log of every record the engine delivers, the copy the other
+// sinks can be rebuilt from. The log is a directory of segment files
+// events_<n>.trl, each of a fixed size and memory mapped:
+//
+//   EventLogHeader | time index | records
+//
+// at offsets that are multiples of EVENT_LOG_ALIGN. The time index holds,
+// for every EVENT_LOG_INDEX_STRIDE records, the largest recvUs up to the
+// end of that block; it never decreases, even across a clock step, so a
+// binary search over it finds the first record received at or after a
+// time. A record is identified by its position, (segment - 1) *
+// EVENT_LOG_SEGMENT_RECORDS + its index in the segment.
+//
+// The writer copies records into the mapping and then publishes count, so a
+// reader, in this process or another, never sees half a record. The pages
+// are flushed to disk every EVENT_LOG_SYNC_MS by a thread of the writer,
+// and when a segment is full.
+
+#define EVENT_LOG_MAGIC				0x4C455254	// "TREL"
+#define EVENT_LOG_VERSION			1
+#define EVENT_LOG_SEGMENT_RECORDS	262144
+#define EVENT_LOG_INDEX_STRIDE		256
+#define EVENT_LOG_ALIGN				65536		// view offsets on Windows are multiples of this
+#define EVENT_LOG_SYNC_MS			1000
+#define EVENT_LOG_END				UINT64_MAX	// no record at or after the time asked for
+#define EVENT_LOG_READER_MAPS		4			// segments a reader keeps mapped, about 90 MB each
+
+struct EventLogHeader
+{
+	std::atomic<uint32_t> magic;	// written last when the segment is created
+	uint32_t version;
+	uint32_t recordSize;			// sizeof(TrafficRecord)
+	uint32_t indexStride;
+	uint64_t segment;
+	uint64_t capacity;				// records
+	uint64_t indexOffset;
+	uint64_t recordOffset;
+	std::atomic<uint64_t> count;	// records written; stored after the records
+	std::atomic<uint32_t> bFull;
+	uint32_t reserved;
+	uint8_t pad[64];
+};
+
+static_assert(sizeof(EventLogHeader) == 128, "event log header layout");
+
+#pragma pack(push, 4)
+typedef struct EventLogStats
+{
+	uint64_t appended;
+	uint64_t failed;			// records that could not be written
+	uint64_t position;			// of the next record
+	uint64_t segment;			// being written
+	uint64_t syncs;
+	double lastSyncMs;
+} EventLogStats;
+#pragma pack(pop)
+
+// One mapped segment file
+class EventLogSegment
+{
+public:
+	~EventLogSegment();
+
+	// Maps an existing segment, or with bCreate makes a new one; NULL when
+	// the file cannot be mapped or its layout is not this version's.
+	static std::shared_ptr<EventLogSegment> Map(const std::string& path, uint64_t segment, bool bWrite, bool bCreate);
+	static std::string PathOf(const std::string& dir, uint64_t segment);
+	// Segment numbers in dir, ascending.
+	static std::vector<uint64_t> List(const std::string& dir);
+
+	// Writes the pages of records [from, to) and the header to disk.
+	bool Sync(uint64_t from, uint64_t to);
+
+	EventLogHeader* Header() const { return m_pHeader; }
+	int64_t* Index() const { return (int64_t*)(m_base + m_pHeader->indexOffset); }
+	TrafficRecord* Records() const { return (TrafficRecord*)(m_base + m_pHeader->recordOffset); }
+	uint64_t Number() const { return m_segment; }
+	uint64_t Count() const { return m_pHeader->count.load(std::memory_order_acquire); }
+	// Index of the first record with recvUs at or after the time, Count()
+	// when there is none.
+	uint64_t Find(int64_t recvUs) const;
+
+private:
+	EventLogSegment();
+
+	uint64_t m_segment;
+	uint8_t* m_base;
+	size_t m_size;
+	EventLogHeader* m_pHeader;
+#ifdef _WIN32
+	HANDLE m_hFile;
+	HANDLE m_hMap;
+#else
+	int m_fd;
+#endif
+};
+
+class EventLogWriter
+{
+public:
+	EventLogWriter();
+	~EventLogWriter();
+
+	// Appends to the last segment in dir when it has room. False when dir
+	// cannot be used.
+	bool Open(const char* dir);
+	// Flushes everything to disk.
+	void Close();
+
+	// Engine dispatcher thread. False when records were lost.
+	bool Append(const TrafficRecord* pRecords, int nCount);
+
+	void GetStats(EventLogStats* pStats);
+
+private:
+	bool NextSegment();
+	void Sync();
+	void Run();
+
+	std::mutex m_lock;
+	std::string m_dir;
+	std::shared_ptr<EventLogSegment> m_segment;
+	uint64_t m_synced;				// records of m_segment on disk
+	std::vector<std::shared_ptr<EventLogSegment>> m_full;	// full, not flushed yet
+	int64_t m_maxRecvUs;			// running maximum for the time index
+	alignas(8) EventLogStats m_stats;
+
+	std::mutex m_waitLock;
+	std::condition_variable m_cv;
+	bool m_bRunning;
+	std::thread m_thread;
+};
+
+// Reads a log, also while it is written. Records are returned in place,
+// pointers into the mapping that stay valid until the next call. Only the
+// EVENT_LOG_READER_MAPS segments used last stay mapped, so a log of any
+// length fits the address space of a 32 bit process.
+class EventLogReader
+{
+public:
+	EventLogReader();
+
+	bool Open(const char* dir);
+	void Close();
+
+	// Position of the first record received at or after recvUs, or
+	// EVENT_LOG_END.
+	uint64_t Seek(int64_t recvUs);
+	// Position after the last record.
+	uint64_t End();
+
+	// Up to maxCount records from *pPosition on, all from one segment, for
+	// sequential replay; advances *pPosition past them. Returns how many,
+	// 0 at the end of the log.
+	int Read(uint64_t* pPosition, const TrafficRecord** ppRecords, int maxCount);
+
+	// The first record received at or after recvUs.
+	bool Find(int64_t recvUs, TrafficRecord* pRecord);
+
+private:
+	struct SegmentInfo
+	{
+		uint64_t number;
+		uint64_t count;				// as last seen
+		int64_t maxRecvUs;			// last time index entry, as last seen
+		bool bFull;					// count and maxRecvUs are final
+	};
+
+	// Finds segments written since the last call.
+	void Refresh();
+	// Maps a segment, or takes it from the mapped ones, and updates info.
+	// NULL when it cannot be mapped any more.
+	std::shared_ptr<EventLogSegment> Acquire(SegmentInfo* pInfo);
+	// The segment holding position, or the next one there is; -1 for none.
+	int Locate(uint64_t position);
+
+	std::string m_dir;
+	std::vector<SegmentInfo> m_segments;	// readable ones, ascending
+	uint64_t m_checked;						// highest segment number looked at
+	std::vector<std::shared_ptr<EventLogSegment>> m_mapped;	// most recently used first
+};
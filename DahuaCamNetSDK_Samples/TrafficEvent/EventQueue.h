@@ -0,0 +1,113 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+
+// Bounded multi-producer multi-consumer queue without locks (Dmitry Vyukov's
+// array queue). Each cell carries a sequence number that tells producers and
+// consumers whose turn it is, so a push or pop is one compare-and-swap on the
+// shared position plus a copy. NetSDK callbacks of many cameras push from
+// their own threads and never wait: when the queue is full TryPush fails and
+// the caller counts the drop.
+//
+// T must be trivially copyable. Capacity is rounded up to a power of two.
+template <typename T>
+class EventQueue
+{
+public:
+	explicit EventQueue(size_t capacity)
+	{
+		size_t n = 2;
+		while (n < capacity)
+			n <<= 1;
+		m_mask = n - 1;
+		m_cells.reset(new Cell[n]);
+		for (size_t i = 0; i < n; i++)
+			m_cells[i].seq.store(i, std::memory_order_relaxed);
+		m_enqueue.store(0, std::memory_order_relaxed);
+		m_dequeue.store(0, std::memory_order_relaxed);
+	}
+
+	bool TryPush(const T& item)
+	{
+		size_t pos = m_enqueue.load(std::memory_order_relaxed);
+		for (;;) {
+			Cell* pCell = &m_cells[pos & m_mask];
+			size_t seq = pCell->seq.load(std::memory_order_acquire);
+			intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+			if (diff == 0) {
+				if (m_enqueue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					pCell->item = item;
+					pCell->seq.store(pos + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (diff < 0) {
+				return false;
+			}
+			else {
+				pos = m_enqueue.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	bool TryPop(T& item)
+	{
+		size_t pos = m_dequeue.load(std::memory_order_relaxed);
+		for (;;) {
+			Cell* pCell = &m_cells[pos & m_mask];
+			size_t seq = pCell->seq.load(std::memory_order_acquire);
+			intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+			if (diff == 0) {
+				if (m_dequeue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+					item = pCell->item;
+					pCell->seq.store(pos + m_mask + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (diff < 0) {
+				return false;
+			}
+			else {
+				pos = m_dequeue.load(std::memory_order_relaxed);
+			}
+		}
+	}
+
+	// Pops up to maxCount items in queue order, returns how many.
+	int PopBatch(T* pItems, int maxCount)
+	{
+		int n = 0;
+		while (n < maxCount && TryPop(pItems[n]))
+			n++;
+		return n;
+	}
+
+	// Approximate while producers or consumers run.
+	size_t Size() const
+	{
+		size_t enqueue = m_enqueue.load(std::memory_order_relaxed);
+		size_t dequeue = m_dequeue.load(std::memory_order_relaxed);
+		return enqueue > dequeue ? enqueue - dequeue : 0;
+	}
+
+	size_t Capacity() const { return m_mask + 1; }
+
+private:
+	EventQueue(const EventQueue&) = delete;
+	EventQueue& operator=(const EventQueue&) = delete;
+
+	struct Cell
+	{
+		std::atomic<size_t> seq;
+		T item;
+	};
+
+	// Producers and consumers each hammer one position; keep them on
+	// separate cache lines
+	alignas(64) std::atomic<size_t> m_enqueue;
+	alignas(64) std::atomic<size_t> m_dequeue;
+	alignas(64) std::unique_ptr<Cell[]> m_cells;
+	size_t m_mask;
+};
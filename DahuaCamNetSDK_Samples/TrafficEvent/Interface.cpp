@@ -0,0 +1,323 @@
+#include <string.h>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "BatchSink.h"
+#include "EventLog.h"
+#include "PictureStore.h"
+#include "TrafficDedup.h"
+#include "TrafficEventEngine.h"
+#include "TrafficPollSink.h"
+
+#define TRAFFIC_POLL_CAPACITY	65536
+
+TrafficEventEngine engine;
+TrafficPollSink pollSink(TRAFFIC_POLL_CAPACITY);
+PlateIndex plateIndex;
+std::unique_ptr<BatchSink> batchSink;
+PictureStore pictureStore;
+TrafficDedup dedup;
+bool dedupRunning = false;
+EventLogWriter eventLog;
+EventLogReader logReader;
+std::mutex logReaderLock;
+
+// Consumers take records from the dedup stage while it runs, else straight
+// from the engine
+static void AttachSink(TrafficSink* pSink) {
+	if (dedupRunning)
+		dedup.AddSink(pSink);
+	else
+		engine.AddSink(pSink);
+}
+
+static void DetachSink(TrafficSink* pSink) {
+	engine.RemoveSink(pSink);
+	dedup.RemoveSink(pSink);
+}
+
+// The sinks that read the dedup stage while it runs
+static std::vector<TrafficSink*> ConsumerSinks() {
+	std::vector<TrafficSink*> sinks(1, &pollSink);
+	if (batchSink)
+		sinks.push_back(batchSink.get());
+	return sinks;
+}
+
+// Takes the dedup stage out of the chain and sends on what it holds. The
+// engine switches to the consumers in one step, so no record goes to
+// neither path, and the passages still open reach them when the stage stops.
+static void StopDedup() {
+	if (!dedupRunning)
+		return;
+	std::vector<TrafficSink*> sinks = ConsumerSinks();
+	engine.ReplaceSinks(std::vector<TrafficSink*>(1, &dedup), sinks);
+	dedup.Stop();
+	dedupRunning = false;
+	for (TrafficSink* pSink : sinks)
+		dedup.RemoveSink(pSink);
+}
+
+extern "C" _declspec(dllexport) int _stdcall interface_TrafficStart();
+int _stdcall interface_TrafficStart() {
+	int status = engine.Start();
+	if (TRAFFIC_OK == status) {
+		engine.SetPlateIndex(&plateIndex);
+		AttachSink(&pollSink);
+	}
+	return status;
+}
+
+extern "C" _declspec(dllexport) int _stdcall interface_TrafficStop();
+int _stdcall interface_TrafficStop() {
+	engine.Stop();
+	engine.SetPictureStore(NULL);
+	pictureStore.Stop();
+	engine.SetEventLog(NULL);
+	eventLog.Close();
+	StopDedup();
+	DetachSink(&pollSink);
+	pollSink.Wake();
+	if (batchSink) {
+		DetachSink(batchSink.get());
+		batchSink.reset();
+	}
+	return TRAFFIC_OK;
+}
+
+// Returns the camera id, or -TRAFFIC_ERR_*
+extern "C" _declspec(dllexport) int _stdcall interface_TrafficSubscribe(const char* ip, int port, const char* user, const char* password, int channel);
+int _stdcall interface_TrafficSubscribe(const char* ip, int port, const char* user, const char* password, int channel) {
+	return engine.Subscribe(ip, port, user, password, channel);
+}
+
+extern "C" _declspec(dllexport) int _stdcall interface_TrafficUnsubscribe(int camera);
+int _stdcall interface_TrafficUnsubscribe(int camera) {
+	return engine.Unsubscribe(camera);
+}
+
+// Copies up to maxCount records into pRecords, waiting up to timeoutMs for
+// the first. Returns the number copied.
+extern "C" _declspec(dllexport) int _stdcall interface_TrafficPoll(TrafficRecord* pRecords, int maxCount, int timeoutMs);
+int _stdcall interface_TrafficPoll(TrafficRecord* pRecords, int maxCount, int timeoutMs) {
+	return pollSink.Poll(pRecords, maxCount, timeoutMs);
+}
+
+extern "C" _declspec(dllexport) int _stdcall interface_TrafficGetStats(TrafficEngineStats* pStats);
+int _stdcall interface_TrafficGetStats(TrafficEngineStats* pStats) {
+	if (pStats == NULL)
+		return TRAFFIC_ERR_PARAM;
+	engine.GetStats(pStats);
+	return TRAFFIC_OK;
+}
+
+// Builds new allow / block lists from the files (NULL or "" leaves that list
+// empty) and swaps them in as a whole. Returns the number of plates, -1 when
+// a file cannot be read; the lists in use stay as they were then.
+extern "C" _declspec(dllexport) int _stdcall interface_TrafficLoadPlateLists(const char* allowPath, const char* blockPath);
+int _stdcall interface_TrafficLoadPlateLists(const char* allowPath, const char* blockPath) {
+	PlateTableBuilder builder;
+	int nAllow = 0;
+	int nBlock = 0;
+	if (allowPath != NULL && allowPath[0] != '\0')
+		nAllow = builder.LoadFile(allowPath, PLATE_LIST_ALLOW);
+	if (blockPath != NULL && blockPath[0] != '\0')
+		nBlock = builder.LoadFile(blockPath, PLATE_LIST_BLOCK);
+	if (nAllow < 0 || nBlock < 0)
+		return -1;
+	plateIndex.Swap(builder.Build());
+	return nAllow + nBlock;
+}
+
+// Returns PLATE_MATCH_*
+extern "C" _declspec(dllexport) int _stdcall interface_TrafficMatchPlate(const char* plate, PlateMatch* pMatch);
+int _stdcall interface_TrafficMatchPlate(const char* plate, PlateMatch* pMatch) {
+	return plateIndex.Lookup(plate, pMatch);
+}
+
+// Starts writing every record to target in batches: a file path for
+// BATCH_TARGET_CSV / BATCH_TARGET_SQL, "host:port" for BATCH_TARGET_SOCKET.
+// Records the target cannot take in time are spilled to spillDir (NULL or
+// "": dropped) and written later. Replaces a batch sink already running.
+extern "C" _declspec(dllexport) int _stdcall interface_TrafficStartBatchSink(int targetType, const char* target, int batchSize, int maxDelayMs, const char* spillDir);
+int _stdcall interface_TrafficStartBatchSink(int targetType, const char* target, int batchSize, int maxDelayMs, const char* spillDir) {
+	BatchTarget* pTarget = CreateBatchTarget(targetType, target);
+	if (pTarget == NULL)
+		return TRAFFIC_ERR_PARAM;
+	BatchSinkOptions options;
+	if (batchSize > 0)
+		options.batchSize = batchSize;
+	if (maxDelayMs >= 0)
+		options.maxDelayMs = maxDelayMs;
+	if (spillDir != NULL)
+		options.spillDir = spillDir;
+
+	if (batchSink) {
+		DetachSink(batchSink.get());
+		batchSink.reset();
+	}
+	std::unique_ptr<BatchSink> sink(new BatchSink(pTarget, options));
+	if (!sink->Start())
+		return TRAFFIC_ERR_PARAM;
+	batchSink = std::move(sink);
+	AttachSink(batchSink.get());
+	return TRAFFIC_OK;
+}
+
+// Writes what is held in memory and stops; the spill stays on disk.
+extern "C" _declspec(dllexport) int _stdcall interface_TrafficStopBatchSink();
+int _stdcall interface_TrafficStopBatchSink() {
+	if (batchSink) {
+		DetachSink(batchSink.get());
+		batchSink.reset();
+	}
+	return TRAFFIC_OK;
+}
+
+extern "C" _declspec(dllexport) int _stdcall interface_TrafficGetBatchStats(BatchSinkStats* pStats);
+int _stdcall interface_TrafficGetBatchStats(BatchSinkStats* pStats) {
+	if (pStats == NULL)
+		return TRAFFIC_ERR_PARAM;
+	if (!batchSink)
+		return TRAFFIC_ERR_INIT;
+	batchSink->GetStats(pStats);
+	return TRAFFIC_OK;
+}
+
+// Stores the pictures of every event from now on under root, with threads
+// writer threads; TrafficRecord::picture names the files.
+extern "C" _declspec(dllexport) int _stdcall interface_TrafficStartPictureStore(const char* root, int threads);
+int _stdcall interface_TrafficStartPictureStore(const char* root, int threads) {
+	if (root == NULL || root[0] == '\0')
+		return TRAFFIC_ERR_PARAM;
+	PictureStoreOptions options;
+	options.root = root;
+	if (threads > 0)
+		options.threads = threads;
+	if (!pictureStore.Start(options))
+		return TRAFFIC_ERR_PARAM;
+	engine.SetPictureStore(&pictureStore);
+	return TRAFFIC_OK;
+}
+
+// Writes the pictures already queued and stops storing new ones.
+extern "C" _declspec(dllexport) int _stdcall interface_TrafficStopPictureStore();
+int _stdcall interface_TrafficStopPictureStore() {
+	engine.SetPictureStore(NULL);
+	pictureStore.Stop();
+	return TRAFFIC_OK;
+}
+
+extern "C" _declspec(dllexport) int _stdcall interface_TrafficGetPictureStats(PictureStoreStats* pStats);
+int _stdcall interface_TrafficGetPictureStats(PictureStoreStats* pStats) {
+	if (pStats == NULL)
+		return TRAFFIC_ERR_PARAM;
+	pictureStore.GetStats(pStats);
+	return TRAFFIC_OK;
+}
+
+// Merges events of one plate seen by cameras of the same group within
+// windowMs (<= 0: DEDUP_DEFAULT_WINDOW_MS) into one record before the poll
+// and batch sinks see them.
+extern "C" _declspec(dllexport) int _stdcall interface_TrafficStartDedup(int windowMs);
+int _stdcall interface_TrafficStartDedup(int windowMs) {
+	if (dedupRunning)
+		return TRAFFIC_OK;
+	dedup.Start(windowMs);
+	dedupRunning = true;
+	std::vector<TrafficSink*> sinks = ConsumerSinks();
+	for (TrafficSink* pSink : sinks)
+		dedup.AddSink(pSink);
+	engine.ReplaceSinks(sinks, std::vector<TrafficSink*>(1, &dedup));
+	return TRAFFIC_OK;
+}
+
+extern "C" _declspec(dllexport) int _stdcall interface_TrafficStopDedup();
+int _stdcall interface_TrafficStopDedup() {
+	StopDedup();
+	return TRAFFIC_OK;
+}
+
+// Cameras of one gantry share a group; DEDUP_NO_GROUP (-1) leaves a
+// camera's events as they are. All cameras start in group 0.
+extern "C" _declspec(dllexport) int _stdcall interface_TrafficSetCameraGroup(int camera, int group);
+int _stdcall interface_TrafficSetCameraGroup(int camera, int group) {
+	if (camera < 0 || camera >= TRAFFIC_MAX_CAMERAS)
+		return TRAFFIC_ERR_PARAM;
+	dedup.SetCameraGroup(camera, group);
+	return TRAFFIC_OK;
+}
+
+extern "C" _declspec(dllexport) int _stdcall interface_TrafficGetDedupStats(TrafficDedupStats* pStats);
+int _stdcall interface_TrafficGetDedupStats(TrafficDedupStats* pStats) {
+	if (pStats == NULL)
+		return TRAFFIC_ERR_PARAM;
+	dedup.GetStats(pStats);
+	return TRAFFIC_OK;
+}
+
+// Appends every record to the log in dir before the sinks see it; picks up
+// where a log already there ends.
+extern "C" _declspec(dllexport) int _stdcall interface_TrafficStartEventLog(const char* dir);
+int _stdcall interface_TrafficStartEventLog(const char* dir) {
+	if (!eventLog.Open(dir))
+		return TRAFFIC_ERR_PARAM;
+	engine.SetEventLog(&eventLog);
+	return TRAFFIC_OK;
+}
+
+extern "C" _declspec(dllexport) int _stdcall interface_TrafficStopEventLog();
+int _stdcall interface_TrafficStopEventLog() {
+	engine.SetEventLog(NULL);
+	eventLog.Close();
+	return TRAFFIC_OK;
+}
+
+extern "C" _declspec(dllexport) int _stdcall interface_TrafficGetEventLogStats(EventLogStats* pStats);
+int _stdcall interface_TrafficGetEventLogStats(EventLogStats* pStats) {
+	if (pStats == NULL)
+		return TRAFFIC_ERR_PARAM;
+	eventLog.GetStats(pStats);
+	return TRAFFIC_OK;
+}
+
+// Opens a log for replay, the one being written or any other.
+extern "C" _declspec(dllexport) int _stdcall interface_TrafficLogOpen(const char* dir);
+int _stdcall interface_TrafficLogOpen(const char* dir) {
+	std::lock_guard<std::mutex> guard(logReaderLock);
+	return logReader.Open(dir) ? TRAFFIC_OK : TRAFFIC_ERR_PARAM;
+}
+
+extern "C" _declspec(dllexport) int _stdcall interface_TrafficLogClose();
+int _stdcall interface_TrafficLogClose() {
+	std::lock_guard<std::mutex> guard(logReaderLock);
+	logReader.Close();
+	return TRAFFIC_OK;
+}
+
+// Position of the first record received (TrafficRecord::recvUs) at or after
+// recvUs; EVENT_LOG_END when there is none.
+extern "C" _declspec(dllexport) uint64_t _stdcall interface_TrafficLogSeek(int64_t recvUs);
+uint64_t _stdcall interface_TrafficLogSeek(int64_t recvUs) {
+	std::lock_guard<std::mutex> guard(logReaderLock);
+	return logReader.Seek(recvUs);
+}
+
+// Copies up to maxCount records from *pPosition on and advances it.
+// Returns the number copied, 0 at the end of the log.
+extern "C" _declspec(dllexport) int _stdcall interface_TrafficLogRead(uint64_t* pPosition, TrafficRecord* pRecords, int maxCount);
+int _stdcall interface_TrafficLogRead(uint64_t* pPosition, TrafficRecord* pRecords, int maxCount) {
+	if (pPosition == NULL || pRecords == NULL)
+		return 0;
+	std::lock_guard<std::mutex> guard(logReaderLock);
+	int nCopied = 0;
+	while (nCopied < maxCount) {
+		const TrafficRecord* pFound = NULL;
+		int n = logReader.Read(pPosition, &pFound, maxCount - nCopied);
+		if (n == 0)
+			break;
+		memcpy(pRecords + nCopied, pFound, sizeof(TrafficRecord) * n);
+		nCopied += n;
+	}
+	return nCopied;
+}
@@ -0,0 +1,223 @@
+#include <io.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include "PictureStore.h"
+
+namespace fs = std::filesystem;
+
+#define PICTURE_BUFFER_ROUND	(256 << 10)
+
+static const char* const SLICE_SUFFIX[3] = { "_scene.jpg", "_plate.jpg", "_vehicle.jpg" };
+
+PictureStore::PictureStore()
+	: m_free(PICTURE_POOL_BUFFERS), m_jobs(PICTURE_POOL_BUFFERS), m_nSubmitted(0), m_nStored(0), m_nFiles(0),
+	m_nBytes(0), m_nDropped(0), m_nFailed(0), m_nSyncs(0), m_nSubmitting(0), m_bAccepting(false), m_nIdle(0), m_bRunning(false)
+{
+}
+
+PictureStore::~PictureStore()
+{
+	Stop();
+}
+
+bool PictureStore::Start(const PictureStoreOptions& options)
+{
+	if (m_bRunning)
+		return true;
+	std::error_code ec;
+	fs::create_directories(options.root, ec);
+	if (options.root.empty() || !fs::is_directory(options.root, ec))
+		return false;
+	m_options = options;
+	m_options.threads = std::min(std::max(1, m_options.threads), PICTURE_MAX_THREADS);
+
+	// Buffers get their memory on first use and keep it
+	if (m_buffers.empty()) {
+		for (int i = 0; i < PICTURE_POOL_BUFFERS; i++) {
+			m_buffers.emplace_back(new Buffer());
+			m_buffers.back()->capacity = 0;
+			m_free.TryPush(m_buffers.back().get());
+		}
+	}
+	m_bRunning = true;
+	for (int i = 0; i < m_options.threads; i++)
+		m_threads.emplace_back(&PictureStore::Run, this);
+	m_bAccepting = true;
+	return true;
+}
+
+void PictureStore::Stop()
+{
+	m_bAccepting = false;
+	while (m_nSubmitting.load() > 0)
+		std::this_thread::yield();
+	if (m_threads.empty())
+		return;
+	{
+		std::lock_guard<std::mutex> guard(m_waitLock);
+		m_bRunning = false;
+		m_cv.notify_all();
+	}
+	for (std::thread& thread : m_threads)
+		thread.join();
+	m_threads.clear();
+}
+
+// A cutout is used when it lies inside the buffer; the scene picture is
+// what comes before the first cutout, or the whole buffer without one
+static void FindSlices(const DEV_EVENT_TRAFFICJUNCTION_INFO* pInfo, DWORD dwBufSize, uint32_t offsets[3], uint32_t sizes[3])
+{
+	const DH_PIC_INFO* cutouts[2] = { &pInfo->stuObject.stPicInfo, &pInfo->stuVehicle.stPicInfo };
+	uint32_t sceneSize = dwBufSize;
+	for (int i = 0; i < 2; i++) {
+		uint64_t end = (uint64_t)cutouts[i]->dwOffSet + cutouts[i]->dwFileLenth;
+		if (cutouts[i]->dwFileLenth > 0 && end <= dwBufSize) {
+			offsets[i + 1] = cutouts[i]->dwOffSet;
+			sizes[i + 1] = cutouts[i]->dwFileLenth;
+			if (cutouts[i]->dwOffSet > 0)
+				sceneSize = std::min(sceneSize, (uint32_t)cutouts[i]->dwOffSet);
+		} else {
+			offsets[i + 1] = 0;
+			sizes[i + 1] = 0;
+		}
+	}
+	offsets[0] = 0;
+	sizes[0] = sceneSize;
+}
+
+void PictureStore::Submit(const DEV_EVENT_TRAFFICJUNCTION_INFO* pInfo, const BYTE* pBuffer, DWORD dwBufSize, TrafficRecord* pRecord)
+{
+	if (pBuffer == NULL || dwBufSize == 0)
+		return;
+	m_nSubmitting++;
+	if (!m_bAccepting) {
+		m_nSubmitting--;
+		return;
+	}
+	m_nSubmitted++;
+	Buffer* pPooled = NULL;
+	if (dwBufSize > PICTURE_MAX_BYTES || !m_free.TryPop(pPooled)) {
+		m_nDropped++;
+		m_nSubmitting--;
+		return;
+	}
+	if (pPooled->capacity < dwBufSize) {
+		uint32_t capacity = (dwBufSize + PICTURE_BUFFER_ROUND - 1) / PICTURE_BUFFER_ROUND * PICTURE_BUFFER_ROUND;
+		pPooled->data.reset(new uint8_t[capacity]);
+		pPooled->capacity = capacity;
+	}
+	// The SDK reuses its buffer once the callback returns: the one copy
+	memcpy(pPooled->data.get(), pBuffer, dwBufSize);
+
+	Job job;
+	job.pBuffer = pPooled;
+	uint32_t offsets[3];
+	uint32_t sizes[3];
+	FindSlices(pInfo, dwBufSize, offsets, sizes);
+	uint8_t pictures = 0;
+	for (int i = 0; i < 3; i++) {
+		job.slices[i].offset = offsets[i];
+		job.slices[i].size = sizes[i];
+		if (sizes[i] > 0)
+			pictures |= (uint8_t)(TRAFFIC_PIC_SCENE << i);
+	}
+
+	int64_t ms = pRecord->eventMs > 0 ? pRecord->eventMs : pRecord->recvUs / 1000;
+	int64_t days = ms >= 0 ? ms / 86400000 : -((-ms + 86399999) / 86400000);
+	int64_t dayMs = ms - days * 86400000;
+	int year, month, day;
+	TrafficCivilFromDays(days, &year, &month, &day);
+	snprintf(job.picture, sizeof(job.picture), "%04d%02d%02d/c%03d/l%d/%02d%02d%02d%03d_%llu",
+		year, month, day, pRecord->camera, pRecord->lane, (int)(dayMs / 3600000), (int)(dayMs / 60000 % 60),
+		(int)(dayMs / 1000 % 60), (int)(dayMs % 1000), (unsigned long long)pRecord->seq);
+
+	// Never full: it holds as many jobs as there are buffers
+	m_jobs.TryPush(job);
+	pRecord->pictures = pictures;
+	memcpy(pRecord->picture, job.picture, sizeof(pRecord->picture));
+	if (m_nIdle.load() > 0) {
+		std::lock_guard<std::mutex> guard(m_waitLock);
+		m_cv.notify_one();
+	}
+	m_nSubmitting--;
+}
+
+void PictureStore::WriteJob(const Job& job, std::string& lastDir)
+{
+	fs::path stem = fs::path(m_options.root) / job.picture;
+	// Events of one camera and lane arrive together; check the directory
+	// only when it changes
+	std::string dir = stem.parent_path().string();
+	if (dir != lastDir) {
+		std::error_code ec;
+		fs::create_directories(dir, ec);
+		lastDir = dir;
+	}
+	std::string base = stem.string();
+	bool bStored = true;
+	for (int i = 0; i < 3; i++) {
+		const Slice& slice = job.slices[i];
+		if (slice.size == 0)
+			continue;
+		FILE* fp = fopen((base + SLICE_SUFFIX[i]).c_str(), "wb");
+		bool bOk = fp != NULL && fwrite(job.pBuffer->data.get() + slice.offset, 1, slice.size, fp) == slice.size
+			&& 0 == fflush(fp);
+		if (bOk && m_options.bSync) {
+			bOk = 0 == _commit(_fileno(fp));
+			m_nSyncs++;
+		}
+		if (fp != NULL && 0 != fclose(fp))
+			bOk = false;
+		if (!bOk) {
+			m_nFailed++;
+			bStored = false;
+			lastDir.clear();
+			continue;
+		}
+		m_nFiles++;
+		m_nBytes += slice.size;
+	}
+	m_free.TryPush(job.pBuffer);
+	if (bStored)
+		m_nStored++;
+}
+
+void PictureStore::Run()
+{
+	std::vector<Job> batch(PICTURE_TAKE_BATCH);
+	std::string lastDir;
+	for (;;) {
+		int n = m_jobs.PopBatch(batch.data(), PICTURE_TAKE_BATCH);
+		if (n > 0) {
+			for (int i = 0; i < n; i++)
+				WriteJob(batch[i], lastDir);
+			continue;
+		}
+		// Stop drains the queue before the threads end
+		if (!m_bRunning)
+			break;
+		std::unique_lock<std::mutex> lock(m_waitLock);
+		m_nIdle++;
+		if (m_jobs.Size() == 0 && m_bRunning)
+			m_cv.wait_for(lock, std::chrono::milliseconds(PICTURE_IDLE_WAIT_MS));
+		m_nIdle--;
+	}
+}
+
+void PictureStore::GetStats(PictureStoreStats* pStats) const
+{
+	if (pStats == NULL)
+		return;
+	pStats->submitted = m_nSubmitted.load();
+	pStats->stored = m_nStored.load();
+	pStats->files = m_nFiles.load();
+	pStats->bytes = m_nBytes.load();
+	pStats->dropped = m_nDropped.load();
+	pStats->failed = m_nFailed.load();
+	pStats->syncs = m_nSyncs.load();
+	pStats->queueDepth = (uint32_t)m_jobs.Size();
+	pStats->buffersInUse = (uint32_t)(m_buffers.size() - m_free.Size());
+}
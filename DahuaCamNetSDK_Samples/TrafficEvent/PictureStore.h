@@ -0,0 +1,123 @@
+#pragma once
+#include <windows.h>
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "dhnetsdk.h"
+#include "EventQueue.h"
+#include "TrafficRecord.h"
+
+#define PICTURE_POOL_BUFFERS	256			// events whose pictures can wait for the disk at once
+#define PICTURE_MAX_BYTES		(32 << 20)	// larger picture buffers are not stored
+#define PICTURE_TAKE_BATCH		32			// jobs a writer takes off the queue at once
+#define PICTURE_IDLE_WAIT_MS	10
+#define PICTURE_MAX_THREADS		16
+
+typedef struct PictureStoreOptions
+{
+	std::string root;				// directory the date / camera / lane tree goes under
+	int threads = 2;				// writer threads
+	bool bSync = true;				// flush every file to disk (_commit) before it counts as stored
+} PictureStoreOptions;
+
+#pragma pack(push, 4)
+typedef struct PictureStoreStats
+{
+	uint64_t submitted;			// events with pictures
+	uint64_t stored;			// events whose files were all written (and flushed with bSync)
+	uint64_t files;
+	uint64_t bytes;
+	uint64_t dropped;			// no free buffer or picture too large: event goes on without files
+	uint64_t failed;			// files that could not be written
+	uint64_t syncs;				// files flushed to disk, one _commit each
+	uint32_t queueDepth;
+	uint32_t buffersInUse;
+} PictureStoreStats;
+#pragma pack(pop)
+
+// Stores the pictures that come with traffic events. On the SDK thread,
+// Submit finds the scene picture and the plate and vehicle cutouts in the
+// event's picture buffer (they are slices of it, located by the stPicInfo
+// offsets), copies the buffer once into a pooled buffer and queues a job;
+// it names the files in the record and returns. Writer threads write each
+// slice straight from the pooled buffer to its file under
+//   <root>/yyyymmdd/cNNN/lN/hhmmssmmm_seq_{scene,plate,vehicle}.jpg
+// flush each file to disk as soon as it is written, and hand the buffer
+// back once the event's files are done.
+//
+// The flush is not shared between files: Windows has no call that syncs a
+// group of files, and the file names are in the record before the write,
+// so the slices cannot go into one file per batch. With bSync an event
+// costs up to three _commit waits; the writer threads overlap them.
+//
+// Nothing on the SDK thread allocates once the pooled buffers have grown to
+// the picture size, takes a lock or waits: without a free buffer the event
+// goes on without pictures and is counted as dropped.
+class PictureStore
+{
+public:
+	PictureStore();
+	~PictureStore();
+
+	// False when root cannot be created.
+	bool Start(const PictureStoreOptions& options);
+	// Writes what is queued, then stops.
+	void Stop();
+
+	// SDK thread. Sets pRecord->pictures and pRecord->picture for what was
+	// queued; needs seq, camera, lane and eventMs filled in.
+	void Submit(const DEV_EVENT_TRAFFICJUNCTION_INFO* pInfo, const BYTE* pBuffer, DWORD dwBufSize, TrafficRecord* pRecord);
+
+	void GetStats(PictureStoreStats* pStats) const;
+
+private:
+	struct Buffer
+	{
+		std::unique_ptr<uint8_t[]> data;
+		uint32_t capacity;
+	};
+
+	struct Slice
+	{
+		uint32_t offset;
+		uint32_t size;
+	};
+
+	struct Job
+	{
+		Buffer* pBuffer;
+		Slice slices[3];			// scene, plate, vehicle; size 0 when absent
+		char picture[TRAFFIC_PATH_LEN];
+	};
+
+	void Run();
+	void WriteJob(const Job& job, std::string& lastDir);
+
+	PictureStoreOptions m_options;
+	std::vector<std::unique_ptr<Buffer>> m_buffers;
+	EventQueue<Buffer*> m_free;
+	EventQueue<Job> m_jobs;
+
+	std::atomic<uint64_t> m_nSubmitted;
+	std::atomic<uint64_t> m_nStored;
+	std::atomic<uint64_t> m_nFiles;
+	std::atomic<uint64_t> m_nBytes;
+	std::atomic<uint64_t> m_nDropped;
+	std::atomic<uint64_t> m_nFailed;
+	std::atomic<uint64_t> m_nSyncs;
+
+	// Submit calls under way; Stop waits them out before draining
+	std::atomic<int> m_nSubmitting;
+	std::atomic<bool> m_bAccepting;
+
+	std::mutex m_waitLock;
+	std::condition_variable m_cv;
+	std::atomic<int> m_nIdle;
+	std::atomic<bool> m_bRunning;
+	std::vector<std::thread> m_threads;
+};
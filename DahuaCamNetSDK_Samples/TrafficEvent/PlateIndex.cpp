@@ -0,0 +1,248 @@
+#include <stdio.h>
+#include <string.h>
+#include <xmmintrin.h>
+#include <atomic>
+#include "PlateIndex.h"
+
+#define PLATE_MAX_LEN			(TRAFFIC_PLATE_LEN - 1)
+
+static char FoldChar(char c)
+{
+	switch (c) {
+	case 'O': case 'Q': case 'D': return '0';
+	case 'I': return '1';
+	case 'Z': return '2';
+	case 'S': return '5';
+	case 'G': return '6';
+	case 'B': return '8';
+	default: return c;
+	}
+}
+
+int PlateNormalize(const char* plate, char* clean, char* folded)
+{
+	int len = 0;
+	for (const char* p = plate; p != NULL && *p != '\0' && len < PLATE_MAX_LEN; p++) {
+		char c = *p;
+		if (c == ' ' || c == '-' || c == '.' || c == '\t' || c == '"')
+			continue;
+		if (c >= 'a' && c <= 'z')
+			c -= 'a' - 'A';
+		clean[len] = c;
+		folded[len] = FoldChar(c);
+		len++;
+	}
+	memset(clean + len, 0, TRAFFIC_PLATE_LEN - len);
+	memset(folded + len, 0, TRAFFIC_PLATE_LEN - len);
+	return len;
+}
+
+// FNV-1a, then a splitmix64 finish so the low bits used for the slot are
+// well mixed even for plates differing in one character
+static uint64_t HashKey(const char* key, int len)
+{
+	uint64_t h = 14695981039346656037ULL;
+	for (int i = 0; i < len; i++) {
+		h ^= (uint8_t)key[i];
+		h *= 1099511628211ULL;
+	}
+	h ^= h >> 30;
+	h *= 0xbf58476d1ce4e5b9ULL;
+	h ^= h >> 27;
+	h *= 0x94d049bb133111ebULL;
+	h ^= h >> 31;
+	return h;
+}
+
+// The key itself and its deletions; a deletion that repeats the previous
+// one (doubled character) is left out. Returns the number of hashes.
+static int KeyHashes(const char* key, int len, uint64_t* pHashes)
+{
+	int n = 0;
+	pHashes[n++] = HashKey(key, len);
+	if (len < 2)
+		return n;
+	char buf[TRAFFIC_PLATE_LEN];
+	for (int i = 0; i < len; i++) {
+		if (i > 0 && key[i] == key[i - 1])
+			continue;
+		memcpy(buf, key, i);
+		memcpy(buf + i, key + i + 1, len - i - 1);
+		pHashes[n++] = HashKey(buf, len - 1);
+	}
+	return n;
+}
+
+static bool WithinOneEdit(const char* a, int la, const char* b, int lb)
+{
+	if (la < lb) {
+		const char* t = a; a = b; b = t;
+		int l = la; la = lb; lb = l;
+	}
+	if (la - lb > 1)
+		return false;
+	int i = 0;
+	while (i < lb && a[i] == b[i])
+		i++;
+	if (i == lb)
+		return true;
+	if (la == lb)
+		return memcmp(a + i + 1, b + i + 1, lb - i - 1) == 0;
+	return memcmp(a + i + 1, b + i, lb - i) == 0;
+}
+
+static uint32_t SlotTag(uint64_t hash)
+{
+	return (uint32_t)(hash >> 32) | 1;
+}
+
+void PlateTable::Probe(uint64_t hash, const char* clean, const char* folded, int len, PlateMatch* pBest) const
+{
+	uint32_t tag = SlotTag(hash);
+	for (uint64_t pos = hash & m_mask; m_slots[pos] != 0; pos = (pos + 1) & m_mask) {
+		if ((uint32_t)(m_slots[pos] >> 32) != tag)
+			continue;
+		const Entry& entry = m_entries[(uint32_t)m_slots[pos]];
+		int match;
+		if (entry.len == len && memcmp(entry.folded, folded, len) == 0)
+			match = memcmp(entry.clean, clean, len) == 0 ? PLATE_MATCH_EXACT : PLATE_MATCH_CONFUSABLE;
+		else if (WithinOneEdit(entry.folded, entry.len, folded, len))
+			match = PLATE_MATCH_FUZZY;
+		else
+			continue;
+		if (pBest->match == PLATE_MATCH_NONE || match < pBest->match
+			|| (match == pBest->match && entry.list == PLATE_LIST_BLOCK && pBest->list != PLATE_LIST_BLOCK)) {
+			pBest->match = match;
+			pBest->list = entry.list;
+			pBest->tag = entry.tag;
+			memcpy(pBest->plate, entry.clean, sizeof(pBest->plate));
+		}
+	}
+}
+
+int PlateTable::Lookup(const char* plate, PlateMatch* pMatch) const
+{
+	PlateMatch best;
+	memset(&best, 0, sizeof(best));
+	char clean[TRAFFIC_PLATE_LEN];
+	char folded[TRAFFIC_PLATE_LEN];
+	int len = plate != NULL ? PlateNormalize(plate, clean, folded) : 0;
+	if (len > 0 && !m_slots.empty()) {
+		uint64_t hashes[TRAFFIC_PLATE_LEN];
+		int nHashes = KeyHashes(folded, len, hashes);
+		// Every probe is a cache miss in a large table; start them all
+		// before walking the first
+		for (int i = 0; i < nHashes; i++)
+			_mm_prefetch((const char*)&m_slots[hashes[i] & m_mask], _MM_HINT_T0);
+		// The folded form itself finds exact and confusable matches, which
+		// beat anything the deletions can find
+		Probe(hashes[0], clean, folded, len, &best);
+		for (int i = 1; i < nHashes && best.match == PLATE_MATCH_NONE; i++)
+			Probe(hashes[i], clean, folded, len, &best);
+		if (best.match == PLATE_MATCH_FUZZY) {
+			// Keep looking only for a block list entry
+			for (int i = 1; i < nHashes && best.list != PLATE_LIST_BLOCK; i++)
+				Probe(hashes[i], clean, folded, len, &best);
+		}
+	}
+	if (pMatch != NULL)
+		*pMatch = best;
+	return best.match;
+}
+
+size_t PlateTable::MemoryBytes() const
+{
+	return m_slots.capacity() * sizeof(uint64_t) + m_entries.capacity() * sizeof(Entry);
+}
+
+bool PlateTableBuilder::Add(const char* plate, int list, uint32_t tag)
+{
+	PlateTable::Entry entry;
+	int len = plate != NULL ? PlateNormalize(plate, entry.clean, entry.folded) : 0;
+	if (len == 0)
+		return false;
+	entry.len = (uint8_t)len;
+	entry.list = (uint8_t)list;
+	entry.tag = tag;
+	m_entries.push_back(entry);
+	return true;
+}
+
+int PlateTableBuilder::LoadFile(const char* path, int list)
+{
+	FILE* fp = fopen(path, "rb");
+	if (fp == NULL)
+		return -1;
+	char line[512];
+	uint32_t lineNo = 0;
+	int n = 0;
+	while (fgets(line, sizeof(line), fp) != NULL) {
+		lineNo++;
+		char* p = line;
+		if (lineNo == 1 && (uint8_t)p[0] == 0xEF && (uint8_t)p[1] == 0xBB && (uint8_t)p[2] == 0xBF)
+			p += 3;
+		while (*p == ' ' || *p == '\t')
+			p++;
+		if (*p == '#')
+			continue;
+		size_t field = strcspn(p, ",\t\r\n");
+		p[field] = '\0';
+		if (field == 0 || strcmp(p, "PlateNumber") == 0 || strcmp(p, "\"PlateNumber\"") == 0)
+			continue;
+		if (Add(p, list, lineNo))
+			n++;
+	}
+	fclose(fp);
+	return n;
+}
+
+std::shared_ptr<const PlateTable> PlateTableBuilder::Build()
+{
+	std::shared_ptr<PlateTable> table = std::make_shared<PlateTable>();
+	table->m_entries.swap(m_entries);
+	m_entries.clear();
+
+	size_t nKeys = 0;
+	for (const PlateTable::Entry& entry : table->m_entries)
+		nKeys += 1 + entry.len;
+	// Linear probing stays short below three quarters full
+	size_t capacity = 16;
+	while (capacity * 3 < nKeys * 4)
+		capacity <<= 1;
+	table->m_slots.assign(capacity, 0);
+	table->m_mask = capacity - 1;
+
+	uint64_t hashes[TRAFFIC_PLATE_LEN];
+	for (size_t i = 0; i < table->m_entries.size(); i++) {
+		const PlateTable::Entry& entry = table->m_entries[i];
+		int nHashes = KeyHashes(entry.folded, entry.len, hashes);
+		for (int k = 0; k < nHashes; k++) {
+			uint64_t pos = hashes[k] & table->m_mask;
+			while (table->m_slots[pos] != 0)
+				pos = (pos + 1) & table->m_mask;
+			table->m_slots[pos] = ((uint64_t)SlotTag(hashes[k]) << 32) | (uint32_t)i;
+		}
+	}
+	return table;
+}
+
+void PlateIndex::Swap(std::shared_ptr<const PlateTable> table)
+{
+	std::atomic_store(&m_table, std::move(table));
+}
+
+std::shared_ptr<const PlateTable> PlateIndex::Current() const
+{
+	return std::atomic_load(&m_table);
+}
+
+int PlateIndex::Lookup(const char* plate, PlateMatch* pMatch) const
+{
+	std::shared_ptr<const PlateTable> table = Current();
+	if (!table) {
+		if (pMatch != NULL)
+			memset(pMatch, 0, sizeof(*pMatch));
+		return PLATE_MATCH_NONE;
+	}
+	return table->Lookup(plate, pMatch);
+}
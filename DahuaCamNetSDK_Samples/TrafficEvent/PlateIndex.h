@@ -0,0 +1,117 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "TrafficRecord.h"
+
+// Allow / block lists of plates, matched in memory so an OCR slip does not
+// cost a hit. Plates are compared in two forms:
+//   clean   upper case, spaces, '-' and '.' removed
+//   folded  clean with the characters OCR confuses mapped onto one:
+//           O Q D -> 0, I -> 1, Z -> 2, S -> 5, G -> 6, B -> 8
+// A query matches a listed plate exactly (same clean form), by confusion
+// (same folded form) or fuzzily (folded forms one insertion, deletion or
+// substitution apart). Bytes outside ASCII (province characters) are kept
+// as they are, so a misread one costs its byte length in edits.
+//
+// Every folded plate and each of its single deletions goes into one open
+// addressing hash table; a query probes its own folded form and its own
+// deletions, which covers all four cases, and verifies the candidates. That
+// is at most TRAFFIC_PLATE_LEN probes, prefetched together, whatever the
+// list size.
+
+#define PLATE_LIST_ALLOW		1	// red list
+#define PLATE_LIST_BLOCK		2	// black list
+
+#define PLATE_MATCH_NONE		0
+#define PLATE_MATCH_EXACT		1
+#define PLATE_MATCH_CONFUSABLE	2
+#define PLATE_MATCH_FUZZY		3
+
+// TrafficRecord::listHit packs list and match kind
+#define PLATE_HIT(list, match)	((uint8_t)((list) | ((match) << 4)))
+#define PLATE_HIT_LIST(hit)		((hit) & 0x0F)
+#define PLATE_HIT_MATCH(hit)	((hit) >> 4)
+
+#pragma pack(push, 4)
+typedef struct PlateMatch
+{
+	int match;					// PLATE_MATCH_*
+	int list;					// PLATE_LIST_*, 0 without a match
+	uint32_t tag;				// value given when the plate was added
+	char plate[TRAFFIC_PLATE_LEN];	// listed plate, clean form
+} PlateMatch;
+#pragma pack(pop)
+
+// Writes the clean and folded forms (each TRAFFIC_PLATE_LEN, NUL
+// terminated) and returns their length; longer plates are cut.
+int PlateNormalize(const char* plate, char* clean, char* folded);
+
+// Immutable once built; share it between threads freely.
+class PlateTable
+{
+public:
+	// Best match for plate: exact before confusable before fuzzy, and on a
+	// tie the block list before the allow list. Returns pMatch->match.
+	int Lookup(const char* plate, PlateMatch* pMatch) const;
+
+	size_t Size() const { return m_entries.size(); }
+	size_t MemoryBytes() const;
+
+private:
+	friend class PlateTableBuilder;
+
+	struct Entry
+	{
+		char clean[TRAFFIC_PLATE_LEN];
+		char folded[TRAFFIC_PLATE_LEN];
+		uint8_t len;
+		uint8_t list;
+		uint32_t tag;
+	};
+
+	void Probe(uint64_t hash, const char* clean, const char* folded, int len, PlateMatch* pBest) const;
+
+	// Key hash in the upper half (never 0, which marks an empty slot),
+	// entry index in the lower
+	std::vector<uint64_t> m_slots;
+	uint64_t m_mask = 0;
+	std::vector<Entry> m_entries;
+};
+
+class PlateTableBuilder
+{
+public:
+	// Plates that normalize to nothing are skipped. Returns false for those.
+	bool Add(const char* plate, int list, uint32_t tag);
+
+	// One plate per line, the first comma or tab separated field; empty
+	// lines and lines starting with '#' are skipped, as is a header line
+	// naming the column "PlateNumber". The tag is the line number. Returns
+	// the number of plates added or -1 when the file cannot be read.
+	int LoadFile(const char* path, int list);
+
+	// Moves the plates added so far into a table and starts over.
+	std::shared_ptr<const PlateTable> Build();
+
+private:
+	std::vector<PlateTable::Entry> m_entries;
+};
+
+// The table in use, replaced as a whole when the lists are reloaded. A
+// lookup keeps the table it started with alive, so a swap never waits for
+// readers and readers never see half a list.
+class PlateIndex
+{
+public:
+	void Swap(std::shared_ptr<const PlateTable> table);
+	std::shared_ptr<const PlateTable> Current() const;
+
+	// PLATE_MATCH_NONE while no table is loaded.
+	int Lookup(const char* plate, PlateMatch* pMatch) const;
+
+private:
+	std::shared_ptr<const PlateTable> m_table;
+};
@@ -0,0 +1,198 @@
+#include <algorithm>
+#include <filesystem>
+#include <vector>
+#include "SpillQueue.h"
+
+namespace fs = std::filesystem;
+
+SpillQueue::SpillQueue()
+	: m_pWrite(NULL), m_nWriteRecords(0), m_pRead(NULL), m_readSegment(0), m_nRecords(0)
+{
+}
+
+SpillQueue::~SpillQueue()
+{
+	Close();
+}
+
+std::string SpillQueue::SegmentPath(uint64_t segment) const
+{
+	char name[64];
+	snprintf(name, sizeof(name), "spill_%08llu.trs", (unsigned long long)segment);
+	return (fs::path(m_dir) / name).string();
+}
+
+// Records in a segment file; a record cut short by a crash does not count
+static uint64_t RecordsInFile(const std::string& path)
+{
+	std::error_code ec;
+	uint64_t size = fs::file_size(path, ec);
+	if (ec || size < sizeof(SpillSegmentHeader))
+		return 0;
+	return (size - sizeof(SpillSegmentHeader)) / sizeof(TrafficRecord);
+}
+
+bool SpillQueue::Open(const char* dir)
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	if (dir == NULL || dir[0] == '\0')
+		return false;
+	std::error_code ec;
+	fs::create_directories(dir, ec);
+	if (!fs::is_directory(dir, ec))
+		return false;
+	m_dir = dir;
+	m_segments.clear();
+	m_nRecords = 0;
+
+	std::vector<uint64_t> found;
+	for (const fs::directory_entry& entry : fs::directory_iterator(m_dir, ec)) {
+		std::string name = entry.path().filename().string();
+		unsigned long long segment;
+		if (sscanf(name.c_str(), "spill_%llu.trs", &segment) == 1)
+			found.push_back(segment);
+	}
+	std::sort(found.begin(), found.end());
+	for (uint64_t segment : found) {
+		m_segments.push_back(segment);
+		m_nRecords += RecordsInFile(SegmentPath(segment));
+	}
+	return true;
+}
+
+void SpillQueue::Close()
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	if (m_pWrite != NULL) {
+		fclose(m_pWrite);
+		m_pWrite = NULL;
+	}
+	if (m_pRead != NULL) {
+		fclose(m_pRead);
+		m_pRead = NULL;
+	}
+	m_dir.clear();
+	m_segments.clear();
+	m_nRecords = 0;
+}
+
+// Every run appends to a segment of its own, so segments left behind are
+// never written again
+bool SpillQueue::OpenWriteSegment()
+{
+	uint64_t segment = m_segments.empty() ? 1 : m_segments.back() + 1;
+	FILE* fp = fopen(SegmentPath(segment).c_str(), "wb");
+	if (fp == NULL)
+		return false;
+	SpillSegmentHeader header;
+	header.magic = SPILL_MAGIC;
+	header.recordSize = sizeof(TrafficRecord);
+	header.segment = segment;
+	if (fwrite(&header, sizeof(header), 1, fp) != 1 || fflush(fp) != 0) {
+		fclose(fp);
+		remove(SegmentPath(segment).c_str());
+		return false;
+	}
+	m_segments.push_back(segment);
+	m_pWrite = fp;
+	m_nWriteRecords = 0;
+	return true;
+}
+
+bool SpillQueue::Append(const TrafficRecord* pRecords, int nCount)
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	if (m_dir.empty())
+		return false;
+	while (nCount > 0) {
+		if (m_pWrite != NULL && m_nWriteRecords >= SPILL_SEGMENT_RECORDS) {
+			fclose(m_pWrite);
+			m_pWrite = NULL;
+		}
+		if (m_pWrite == NULL && !OpenWriteSegment())
+			return false;
+		int n = std::min(nCount, (int)(SPILL_SEGMENT_RECORDS - m_nWriteRecords));
+		// Flushed so the reader, which has the file open separately, sees them
+		if (fwrite(pRecords, sizeof(TrafficRecord), n, m_pWrite) != (size_t)n || fflush(m_pWrite) != 0)
+			return false;
+		m_nWriteRecords += n;
+		m_nRecords += n;
+		pRecords += n;
+		nCount -= n;
+	}
+	return true;
+}
+
+bool SpillQueue::OpenReadSegment()
+{
+	while (!m_segments.empty()) {
+		uint64_t segment = m_segments.front();
+		FILE* fp = fopen(SegmentPath(segment).c_str(), "rb");
+		SpillSegmentHeader header;
+		if (fp != NULL && fread(&header, sizeof(header), 1, fp) == 1
+			&& header.magic == SPILL_MAGIC && header.recordSize == sizeof(TrafficRecord)) {
+			m_pRead = fp;
+			m_readSegment = segment;
+			return true;
+		}
+		// Unreadable or from another record layout: give it up
+		if (fp != NULL)
+			fclose(fp);
+		printf("Spill: dropping unreadable segment %s\n", SegmentPath(segment).c_str());
+		m_nRecords -= std::min(m_nRecords, RecordsInFile(SegmentPath(segment)));
+		remove(SegmentPath(segment).c_str());
+		m_segments.pop_front();
+	}
+	return false;
+}
+
+int SpillQueue::Read(TrafficRecord* pRecords, int maxCount)
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	int n = 0;
+	while (n < maxCount && m_nRecords > 0) {
+		if (m_pRead == NULL && !OpenReadSegment())
+			break;
+		size_t got = fread(pRecords + n, sizeof(TrafficRecord), maxCount - n, m_pRead);
+		n += (int)got;
+		m_nRecords -= std::min<uint64_t>(m_nRecords, got);
+		if (n == maxCount)
+			break;
+		// End of file: the segment being written stays, anything older is done
+		clearerr(m_pRead);
+		if (m_pWrite != NULL && m_readSegment == m_segments.back())
+			break;
+		fclose(m_pRead);
+		m_pRead = NULL;
+		remove(SegmentPath(m_readSegment).c_str());
+		m_segments.pop_front();
+	}
+	// Everything read: drop the segments, including the one being written,
+	// rather than let them grow or be read again after a restart
+	if (m_nRecords == 0 && !m_segments.empty()) {
+		if (m_pRead != NULL) {
+			fclose(m_pRead);
+			m_pRead = NULL;
+		}
+		if (m_pWrite != NULL) {
+			fclose(m_pWrite);
+			m_pWrite = NULL;
+		}
+		for (uint64_t segment : m_segments)
+			remove(SegmentPath(segment).c_str());
+		m_segments.clear();
+	}
+	return n;
+}
+
+uint64_t SpillQueue::Count()
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	return m_nRecords;
+}
+
+uint64_t SpillQueue::Bytes()
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	return m_nRecords * sizeof(TrafficRecord);
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <deque>
+#include <mutex>
+#include <string>
+#include "TrafficRecord.h"
+
+// First in, first out queue of records on disk, for what BatchSink cannot
+// hold in memory while its target is slow or down. Records are appended
+// raw to segment files spill_<n>.trs of up to SPILL_SEGMENT_RECORDS each;
+// a segment is deleted once it has been read to the end. Segments found at
+// Open are a previous run's backlog and are read first.
+//
+// Delivery is at least once: how far the head segment was read is not
+// persisted, so after a crash its records are read again.
+#define SPILL_SEGMENT_RECORDS	8192
+#define SPILL_MAGIC				0x50535254	// "TRSP"
+
+#pragma pack(push, 4)
+typedef struct SpillSegmentHeader
+{
+	uint32_t magic;
+	uint32_t recordSize;
+	uint64_t segment;
+} SpillSegmentHeader;
+#pragma pack(pop)
+
+class SpillQueue
+{
+public:
+	SpillQueue();
+	~SpillQueue();
+
+	// Creates dir when needed. False when it cannot be used.
+	bool Open(const char* dir);
+	void Close();
+	bool IsOpen() const { return !m_dir.empty(); }
+
+	bool Append(const TrafficRecord* pRecords, int nCount);
+	// Takes up to maxCount of the oldest records; returns how many.
+	int Read(TrafficRecord* pRecords, int maxCount);
+
+	uint64_t Count();
+	uint64_t Bytes();
+
+private:
+	std::string SegmentPath(uint64_t segment) const;
+	bool OpenWriteSegment();
+	bool OpenReadSegment();
+
+	std::mutex m_lock;
+	std::string m_dir;
+	std::deque<uint64_t> m_segments;	// oldest first; the last one is written
+	FILE* m_pWrite;
+	uint32_t m_nWriteRecords;
+	FILE* m_pRead;
+	uint64_t m_readSegment;
+	uint64_t m_nRecords;
+};
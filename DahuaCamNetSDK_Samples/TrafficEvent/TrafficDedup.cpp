@@ -0,0 +1,275 @@
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include "TrafficDedup.h"
+
+TrafficDedup::TrafficDedup()
+	: m_tickUs(DEDUP_TICK_MS * 1000LL), m_windowTicks(0), m_lastTick(0), m_passages(DEDUP_MAX_PASSAGES),
+	m_free(-1), m_bucketMask(0), m_wheelMask(0), m_bRunning(false)
+{
+	for (int32_t i = DEDUP_MAX_PASSAGES - 1; i >= 0; i--) {
+		m_passages[i].wheelNext = m_free;
+		m_free = i;
+	}
+	uint32_t buckets = 2;
+	while (buckets < 2 * DEDUP_MAX_PASSAGES)
+		buckets <<= 1;
+	m_buckets.assign(buckets, -1);
+	m_bucketMask = buckets - 1;
+	for (int i = 0; i < TRAFFIC_MAX_CAMERAS; i++)
+		m_groups[i] = 0;
+	memset(&m_stats, 0, sizeof(m_stats));
+}
+
+TrafficDedup::~TrafficDedup()
+{
+	Stop();
+}
+
+void TrafficDedup::Start(int windowMs)
+{
+	if (m_thread.joinable())
+		return;
+	if (windowMs <= 0)
+		windowMs = DEDUP_DEFAULT_WINDOW_MS;
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		m_windowTicks = (windowMs + DEDUP_TICK_MS - 1) / DEDUP_TICK_MS;
+		// Every open passage closes less than one turn of the wheel ahead
+		uint32_t slots = 2;
+		while (slots < m_windowTicks + 2)
+			slots <<= 1;
+		m_wheel.assign(slots, -1);
+		m_wheelMask = slots - 1;
+		m_lastTick = NowTick();
+		m_stats.windowMs = (uint32_t)windowMs;
+	}
+	m_bRunning = true;
+	m_thread = std::thread(&TrafficDedup::Run, this);
+}
+
+void TrafficDedup::Stop()
+{
+	if (!m_thread.joinable())
+		return;
+	{
+		std::lock_guard<std::mutex> guard(m_waitLock);
+		m_bRunning = false;
+		m_cv.notify_one();
+	}
+	m_thread.join();
+}
+
+void TrafficDedup::SetCameraGroup(int camera, int group)
+{
+	if (camera < 0 || camera >= TRAFFIC_MAX_CAMERAS)
+		return;
+	std::lock_guard<std::mutex> guard(m_lock);
+	m_groups[camera] = group;
+}
+
+void TrafficDedup::AddSink(TrafficSink* pSink)
+{
+	std::lock_guard<std::mutex> guard(m_sinkLock);
+	if (std::find(m_sinks.begin(), m_sinks.end(), pSink) == m_sinks.end())
+		m_sinks.push_back(pSink);
+}
+
+void TrafficDedup::RemoveSink(TrafficSink* pSink)
+{
+	std::lock_guard<std::mutex> guard(m_sinkLock);
+	m_sinks.erase(std::remove(m_sinks.begin(), m_sinks.end(), pSink), m_sinks.end());
+}
+
+// Steady clock, so a wall clock step neither holds passages open nor
+// closes them early
+int64_t TrafficDedup::NowTick() const
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count() / m_tickUs;
+}
+
+static uint64_t PassageHash(int32_t group, const char* folded)
+{
+	uint64_t hash = 14695981039346656037ULL ^ (uint32_t)group;
+	for (const char* p = folded; *p != '\0'; p++) {
+		hash ^= (uint8_t)*p;
+		hash *= 1099511628211ULL;
+	}
+	return hash ^ (hash >> 29);
+}
+
+static TrafficSighting ToSighting(const TrafficRecord& record)
+{
+	TrafficSighting sighting;
+	sighting.seq = record.seq;
+	sighting.camera = record.camera;
+	sighting.lane = record.lane;
+	sighting.confidence = record.confidence;
+	sighting.pictures = record.pictures;
+	memcpy(sighting.picture, record.picture, sizeof(sighting.picture));
+	return sighting;
+}
+
+// A block list hit outranks an allow list hit, which outranks none
+static uint8_t StrongerHit(uint8_t a, uint8_t b)
+{
+	if (b == 0 || (a != 0 && PLATE_HIT_LIST(a) == PLATE_LIST_BLOCK))
+		return a;
+	if (a == 0 || PLATE_HIT_LIST(b) == PLATE_LIST_BLOCK)
+		return b;
+	return a;
+}
+
+void TrafficDedup::Merge(Passage* pPassage, const TrafficRecord& record)
+{
+	TrafficRecord& best = pPassage->record;
+	int sightings = best.sightings;
+	uint8_t listHit = StrongerHit(best.listHit, record.listHit);
+	TrafficSighting other;
+	if (record.confidence > best.confidence) {
+		other = ToSighting(best);
+		TrafficSighting merged[TRAFFIC_MAX_MERGED];
+		memcpy(merged, best.merged, sizeof(merged));
+		best = record;
+		memcpy(best.merged, merged, sizeof(merged));
+	} else {
+		other = ToSighting(record);
+	}
+	if (sightings - 1 < TRAFFIC_MAX_MERGED)
+		best.merged[sightings - 1] = other;
+	best.sightings = (uint8_t)std::min(sightings + 1, 255);
+	best.listHit = listHit;
+}
+
+void TrafficDedup::OnTrafficEvents(const TrafficRecord* pRecords, int nCount)
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	for (int i = 0; i < nCount; i++) {
+		const TrafficRecord& record = pRecords[i];
+		m_stats.received++;
+		int32_t group = record.camera >= 0 && record.camera < TRAFFIC_MAX_CAMERAS ? m_groups[record.camera] : 0;
+		char clean[TRAFFIC_PLATE_LEN];
+		char folded[TRAFFIC_PLATE_LEN];
+		if (group == DEDUP_NO_GROUP || m_wheel.empty() || 0 == PlateNormalize(record.plate, clean, folded)) {
+			m_out.push_back(record);
+			m_stats.passedThrough++;
+			m_stats.passages++;
+			continue;
+		}
+
+		uint64_t hash = PassageHash(group, folded);
+		int32_t* pBucket = &m_buckets[hash & m_bucketMask];
+		int32_t index = *pBucket;
+		while (index >= 0) {
+			Passage& passage = m_passages[index];
+			if (passage.hash == hash && passage.group == group && 0 == strcmp(passage.folded, folded))
+				break;
+			index = passage.hashNext;
+		}
+		if (index >= 0) {
+			Merge(&m_passages[index], record);
+			m_stats.merged++;
+			continue;
+		}
+		if (m_free < 0) {
+			m_out.push_back(record);
+			m_stats.passedThrough++;
+			m_stats.passages++;
+			continue;
+		}
+
+		index = m_free;
+		Passage& passage = m_passages[index];
+		m_free = passage.wheelNext;
+		passage.record = record;
+		passage.record.sightings = 1;
+		passage.hash = hash;
+		passage.group = group;
+		memcpy(passage.folded, folded, sizeof(passage.folded));
+		// A passage never closes in a slot the wheel has already passed
+		passage.closeTick = std::max(NowTick(), m_lastTick) + m_windowTicks;
+		passage.hashNext = *pBucket;
+		*pBucket = index;
+		int32_t* pSlot = &m_wheel[passage.closeTick & m_wheelMask];
+		passage.wheelNext = *pSlot;
+		*pSlot = index;
+		m_stats.open++;
+	}
+}
+
+// Unlinks the passage from its hash chain and sends it on; the caller has
+// taken it off the wheel
+void TrafficDedup::Close(int32_t index)
+{
+	Passage& passage = m_passages[index];
+	int32_t* pLink = &m_buckets[passage.hash & m_bucketMask];
+	while (*pLink != index)
+		pLink = &m_passages[*pLink].hashNext;
+	*pLink = passage.hashNext;
+	m_out.push_back(passage.record);
+	m_stats.passages++;
+	m_stats.open--;
+	passage.wheelNext = m_free;
+	m_free = index;
+}
+
+// Closes what is due up to tick, or everything with bAll. After a long
+// stall every slot is visited once rather than once per tick missed.
+void TrafficDedup::Advance(int64_t tick, bool bAll)
+{
+	if (tick <= m_lastTick && !bAll)
+		return;
+	int64_t from = bAll ? 0 : std::max(m_lastTick + 1, tick - (int64_t)m_wheelMask);
+	int64_t to = bAll ? (int64_t)m_wheelMask : tick;
+	for (int64_t t = from; t <= to; t++) {
+		int32_t* pLink = &m_wheel[t & m_wheelMask];
+		while (*pLink >= 0) {
+			int32_t index = *pLink;
+			Passage& passage = m_passages[index];
+			if (passage.closeTick > tick && !bAll) {
+				pLink = &passage.wheelNext;
+				continue;
+			}
+			*pLink = passage.wheelNext;
+			Close(index);
+		}
+	}
+	m_lastTick = std::max(m_lastTick, tick);
+}
+
+void TrafficDedup::Run()
+{
+	std::vector<TrafficRecord> out;
+	for (;;) {
+		bool bRunning;
+		{
+			std::unique_lock<std::mutex> lock(m_waitLock);
+			if (m_bRunning)
+				m_cv.wait_for(lock, std::chrono::milliseconds(DEDUP_TICK_MS));
+			bRunning = m_bRunning;
+		}
+		{
+			std::lock_guard<std::mutex> guard(m_lock);
+			// Stopping closes everything
+			Advance(NowTick(), !bRunning);
+			out.swap(m_out);
+		}
+		if (!out.empty()) {
+			std::lock_guard<std::mutex> guard(m_sinkLock);
+			for (TrafficSink* pSink : m_sinks)
+				pSink->OnTrafficEvents(out.data(), (int)out.size());
+			out.clear();
+		}
+		if (!bRunning)
+			break;
+	}
+}
+
+void TrafficDedup::GetStats(TrafficDedupStats* pStats)
+{
+	if (pStats == NULL)
+		return;
+	std::lock_guard<std::mutex> guard(m_lock);
+	*pStats = m_stats;
+}
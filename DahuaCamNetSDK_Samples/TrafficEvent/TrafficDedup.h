@@ -0,0 +1,100 @@
+#pragma once
+#include <stdint.h>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "TrafficEventEngine.h"
+
+#define DEDUP_MAX_PASSAGES		16384	// passages inside the window at once
+#define DEDUP_TICK_MS			20		// wheel resolution; a passage closes up to this late
+#define DEDUP_DEFAULT_WINDOW_MS	1500
+#define DEDUP_NO_GROUP			-1		// camera group that is never deduplicated
+
+#pragma pack(push, 4)
+typedef struct TrafficDedupStats
+{
+	uint64_t received;
+	uint64_t passages;			// records sent on, merged or not
+	uint64_t merged;			// events folded into an earlier one
+	uint64_t passedThrough;		// no plate, no group or no free slot: sent on as they are
+	uint32_t open;				// passages still inside the window
+	uint32_t windowMs;
+} TrafficDedupStats;
+#pragma pack(pop)
+
+// Merges the events several cameras of a gantry report for one vehicle. A
+// sink of the engine and a source for sinks of its own: events of cameras
+// in the same group whose plates match (PlateNormalize folded form) within
+// windowMs of the first one become one record, sent on when the window
+// closes. The most confident event is the record; the others ride along in
+// TrafficRecord::merged with their pictures, sightings counts them all.
+//
+// Open passages sit in a hash table keyed on group and plate, and on a time
+// wheel of DEDUP_TICK_MS slots by the tick they close at, so adding,
+// finding and closing one is O(1) whatever the traffic. Downstream sinks are
+// called on the stage's own thread, every DEDUP_TICK_MS.
+class TrafficDedup : public TrafficSink
+{
+public:
+	TrafficDedup();
+	~TrafficDedup();
+
+	void Start(int windowMs);
+	// Sends on every open passage, then stops.
+	void Stop();
+
+	// Cameras start in group 0, deduplicated against each other.
+	void SetCameraGroup(int camera, int group);
+
+	void AddSink(TrafficSink* pSink);
+	void RemoveSink(TrafficSink* pSink);
+
+	void OnTrafficEvents(const TrafficRecord* pRecords, int nCount) override;
+
+	void GetStats(TrafficDedupStats* pStats);
+
+private:
+	struct Passage
+	{
+		TrafficRecord record;
+		uint64_t hash;
+		int64_t closeTick;
+		int32_t group;
+		int32_t hashNext;			// chain in m_buckets
+		int32_t wheelNext;			// list of one wheel slot, or free list
+		char folded[TRAFFIC_PLATE_LEN];
+	};
+
+	void Merge(Passage* pPassage, const TrafficRecord& record);
+	void Close(int32_t index);
+	void Advance(int64_t tick, bool bAll);
+	int64_t NowTick() const;
+	void Run();
+
+	int64_t m_tickUs;
+	int64_t m_windowTicks;
+	int64_t m_lastTick;				// slots up to this one are closed
+
+	std::vector<Passage> m_passages;
+	int32_t m_free;
+	std::vector<int32_t> m_buckets;
+	std::vector<int32_t> m_wheel;
+	uint32_t m_bucketMask;
+	uint32_t m_wheelMask;
+	int m_groups[TRAFFIC_MAX_CAMERAS];
+
+	// m_lock guards all of the above and m_out
+	std::mutex m_lock;
+	std::vector<TrafficRecord> m_out;
+	TrafficDedupStats m_stats;
+
+	std::mutex m_sinkLock;
+	std::vector<TrafficSink*> m_sinks;
+
+	std::mutex m_waitLock;
+	std::condition_variable m_cv;
+	bool m_bRunning;
+	std::thread m_thread;
+};
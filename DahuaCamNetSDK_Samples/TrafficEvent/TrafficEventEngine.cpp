@@ -0,0 +1,331 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include "TrafficEventEngine.h"
+
+static void CALLBACK DisConnectFunc(LLONG lLoginID, char* pchDVRIP, LONG nDVRPort, LDWORD dwUser)
+{
+	printf("Traffic: device %s:%d disconnected\n", pchDVRIP != NULL ? pchDVRIP : "", (int)nDVRPort);
+}
+
+static void CALLBACK HaveReConnect(LLONG lLoginID, char* pchDVRIP, LONG nDVRPort, LDWORD dwUser)
+{
+	printf("Traffic: device %s:%d reconnected\n", pchDVRIP != NULL ? pchDVRIP : "", (int)nDVRPort);
+}
+
+static TrafficBox ToBox(const DH_RECT& rect)
+{
+	TrafficBox box;
+	box.left = (int16_t)rect.left;
+	box.top = (int16_t)rect.top;
+	box.right = (int16_t)rect.right;
+	box.bottom = (int16_t)rect.bottom;
+	return box;
+}
+
+// Color names arrive in fixed char arrays; terminate before matching
+static uint8_t ColorOf(const char* field, size_t fieldSize)
+{
+	char name[32];
+	TrafficCopyText(name, sizeof(name), field, fieldSize);
+	return TrafficColorCode(name);
+}
+
+TrafficEventEngine::TrafficEventEngine()
+	: m_queue(TRAFFIC_QUEUE_SIZE), m_nextSeq(1), m_nReceived(0), m_nDropped(0), m_nIgnored(0),
+	m_nDelivered(0), m_nBatches(0), m_nCameras(0), m_pPlates(NULL), m_pPictures(NULL), m_pLog(NULL), m_bIdle(false), m_bRunning(false), m_bNetSDKInitFlag(FALSE)
+{
+}
+
+TrafficEventEngine::~TrafficEventEngine()
+{
+	Stop();
+}
+
+int TrafficEventEngine::Start()
+{
+	if (m_bRunning)
+		return TRAFFIC_OK;
+	m_bNetSDKInitFlag = CLIENT_Init(DisConnectFunc, 0);
+	if (FALSE == m_bNetSDKInitFlag)
+		return TRAFFIC_ERR_INIT;
+	CLIENT_SetAutoReconnect(&HaveReConnect, 0);
+	CLIENT_SetConnectTime(5000, 3);
+
+	m_bRunning = true;
+	m_thread = std::thread(&TrafficEventEngine::Run, this);
+	return TRAFFIC_OK;
+}
+
+void TrafficEventEngine::Stop()
+{
+	for (int i = 0; i < TRAFFIC_MAX_CAMERAS; i++) {
+		if (m_cameras[i])
+			Unsubscribe(i);
+	}
+	if (m_thread.joinable()) {
+		m_bRunning = false;
+		{
+			std::lock_guard<std::mutex> guard(m_waitLock);
+			m_cv.notify_one();
+		}
+		m_thread.join();
+	}
+	m_bRunning = false;
+	if (TRUE == m_bNetSDKInitFlag) {
+		CLIENT_Cleanup();
+		m_bNetSDKInitFlag = FALSE;
+	}
+}
+
+int TrafficEventEngine::Subscribe(const char* ip, int port, const char* user, const char* password, int channel)
+{
+	if (ip == NULL || user == NULL || password == NULL || channel < 0)
+		return -TRAFFIC_ERR_PARAM;
+	if (!m_bRunning)
+		return -TRAFFIC_ERR_INIT;
+
+	std::unique_ptr<Camera> camera(new Camera());
+	camera->pEngine = this;
+	camera->channel = channel;
+	camera->ip = ip;
+	camera->lAnalyzerHandle = 0;
+
+	NET_IN_LOGIN_WITH_HIGHLEVEL_SECURITY stInparam;
+	memset(&stInparam, 0, sizeof(stInparam));
+	stInparam.dwSize = sizeof(stInparam);
+	strncpy_s(stInparam.szIP, ip, sizeof(stInparam.szIP) - 1);
+	strncpy_s(stInparam.szUserName, user, sizeof(stInparam.szUserName) - 1);
+	strncpy_s(stInparam.szPassword, password, sizeof(stInparam.szPassword) - 1);
+	stInparam.nPort = port > 0 ? port : 37777;
+	stInparam.emSpecCap = EM_LOGIN_SPEC_CAP_TCP;
+	NET_OUT_LOGIN_WITH_HIGHLEVEL_SECURITY stOutparam;
+	memset(&stOutparam, 0, sizeof(stOutparam));
+	stOutparam.dwSize = sizeof(stOutparam);
+	camera->lLoginHandle = CLIENT_LoginWithHighLevelSecurity(&stInparam, &stOutparam);
+	if (0 == camera->lLoginHandle) {
+		printf("Traffic: login to %s failed, Last Error[%x]\n", ip, CLIENT_GetLastError());
+		return -TRAFFIC_ERR_LOGIN;
+	}
+
+	std::lock_guard<std::mutex> guard(m_cameraLock);
+	int id = -1;
+	for (int i = 0; i < TRAFFIC_MAX_CAMERAS && id < 0; i++) {
+		if (!m_cameras[i])
+			id = i;
+	}
+	if (id < 0) {
+		CLIENT_Logout(camera->lLoginHandle);
+		return -TRAFFIC_ERR_FULL;
+	}
+	camera->id = id;
+	// Events may fire before RealLoadPicture returns, so the camera is in
+	// place first; the callback only needs the pointer passed as dwUser
+	Camera* pCamera = camera.get();
+	m_cameras[id] = std::move(camera);
+	pCamera->lAnalyzerHandle = CLIENT_RealLoadPictureEx(pCamera->lLoginHandle, channel, EVENT_IVS_TRAFFICJUNCTION,
+		TRUE, AnalyzerDataCallBack, (LDWORD)pCamera, NULL);
+	if (0 == pCamera->lAnalyzerHandle) {
+		printf("Traffic: subscribe to %s channel %d failed, Last Error[%x]\n", ip, channel, CLIENT_GetLastError());
+		CLIENT_Logout(pCamera->lLoginHandle);
+		m_cameras[id].reset();
+		return -TRAFFIC_ERR_SUBSCRIBE;
+	}
+	m_nCameras++;
+	return id;
+}
+
+int TrafficEventEngine::Unsubscribe(int camera)
+{
+	if (camera < 0 || camera >= TRAFFIC_MAX_CAMERAS)
+		return TRAFFIC_ERR_PARAM;
+	std::unique_ptr<Camera> pCamera;
+	{
+		std::lock_guard<std::mutex> guard(m_cameraLock);
+		if (!m_cameras[camera])
+			return TRAFFIC_ERR_PARAM;
+		pCamera.swap(m_cameras[camera]);
+		m_nCameras--;
+	}
+	// No callback runs for the handle once CLIENT_StopLoadPic has returned
+	if (0 != pCamera->lAnalyzerHandle && FALSE == CLIENT_StopLoadPic(pCamera->lAnalyzerHandle))
+		printf("Traffic: CLIENT_StopLoadPic (%s) failed, Last Error[%x]\n", pCamera->ip.c_str(), CLIENT_GetLastError());
+	if (FALSE == CLIENT_Logout(pCamera->lLoginHandle))
+		printf("Traffic: CLIENT_Logout (%s) failed, Last Error[%x]\n", pCamera->ip.c_str(), CLIENT_GetLastError());
+	return TRAFFIC_OK;
+}
+
+void TrafficEventEngine::AddSink(TrafficSink* pSink)
+{
+	std::lock_guard<std::mutex> guard(m_sinkLock);
+	if (std::find(m_sinks.begin(), m_sinks.end(), pSink) == m_sinks.end())
+		m_sinks.push_back(pSink);
+}
+
+// Once this returns the sink is not called again
+void TrafficEventEngine::RemoveSink(TrafficSink* pSink)
+{
+	std::lock_guard<std::mutex> guard(m_sinkLock);
+	m_sinks.erase(std::remove(m_sinks.begin(), m_sinks.end(), pSink), m_sinks.end());
+}
+
+void TrafficEventEngine::ReplaceSinks(const std::vector<TrafficSink*>& remove, const std::vector<TrafficSink*>& add)
+{
+	std::lock_guard<std::mutex> guard(m_sinkLock);
+	for (TrafficSink* pSink : remove)
+		m_sinks.erase(std::remove(m_sinks.begin(), m_sinks.end(), pSink), m_sinks.end());
+	for (TrafficSink* pSink : add) {
+		if (std::find(m_sinks.begin(), m_sinks.end(), pSink) == m_sinks.end())
+			m_sinks.push_back(pSink);
+	}
+}
+
+void TrafficEventEngine::GetStats(TrafficEngineStats* pStats) const
+{
+	if (pStats == NULL)
+		return;
+	pStats->received = m_nReceived.load();
+	pStats->dropped = m_nDropped.load();
+	pStats->queued = pStats->received - pStats->dropped;
+	pStats->ignored = m_nIgnored.load();
+	pStats->delivered = m_nDelivered.load();
+	pStats->batches = m_nBatches.load();
+	pStats->queueDepth = (uint32_t)m_queue.Size();
+	pStats->cameras = (uint32_t)m_nCameras;
+}
+
+void TrafficEventEngine::Decode(const DEV_EVENT_TRAFFICJUNCTION_INFO* pInfo, DWORD dwBufSize, TrafficRecord* pRecord)
+{
+	const NET_TIME_EX& t = pInfo->UTC;
+	int64_t seconds = TrafficDaysFromCivil(t.dwYear, t.dwMonth, t.dwDay) * 86400
+		+ t.dwHour * 3600 + t.dwMinute * 60 + t.dwSecond;
+	pRecord->eventMs = seconds * 1000 + t.dwMillisecond;
+	pRecord->eventId = (uint32_t)pInfo->nEventID;
+	pRecord->groupId = (uint32_t)pInfo->stuFileInfo.nGroupId;
+	pRecord->channel = pInfo->nChannelID;
+	pRecord->lane = (int16_t)pInfo->nLane;
+	pRecord->speed = (int16_t)pInfo->nSpeed;
+	pRecord->action = (uint8_t)pInfo->bEventAction;
+	pRecord->triggerType = (uint8_t)pInfo->nTriggerType;
+
+	// stuObject is the plate, stuVehicle the car; stTrafficCar repeats the
+	// plate as text and adds the color names
+	const DH_MSG_OBJECT& plate = pInfo->stuObject;
+	const DH_MSG_OBJECT& vehicle = pInfo->stuVehicle;
+	const DEV_EVENT_TRAFFIC_TRAFFICCAR_INFO& car = pInfo->stTrafficCar;
+	if (plate.szText[0] != '\0')
+		TrafficCopyText(pRecord->plate, sizeof(pRecord->plate), plate.szText, sizeof(plate.szText));
+	else
+		TrafficCopyText(pRecord->plate, sizeof(pRecord->plate), car.szPlateNumber, sizeof(car.szPlateNumber));
+	TrafficCopyText(pRecord->plateType, sizeof(pRecord->plateType), car.szPlateType, sizeof(car.szPlateType));
+	TrafficCopyText(pRecord->vehicleType, sizeof(pRecord->vehicleType), vehicle.szObjectSubType, sizeof(vehicle.szObjectSubType));
+	TrafficCopyText(pRecord->brand, sizeof(pRecord->brand), vehicle.szText, sizeof(vehicle.szText));
+	pRecord->plateColor = ColorOf(car.szPlateColor, sizeof(car.szPlateColor));
+	pRecord->vehicleColor = ColorOf(car.szVehicleColor, sizeof(car.szVehicleColor));
+	pRecord->subBrand = vehicle.wSubBrand;
+	pRecord->brandYear = vehicle.wBrandYear;
+	pRecord->plateBox = ToBox(plate.BoundingBox);
+	pRecord->vehicleBox = ToBox(vehicle.BoundingBox);
+	pRecord->confidence = (uint8_t)std::min(std::max(plate.nConfidence, 0), 100);
+
+	memset(pRecord->seats, 0, sizeof(pRecord->seats));
+	for (int i = 0; i < COMMON_SEAT_MAX_NUMBER; i++) {
+		const EVENT_COMM_SEAT& seat = pInfo->stCommInfo.stCommSeat[i];
+		int slot = seat.emSeatType == EM_COMMON_SEAT_TYPE_MAIN ? 0
+			: seat.emSeatType == EM_COMMON_SEAT_TYPE_SLAVE ? 1 : -1;
+		if (!seat.bEnable || slot < 0)
+			continue;
+		uint8_t flags = TRAFFIC_SEAT_PRESENT;
+		if (seat.emSafeBeltStatus == SS_WITH_SAFE_BELT)
+			flags |= TRAFFIC_SEAT_BELT;
+		else if (seat.emSafeBeltStatus == SS_WITHOUT_SAFE_BELT)
+			flags |= TRAFFIC_SEAT_NO_BELT;
+		if (seat.emSunShadeStatus == SS_WITH_SUN_SHADE)
+			flags |= TRAFFIC_SEAT_SUNSHADE;
+		if (seat.stSeatInfo.bySmoking)
+			flags |= TRAFFIC_SEAT_SMOKING;
+		if (seat.stSeatInfo.byCalling)
+			flags |= TRAFFIC_SEAT_CALLING;
+		pRecord->seats[slot] = flags;
+	}
+	pRecord->listHit = 0;
+	pRecord->pictureBytes = dwBufSize;
+	pRecord->pictures = 0;
+	pRecord->sightings = 1;
+	memset(pRecord->reserved, 0, sizeof(pRecord->reserved));
+	memset(pRecord->picture, 0, sizeof(pRecord->picture));
+	memset(pRecord->merged, 0, sizeof(pRecord->merged));
+}
+
+int CALLBACK TrafficEventEngine::AnalyzerDataCallBack(LLONG lAnalyzerHandle, DWORD dwAlarmType, void* pAlarmInfo,
+	BYTE* pBuffer, DWORD dwBufSize, LDWORD dwUser, int nSequence, void* reserved)
+{
+	Camera* pCamera = (Camera*)dwUser;
+	if (pCamera != NULL && pAlarmInfo != NULL)
+		pCamera->pEngine->OnEvent(pCamera, dwAlarmType, pAlarmInfo, pBuffer, dwBufSize);
+	return 0;
+}
+
+void TrafficEventEngine::OnEvent(Camera* pCamera, DWORD dwAlarmType, void* pAlarmInfo, BYTE* pBuffer, DWORD dwBufSize)
+{
+	if (EVENT_IVS_TRAFFICJUNCTION != dwAlarmType) {
+		m_nIgnored++;
+		return;
+	}
+	m_nReceived++;
+	const DEV_EVENT_TRAFFICJUNCTION_INFO* pInfo = (const DEV_EVENT_TRAFFICJUNCTION_INFO*)pAlarmInfo;
+	TrafficRecord record;
+	Decode(pInfo, dwBufSize, &record);
+	record.camera = pCamera->id;
+	record.recvUs = TrafficNowUs();
+	const PlateIndex* pPlates = m_pPlates.load();
+	PlateMatch match;
+	if (pPlates != NULL && PLATE_MATCH_NONE != pPlates->Lookup(record.plate, &match))
+		record.listHit = PLATE_HIT(match.list, match.match);
+	record.seq = m_nextSeq++;
+	PictureStore* pPictures = m_pPictures.load();
+	if (pPictures != NULL)
+		pPictures->Submit(pInfo, pBuffer, dwBufSize, &record);
+	if (!m_queue.TryPush(record)) {
+		m_nDropped++;
+		return;
+	}
+	// The only lock on this path, and only while the dispatcher sleeps
+	if (m_bIdle.load()) {
+		std::lock_guard<std::mutex> guard(m_waitLock);
+		m_cv.notify_one();
+	}
+}
+
+void TrafficEventEngine::Deliver(const TrafficRecord* pRecords, int nCount)
+{
+	EventLogWriter* pLog = m_pLog.load();
+	if (pLog != NULL)
+		pLog->Append(pRecords, nCount);
+	std::lock_guard<std::mutex> guard(m_sinkLock);
+	for (TrafficSink* pSink : m_sinks)
+		pSink->OnTrafficEvents(pRecords, nCount);
+	m_nDelivered += nCount;
+	m_nBatches++;
+}
+
+void TrafficEventEngine::Run()
+{
+	std::vector<TrafficRecord> batch(TRAFFIC_BATCH_MAX);
+	for (;;) {
+		int n = m_queue.PopBatch(batch.data(), TRAFFIC_BATCH_MAX);
+		if (n > 0) {
+			Deliver(batch.data(), n);
+			continue;
+		}
+		// Stop drains the queue before the thread ends
+		if (!m_bRunning)
+			break;
+		std::unique_lock<std::mutex> lock(m_waitLock);
+		m_bIdle = true;
+		if (m_queue.Size() == 0 && m_bRunning)
+			m_cv.wait_for(lock, std::chrono::milliseconds(TRAFFIC_IDLE_WAIT_MS));
+		m_bIdle = false;
+	}
+}
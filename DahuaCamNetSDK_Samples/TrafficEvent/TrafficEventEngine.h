@@ -0,0 +1,148 @@
+#pragma once
+#include <windows.h>
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "dhnetsdk.h"
+#include "EventLog.h"
+#include "EventQueue.h"
+#include "PictureStore.h"
+#include "PlateIndex.h"
+#include "TrafficRecord.h"
+
+#pragma comment(lib , "dhnetsdk.lib")
+
+// Traffic event result codes
+#define TRAFFIC_OK				0
+#define TRAFFIC_ERR_INIT		1	// CLIENT_Init failed, or the engine is not started
+#define TRAFFIC_ERR_LOGIN		2
+#define TRAFFIC_ERR_SUBSCRIBE	3	// CLIENT_RealLoadPictureEx failed
+#define TRAFFIC_ERR_FULL		4	// TRAFFIC_MAX_CAMERAS subscribed
+#define TRAFFIC_ERR_PARAM		5
+
+#define TRAFFIC_MAX_CAMERAS		256
+#define TRAFFIC_QUEUE_SIZE		16384	// records between the SDK threads and the dispatcher
+#define TRAFFIC_BATCH_MAX		256		// records per OnTrafficEvents call
+#define TRAFFIC_IDLE_WAIT_MS	10		// dispatcher sleep when the queue ran dry
+
+// Receives decoded events in batches on the dispatcher thread, in queue
+// order. A sink that blocks holds up every other sink and, once the queue
+// fills, makes the engine drop events; hand slow work to a thread of your own.
+class TrafficSink
+{
+public:
+	virtual ~TrafficSink() {}
+	virtual void OnTrafficEvents(const TrafficRecord* pRecords, int nCount) = 0;
+};
+
+#pragma pack(push, 4)
+typedef struct TrafficEngineStats
+{
+	uint64_t received;			// traffic junction callbacks
+	uint64_t queued;
+	uint64_t dropped;			// queue full
+	uint64_t ignored;			// other event types
+	uint64_t delivered;			// records handed to the sinks
+	uint64_t batches;
+	uint32_t queueDepth;
+	uint32_t cameras;
+} TrafficEngineStats;
+#pragma pack(pop)
+
+// Subscribes to the intelligent traffic events (EVENT_IVS_TRAFFICJUNCTION)
+// of any number of cameras and turns them into TrafficRecord as they arrive.
+// The SDK callback decodes the event structure in place and pushes the
+// record into a lock free EventQueue; one dispatcher thread drains it in
+// batches of up to TRAFFIC_BATCH_MAX and hands each batch to the sinks.
+// The callback does not allocate and takes a lock only to wake an idle
+// dispatcher, so a burst at a busy junction costs the SDK thread a few
+// microseconds per event.
+class TrafficEventEngine
+{
+public:
+	TrafficEventEngine();
+	~TrafficEventEngine();
+
+	// CLIENT_Init and the dispatcher thread. Calls after the first do nothing.
+	int Start();
+	// Unsubscribes every camera, delivers what is queued and cleans up.
+	void Stop();
+
+	// Logs in and subscribes one channel. Returns the camera id (>= 0), the
+	// value of TrafficRecord::camera, or -TRAFFIC_ERR_*.
+	int Subscribe(const char* ip, int port, const char* user, const char* password, int channel);
+	int Unsubscribe(int camera);
+
+	void AddSink(TrafficSink* pSink);
+	void RemoveSink(TrafficSink* pSink);
+	// Takes out one set of sinks and puts in another under one lock, so every
+	// batch reaches either the old set or the new one, never neither or both.
+	void ReplaceSinks(const std::vector<TrafficSink*>& remove, const std::vector<TrafficSink*>& add);
+
+	// Plates are looked up on the SDK thread as events are decoded and the
+	// result is stored in TrafficRecord::listHit. NULL turns it off.
+	void SetPlateIndex(const PlateIndex* pIndex) { m_pPlates = pIndex; }
+
+	// Pictures that come with the events are handed to the store on the SDK
+	// thread, which names the files in the record. NULL turns it off.
+	void SetPictureStore(PictureStore* pStore) { m_pPictures = pStore; }
+
+	// Every batch is appended to the log before any sink sees it. NULL turns
+	// it off.
+	void SetEventLog(EventLogWriter* pLog) { m_pLog = pLog; }
+
+	void GetStats(TrafficEngineStats* pStats) const;
+
+	// Decodes one traffic junction event into pRecord; seq, camera and
+	// recvUs are left to the caller. Public so tools can decode captured
+	// event structures.
+	static void Decode(const DEV_EVENT_TRAFFICJUNCTION_INFO* pInfo, DWORD dwBufSize, TrafficRecord* pRecord);
+
+private:
+	struct Camera
+	{
+		TrafficEventEngine* pEngine;
+		int id;
+		int channel;
+		std::string ip;
+		LLONG lLoginHandle;
+		LLONG lAnalyzerHandle;
+	};
+
+	static int CALLBACK AnalyzerDataCallBack(LLONG lAnalyzerHandle, DWORD dwAlarmType, void* pAlarmInfo,
+		BYTE* pBuffer, DWORD dwBufSize, LDWORD dwUser, int nSequence, void* reserved);
+	void OnEvent(Camera* pCamera, DWORD dwAlarmType, void* pAlarmInfo, BYTE* pBuffer, DWORD dwBufSize);
+	void Run();
+	void Deliver(const TrafficRecord* pRecords, int nCount);
+
+	EventQueue<TrafficRecord> m_queue;
+	std::atomic<uint64_t> m_nextSeq;
+	std::atomic<uint64_t> m_nReceived;
+	std::atomic<uint64_t> m_nDropped;
+	std::atomic<uint64_t> m_nIgnored;
+	std::atomic<uint64_t> m_nDelivered;
+	std::atomic<uint64_t> m_nBatches;
+
+	std::mutex m_cameraLock;
+	std::unique_ptr<Camera> m_cameras[TRAFFIC_MAX_CAMERAS];
+	int m_nCameras;
+
+	std::mutex m_sinkLock;
+	std::vector<TrafficSink*> m_sinks;
+	std::atomic<const PlateIndex*> m_pPlates;
+	std::atomic<PictureStore*> m_pPictures;
+	std::atomic<EventLogWriter*> m_pLog;
+
+	// Dispatcher wake up: producers only signal when it is idle
+	std::mutex m_waitLock;
+	std::condition_variable m_cv;
+	std::atomic<bool> m_bIdle;
+	std::atomic<bool> m_bRunning;
+	std::thread m_thread;
+	BOOL m_bNetSDKInitFlag;
+};
@@ -0,0 +1,45 @@
+#include <chrono>
+#include "TrafficPollSink.h"
+
+TrafficPollSink::TrafficPollSink(size_t capacity)
+	: m_queue(capacity), m_nDropped(0), m_nWakes(0)
+{
+}
+
+void TrafficPollSink::OnTrafficEvents(const TrafficRecord* pRecords, int nCount)
+{
+	int n = 0;
+	while (n < nCount && m_queue.TryPush(pRecords[n]))
+		n++;
+	m_nDropped += nCount - n;
+	if (n > 0) {
+		std::lock_guard<std::mutex> guard(m_waitLock);
+		m_cv.notify_all();
+	}
+}
+
+int TrafficPollSink::Poll(TrafficRecord* pRecords, int maxCount, int timeoutMs)
+{
+	if (pRecords == NULL || maxCount <= 0)
+		return 0;
+	int n = m_queue.PopBatch(pRecords, maxCount);
+	if (n > 0 || timeoutMs == 0)
+		return n;
+
+	std::unique_lock<std::mutex> lock(m_waitLock);
+	uint64_t wakes = m_nWakes;
+	auto ready = [&] { return m_queue.Size() > 0 || m_nWakes != wakes; };
+	if (timeoutMs < 0)
+		m_cv.wait(lock, ready);
+	else
+		m_cv.wait_for(lock, std::chrono::milliseconds(timeoutMs), ready);
+	lock.unlock();
+	return m_queue.PopBatch(pRecords, maxCount);
+}
+
+void TrafficPollSink::Wake()
+{
+	std::lock_guard<std::mutex> guard(m_waitLock);
+	m_nWakes++;
+	m_cv.notify_all();
+}
@@ -0,0 +1,32 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include "TrafficEventEngine.h"
+
+// Keeps delivered records for a consumer that pulls them in batches, e.g.
+// the C# side through interface_TrafficPoll. Holds up to capacity records;
+// when the consumer falls that far behind, new records are dropped and
+// counted rather than blocking the dispatcher.
+class TrafficPollSink : public TrafficSink
+{
+public:
+	explicit TrafficPollSink(size_t capacity);
+
+	void OnTrafficEvents(const TrafficRecord* pRecords, int nCount) override;
+
+	// Copies up to maxCount records, waiting up to timeoutMs (-1: forever)
+	// for the first. Returns how many were copied, 0 on timeout.
+	int Poll(TrafficRecord* pRecords, int maxCount, int timeoutMs);
+	// Releases a blocked Poll.
+	void Wake();
+
+	uint64_t Dropped() const { return m_nDropped.load(); }
+
+private:
+	EventQueue<TrafficRecord> m_queue;
+	std::atomic<uint64_t> m_nDropped;
+	std::mutex m_waitLock;
+	std::condition_variable m_cv;
+	uint64_t m_nWakes;
+};
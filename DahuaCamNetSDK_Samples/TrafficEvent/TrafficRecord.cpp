@@ -0,0 +1,88 @@
+#include <string.h>
+#include <chrono>
+#include "TrafficRecord.h"
+
+static const char* g_colorNames[] = {
+	"Unknown", "White", "Black", "Red", "Yellow", "Blue", "Green", "Gray",
+	"Silver", "Brown", "Orange", "Purple", "Pink", "Cyan", "Golden", "Other"
+};
+
+static bool SameText(const char* a, const char* b)
+{
+	for (; *a != '\0' && *b != '\0'; a++, b++) {
+		char ca = *a >= 'A' && *a <= 'Z' ? *a + ('a' - 'A') : *a;
+		char cb = *b >= 'A' && *b <= 'Z' ? *b + ('a' - 'A') : *b;
+		if (ca != cb)
+			return false;
+	}
+	return *a == *b;
+}
+
+uint8_t TrafficColorCode(const char* name)
+{
+	if (name == NULL || name[0] == '\0')
+		return TRAFFIC_COLOR_UNKNOWN;
+	// Shades share the base color: "DarkBlue", "LightGreen"
+	if (strncmp(name, "Dark", 4) == 0)
+		name += 4;
+	else if (strncmp(name, "Light", 5) == 0)
+		name += 5;
+	for (uint8_t i = 0; i < sizeof(g_colorNames) / sizeof(g_colorNames[0]); i++) {
+		if (SameText(name, g_colorNames[i]))
+			return i;
+	}
+	if (SameText(name, "Grey"))
+		return TRAFFIC_COLOR_GRAY;
+	if (SameText(name, "Gold"))
+		return TRAFFIC_COLOR_GOLD;
+	return TRAFFIC_COLOR_OTHER;
+}
+
+const char* TrafficColorName(uint8_t code)
+{
+	return code < sizeof(g_colorNames) / sizeof(g_colorNames[0]) ? g_colorNames[code] : "Other";
+}
+
+// Howard Hinnant's days_from_civil
+int64_t TrafficDaysFromCivil(int year, int month, int day)
+{
+	year -= month <= 2;
+	int64_t era = (year >= 0 ? year : year - 399) / 400;
+	int64_t yoe = year - era * 400;
+	int64_t doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+	int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + doe - 719468;
+}
+
+void TrafficCivilFromDays(int64_t days, int* pYear, int* pMonth, int* pDay)
+{
+	days += 719468;
+	int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+	int64_t doe = days - era * 146097;
+	int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	int64_t mp = (5 * doy + 2) / 153;
+	*pDay = (int)(doy - (153 * mp + 2) / 5 + 1);
+	*pMonth = (int)(mp < 10 ? mp + 3 : mp - 9);
+	*pYear = (int)(yoe + era * 400 + (*pMonth <= 2));
+}
+
+int64_t TrafficNowUs()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+void TrafficCopyText(char* dst, size_t dstSize, const char* src, size_t srcSize)
+{
+	if (dstSize == 0)
+		return;
+	size_t n = 0;
+	if (src != NULL) {
+		size_t max = srcSize < dstSize - 1 ? srcSize : dstSize - 1;
+		while (n < max && src[n] != '\0')
+			n++;
+		memcpy(dst, src, n);
+	}
+	memset(dst + n, 0, dstSize - n);
+}
@@ -0,0 +1,124 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// Compact binary form of an intelligent traffic event, decoded straight from
+// the NetSDK event structure (DEV_EVENT_TRAFFICJUNCTION_INFO) without going
+// through text. Fixed size and plain data, so batches can be copied, queued,
+// written to disk and marshalled to C# as arrays.
+
+#define TRAFFIC_PLATE_LEN		16		// plate text as sent by the device, NUL terminated
+#define TRAFFIC_TEXT_LEN		24
+#define TRAFFIC_MAX_SEATS		2		// driver and front passenger
+#define TRAFFIC_PATH_LEN		48		// picture path stem, relative to the PictureStore root
+#define TRAFFIC_MAX_MERGED		2		// other sightings a deduplicated record carries
+
+// Event action (bEventAction)
+#define TRAFFIC_ACTION_PULSE	0
+#define TRAFFIC_ACTION_START	1
+#define TRAFFIC_ACTION_STOP		2
+
+// Colors of plate and vehicle, from the device's color names
+#define TRAFFIC_COLOR_UNKNOWN	0
+#define TRAFFIC_COLOR_WHITE		1
+#define TRAFFIC_COLOR_BLACK		2
+#define TRAFFIC_COLOR_RED		3
+#define TRAFFIC_COLOR_YELLOW	4
+#define TRAFFIC_COLOR_BLUE		5
+#define TRAFFIC_COLOR_GREEN		6
+#define TRAFFIC_COLOR_GRAY		7
+#define TRAFFIC_COLOR_SILVER	8
+#define TRAFFIC_COLOR_BROWN		9
+#define TRAFFIC_COLOR_ORANGE	10
+#define TRAFFIC_COLOR_PURPLE	11
+#define TRAFFIC_COLOR_PINK		12
+#define TRAFFIC_COLOR_CYAN		13
+#define TRAFFIC_COLOR_GOLD		14
+#define TRAFFIC_COLOR_OTHER		15
+
+// Seat flags
+#define TRAFFIC_SEAT_PRESENT	0x01
+#define TRAFFIC_SEAT_BELT		0x02	// wearing a safety belt
+#define TRAFFIC_SEAT_NO_BELT	0x04	// seen without one
+#define TRAFFIC_SEAT_SUNSHADE	0x08	// sun shade down
+#define TRAFFIC_SEAT_SMOKING	0x10
+#define TRAFFIC_SEAT_CALLING	0x20
+
+// Pictures stored with the event (TrafficRecord::pictures); the files are
+// <root>/<picture>_scene.jpg, _plate.jpg and _vehicle.jpg
+#define TRAFFIC_PIC_SCENE		0x01
+#define TRAFFIC_PIC_PLATE		0x02	// plate cutout
+#define TRAFFIC_PIC_VEHICLE		0x04	// vehicle cutout
+
+#pragma pack(push, 4)
+// Device coordinates, 0..8191 on both axes whatever the picture size
+typedef struct TrafficBox
+{
+	int16_t left;
+	int16_t top;
+	int16_t right;
+	int16_t bottom;
+} TrafficBox;
+
+// Another camera's event of the same passage, kept for its pictures
+typedef struct TrafficSighting
+{
+	uint64_t seq;
+	int32_t camera;
+	int16_t lane;
+	uint8_t confidence;
+	uint8_t pictures;						// TRAFFIC_PIC_*
+	char picture[TRAFFIC_PATH_LEN];
+} TrafficSighting;
+
+typedef struct TrafficRecord
+{
+	uint64_t seq;							// engine wide, from 1; a gap is a record dropped on a full queue or merged by TrafficDedup
+	int64_t eventMs;						// device event time (UTC field) as ms since 1970
+	int64_t recvUs;							// SDK callback, local wall clock
+	uint32_t eventId;
+	uint32_t groupId;						// pictures of one pass share it
+	int32_t camera;							// TrafficEventEngine camera id
+	int32_t channel;
+	int16_t lane;
+	int16_t speed;							// km/h
+	uint8_t action;							// TRAFFIC_ACTION_*
+	uint8_t triggerType;					// 0 loop, 1 radar, 2 video
+	uint8_t plateColor;						// TRAFFIC_COLOR_*
+	uint8_t vehicleColor;
+	char plate[TRAFFIC_PLATE_LEN];
+	char plateType[TRAFFIC_TEXT_LEN];		// e.g. "Normal", "Yellow"
+	char vehicleType[TRAFFIC_TEXT_LEN];		// object sub type, e.g. "Motor", "SUV"
+	char brand[TRAFFIC_TEXT_LEN];			// vehicle text
+	uint16_t subBrand;
+	uint16_t brandYear;
+	TrafficBox plateBox;
+	TrafficBox vehicleBox;
+	uint8_t seats[TRAFFIC_MAX_SEATS];		// TRAFFIC_SEAT_* per seat, driver first
+	uint8_t confidence;						// plate, 0..100
+	uint8_t listHit;						// PlateIndex hit, PLATE_HIT(list, match); 0: on no list
+	uint32_t pictureBytes;					// size of the picture buffer delivered with the event
+	uint8_t pictures;						// TRAFFIC_PIC_* queued for storage
+	uint8_t sightings;						// events TrafficDedup merged into this one, 1 for a single event
+	uint8_t reserved[2];
+	char picture[TRAFFIC_PATH_LEN];			// "yyyymmdd/cNNN/lN/hhmmssmmm_seq", "" when not stored
+	TrafficSighting merged[TRAFFIC_MAX_MERGED];	// the other sightings, sightings - 1 of them used
+} TrafficRecord;
+#pragma pack(pop)
+
+// Maps a device color name ("Yellow", "DarkBlue", ...) to TRAFFIC_COLOR_*.
+uint8_t TrafficColorCode(const char* name);
+const char* TrafficColorName(uint8_t code);
+
+// Days from 1970-01-01 for a proleptic Gregorian date, no time zone applied.
+int64_t TrafficDaysFromCivil(int year, int month, int day);
+
+// Inverse of TrafficDaysFromCivil.
+void TrafficCivilFromDays(int64_t days, int* pYear, int* pMonth, int* pDay);
+
+// Local wall clock in microseconds since 1970.
+int64_t TrafficNowUs();
+
+// Bounded string copy that always terminates and never reads past the
+// source field.
+void TrafficCopyText(char* dst, size_t dstSize, const char* src, size_t srcSize);
@@ -0,0 +1,115 @@
+#include <string.h>
+#include "BatchTransfer.h"
+
+static size_t CopyTransfer(const char* src, size_t srcLen, char* dst, size_t dstCap)
+{
+	memcpy(dst, src, srcLen < dstCap ? srcLen : dstCap);
+	return srcLen;
+}
+
+int DetectCharset(const std::vector<std::string_view>& inputs)
+{
+	bool bNonAscii = false;
+	size_t nExamined = 0;
+	for (const std::string_view& s : inputs) {
+		size_t nAscii = AsciiPrefix(s.data(), s.size());
+		if (nAscii == s.size())
+			continue;
+		bNonAscii = true;
+		size_t nRest = s.size() - nAscii;
+		if (Utf8ValidPrefix(s.data() + nAscii, nRest) != nRest)
+			return CHARSET_GBK;
+		nExamined += nRest;
+		if (nExamined >= TRANSFER_DETECT_SAMPLE)
+			break;
+	}
+	return bNonAscii ? CHARSET_UTF8 : CHARSET_ASCII;
+}
+
+// One pass over the batch with the conversion chosen for it. Every output
+// gets its worst case room plus a terminator inside one reservation, so the
+// per-string work is the conversion itself.
+void TransferArena::Transfer(const std::vector<std::string_view>& inputs, std::vector<std::string_view>* outputs,
+	TransferFunc func, size_t ratio)
+{
+	size_t nTotal = 0;
+	for (const std::string_view& s : inputs)
+		nTotal += s.size() * ratio + 1;
+
+	char* base = Reserve(nTotal);
+	outputs->clear();
+	outputs->reserve(inputs.size());
+	size_t offset = 0;
+	for (const std::string_view& s : inputs) {
+		size_t n = func(s.data(), s.size(), base + offset, s.size() * ratio);
+		base[offset + n] = '\0';
+		outputs->emplace_back(base + offset, n);
+		offset += n + 1;
+	}
+	Commit(offset);
+}
+
+TransferArena::TransferArena() : m_nUsedTotal(0)
+{
+}
+
+char* TransferArena::Reserve(size_t nBytes)
+{
+	if (!m_blocks.empty()) {
+		Block& last = m_blocks.back();
+		if (last.size - last.used >= nBytes)
+			return last.data.get() + last.used;
+	}
+	Block block;
+	block.size = nBytes > TRANSFER_BLOCK_SIZE ? nBytes : TRANSFER_BLOCK_SIZE;
+	block.data.reset(new char[block.size]);
+	block.used = 0;
+	m_blocks.push_back(std::move(block));
+	return m_blocks.back().data.get();
+}
+
+void TransferArena::Commit(size_t nBytes)
+{
+	m_blocks.back().used += nBytes;
+	m_nUsedTotal += nBytes;
+}
+
+void TransferArena::Clear()
+{
+	if (m_blocks.empty())
+		return;
+	size_t nLargest = 0;
+	for (size_t i = 1; i < m_blocks.size(); i++) {
+		if (m_blocks[i].size > m_blocks[nLargest].size)
+			nLargest = i;
+	}
+	Block keep = std::move(m_blocks[nLargest]);
+	keep.used = 0;
+	m_blocks.clear();
+	m_blocks.push_back(std::move(keep));
+	m_nUsedTotal = 0;
+}
+
+int TransferArena::ToUtf8(const std::vector<std::string_view>& inputs, std::vector<std::string_view>* outputs,
+	int srcCharset)
+{
+	if (srcCharset == CHARSET_AUTO)
+		srcCharset = DetectCharset(inputs);
+	if (srcCharset == CHARSET_GBK)
+		Transfer(inputs, outputs, GbkToUtf8, 3);
+	else
+		Transfer(inputs, outputs, CopyTransfer, 1);
+	return srcCharset;
+}
+
+int TransferArena::ToGbk(const std::vector<std::string_view>& inputs, std::vector<std::string_view>* outputs,
+	int srcCharset)
+{
+	if (srcCharset == CHARSET_AUTO)
+		srcCharset = DetectCharset(inputs);
+	if (srcCharset == CHARSET_UTF8)
+		Transfer(inputs, outputs, Utf8ToGbk, 1);
+	else
+		Transfer(inputs, outputs, CopyTransfer, 1);
+	return srcCharset;
+}
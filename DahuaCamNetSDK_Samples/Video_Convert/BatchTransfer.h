@@ -0,0 +1,61 @@
+#pragma once
+#include <memory>
+#include <string_view>
+#include <vector>
+#include "CharactorTansfer.h"
+
+// Charsets for the batch API
+#define CHARSET_AUTO			0	// detect once per batch
+#define CHARSET_ASCII			1
+#define CHARSET_UTF8			2
+#define CHARSET_GBK				3
+
+#define TRANSFER_BLOCK_SIZE		(256 * 1024)
+#define TRANSFER_DETECT_SAMPLE	(64 * 1024)		// non-ASCII bytes examined
+
+// Charset of a whole batch: ASCII when no string has a byte above 0x7F,
+// UTF-8 when every examined string is well formed UTF-8, GBK otherwise.
+// Detection stops after TRANSFER_DETECT_SAMPLE non-ASCII bytes.
+int DetectCharset(const std::vector<std::string_view>& inputs);
+
+// Converts batches of short strings (channel names, OSD titles, event text)
+// into arena memory. Each batch is sized for its worst case up front and
+// written into a single block, so a string costs one table-driven
+// conversion and no allocation; the returned views stay valid until Clear
+// or destruction, across any number of batches. Outputs are also NUL
+// terminated for C APIs.
+class TransferArena
+{
+public:
+	TransferArena();
+
+	// srcCharset CHARSET_AUTO detects once for the whole batch. Returns the
+	// source charset used.
+	int ToUtf8(const std::vector<std::string_view>& inputs, std::vector<std::string_view>* outputs,
+		int srcCharset = CHARSET_AUTO);
+	int ToGbk(const std::vector<std::string_view>& inputs, std::vector<std::string_view>* outputs,
+		int srcCharset = CHARSET_AUTO);
+
+	// Drops every view handed out; the largest block is kept for reuse.
+	void Clear();
+
+	size_t BytesUsed() const { return m_nUsedTotal; }
+
+private:
+	typedef size_t (*TransferFunc)(const char* src, size_t srcLen, char* dst, size_t dstCap);
+
+	void Transfer(const std::vector<std::string_view>& inputs, std::vector<std::string_view>* outputs,
+		TransferFunc func, size_t ratio);
+	char* Reserve(size_t nBytes);
+	void Commit(size_t nBytes);
+
+	struct Block
+	{
+		std::unique_ptr<char[]> data;
+		size_t size;
+		size_t used;
+	};
+
+	std::vector<Block> m_blocks;
+	size_t m_nUsedTotal;
+};
@@ -1,79 +1,480 @@
-// stdafx.cpp : source file that includes just the standard includes
-//	PlayDemo.pch will be the pre-compiled header
-//	stdafx.obj will contain the pre-compiled type information
+#include <string.h>
+#include <mutex>
+#include "CharactorTansfer.h"
 
-#include "stdafx.h"
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TRANSFER_SSE2
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#include <arm_neon.h>
+#define TRANSFER_NEON
+#endif
 
-#include "CharactorTansfer.h"
-//gbkתUTF-8
-std::string GbkToUtf8(const std::string& strGbk)//strGbkGBK
-{
-	//gbkתunicode
-	int len = MultiByteToWideChar(CHINESE_CODE_PAGE, 0, strGbk.c_str(), -1, NULL, 0);
-	wchar_t *strUnicode = new wchar_t[len];
-	wmemset(strUnicode, 0, len);
-	MultiByteToWideChar(CHINESE_CODE_PAGE, 0, strGbk.c_str(), -1, strUnicode, len);
-
-	//unicodeתUTF-8
-	len = WideCharToMultiByte(CP_UTF8, 0, strUnicode, -1, NULL, 0, NULL, NULL);
-	char * strUtf8 = new char[len];
-	WideCharToMultiByte(CP_UTF8, 0, strUnicode, -1, strUtf8, len, NULL, NULL);
-
-	std::string strTemp(strUtf8);//ʱstrTempUTF-8
-	delete[]strUnicode;
-	delete[]strUtf8;
-	strUnicode = NULL;
-	strUtf8 = NULL;
-	return strTemp;
-}
-
-//UTF-8תgbk
-std::string Utf8ToGbk(const std::string& strUtf8)//strUtf8UTF-8
-{
-	//UTF-8תunicode
-	int len = MultiByteToWideChar(CP_UTF8, 0, strUtf8.c_str(), -1, NULL, 0);
-	wchar_t * strUnicode = new wchar_t[len];//len = 2
-	wmemset(strUnicode, 0, len);
-	MultiByteToWideChar(CP_UTF8, 0, strUtf8.c_str(), -1, strUnicode, len);
-
-	//unicodeתgbk
-	len = WideCharToMultiByte(CHINESE_CODE_PAGE, 0, strUnicode, -1, NULL, 0, NULL, NULL);
-	char *strGbk = new char[len];//len=3 Ϊ2char*Զ\0
-	memset(strGbk, 0, len);
-	WideCharToMultiByte(CHINESE_CODE_PAGE,0, strUnicode, -1, strGbk, len, NULL, NULL);
-
-	std::string strTemp(strGbk);//ʱstrTempGBK
-	delete[]strUnicode;
-	delete[]strGbk;
-	strUnicode = NULL;
-	strGbk = NULL;
-	return strTemp;
-}
-
-//gbkתunicode (ûõ)
-std::wstring GbkToUnicode(const std::string& strGbk)//ֵwstring
-{
-	int len = MultiByteToWideChar(CHINESE_CODE_PAGE, 0, strGbk.c_str(), -1, NULL, 0);
-	wchar_t *strUnicode = new wchar_t[len];
-	wmemset(strUnicode, 0, len);
-	MultiByteToWideChar(CHINESE_CODE_PAGE, 0, strGbk.c_str(), -1, strUnicode, len);
-
-	std::wstring strTemp(strUnicode);//ʱstrTempUnicode
-	delete[]strUnicode;
-	strUnicode = NULL;
-	return strTemp;
-}
-
-//Unicodeתgbk
-std::string UnicodeToGbk (const std::wstring& strUnicode)//wstring
-{
-	int len = WideCharToMultiByte(CHINESE_CODE_PAGE, 0, strUnicode.c_str(), -1, NULL, 0, NULL, NULL);
-	char *strGbk = new char[len];//len=3 Ϊ2char*Զ\0
-	memset(strGbk, 0, len);
-	WideCharToMultiByte(CHINESE_CODE_PAGE,0,strUnicode.c_str(), -1, strGbk, len, NULL, NULL);
-	
-	std::string strTemp(strGbk);
-	delete []strGbk;
-	strGbk = NULL;
-	return strTemp;
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#define GBK_EURO				0x80		// code page 936 single byte euro
+#define UNICODE_EURO			0x20AC
+#define UNICODE_REPLACEMENT		0xFFFD
+
+static uint16_t s_unicodeToGbk[0x10000];	// 0: no mapping
+static std::once_flag s_reverseOnce;
+
+// The reverse table is only needed by the encoders, build it on first use
+static void BuildReverseTable()
+{
+	for (int i = 0; i < GBK_TABLE_SIZE; i++) {
+		uint16_t u = g_gbkToUnicode[i];
+		if (u != 0 && s_unicodeToGbk[u] == 0)
+			s_unicodeToGbk[u] = (uint16_t)(((0x81 + i / 191) << 8) | (0x40 + i % 191));
+	}
+	s_unicodeToGbk[UNICODE_EURO] = GBK_EURO;
+}
+
+static inline unsigned CountTrailingZeros(unsigned v)
+{
+#ifdef _MSC_VER
+	unsigned long idx;
+	_BitScanForward(&idx, v);
+	return idx;
+#else
+	return (unsigned)__builtin_ctz(v);
+#endif
+}
+
+// Length of the ASCII run at p
+static size_t AsciiSpan(const uint8_t* p, size_t n)
+{
+	size_t i = 0;
+#if defined(TRANSFER_SSE2)
+	for (; i + 16 <= n; i += 16) {
+		int mask = _mm_movemask_epi8(_mm_loadu_si128((const __m128i*)(p + i)));
+		if (mask != 0)
+			return i + CountTrailingZeros((unsigned)mask);
+	}
+#elif defined(TRANSFER_NEON)
+	for (; i + 16 <= n; i += 16) {
+		if (vmaxvq_u8(vld1q_u8(p + i)) >= 0x80)
+			break;
+	}
+#else
+	for (; i + 8 <= n; i += 8) {
+		uint64_t v;
+		memcpy(&v, p + i, 8);
+		if (v & 0x8080808080808080ULL)
+			break;
+	}
+#endif
+	while (i < n && p[i] < 0x80)
+		i++;
+	return i;
+}
+
+// Length of the run of UTF-16 units below 0x80 at p
+static size_t AsciiSpan16(const char16_t* p, size_t n)
+{
+	size_t i = 0;
+#if defined(TRANSFER_SSE2)
+	const __m128i high = _mm_set1_epi16((short)0xFF80);
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + 8 <= n; i += 8) {
+		__m128i v = _mm_and_si128(_mm_loadu_si128((const __m128i*)(p + i)), high);
+		if (_mm_movemask_epi8(_mm_cmpeq_epi16(v, zero)) != 0xFFFF)
+			break;
+	}
+#endif
+	while (i < n && p[i] < 0x80)
+		i++;
+	return i;
+}
+
+// Output cursor that keeps counting past the end of the buffer
+template<typename T>
+struct TransferOut
+{
+	T* dst;
+	size_t cap;
+	size_t len;
+
+	inline void Put(uint32_t v)
+	{
+		if (len < cap)
+			dst[len] = (T)v;
+		len++;
+	}
+};
+
+static void PutAscii(TransferOut<char>& out, const uint8_t* p, size_t n)
+{
+	if (out.len < out.cap)
+		memcpy(out.dst + out.len, p, out.cap - out.len < n ? out.cap - out.len : n);
+	out.len += n;
+}
+
+static void PutAscii(TransferOut<char16_t>& out, const uint8_t* p, size_t n)
+{
+	size_t nCopy = out.len < out.cap ? (out.cap - out.len < n ? out.cap - out.len : n) : 0;
+	char16_t* dst = out.dst + out.len;
+	size_t i = 0;
+#if defined(TRANSFER_SSE2)
+	const __m128i zero = _mm_setzero_si128();
+	for (; i + 16 <= nCopy; i += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i*)(p + i));
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_unpacklo_epi8(v, zero));
+		_mm_storeu_si128((__m128i*)(dst + i + 8), _mm_unpackhi_epi8(v, zero));
+	}
+#endif
+	for (; i < nCopy; i++)
+		dst[i] = p[i];
+	out.len += n;
+}
+
+static void PutAscii16(TransferOut<char>& out, const char16_t* p, size_t n)
+{
+	size_t nCopy = out.len < out.cap ? (out.cap - out.len < n ? out.cap - out.len : n) : 0;
+	char* dst = out.dst + out.len;
+	size_t i = 0;
+#if defined(TRANSFER_SSE2)
+	for (; i + 16 <= nCopy; i += 16) {
+		__m128i lo = _mm_loadu_si128((const __m128i*)(p + i));
+		__m128i hi = _mm_loadu_si128((const __m128i*)(p + i + 8));
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(lo, hi));
+	}
+#endif
+	for (; i < nCopy; i++)
+		dst[i] = (char)p[i];
+	out.len += n;
+}
+
+static inline void PutUtf8(TransferOut<char>& out, uint32_t u)
+{
+	if (u < 0x80) {
+		out.Put(u);
+	}
+	else if (u < 0x800) {
+		out.Put(0xC0 | (u >> 6));
+		out.Put(0x80 | (u & 0x3F));
+	}
+	else if (u < 0x10000) {
+		out.Put(0xE0 | (u >> 12));
+		out.Put(0x80 | ((u >> 6) & 0x3F));
+		out.Put(0x80 | (u & 0x3F));
+	}
+	else {
+		out.Put(0xF0 | (u >> 18));
+		out.Put(0x80 | ((u >> 12) & 0x3F));
+		out.Put(0x80 | ((u >> 6) & 0x3F));
+		out.Put(0x80 | (u & 0x3F));
+	}
+}
+
+static inline void PutUtf16(TransferOut<char16_t>& out, uint32_t u)
+{
+	if (u < 0x10000) {
+		out.Put(u);
+	}
+	else {
+		u -= 0x10000;
+		out.Put(0xD800 | (u >> 10));
+		out.Put(0xDC00 | (u & 0x3FF));
+	}
+}
+
+static inline void PutGbk(TransferOut<char>& out, uint32_t u)
+{
+	uint16_t code = u < 0x10000 ? s_unicodeToGbk[u] : 0;
+	if (code == 0) {
+		out.Put('?');
+	}
+	else if (code < 0x100) {
+		out.Put(code);
+	}
+	else {
+		out.Put(code >> 8);
+		out.Put(code & 0xFF);
+	}
+}
+
+// One non-ASCII GBK character at p[0]; returns the bytes consumed
+static inline size_t DecodeGbk(const uint8_t* p, size_t n, uint32_t* u)
+{
+	uint8_t lead = p[0];
+	if (lead == GBK_EURO) {
+		*u = UNICODE_EURO;
+		return 1;
+	}
+	if (lead == 0xFF || n < 2 || p[1] < 0x40 || p[1] == 0x7F || p[1] == 0xFF) {
+		// a bad trail byte is left alone so that ASCII after it survives
+		*u = UNICODE_REPLACEMENT;
+		return 1;
+	}
+	uint16_t v = g_gbkToUnicode[(lead - 0x81) * 191 + (p[1] - 0x40)];
+	*u = v != 0 ? v : UNICODE_REPLACEMENT;
+	return 2;
+}
+
+// One non-ASCII UTF-8 sequence at p[0]. Malformed input yields one U+FFFD
+// per maximal invalid prefix, as the Unicode standard recommends.
+static inline size_t DecodeUtf8(const uint8_t* p, size_t n, uint32_t* u)
+{
+	uint8_t b = p[0];
+	size_t nLen;
+	uint32_t v;
+	if (b >= 0xC2 && b <= 0xDF) {
+		nLen = 2;
+		v = b & 0x1F;
+	}
+	else if (b >= 0xE0 && b <= 0xEF) {
+		nLen = 3;
+		v = b & 0x0F;
+	}
+	else if (b >= 0xF0 && b <= 0xF4) {
+		nLen = 4;
+		v = b & 0x07;
+	}
+	else {
+		*u = UNICODE_REPLACEMENT;
+		return 1;
+	}
+
+	// The second byte range rules out overlongs, surrogates and > U+10FFFF
+	uint8_t lo = b == 0xE0 ? 0xA0 : b == 0xF0 ? 0x90 : 0x80;
+	uint8_t hi = b == 0xED ? 0x9F : b == 0xF4 ? 0x8F : 0xBF;
+	for (size_t i = 1; i < nLen; i++) {
+		if (i >= n || p[i] < lo || p[i] > hi) {
+			*u = UNICODE_REPLACEMENT;
+			return i;
+		}
+		v = (v << 6) | (p[i] & 0x3F);
+		lo = 0x80;
+		hi = 0xBF;
+	}
+	*u = v;
+	return nLen;
+}
+
+// One UTF-16 unit or pair at p[0]; lone surrogates become U+FFFD
+static inline size_t DecodeUtf16(const char16_t* p, size_t n, uint32_t* u)
+{
+	uint32_t c = p[0];
+	if (c < 0xD800 || c > 0xDFFF) {
+		*u = c;
+		return 1;
+	}
+	if (c <= 0xDBFF && n >= 2 && p[1] >= 0xDC00 && p[1] <= 0xDFFF) {
+		*u = 0x10000 + ((c - 0xD800) << 10) + (p[1] - 0xDC00);
+		return 2;
+	}
+	*u = UNICODE_REPLACEMENT;
+	return 1;
+}
+
+size_t GbkToUtf8(const char* src, size_t srcLen, char* dst, size_t dstCap)
+{
+	const uint8_t* p = (const uint8_t*)src;
+	TransferOut<char> out = { dst, dstCap, 0 };
+	size_t i = 0;
+	while (i < srcLen) {
+		size_t nAscii = AsciiSpan(p + i, srcLen - i);
+		PutAscii(out, p + i, nAscii);
+		i += nAscii;
+		while (i < srcLen && p[i] >= 0x80) {
+			uint32_t u;
+			i += DecodeGbk(p + i, srcLen - i, &u);
+			PutUtf8(out, u);
+		}
+	}
+	return out.len;
+}
+
+size_t Utf8ToGbk(const char* src, size_t srcLen, char* dst, size_t dstCap)
+{
+	std::call_once(s_reverseOnce, BuildReverseTable);
+	const uint8_t* p = (const uint8_t*)src;
+	TransferOut<char> out = { dst, dstCap, 0 };
+	size_t i = 0;
+	while (i < srcLen) {
+		size_t nAscii = AsciiSpan(p + i, srcLen - i);
+		PutAscii(out, p + i, nAscii);
+		i += nAscii;
+		while (i < srcLen && p[i] >= 0x80) {
+			uint32_t u;
+			i += DecodeUtf8(p + i, srcLen - i, &u);
+			PutGbk(out, u);
+		}
+	}
+	return out.len;
+}
+
+size_t GbkToUtf16(const char* src, size_t srcLen, char16_t* dst, size_t dstCap)
+{
+	const uint8_t* p = (const uint8_t*)src;
+	TransferOut<char16_t> out = { dst, dstCap, 0 };
+	size_t i = 0;
+	while (i < srcLen) {
+		size_t nAscii = AsciiSpan(p + i, srcLen - i);
+		PutAscii(out, p + i, nAscii);
+		i += nAscii;
+		while (i < srcLen && p[i] >= 0x80) {
+			uint32_t u;
+			i += DecodeGbk(p + i, srcLen - i, &u);
+			out.Put(u);
+		}
+	}
+	return out.len;
+}
+
+size_t Utf16ToGbk(const char16_t* src, size_t srcLen, char* dst, size_t dstCap)
+{
+	std::call_once(s_reverseOnce, BuildReverseTable);
+	TransferOut<char> out = { dst, dstCap, 0 };
+	size_t i = 0;
+	while (i < srcLen) {
+		size_t nAscii = AsciiSpan16(src + i, srcLen - i);
+		PutAscii16(out, src + i, nAscii);
+		i += nAscii;
+		while (i < srcLen && src[i] >= 0x80) {
+			uint32_t u;
+			i += DecodeUtf16(src + i, srcLen - i, &u);
+			PutGbk(out, u);
+		}
+	}
+	return out.len;
+}
+
+size_t Utf8ToUtf16(const char* src, size_t srcLen, char16_t* dst, size_t dstCap)
+{
+	const uint8_t* p = (const uint8_t*)src;
+	TransferOut<char16_t> out = { dst, dstCap, 0 };
+	size_t i = 0;
+	while (i < srcLen) {
+		size_t nAscii = AsciiSpan(p + i, srcLen - i);
+		PutAscii(out, p + i, nAscii);
+		i += nAscii;
+		while (i < srcLen && p[i] >= 0x80) {
+			uint32_t u;
+			i += DecodeUtf8(p + i, srcLen - i, &u);
+			PutUtf16(out, u);
+		}
+	}
+	return out.len;
+}
+
+size_t Utf16ToUtf8(const char16_t* src, size_t srcLen, char* dst, size_t dstCap)
+{
+	TransferOut<char> out = { dst, dstCap, 0 };
+	size_t i = 0;
+	while (i < srcLen) {
+		size_t nAscii = AsciiSpan16(src + i, srcLen - i);
+		PutAscii16(out, src + i, nAscii);
+		i += nAscii;
+		while (i < srcLen && src[i] >= 0x80) {
+			uint32_t u;
+			i += DecodeUtf16(src + i, srcLen - i, &u);
+			PutUtf8(out, u);
+		}
+	}
+	return out.len;
+}
+
+size_t AsciiPrefix(const char* src, size_t srcLen)
+{
+	return AsciiSpan((const uint8_t*)src, srcLen);
+}
+
+size_t Utf8ValidPrefix(const char* src, size_t srcLen)
+{
+	const uint8_t* p = (const uint8_t*)src;
+	size_t i = 0;
+	while (i < srcLen) {
+		i += AsciiSpan(p + i, srcLen - i);
+		while (i < srcLen && p[i] >= 0x80) {
+			uint32_t u;
+			size_t n = DecodeUtf8(p + i, srcLen - i, &u);
+			// a literal U+FFFD is EF BF BD, a replaced error is shorter
+			if (u == UNICODE_REPLACEMENT && (n != 3 || p[i] != 0xEF))
+				return i;
+			i += n;
+		}
+	}
+	return i;
+}
+
+// std::string wrappers: one allocation sized for the worst case, trimmed to
+// the exact length. Like the code page calls they replace (length -1),
+// they stop at the first NUL, so a fixed size SDK field copied whole into
+// a string converts to its text only.
+
+template<typename S>
+static size_t TextLength(const S& str)
+{
+	size_t n = str.find((typename S::value_type)0);
+	return n != S::npos ? n : str.size();
+}
+
+//gbk to UTF-8
+std::string GbkToUtf8(const std::string& strGbk)
+{
+	size_t n = TextLength(strGbk);
+	std::string strUtf8(GBK_TO_UTF8_MAX(n), '\0');
+	strUtf8.resize(GbkToUtf8(strGbk.data(), n, &strUtf8[0], strUtf8.size()));
+	return strUtf8;
+}
+
+//UTF-8 to gbk
+std::string Utf8ToGbk(const std::string& strUtf8)
+{
+	size_t n = TextLength(strUtf8);
+	std::string strGbk(UTF8_TO_GBK_MAX(n), '\0');
+	strGbk.resize(Utf8ToGbk(strUtf8.data(), n, &strGbk[0], strGbk.size()));
+	return strGbk;
+}
+
+//gbk to unicode
+std::wstring GbkToUnicode(const std::string& strGbk)
+{
+	size_t n = TextLength(strGbk);
+	std::wstring strUnicode(GBK_TO_UTF16_MAX(n), L'\0');
+	if (sizeof(wchar_t) == sizeof(char16_t)) {
+		strUnicode.resize(GbkToUtf16(strGbk.data(), n, (char16_t*)&strUnicode[0], strUnicode.size()));
+		return strUnicode;
+	}
+	// 32 bit wchar_t: GBK only reaches the BMP, so each UTF-16 unit is one
+	// wchar_t
+	const uint8_t* p = (const uint8_t*)strGbk.data();
+	TransferOut<wchar_t> out = { &strUnicode[0], strUnicode.size(), 0 };
+	size_t i = 0;
+	while (i < n) {
+		if (p[i] < 0x80) {
+			out.Put(p[i++]);
+			continue;
+		}
+		uint32_t u;
+		i += DecodeGbk(p + i, n - i, &u);
+		out.Put(u);
+	}
+	strUnicode.resize(out.len);
+	return strUnicode;
+}
+
+//Unicode to gbk
+std::string UnicodeToGbk(const std::wstring& strUnicode)
+{
+	size_t n = TextLength(strUnicode);
+	std::string strGbk(UTF16_TO_GBK_MAX(n), '\0');
+	if (sizeof(wchar_t) == sizeof(char16_t)) {
+		strGbk.resize(Utf16ToGbk((const char16_t*)strUnicode.data(), n, &strGbk[0], strGbk.size()));
+	}
+	else {
+		// 32 bit wchar_t: nothing outside the BMP has a GBK code anyway
+		std::u16string strUtf16;
+		strUtf16.reserve(n);
+		for (size_t i = 0; i < n; i++) {
+			wchar_t c = strUnicode[i];
+			strUtf16.push_back((uint32_t)c < 0x10000 ? (char16_t)c : (char16_t)UNICODE_REPLACEMENT);
+		}
+		strGbk.resize(Utf16ToGbk(strUtf16.data(), strUtf16.size(), &strGbk[0], strGbk.size()));
+	}
+	return strGbk;
 }
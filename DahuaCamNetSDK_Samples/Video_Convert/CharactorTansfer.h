@@ -1,10 +1,49 @@
 #ifndef CHARACTOR_TANSFER
 #define CHARACTOR_TANSFER
 
+#include <stddef.h>
+#include <stdint.h>
 #include <string>
 
 #define CHINESE_CODE_PAGE    936
 
+// Two byte GBK codes: lead 0x81..0xFE, trail 0x40..0xFE
+#define GBK_TABLE_SIZE			(126 * 191)
+
+// Worst case output lengths of the buffer functions, in output units
+#define GBK_TO_UTF8_MAX(n)		((n) * 3)
+#define UTF8_TO_GBK_MAX(n)		(n)
+#define GBK_TO_UTF16_MAX(n)		(n)
+#define UTF16_TO_GBK_MAX(n)		((n) * 2)
+#define UTF8_TO_UTF16_MAX(n)	(n)
+#define UTF16_TO_UTF8_MAX(n)	((n) * 3)
+
+extern const uint16_t g_gbkToUnicode[GBK_TABLE_SIZE];
+
+std::string GbkToUtf8(const std::string& strGbk);
+std::string Utf8ToGbk(const std::string& strUtf8);
+
 std::string UnicodeToGbk (const std::wstring& strUnicode);//wstring
 std::wstring GbkToUnicode(const std::string& strGbk);
+
+// Table driven conversions into caller buffers, same results on every
+// platform (code page 936 plus 0x80 for the euro sign). Each returns the
+// exact output length in output units; when that exceeds dstCap only the
+// first dstCap units were written, so a NULL dst with dstCap 0 measures.
+// No terminator is written, and NULs are converted like any other
+// character; the std::string functions above stop at the first NUL, as
+// the code page calls they replaced did. Characters with no mapping become
+// '?' in GBK and U+FFFD in UTF-8/UTF-16; ASCII runs are copied 16 bytes at
+// a time.
+size_t GbkToUtf8(const char* src, size_t srcLen, char* dst, size_t dstCap);
+size_t Utf8ToGbk(const char* src, size_t srcLen, char* dst, size_t dstCap);
+size_t GbkToUtf16(const char* src, size_t srcLen, char16_t* dst, size_t dstCap);
+size_t Utf16ToGbk(const char16_t* src, size_t srcLen, char* dst, size_t dstCap);
+size_t Utf8ToUtf16(const char* src, size_t srcLen, char16_t* dst, size_t dstCap);
+size_t Utf16ToUtf8(const char16_t* src, size_t srcLen, char* dst, size_t dstCap);
+
+// Length of the leading ASCII run, and of the longest well formed UTF-8
+// prefix of src.
+size_t AsciiPrefix(const char* src, size_t srcLen);
+size_t Utf8ValidPrefix(const char* src, size_t srcLen);
 #endif
\ No newline at end of file
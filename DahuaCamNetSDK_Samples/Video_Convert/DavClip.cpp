@@ -0,0 +1,220 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "DavClip.h"
+
+#define CLIP_COPY_CHUNK		(1024 * 1024)
+
+struct ClipSegment
+{
+	std::string file;
+	DavIndex index;			// key frames only
+	int64_t startMs;		// wall clock of the first frame
+	int64_t endMs;			// wall clock of the last frame
+
+	int64_t KeyTime(size_t k) const { return startMs + index.frames[k].ptsMs; }
+	int64_t KeyOffset(size_t k) const { return k < index.frames.size() ? index.frames[k].offset : index.validEnd; }
+};
+
+static int LoadSegments(const std::vector<std::string>& sources, std::vector<ClipSegment>* segments)
+{
+	segments->clear();
+	segments->reserve(sources.size());
+	for (const std::string& file : sources) {
+		ClipSegment seg;
+		seg.file = file;
+		if (DavLoadIndex(file.c_str(), &seg.index) != DAV_INDEX_OK)
+			return CLIP_ERR_OPEN_SRC;
+		if (seg.index.frames.empty())
+			continue;
+		seg.startMs = (int64_t)DavDateToUnix(seg.index.firstDateTime) * 1000;
+		seg.endMs = seg.startMs + seg.index.lastPtsMs;
+		segments->push_back(std::move(seg));
+	}
+	std::stable_sort(segments->begin(), segments->end(),
+		[](const ClipSegment& a, const ClipSegment& b) { return a.startMs < b.startMs; });
+	return CLIP_OK;
+}
+
+// First key frame at or after t, frames.size() when there is none
+static size_t KeyAtOrAfter(const ClipSegment& seg, int64_t t)
+{
+	const std::vector<DavIndexEntry>& keys = seg.index.frames;
+	return std::lower_bound(keys.begin(), keys.end(), t - seg.startMs,
+		[](const DavIndexEntry& e, int64_t pts) { return e.ptsMs < pts; }) - keys.begin();
+}
+
+// Last key frame at or before t, the first one when t precedes them all
+static size_t KeyAtOrBefore(const ClipSegment& seg, int64_t t)
+{
+	const std::vector<DavIndexEntry>& keys = seg.index.frames;
+	size_t k = std::upper_bound(keys.begin(), keys.end(), t - seg.startMs,
+		[](int64_t pts, const DavIndexEntry& e) { return pts < e.ptsMs; }) - keys.begin();
+	return k > 0 ? k - 1 : 0;
+}
+
+// Appends the byte range [begin, end) of file to dst
+static int CopyRange(const std::string& file, int64_t begin, int64_t end, FILE* dst,
+	std::vector<uint8_t>& buf, ClipReport* report)
+{
+	FILE* src = fopen(file.c_str(), "rb");
+	if (src == NULL)
+		return CLIP_ERR_OPEN_SRC;
+	int ret = DavFileSeek(src, begin) == 0 ? CLIP_OK : CLIP_ERR_IO;
+	while (ret == CLIP_OK && begin < end) {
+		size_t n = (size_t)std::min<int64_t>(end - begin, (int64_t)buf.size());
+		if (fread(buf.data(), 1, n, src) != n || fwrite(buf.data(), 1, n, dst) != n)
+			ret = CLIP_ERR_IO;
+		begin += n;
+		report->nBytes += n;
+	}
+	fclose(src);
+	return ret;
+}
+
+static int CloseOutput(FILE* dst, const char* dstFile, int ret)
+{
+	if (fclose(dst) != 0 && ret == CLIP_OK)
+		ret = CLIP_ERR_IO;
+	if (ret != CLIP_OK)
+		remove(dstFile);
+	return ret;
+}
+
+int DavCutClip(const std::vector<std::string>& sources, time_t beginTime, time_t endTime,
+	const char* dstFile, ClipReport* report)
+{
+	*report = ClipReport();
+	if (endTime <= beginTime)
+		return CLIP_ERR_PARAM;
+	int64_t beginMs = (int64_t)beginTime * 1000;
+	int64_t endMs = (int64_t)endTime * 1000;
+
+	std::vector<ClipSegment> segments;
+	int ret = LoadSegments(sources, &segments);
+	if (ret != CLIP_OK)
+		return ret;
+
+	FILE* dst = fopen(dstFile, "wb");
+	if (dst == NULL)
+		return CLIP_ERR_OPEN_DST;
+
+	std::vector<uint8_t> buf(CLIP_COPY_CHUNK);
+	for (const ClipSegment& seg : segments) {
+		if (seg.endMs < beginMs || seg.startMs >= endMs)
+			continue;
+		// Later segments continue the clip from their first key frame
+		size_t k0 = report->nSources == 0 ? KeyAtOrBefore(seg, beginMs) : 0;
+		size_t k1 = KeyAtOrAfter(seg, endMs);
+		if (k1 <= k0)
+			continue;
+
+		ret = CopyRange(seg.file, seg.KeyOffset(k0), seg.KeyOffset(k1), dst, buf, report);
+		if (ret != CLIP_OK)
+			break;
+		if (report->nSources++ == 0)
+			report->beginMs = seg.KeyTime(k0);
+		report->endMs = k1 < seg.index.frames.size() ? seg.KeyTime(k1) : seg.endMs;
+		if (k1 < seg.index.frames.size())
+			break;
+	}
+
+	if (ret == CLIP_OK && report->nSources == 0)
+		ret = CLIP_ERR_NO_DATA;
+	return CloseOutput(dst, dstFile, ret);
+}
+
+int DavConcat(const std::vector<std::string>& sources, const char* dstFile, ClipReport* report)
+{
+	*report = ClipReport();
+	std::vector<ClipSegment> segments;
+	int ret = LoadSegments(sources, &segments);
+	if (ret != CLIP_OK)
+		return ret;
+	if (segments.empty())
+		return CLIP_ERR_NO_DATA;
+
+	FILE* dst = fopen(dstFile, "wb");
+	if (dst == NULL)
+		return CLIP_ERR_OPEN_DST;
+
+	std::vector<uint8_t> buf(CLIP_COPY_CHUNK);
+	for (const ClipSegment& seg : segments) {
+		ret = CopyRange(seg.file, seg.KeyOffset(0), seg.index.validEnd, dst, buf, report);
+		if (ret != CLIP_OK)
+			break;
+		if (report->nSources++ == 0)
+			report->beginMs = seg.KeyTime(0);
+		report->endMs = seg.endMs;
+	}
+	return CloseOutput(dst, dstFile, ret);
+}
+
+// The pattern is handed to snprintf with one int: it must hold exactly one
+// %d or %i, with flags, width and precision but no length modifier, and no
+// other conversion than %%
+static bool IsPiecePattern(const char* pattern)
+{
+	int nConversions = 0;
+	for (const char* p = pattern; *p != '\0'; p++) {
+		if (*p != '%')
+			continue;
+		p++;
+		if (*p == '%')
+			continue;
+		while (*p != '\0' && strchr("-+ #0", *p) != NULL)
+			p++;
+		while (*p >= '0' && *p <= '9')
+			p++;
+		if (*p == '.') {
+			p++;
+			while (*p >= '0' && *p <= '9')
+				p++;
+		}
+		if (*p != 'd' && *p != 'i')
+			return false;
+		nConversions++;
+	}
+	return nConversions == 1;
+}
+
+int DavSplitFile(const char* srcFile, int segmentSeconds, const char* dstPattern, ClipReport* report)
+{
+	*report = ClipReport();
+	if (segmentSeconds <= 0 || dstPattern == NULL || !IsPiecePattern(dstPattern))
+		return CLIP_ERR_PARAM;
+
+	std::vector<ClipSegment> segments;
+	int ret = LoadSegments(std::vector<std::string>(1, srcFile), &segments);
+	if (ret != CLIP_OK)
+		return ret;
+	if (segments.empty())
+		return CLIP_ERR_NO_DATA;
+
+	const ClipSegment& seg = segments[0];
+	report->nSources = 1;
+	report->beginMs = seg.KeyTime(0);
+	report->endMs = seg.endMs;
+
+	std::vector<uint8_t> buf(CLIP_COPY_CHUNK);
+	char path[512];
+	size_t k0 = 0;
+	while (k0 < seg.index.frames.size()) {
+		size_t k1 = KeyAtOrAfter(seg, seg.KeyTime(k0) + (int64_t)segmentSeconds * 1000);
+		if (k1 <= k0)
+			k1 = k0 + 1;
+
+		int n = snprintf(path, sizeof(path), dstPattern, (int)report->outputs.size());
+		if (n < 0 || n >= (int)sizeof(path))
+			return CLIP_ERR_PARAM;
+		FILE* dst = fopen(path, "wb");
+		if (dst == NULL)
+			return CLIP_ERR_OPEN_DST;
+		ret = CloseOutput(dst, path, CopyRange(seg.file, seg.KeyOffset(k0), seg.KeyOffset(k1), dst, buf, report));
+		if (ret != CLIP_OK)
+			return ret;
+		report->outputs.push_back(path);
+		k0 = k1;
+	}
+	return CLIP_OK;
+}
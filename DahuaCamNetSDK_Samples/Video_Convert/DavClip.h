@@ -0,0 +1,44 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "DavIndex.h"
+
+// Clip result codes
+#define CLIP_OK					0
+#define CLIP_ERR_OPEN_SRC		1	// a source file cannot be opened or indexed
+#define CLIP_ERR_OPEN_DST		2
+#define CLIP_ERR_NO_DATA		3	// no source covers the requested time
+#define CLIP_ERR_IO				4	// read or write failed part way
+#define CLIP_ERR_PARAM			5
+
+struct ClipReport
+{
+	int64_t beginMs = 0;			// wall clock of the first copied key frame
+	int64_t endMs = 0;				// wall clock where the copy stops
+	int nSources = 0;				// segment files that contributed
+	uint64_t nBytes = 0;
+	std::vector<std::string> outputs;	// DavSplitFile only
+};
+
+// Stream copy clip engine. Cuts fall on I frames, so the output is made of
+// whole source frames, never re-encoded: a clip starts at the last I frame at
+// or before the requested begin and stops before the first I frame at or
+// after the requested end. Sources are located through DavLoadIndex, so
+// with sidecar indexes in place only the clip bytes are read.
+//
+// Times are local wall clock seconds as returned by DavDateToUnix; the file
+// start is taken from the date of its first frame.
+
+// Copies [beginTime, endTime) out of any number of segment files, in time
+// order, into one DAV file.
+int DavCutClip(const std::vector<std::string>& sources, time_t beginTime, time_t endTime,
+	const char* dstFile, ClipReport* report);
+
+// Concatenates whole segment files in time order, each from its first I frame.
+int DavConcat(const std::vector<std::string>& sources, const char* dstFile, ClipReport* report);
+
+// Splits a file into pieces of at least segmentSeconds, each starting on an
+// I frame. dstPattern takes the piece number, e.g. "D:/out/part_%03d.dav";
+// one that does not hold exactly one %d (or %i) and no other conversion is
+// CLIP_ERR_PARAM.
+int DavSplitFile(const char* srcFile, int segmentSeconds, const char* dstPattern, ClipReport* report);
@@ -0,0 +1,295 @@
+#include <string.h>
+#include "DavFrame.h"
+
+static inline uint32_t ReadLE32(const uint8_t* p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint16_t ReadLE16(const uint8_t* p)
+{
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static const uint32_t s_sampleRates[] = { 8000, 4000, 8000, 11025, 16000, 20000, 22050, 32000, 44100, 48000, 96000, 192000, 64000 };
+
+static void ParseExtensions(const uint8_t* p, int len, DavFrame* frame)
+{
+	while (len > 0) {
+		int nUsed;
+		switch (p[0]) {
+		case 0x80:
+			if (len >= 4) {
+				frame->width = (uint16_t)(p[2] * 8);
+				frame->height = (uint16_t)(p[3] * 8);
+			}
+			nUsed = 4;
+			break;
+		case 0x81:
+			if (len >= 4) {
+				frame->videoCodec = p[2];
+				frame->frameRate = p[3];
+			}
+			nUsed = 4;
+			break;
+		case 0x82:
+			if (len >= 8) {
+				frame->width = ReadLE16(p + 4);
+				frame->height = ReadLE16(p + 6);
+			}
+			nUsed = 8;
+			break;
+		case 0x83:
+			if (len >= 4) {
+				frame->audioChannels = p[1];
+				frame->audioCodec = p[2];
+				frame->sampleRate = p[3] < sizeof(s_sampleRates) / sizeof(s_sampleRates[0]) ? s_sampleRates[p[3]] : 8000;
+			}
+			nUsed = 4;
+			break;
+		case 0x8C:
+			if (len >= 8) {
+				frame->audioChannels = p[2];
+				frame->audioCodec = p[3];
+				frame->sampleRate = p[4] < sizeof(s_sampleRates) / sizeof(s_sampleRates[0]) ? s_sampleRates[p[4]] : 8000;
+			}
+			nUsed = 8;
+			break;
+		case 0x88: case 0x91: case 0x92: case 0x93: case 0x95:
+		case 0x9A: case 0x9B: case 0xB3:
+			nUsed = 8;
+			break;
+		case 0x84: case 0x85: case 0x8B: case 0x94: case 0x96:
+		case 0xA0: case 0xB2: case 0xB4:
+			// variable length block, byte 1 holds the block size
+			nUsed = len >= 2 && p[1] >= 2 ? p[1] : len;
+			break;
+		default:
+			// unknown block, the rest of the extension area cannot be walked
+			nUsed = len;
+			break;
+		}
+		p += nUsed;
+		len -= nUsed;
+	}
+}
+
+int DavParseHeader(const uint8_t* p, size_t n, DavFrame* frame)
+{
+	if (n < 4)
+		return memcmp(p, "DHAV", n) == 0 ? DAV_PARSE_NEED_MORE : DAV_PARSE_BAD;
+	if (memcmp(p, "DHAV", 4) != 0)
+		return DAV_PARSE_BAD;
+	if (n < DAV_HEADER_LEN)
+		return DAV_PARSE_NEED_MORE;
+
+	// "DHAV" turns up inside payloads too; the checksum rules most of those
+	// out before the length is trusted
+	uint8_t sum = 0;
+	for (int i = 0; i < DAV_HEADER_LEN - 1; i++)
+		sum += p[i];
+	if (sum != p[DAV_HEADER_LEN - 1])
+		return DAV_PARSE_BAD;
+
+	uint8_t type = p[4];
+	if (type != DAV_FRAME_I && type != DAV_FRAME_P && type != DAV_FRAME_JPEG
+		&& type != DAV_FRAME_AUDIO && type != DAV_FRAME_AUX)
+		return DAV_PARSE_BAD;
+
+	uint32_t length = ReadLE32(p + 12);
+	uint8_t extLen = p[22];
+	if (length < (uint32_t)(DAV_HEADER_LEN + DAV_TAIL_LEN + extLen) || length > DAV_MAX_FRAME_LEN)
+		return DAV_PARSE_BAD;
+	if (n < (size_t)DAV_HEADER_LEN + extLen)
+		return DAV_PARSE_NEED_MORE;
+
+	memset(frame, 0, sizeof(*frame));
+	frame->type = type;
+	frame->subType = p[5];
+	frame->channel = p[6];
+	frame->seq = ReadLE32(p + 8);
+	frame->length = length;
+	frame->dateTime = ReadLE32(p + 16);
+	frame->stampMs = ReadLE16(p + 20);
+	frame->data = p;
+	frame->payload = p + DAV_HEADER_LEN + extLen;
+	frame->payloadLen = length - DAV_HEADER_LEN - DAV_TAIL_LEN - extLen;
+	ParseExtensions(p + DAV_HEADER_LEN, extLen, frame);
+	return DAV_PARSE_OK;
+}
+
+bool DavCheckTail(const uint8_t* tail, uint32_t length)
+{
+	return memcmp(tail, "dhav", 4) == 0 && ReadLE32(tail + 4) == length;
+}
+
+int DavParseFrame(const uint8_t* p, size_t n, DavFrame* frame)
+{
+	int ret = DavParseHeader(p, n, frame);
+	if (ret != DAV_PARSE_OK)
+		return ret;
+	if (n < frame->length)
+		return DAV_PARSE_NEED_MORE;
+	if (!DavCheckTail(p + frame->length - DAV_TAIL_LEN, frame->length))
+		return DAV_PARSE_BAD;
+	return DAV_PARSE_OK;
+}
+
+size_t DavFindSync(const uint8_t* p, size_t n)
+{
+	const uint8_t* cur = p;
+	const uint8_t* end = p + n;
+	while (cur < end) {
+		cur = (const uint8_t*)memchr(cur, 'D', end - cur);
+		if (cur == NULL)
+			return n;
+		// a header split across two inputs keeps its leading bytes
+		size_t nLeft = end - cur;
+		if (memcmp(cur, "DHAV", nLeft < 4 ? nLeft : 4) == 0)
+			return cur - p;
+		cur++;
+	}
+	return n;
+}
+
+// Days since 1970-01-01 for a proleptic Gregorian date
+static int64_t DaysFromCivil(int y, unsigned m, unsigned d)
+{
+	y -= m <= 2;
+	const int64_t era = (y >= 0 ? y : y - 399) / 400;
+	const unsigned yoe = (unsigned)(y - era * 400);
+	const unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+	const unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + (int64_t)doe - 719468;
+}
+
+time_t DavDateToUnix(uint32_t dateTime)
+{
+	unsigned sec = dateTime & 0x3F;
+	unsigned min = (dateTime >> 6) & 0x3F;
+	unsigned hour = (dateTime >> 12) & 0x1F;
+	unsigned day = (dateTime >> 17) & 0x1F;
+	unsigned month = (dateTime >> 22) & 0x0F;
+	int year = (int)((dateTime >> 26) & 0x3F) + 2000;
+	if (month < 1 || month > 12 || day < 1)
+		return 0;
+	return (time_t)(DaysFromCivil(year, month, day) * 86400 + hour * 3600 + min * 60 + sec);
+}
+
+uint32_t DavUnixToDate(time_t t)
+{
+	int64_t days = (int64_t)t / 86400;
+	unsigned secs = (unsigned)((int64_t)t - days * 86400);
+	// civil_from_days
+	days += 719468;
+	const int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+	const unsigned doe = (unsigned)(days - era * 146097);
+	const unsigned yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	const unsigned doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	const unsigned mp = (5 * doy + 2) / 153;
+	const unsigned d = doy - (153 * mp + 2) / 5 + 1;
+	const unsigned m = mp < 10 ? mp + 3 : mp - 9;
+	const int y = (int)(yoe + era * 400) + (m <= 2);
+
+	return ((uint32_t)(y - 2000) & 0x3F) << 26 | (m & 0x0F) << 22 | (d & 0x1F) << 17
+		| ((secs / 3600) & 0x1F) << 12 | ((secs / 60 % 60) & 0x3F) << 6 | (secs % 60);
+}
+
+DavFrameReader::DavFrameReader(FrameCallBack cb, void* pUser)
+	: m_cb(cb), m_pUser(pUser), m_nStart(0), m_nSkipped(0), m_bHaveStamp(false), m_lastStamp(0), m_ptsMs(0)
+{
+}
+
+void DavFrameReader::Reset()
+{
+	m_buf.clear();
+	m_nStart = 0;
+	m_bHaveStamp = false;
+	m_ptsMs = 0;
+}
+
+void DavFrameReader::Emit(DavFrame& frame)
+{
+	if (!m_bHaveStamp) {
+		m_bHaveStamp = true;
+		m_ptsMs = 0;
+	}
+	else {
+		// Small backward steps (audio interleaved with video) and the 16 bit
+		// wrap are both handled by the signed difference.
+		m_ptsMs += (int16_t)(uint16_t)(frame.stampMs - m_lastStamp);
+	}
+	m_lastStamp = frame.stampMs;
+	frame.ptsMs = m_ptsMs;
+	m_cb(frame, m_pUser);
+}
+
+void DavFrameReader::Input(const uint8_t* p, size_t n)
+{
+	// Fast path: nothing pending, parse straight out of the caller's buffer
+	if (m_buf.size() == m_nStart) {
+		m_buf.clear();
+		m_nStart = 0;
+		while (n > 0) {
+			size_t nSkip = DavFindSync(p, n);
+			m_nSkipped += nSkip;
+			p += nSkip;
+			n -= nSkip;
+			if (n == 0)
+				return;
+
+			DavFrame frame;
+			int ret = DavParseFrame(p, n, &frame);
+			if (ret == DAV_PARSE_OK) {
+				Emit(frame);
+				p += frame.length;
+				n -= frame.length;
+			}
+			else if (ret == DAV_PARSE_BAD) {
+				m_nSkipped++;
+				p++;
+				n--;
+			}
+			else {
+				break;
+			}
+		}
+		m_buf.assign(p, p + n);
+		return;
+	}
+
+	m_buf.insert(m_buf.end(), p, p + n);
+	for (;;) {
+		size_t nAvail = m_buf.size() - m_nStart;
+		const uint8_t* cur = m_buf.data() + m_nStart;
+		size_t nSkip = DavFindSync(cur, nAvail);
+		m_nSkipped += nSkip;
+		m_nStart += nSkip;
+		nAvail -= nSkip;
+		if (nAvail == 0)
+			break;
+
+		DavFrame frame;
+		int ret = DavParseFrame(m_buf.data() + m_nStart, nAvail, &frame);
+		if (ret == DAV_PARSE_OK) {
+			Emit(frame);
+			m_nStart += frame.length;
+		}
+		else if (ret == DAV_PARSE_BAD) {
+			m_nSkipped++;
+			m_nStart++;
+		}
+		else {
+			break;
+		}
+	}
+
+	if (m_nStart == m_buf.size()) {
+		m_buf.clear();
+		m_nStart = 0;
+	}
+	else if (m_nStart > m_buf.size() / 2) {
+		m_buf.erase(m_buf.begin(), m_buf.begin() + m_nStart);
+		m_nStart = 0;
+	}
+}
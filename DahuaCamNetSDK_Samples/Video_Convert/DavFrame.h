@@ -0,0 +1,114 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include <vector>
+
+// DAV (DHAV) container framing as written by CLIENT_SaveRealData,
+// CLIENT_DownloadByTimeEx and the realplay raw data callback.
+//
+//  0  "DHAV"
+//  4  frame type (DAV_FRAME_*)
+//  5  sub type
+//  6  channel
+//  7  sub frame index
+//  8  frame sequence (LE32)
+// 12  total frame length incl. header and tail (LE32)
+// 16  packed local date time (LE32)
+// 20  millisecond stamp, wraps at 65536 (LE16)
+// 22  extension length
+// 23  checksum: low byte of the sum of bytes 0..22
+// 24  extensions, payload, then tail "dhav" + frame length (LE32)
+
+#define DAV_HEADER_LEN			24
+#define DAV_TAIL_LEN			8
+#define DAV_MAX_FRAME_LEN		(8 * 1024 * 1024)
+
+#define DAV_FRAME_I				0xFD
+#define DAV_FRAME_P				0xFC
+#define DAV_FRAME_JPEG			0xFB
+#define DAV_FRAME_AUDIO			0xF0
+#define DAV_FRAME_AUX			0xF1
+
+// Video codec ids carried in extension 0x81
+#define DAV_CODEC_MPEG4			0x01
+#define DAV_CODEC_H264			0x02
+#define DAV_CODEC_H264_STD		0x08
+#define DAV_CODEC_H265			0x0C
+
+// DavParseFrame results
+#define DAV_PARSE_OK			0
+#define DAV_PARSE_NEED_MORE		1	// header valid but the frame is not complete yet
+#define DAV_PARSE_BAD			2	// not a frame start
+
+struct DavFrame
+{
+	uint8_t  type;
+	uint8_t  subType;
+	uint8_t  channel;
+	uint32_t seq;
+	uint32_t length;			// whole frame, header to tail
+	uint32_t dateTime;			// packed, see DavDateToUnix
+	uint16_t stampMs;
+	int64_t  ptsMs;				// unwrapped stamp, filled by DavFrameReader
+
+	uint16_t width;				// from extensions, 0 when absent
+	uint16_t height;
+	uint8_t  videoCodec;
+	uint8_t  frameRate;
+	uint8_t  audioCodec;
+	uint8_t  audioChannels;
+	uint32_t sampleRate;
+
+	const uint8_t* data;		// start of the frame ("DHAV")
+	const uint8_t* payload;		// elementary stream data
+	uint32_t payloadLen;
+
+	bool IsVideo() const { return type == DAV_FRAME_I || type == DAV_FRAME_P; }
+	bool IsKey() const { return type == DAV_FRAME_I; }
+};
+
+// Parses the frame at p. On DAV_PARSE_OK the whole frame (tail included) is
+// inside [p, p + n) and frame->length bytes may be consumed.
+int DavParseFrame(const uint8_t* p, size_t n, DavFrame* frame);
+
+// Header and extensions only; a header with a wrong checksum is
+// DAV_PARSE_BAD. The payload pointers are set but the payload and tail may
+// lie beyond n; callers that skip through files use this with DavCheckTail
+// on the 8 tail bytes.
+int DavParseHeader(const uint8_t* p, size_t n, DavFrame* frame);
+bool DavCheckTail(const uint8_t* tail, uint32_t length);
+
+// Offset of the next plausible frame header at or after p, or n if none.
+size_t DavFindSync(const uint8_t* p, size_t n);
+
+// Local wall-clock seconds since 1970 for a packed DAV date time.
+time_t DavDateToUnix(uint32_t dateTime);
+uint32_t DavUnixToDate(time_t t);
+
+// Reassembles frames from arbitrarily split input (live callbacks, fread
+// chunks). Memory is bounded by DAV_MAX_FRAME_LEN plus one input chunk.
+class DavFrameReader
+{
+public:
+	typedef void (*FrameCallBack)(const DavFrame& frame, void* pUser);
+
+	DavFrameReader(FrameCallBack cb, void* pUser);
+
+	void Input(const uint8_t* p, size_t n);
+	void Reset();
+
+	uint64_t BytesSkipped() const { return m_nSkipped; }
+
+private:
+	void Emit(DavFrame& frame);
+
+	FrameCallBack m_cb;
+	void* m_pUser;
+	std::vector<uint8_t> m_buf;
+	size_t m_nStart;
+	uint64_t m_nSkipped;
+	bool m_bHaveStamp;
+	uint16_t m_lastStamp;
+	int64_t m_ptsMs;
+};
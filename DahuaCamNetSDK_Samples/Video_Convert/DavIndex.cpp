@@ -0,0 +1,311 @@
+#include <string.h>
+#include <filesystem>
+#include <string>
+#include "DavIndex.h"
+
+int DavFileSeek(FILE* fp, int64_t pos)
+{
+#ifdef _WIN32
+	return _fseeki64(fp, pos, SEEK_SET);
+#else
+	return fseeko(fp, (off_t)pos, SEEK_SET);
+#endif
+}
+
+int64_t DavFileSize(FILE* fp)
+{
+#ifdef _WIN32
+	if (_fseeki64(fp, 0, SEEK_END) != 0)
+		return -1;
+	int64_t size = _ftelli64(fp);
+#else
+	if (fseeko(fp, 0, SEEK_END) != 0)
+		return -1;
+	int64_t size = (int64_t)ftello(fp);
+#endif
+	DavFileSeek(fp, 0);
+	return size;
+}
+
+int64_t DavFileTime(const char* file)
+{
+	std::error_code ec;
+	std::filesystem::file_time_type t = std::filesystem::last_write_time(file, ec);
+	return ec ? 0 : (int64_t)t.time_since_epoch().count();
+}
+
+DavFileWindow::DavFileWindow(FILE* fp, size_t chunk)
+	: m_fp(fp), m_buf(chunk), m_start(0), m_len(0), m_filePos(0)
+{
+	DavFileSeek(m_fp, 0);
+}
+
+size_t DavFileWindow::Get(int64_t pos, size_t n, const uint8_t** p)
+{
+	if (pos >= m_start && pos + (int64_t)n <= m_start + (int64_t)m_len) {
+		*p = m_buf.data() + (pos - m_start);
+		return n;
+	}
+	if (n > m_buf.size())
+		m_buf.resize(n);
+
+	size_t nKeep = 0;
+	if (pos >= m_start && pos < m_start + (int64_t)m_len) {
+		// the file position already sits at the end of the window
+		nKeep = (size_t)(m_start + (int64_t)m_len - pos);
+		memmove(m_buf.data(), m_buf.data() + (pos - m_start), nKeep);
+	}
+	else if (pos != m_filePos) {
+		if (DavFileSeek(m_fp, pos) != 0) {
+			m_start = pos;
+			m_len = 0;
+			return 0;
+		}
+	}
+
+	m_start = pos;
+	m_len = nKeep + fread(m_buf.data() + nKeep, 1, m_buf.size() - nKeep, m_fp);
+	m_filePos = m_start + (int64_t)m_len;
+	*p = m_buf.data();
+	return m_len < n ? m_len : n;
+}
+
+int DavBuildIndex(FILE* fp, DavIndex* index, int flags)
+{
+	*index = DavIndex();
+
+	DavFileWindow window(fp);
+	int64_t pos = 0;
+	bool bHaveStamp = false;
+	uint16_t lastStamp = 0;
+	int64_t ptsMs = 0;
+
+	for (;;) {
+		const uint8_t* p;
+		size_t n = window.Get(pos, DAV_HEADER_LEN + 255, &p);
+		if (n == 0)
+			break;
+
+		DavFrame frame;
+		int ret = DavParseHeader(p, n, &frame);
+		if (ret == DAV_PARSE_NEED_MORE)
+			break;	// partial header at end of file
+		if (ret == DAV_PARSE_OK) {
+			DavIndexEntry entry;
+			entry.offset = pos;
+			entry.length = frame.length;
+			entry.type = frame.type;
+			entry.videoCodec = frame.videoCodec;
+			entry.width = frame.width;
+			entry.height = frame.height;
+			entry.dateTime = frame.dateTime;
+
+			const uint8_t* tail;
+			if (window.Get(pos + frame.length - DAV_TAIL_LEN, DAV_TAIL_LEN, &tail) == DAV_TAIL_LEN
+				&& DavCheckTail(tail, frame.length)) {
+				if (bHaveStamp)
+					ptsMs += (int16_t)(uint16_t)(frame.stampMs - lastStamp);
+				bHaveStamp = true;
+				lastStamp = frame.stampMs;
+				entry.ptsMs = ptsMs;
+				if (index->nFrames++ == 0)
+					index->firstDateTime = frame.dateTime;
+				index->lastDateTime = frame.dateTime;
+				index->lastPtsMs = ptsMs;
+
+				if (!(flags & DAV_INDEX_KEY_ONLY) || entry.type == DAV_FRAME_I)
+					index->frames.push_back(entry);
+				pos += frame.length;
+				index->validEnd = pos;
+				continue;
+			}
+		}
+
+		// Not a frame, or a frame whose tail is missing: look for the next header
+		int64_t from = pos + 1;
+		for (;;) {
+			n = window.Get(from, DAV_INDEX_CHUNK, &p);
+			size_t off = DavFindSync(p, n);
+			if (off < n || n < DAV_INDEX_CHUNK) {
+				from += off;
+				break;
+			}
+			from += n;
+		}
+		index->nSkipped += (uint64_t)(from - pos);
+		pos = from;
+	}
+
+	// a partial header at the end stops the walk short of the file size
+	index->fileSize = DavFileSize(fp);
+	if (index->fileSize > pos)
+		index->nSkipped += (uint64_t)(index->fileSize - pos);
+	return DAV_INDEX_OK;
+}
+
+#define DAV_INDEX_MAGIC			"DIDX"
+#define DAV_INDEX_VERSION		2
+#define DAV_INDEX_HEADER_LEN	64
+#define DAV_INDEX_ENTRY_LEN		30
+
+static void PutLE(std::vector<uint8_t>& out, uint64_t v, int nBytes)
+{
+	for (int i = 0; i < nBytes; i++)
+		out.push_back((uint8_t)(v >> (8 * i)));
+}
+
+static uint64_t GetLE(const uint8_t*& p, int nBytes)
+{
+	uint64_t v = 0;
+	for (int i = 0; i < nBytes; i++)
+		v |= (uint64_t)p[i] << (8 * i);
+	p += nBytes;
+	return v;
+}
+
+int DavWriteIndexFile(const char* path, const DavIndex& index)
+{
+	std::vector<uint8_t> out;
+	out.reserve(DAV_INDEX_HEADER_LEN + index.frames.size() * DAV_INDEX_ENTRY_LEN);
+	out.insert(out.end(), DAV_INDEX_MAGIC, DAV_INDEX_MAGIC + 4);
+	PutLE(out, DAV_INDEX_VERSION, 4);
+	PutLE(out, (uint64_t)index.fileSize, 8);
+	PutLE(out, (uint64_t)index.fileTime, 8);
+	PutLE(out, (uint64_t)index.validEnd, 8);
+	PutLE(out, index.nSkipped, 8);
+	PutLE(out, index.nFrames, 4);
+	PutLE(out, index.firstDateTime, 4);
+	PutLE(out, index.lastDateTime, 4);
+	PutLE(out, (uint64_t)index.lastPtsMs, 8);
+	PutLE(out, (uint32_t)index.frames.size(), 4);
+	for (const DavIndexEntry& e : index.frames) {
+		PutLE(out, (uint64_t)e.offset, 8);
+		PutLE(out, e.length, 4);
+		PutLE(out, e.type, 1);
+		PutLE(out, e.videoCodec, 1);
+		PutLE(out, e.width, 2);
+		PutLE(out, e.height, 2);
+		PutLE(out, e.dateTime, 4);
+		PutLE(out, (uint64_t)e.ptsMs, 8);
+	}
+
+	std::string tmp = std::string(path) + ".tmp";
+	FILE* fp = fopen(tmp.c_str(), "wb");
+	if (fp == NULL)
+		return DAV_INDEX_ERR_WRITE;
+	bool bOk = fwrite(out.data(), 1, out.size(), fp) == out.size();
+	bOk = fclose(fp) == 0 && bOk;
+	std::error_code ec;
+	if (bOk)
+		std::filesystem::rename(tmp, path, ec);
+	if (!bOk || ec) {
+		std::filesystem::remove(tmp, ec);
+		return DAV_INDEX_ERR_WRITE;
+	}
+	return DAV_INDEX_OK;
+}
+
+int DavReadIndexFile(const char* path, DavIndex* index)
+{
+	FILE* fp = fopen(path, "rb");
+	if (fp == NULL)
+		return DAV_INDEX_ERR_OPEN;
+	std::vector<uint8_t> in;
+	uint8_t chunk[64 * 1024];
+	size_t nRead;
+	while ((nRead = fread(chunk, 1, sizeof(chunk), fp)) > 0)
+		in.insert(in.end(), chunk, chunk + nRead);
+	fclose(fp);
+
+	if (in.size() < DAV_INDEX_HEADER_LEN || memcmp(in.data(), DAV_INDEX_MAGIC, 4) != 0)
+		return DAV_INDEX_ERR_FORMAT;
+	const uint8_t* p = in.data() + 4;
+	if (GetLE(p, 4) != DAV_INDEX_VERSION)
+		return DAV_INDEX_ERR_FORMAT;
+
+	*index = DavIndex();
+	index->fileSize = (int64_t)GetLE(p, 8);
+	index->fileTime = (int64_t)GetLE(p, 8);
+	index->validEnd = (int64_t)GetLE(p, 8);
+	index->nSkipped = GetLE(p, 8);
+	index->nFrames = (uint32_t)GetLE(p, 4);
+	index->firstDateTime = (uint32_t)GetLE(p, 4);
+	index->lastDateTime = (uint32_t)GetLE(p, 4);
+	index->lastPtsMs = (int64_t)GetLE(p, 8);
+	uint32_t nEntries = (uint32_t)GetLE(p, 4);
+	if (in.size() != DAV_INDEX_HEADER_LEN + (size_t)nEntries * DAV_INDEX_ENTRY_LEN)
+		return DAV_INDEX_ERR_FORMAT;
+
+	index->frames.resize(nEntries);
+	for (DavIndexEntry& e : index->frames) {
+		e.offset = (int64_t)GetLE(p, 8);
+		e.length = (uint32_t)GetLE(p, 4);
+		e.type = (uint8_t)GetLE(p, 1);
+		e.videoCodec = (uint8_t)GetLE(p, 1);
+		e.width = (uint16_t)GetLE(p, 2);
+		e.height = (uint16_t)GetLE(p, 2);
+		e.dateTime = (uint32_t)GetLE(p, 4);
+		e.ptsMs = (int64_t)GetLE(p, 8);
+	}
+	return DAV_INDEX_OK;
+}
+
+int DavBuildIndex(const char* file, DavIndex* index, int flags)
+{
+	FILE* fp = fopen(file, "rb");
+	if (fp == NULL)
+		return DAV_INDEX_ERR_OPEN;
+	int ret = DavBuildIndex(fp, index, flags);
+	fclose(fp);
+	return ret;
+}
+
+// The frame recorded at e is still in fp: header, tail and summary agree
+static bool CheckEntry(FILE* fp, const DavIndexEntry& e)
+{
+	uint8_t buf[DAV_HEADER_LEN + 255];
+	DavFrame frame;
+	if (DavFileSeek(fp, e.offset) != 0)
+		return false;
+	size_t n = fread(buf, 1, sizeof(buf), fp);
+	if (DavParseHeader(buf, n, &frame) != DAV_PARSE_OK || frame.type != e.type
+		|| frame.length != e.length || frame.dateTime != e.dateTime)
+		return false;
+	uint8_t tail[DAV_TAIL_LEN];
+	return DavFileSeek(fp, e.offset + e.length - DAV_TAIL_LEN) == 0
+		&& fread(tail, 1, DAV_TAIL_LEN, fp) == DAV_TAIL_LEN && DavCheckTail(tail, e.length);
+}
+
+bool DavCheckIndex(const char* file, const DavIndex& index)
+{
+	int64_t fileTime = DavFileTime(file);
+	if (fileTime == 0 || fileTime != index.fileTime)
+		return false;
+	FILE* fp = fopen(file, "rb");
+	if (fp == NULL)
+		return false;
+	bool bOk = DavFileSize(fp) == index.fileSize;
+	if (bOk && !index.frames.empty())
+		bOk = CheckEntry(fp, index.frames.front()) && CheckEntry(fp, index.frames.back());
+	fclose(fp);
+	return bOk;
+}
+
+int DavLoadIndex(const char* file, DavIndex* index)
+{
+	std::string idxPath = std::string(file) + ".idx";
+	if (DavReadIndexFile(idxPath.c_str(), index) == DAV_INDEX_OK && DavCheckIndex(file, *index))
+		return DAV_INDEX_OK;
+
+	FILE* fp = fopen(file, "rb");
+	if (fp == NULL)
+		return DAV_INDEX_ERR_OPEN;
+	// Taken before the scan, so a write during it shows as a change
+	int64_t fileTime = DavFileTime(file);
+	int ret = DavBuildIndex(fp, index, DAV_INDEX_KEY_ONLY);
+	fclose(fp);
+	index->fileTime = fileTime;
+	if (ret == DAV_INDEX_OK)
+		DavWriteIndexFile(idxPath.c_str(), *index);	// a cache, failure is not an error
+	return ret;
+}
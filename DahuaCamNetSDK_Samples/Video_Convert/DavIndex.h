@@ -0,0 +1,90 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+#include "DavFrame.h"
+
+// DavBuildIndex result codes
+#define DAV_INDEX_OK			0
+#define DAV_INDEX_ERR_OPEN		1	// file cannot be opened
+#define DAV_INDEX_ERR_FORMAT	2	// index file damaged or of another version
+#define DAV_INDEX_ERR_WRITE		3
+
+// DavBuildIndex flags
+#define DAV_INDEX_KEY_ONLY		0x01	// record I frames only
+
+#define DAV_INDEX_CHUNK			(256 * 1024)
+
+struct DavIndexEntry
+{
+	int64_t  offset;			// file offset of "DHAV"
+	uint32_t length;
+	uint8_t  type;
+	uint8_t  videoCodec;
+	uint16_t width;
+	uint16_t height;
+	uint32_t dateTime;
+	int64_t  ptsMs;				// unwrapped over every frame in the file
+};
+
+struct DavIndex
+{
+	std::vector<DavIndexEntry> frames;
+	int64_t fileSize = 0;
+	int64_t fileTime = 0;		// last write time when indexed (DavFileTime), set by the path callers
+	int64_t validEnd = 0;		// end of the last complete frame
+	uint64_t nSkipped = 0;		// bytes outside any complete frame, partial tail included
+	uint32_t nFrames = 0;		// complete frames of any type, recorded or not
+	uint32_t firstDateTime = 0;
+	uint32_t lastDateTime = 0;
+	int64_t lastPtsMs = 0;		// stamp of the last complete frame, i.e. the duration
+};
+
+// Buffered positional reads over a FILE*. Sequential access costs one fread
+// per chunk; a jump outside the window costs one seek.
+class DavFileWindow
+{
+public:
+	DavFileWindow(FILE* fp, size_t chunk = DAV_INDEX_CHUNK);
+
+	// Makes up to n bytes at pos readable through *p. Returns the count, which
+	// is less than n only at end of file.
+	size_t Get(int64_t pos, size_t n, const uint8_t** p);
+
+private:
+	FILE* m_fp;
+	std::vector<uint8_t> m_buf;
+	int64_t m_start;
+	size_t m_len;
+	int64_t m_filePos;
+};
+
+// Walks the frame headers of a DAV file without touching payloads: every
+// frame costs a header read and a tail check, payloads are skipped by seeking
+// whenever they exceed the read window. Damaged regions are resynchronized
+// on the next "DHAV" whose tail also checks out.
+int DavBuildIndex(const char* file, DavIndex* index, int flags = 0);
+int DavBuildIndex(FILE* fp, DavIndex* index, int flags = 0);
+
+// Sidecar index ("<file>.idx"): the summary fields plus the recorded entries,
+// little endian, written through a temporary file and renamed into place.
+int DavWriteIndexFile(const char* path, const DavIndex& index);
+int DavReadIndexFile(const char* path, DavIndex* index);
+
+// Whether a sidecar read back still describes file: same size and last
+// write time, and the first and last recorded frames still sit where the
+// index says, with the same type, length and date. A file rewritten to the
+// same size fails at least one of these.
+bool DavCheckIndex(const char* file, const DavIndex& index);
+
+// Key frame index of a file: the sidecar when DavCheckIndex accepts it,
+// otherwise a fresh DAV_INDEX_KEY_ONLY scan that is then saved as the
+// sidecar for the next caller.
+int DavLoadIndex(const char* file, DavIndex* index);
+
+// 64 bit file positioning; DavFileSize leaves the position at 0.
+int DavFileSeek(FILE* fp, int64_t pos);
+int64_t DavFileSize(FILE* fp);
+
+// Last write time in file system ticks, 0 when it cannot be read.
+int64_t DavFileTime(const char* file);
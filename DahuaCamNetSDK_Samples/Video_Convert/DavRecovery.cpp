@@ -0,0 +1,217 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <algorithm>
+#include <filesystem>
+#include "DavRecovery.h"
+
+namespace fs = std::filesystem;
+
+static void FillReport(const DavIndex& index, RecoverReport* report)
+{
+	report->validSize = index.validEnd;
+	report->nFrames = index.nFrames;
+	report->nKeyFrames = 0;
+	for (const DavIndexEntry& e : index.frames)
+		report->nKeyFrames += e.type == DAV_FRAME_I;
+	report->durationMs = index.lastPtsMs;
+}
+
+// Copies the complete frames to a new file and renames it over the original.
+// Adjacent frames are copied as one range.
+static bool RewriteFrames(const std::string& file, const DavIndex& full)
+{
+	FILE* src = fopen(file.c_str(), "rb");
+	if (src == NULL)
+		return false;
+	std::string tmp = file + ".repair";
+	FILE* dst = fopen(tmp.c_str(), "wb");
+	if (dst == NULL) {
+		fclose(src);
+		return false;
+	}
+
+	std::vector<uint8_t> buf(1024 * 1024);
+	bool bOk = true;
+	size_t i = 0;
+	while (bOk && i < full.frames.size()) {
+		int64_t start = full.frames[i].offset;
+		int64_t end = start + full.frames[i].length;
+		for (i++; i < full.frames.size() && full.frames[i].offset == end; i++)
+			end += full.frames[i].length;
+
+		bOk = DavFileSeek(src, start) == 0;
+		while (bOk && start < end) {
+			size_t n = (size_t)std::min<int64_t>(end - start, (int64_t)buf.size());
+			bOk = fread(buf.data(), 1, n, src) == n && fwrite(buf.data(), 1, n, dst) == n;
+			start += n;
+		}
+	}
+	fclose(src);
+	bOk = fclose(dst) == 0 && bOk;
+
+	std::error_code ec;
+	if (bOk)
+		fs::rename(tmp, file, ec);
+	if (!bOk || ec) {
+		fs::remove(tmp, ec);
+		return false;
+	}
+	return true;
+}
+
+int DavRecoverFile(const std::string& file, const RecoverOptions& options, RecoverReport* report)
+{
+	*report = RecoverReport();
+	report->file = file;
+	std::string idxPath = file + ".idx";
+
+	std::error_code ec;
+	uintmax_t size = fs::file_size(file, ec);
+	if (ec)
+		return report->error = RECOVER_ERR_OPEN;
+	report->fileSize = (int64_t)size;
+
+	DavIndex index;
+	if (options.bTrustIndex && DavReadIndexFile(idxPath.c_str(), &index) == DAV_INDEX_OK
+		&& index.validEnd == (int64_t)size && index.nSkipped == 0 && DavCheckIndex(file.c_str(), index)) {
+		report->bFromIndex = true;
+		FillReport(index, report);
+		return RECOVER_OK;
+	}
+
+	int64_t fileTime = DavFileTime(file.c_str());
+	if (DavBuildIndex(file.c_str(), &index, DAV_INDEX_KEY_ONLY) != DAV_INDEX_OK)
+		return report->error = RECOVER_ERR_OPEN;
+	report->nDamaged = index.nSkipped;
+	if (index.nFrames == 0) {
+		FillReport(index, report);
+		return report->error = RECOVER_ERR_NO_FRAME;
+	}
+
+	uint64_t nTail = (uint64_t)(index.fileSize - index.validEnd);
+	if (options.mode == RECOVER_MODE_REPAIR && index.nSkipped > nTail) {
+		// Damage inside the file: keep only the complete frames
+		DavIndex full;
+		if (DavBuildIndex(file.c_str(), &full) != DAV_INDEX_OK || !RewriteFrames(file, full))
+			return report->error = RECOVER_ERR_WRITE;
+
+		index.frames.clear();
+		int64_t offset = 0;
+		for (DavIndexEntry e : full.frames) {
+			e.offset = offset;
+			offset += e.length;
+			if (e.type == DAV_FRAME_I)
+				index.frames.push_back(e);
+		}
+		index.fileSize = index.validEnd = offset;
+		index.nSkipped = 0;
+		report->action = RECOVER_ACTION_REPAIRED;
+	}
+	else if (options.mode != RECOVER_MODE_SCAN && nTail > 0) {
+		fs::resize_file(file, (uintmax_t)index.validEnd, ec);
+		if (ec)
+			return report->error = RECOVER_ERR_WRITE;
+		index.fileSize = index.validEnd;
+		index.nSkipped -= nTail;
+		report->action = RECOVER_ACTION_TRUNCATED;
+	}
+
+	FillReport(index, report);
+	if (options.bWriteIndex) {
+		// A repaired or truncated file has a new write time
+		index.fileTime = report->action == RECOVER_ACTION_NONE ? fileTime : DavFileTime(file.c_str());
+		if (DavWriteIndexFile(idxPath.c_str(), index) != DAV_INDEX_OK)
+			return report->error = RECOVER_ERR_WRITE;
+		report->bIndexWritten = true;
+	}
+	return RECOVER_OK;
+}
+
+DavRecoveryScanner::DavRecoveryScanner(int nWorkers) : m_bExit(false)
+{
+	if (nWorkers < 1)
+		nWorkers = (int)std::thread::hardware_concurrency();
+	if (nWorkers < 1)
+		nWorkers = 1;
+	for (int i = 0; i < nWorkers; i++)
+		m_workers.emplace_back(&DavRecoveryScanner::WorkerLoop, this);
+}
+
+DavRecoveryScanner::~DavRecoveryScanner()
+{
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		m_bExit = true;
+	}
+	m_cvJobs.notify_all();
+	for (std::thread& t : m_workers)
+		t.join();
+
+	for (RecoverJob* pJob : m_jobs) {
+		RecoverReport report;
+		report.file = pJob->file;
+		report.error = RECOVER_ERR_CANCELED;
+		pJob->done.set_value(report);
+		delete pJob;
+	}
+	m_jobs.clear();
+}
+
+std::future<RecoverReport> DavRecoveryScanner::Submit(const std::string& file, const RecoverOptions& options)
+{
+	RecoverJob* pJob = new RecoverJob;
+	pJob->file = file;
+	pJob->options = options;
+	std::future<RecoverReport> result = pJob->done.get_future();
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		m_jobs.push_back(pJob);
+	}
+	m_cvJobs.notify_one();
+	return result;
+}
+
+void DavRecoveryScanner::WorkerLoop()
+{
+	for (;;) {
+		RecoverJob* pJob = NULL;
+		{
+			std::unique_lock<std::mutex> lk(m_lock);
+			m_cvJobs.wait(lk, [this] { return m_bExit || !m_jobs.empty(); });
+			if (m_bExit)
+				return;
+			pJob = m_jobs.front();
+			m_jobs.pop_front();
+		}
+		RecoverReport report;
+		DavRecoverFile(pJob->file, pJob->options, &report);
+		pJob->done.set_value(report);
+		delete pJob;
+	}
+}
+
+std::vector<RecoverReport> DavRecoveryScanner::RecoverDirectory(const std::string& dir, const RecoverOptions& options)
+{
+	std::vector<std::string> files;
+	std::error_code ec;
+	for (fs::recursive_directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+		if (!it->is_regular_file(ec))
+			continue;
+		std::string ext = it->path().extension().string();
+		std::transform(ext.begin(), ext.end(), ext.begin(), [](char c) { return (char)tolower((unsigned char)c); });
+		if (ext == ".dav")
+			files.push_back(it->path().string());
+	}
+	std::sort(files.begin(), files.end());
+
+	std::vector<std::future<RecoverReport>> pending;
+	pending.reserve(files.size());
+	for (const std::string& file : files)
+		pending.push_back(Submit(file, options));
+
+	std::vector<RecoverReport> reports;
+	reports.reserve(files.size());
+	for (std::future<RecoverReport>& f : pending)
+		reports.push_back(f.get());
+	return reports;
+}
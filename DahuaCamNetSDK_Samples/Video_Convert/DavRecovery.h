@@ -0,0 +1,85 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "DavIndex.h"
+
+// Recovery result codes
+#define RECOVER_OK				0
+#define RECOVER_ERR_OPEN		1	// file cannot be opened
+#define RECOVER_ERR_NO_FRAME	2	// not a single complete frame, left untouched
+#define RECOVER_ERR_WRITE		3	// truncate, rewrite or index write failed
+#define RECOVER_ERR_CANCELED	4	// scanner destroyed before the job ran
+
+// What to do with a damaged file
+#define RECOVER_MODE_SCAN		0	// report only
+#define RECOVER_MODE_TRUNCATE	1	// cut the partial frame off the end
+#define RECOVER_MODE_REPAIR		2	// also drop damaged regions inside the file
+
+// Action taken
+#define RECOVER_ACTION_NONE			0
+#define RECOVER_ACTION_TRUNCATED	1
+#define RECOVER_ACTION_REPAIRED		2
+
+struct RecoverOptions
+{
+	int mode = RECOVER_MODE_TRUNCATE;
+	bool bWriteIndex = true;		// write "<file>.idx" when missing or stale
+	bool bTrustIndex = true;		// skip files whose sidecar DavCheckIndex accepts
+};
+
+struct RecoverReport
+{
+	std::string file;
+	int error = RECOVER_OK;
+	int action = RECOVER_ACTION_NONE;
+	bool bFromIndex = false;		// answered by an up to date index, no scan
+	bool bIndexWritten = false;
+	int64_t fileSize = 0;			// before any change
+	int64_t validSize = 0;			// after the change, or what it would be
+	uint64_t nDamaged = 0;			// bytes outside complete frames
+	uint32_t nFrames = 0;
+	uint32_t nKeyFrames = 0;
+	int64_t durationMs = 0;
+};
+
+// Checks one DAV file and brings it back to a sequence of complete frames.
+// The file must not be open for writing: run this on startup, before
+// recording resumes, for files such as the temp.dav left by a crash during
+// CLIENT_SaveRealData.
+int DavRecoverFile(const std::string& file, const RecoverOptions& options, RecoverReport* report);
+
+struct RecoverJob
+{
+	std::string file;
+	RecoverOptions options;
+	std::promise<RecoverReport> done;
+};
+
+// Recovers many files in parallel, one file per worker at a time. The work
+// is bound by sequential header reads, so a handful of workers is enough to
+// keep a disk array busy.
+class DavRecoveryScanner
+{
+public:
+	explicit DavRecoveryScanner(int nWorkers = 0);	// 0: one per core
+	~DavRecoveryScanner();
+
+	std::future<RecoverReport> Submit(const std::string& file, const RecoverOptions& options = RecoverOptions());
+
+	// Every *.dav below dir, reports in path order.
+	std::vector<RecoverReport> RecoverDirectory(const std::string& dir, const RecoverOptions& options = RecoverOptions());
+
+private:
+	void WorkerLoop();
+
+	std::mutex m_lock;
+	std::condition_variable m_cvJobs;
+	std::deque<RecoverJob*> m_jobs;
+	std::vector<std::thread> m_workers;
+	bool m_bExit;
+};
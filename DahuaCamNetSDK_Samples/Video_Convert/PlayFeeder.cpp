@@ -0,0 +1,161 @@
+#include "PlayFeeder.h"
+
+PlayFeeder::PlayFeeder(LONG nPort, DWORD nBufPoolSize)
+	: m_nPort(nPort), m_nConsumed(0), m_bAbort(false)
+{
+	if (nBufPoolSize < SOURCE_BUF_MIN)
+		nBufPoolSize = SOURCE_BUF_MIN;
+	if (nBufPoolSize > SOURCE_BUF_MAX)
+		nBufPoolSize = SOURCE_BUF_MAX;
+	m_nPoolSize = nBufPoolSize;
+	PLAY_SetDemuxCallBack(m_nPort, DemuxCallBack, this);
+}
+
+void CALLBACK PlayFeeder::DemuxCallBack(LONG nPort, char* pBuf, LONG nSize, void* pMutexInfo, void* pMutexInfoEx, void* pUserData)
+{
+	PlayFeeder* pFeeder = (PlayFeeder*)pUserData;
+	std::lock_guard<std::mutex> guard(pFeeder->m_lock);
+	pFeeder->m_nConsumed++;
+	pFeeder->m_cvSpace.notify_all();
+}
+
+DWORD PlayFeeder::FreeSpace()
+{
+	DWORD nRemain = PLAY_GetSourceBufferRemain(m_nPort);
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		if (nRemain > m_stats.maxFill)
+			m_stats.maxFill = nRemain;
+	}
+	return nRemain < m_nPoolSize ? m_nPoolSize - nRemain : 0;
+}
+
+bool PlayFeeder::WaitForSpace(unsigned long long nSeen, std::chrono::steady_clock::time_point deadline, bool bForever)
+{
+	std::unique_lock<std::mutex> lk(m_lock);
+	m_stats.nWaits++;
+
+	// Demux signals are the only wake up
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	if (bForever)
+		deadline = start + std::chrono::milliseconds(FEED_STALL_MS);
+	bool bSignaled = m_cvSpace.wait_until(lk, deadline, [&] { return m_bAbort || m_nConsumed != nSeen; });
+
+	m_stats.waitMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	if (m_bAbort)
+		return false;
+	if (!bSignaled && bForever)
+		m_stats.nStalls++;
+	return bSignaled;
+}
+
+bool PlayFeeder::Input(const BYTE* p, DWORD n, int timeoutMs)
+{
+	bool bForever = timeoutMs < 0;
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now()
+		+ std::chrono::milliseconds(bForever ? 0 : timeoutMs);
+
+	while (n > 0) {
+		unsigned long long nSeen;
+		{
+			std::lock_guard<std::mutex> guard(m_lock);
+			if (m_bAbort)
+				return false;
+			nSeen = m_nConsumed;
+		}
+
+		// The SDK takes a push whole or not at all, so never offer more than
+		// fits; tiny slivers of space are not worth a call unless they finish
+		// the input.
+		DWORD nFree = FreeSpace();
+		DWORD nChunk = n < FEED_MAX_CHUNK ? n : FEED_MAX_CHUNK;
+		if (nChunk > nFree)
+			nChunk = nFree;
+		if (nChunk >= FEED_MIN_CHUNK || nChunk == n) {
+			if (PLAY_InputData(m_nPort, (PBYTE)p, nChunk)) {
+				std::lock_guard<std::mutex> guard(m_lock);
+				if (m_stats.nPushes == 0 || nChunk < m_stats.minChunk)
+					m_stats.minChunk = nChunk;
+				if (nChunk > m_stats.maxChunk)
+					m_stats.maxChunk = nChunk;
+				m_stats.nPushes++;
+				m_stats.nBytes += nChunk;
+				p += nChunk;
+				n -= nChunk;
+				continue;
+			}
+			std::lock_guard<std::mutex> guard(m_lock);
+			m_stats.nRejects++;
+		}
+
+		if (!WaitForSpace(nSeen, deadline, bForever)) {
+			std::lock_guard<std::mutex> guard(m_lock);
+			if (!m_bAbort && !bForever)
+				m_stats.nDropped += n;
+			return false;
+		}
+	}
+	return true;
+}
+
+bool PlayFeeder::FeedFile(FILE* fp)
+{
+	m_readBuf.resize(FEED_MAX_CHUNK);
+	for (;;) {
+		DWORD nWant = FreeSpace();
+		if (nWant < FEED_MIN_CHUNK)
+			nWant = FEED_MIN_CHUNK;
+		if (nWant > FEED_MAX_CHUNK)
+			nWant = FEED_MAX_CHUNK;
+
+		size_t nRead = fread(m_readBuf.data(), 1, nWant, fp);
+		if (nRead > 0 && !Input(m_readBuf.data(), (DWORD)nRead))
+			return false;
+		if (nRead < nWant)
+			return ferror(fp) == 0;
+	}
+}
+
+bool PlayFeeder::WaitDrained(int stallMs)
+{
+	for (;;) {
+		unsigned long long nSeen;
+		{
+			std::lock_guard<std::mutex> guard(m_lock);
+			if (m_bAbort)
+				return false;
+			nSeen = m_nConsumed;
+		}
+		// The port is asked outside m_lock, which its callbacks take
+		if (PLAY_GetSourceBufferRemain(m_nPort) == 0 && PLAY_GetBufferValue(m_nPort, BUF_VIDEO_RENDER) == 0)
+			return true;
+
+		std::unique_lock<std::mutex> lk(m_lock);
+		if (!m_cvSpace.wait_for(lk, std::chrono::milliseconds(stallMs), [&] { return m_bAbort || m_nConsumed != nSeen; })) {
+			// The last callback may have come just before the buffers
+			// reported empty
+			lk.unlock();
+			return PLAY_GetSourceBufferRemain(m_nPort) == 0 && PLAY_GetBufferValue(m_nPort, BUF_VIDEO_RENDER) == 0;
+		}
+	}
+}
+
+void PlayFeeder::Progress()
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	m_nConsumed++;
+	m_cvSpace.notify_all();
+}
+
+void PlayFeeder::Abort()
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	m_bAbort = true;
+	m_cvSpace.notify_all();
+}
+
+FeederStats PlayFeeder::GetStats() const
+{
+	std::lock_guard<std::mutex> guard(m_lock);
+	return m_stats;
+}
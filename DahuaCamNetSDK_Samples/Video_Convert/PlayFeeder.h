@@ -0,0 +1,84 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+#include "play.h"
+
+#define FEED_MIN_CHUNK			(4 * 1024)		// smallest push worth a call
+#define FEED_MAX_CHUNK			(512 * 1024)	// largest single push
+#define FEED_STALL_MS			30000			// no demux signal this long while full: the port is stuck
+
+struct FeederStats
+{
+	uint64_t nBytes = 0;			// accepted by PLAY_InputData
+	uint64_t nPushes = 0;			// accepted calls
+	uint64_t nRejects = 0;			// PLAY_InputData returned FALSE
+	uint64_t nWaits = 0;			// times the feeder blocked for space
+	uint64_t nDropped = 0;			// bytes given up after a timeout (realtime)
+	uint64_t nStalls = 0;			// waits without a timeout that hit FEED_STALL_MS
+	double waitMs = 0;				// total time blocked
+	uint32_t minChunk = 0;			// smallest and largest push
+	uint32_t maxChunk = 0;
+	uint32_t maxFill = 0;			// highest PLAY_GetSourceBufferRemain seen
+};
+
+// Pushes data into a play port in stream mode without overrunning its source
+// buffer. Each push is sized from the free space, i.e. the pool size given
+// to PLAY_OpenStream minus PLAY_GetSourceBufferRemain, and when the pool is
+// full the feeder sleeps on the demux callback, which fires every time a
+// frame leaves the source buffer. The feeder installs that callback itself;
+// install nothing else with PLAY_SetDemuxCallBack on the port, and keep the
+// feeder alive until PLAY_Stop has returned.
+class PlayFeeder
+{
+public:
+	// nBufPoolSize: the value passed to PLAY_OpenStream, clamped to
+	// SOURCE_BUF_MIN..SOURCE_BUF_MAX as the SDK does.
+	PlayFeeder(LONG nPort, DWORD nBufPoolSize);
+
+	// Pushes all n bytes, in pieces when they exceed the free space. Waits up
+	// to timeoutMs for space; on timeout the rest is dropped and counted,
+	// which is what a realtime source wants. With -1 it waits as long as the
+	// port keeps demuxing, and gives up as a stall once it has not for
+	// FEED_STALL_MS. False when anything was dropped, on a stall, or when
+	// the feeder was aborted.
+	bool Input(const BYTE* p, DWORD n, int timeoutMs = -1);
+
+	// File mode: reads fp to the end, sizing each read from the free space.
+	// The final short read is pushed with its real length. False on a read
+	// error or abort.
+	bool FeedFile(FILE* fp);
+
+	// Blocks until the port has played what was fed: the source buffer and
+	// the video render buffer are both empty. Each demux callback or
+	// Progress call wakes it to look again. False on Abort, or when neither
+	// buffer emptied within stallMs of the last wake up.
+	bool WaitDrained(int stallMs);
+
+	// Wakes WaitDrained; for the owner's own port callbacks, such as the
+	// display callback once the source buffer is empty.
+	void Progress();
+
+	// Releases blocked callers, e.g. on file end or when the port is stopped.
+	void Abort();
+
+	FeederStats GetStats() const;
+
+private:
+	static void CALLBACK DemuxCallBack(LONG nPort, char* pBuf, LONG nSize, void* pMutexInfo, void* pMutexInfoEx, void* pUserData);
+
+	DWORD FreeSpace();
+	bool WaitForSpace(unsigned long long nSeen, std::chrono::steady_clock::time_point deadline, bool bForever);
+
+	LONG m_nPort;
+	DWORD m_nPoolSize;
+	mutable std::mutex m_lock;
+	std::condition_variable m_cvSpace;
+	unsigned long long m_nConsumed;		// demux callbacks and Progress calls
+	bool m_bAbort;
+	FeederStats m_stats;
+	std::vector<BYTE> m_readBuf;
+};
@@ -0,0 +1,421 @@
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include "play.h"
+#include "ThumbnailExtractor.h"
+
+#define THUMB_SLOT_PENDING		0
+#define THUMB_SLOT_READY		1
+#define THUMB_SLOT_FAILED		2
+
+// I frames handed to the decoder but not yet called back. Two keeps the
+// decoder busy while the worker reads and encodes.
+#define THUMB_MAX_IN_FLIGHT		2
+
+// An I frame handed to the decoder, known by the stamp of its DAV header
+struct ThumbPending
+{
+	size_t slot;
+	uint16_t stampMs;
+};
+
+// Per-port state shared with the decode callback
+struct ThumbPortState
+{
+	std::mutex lock;
+	std::condition_variable cv;
+	int targetWidth = 0;
+	int width = 0;						// fixed by the first decoded frame
+	int height = 0;
+	std::deque<ThumbPending> pending;	// in feed order
+	std::vector<std::vector<uint8_t>> thumbs;
+	std::vector<uint8_t> status;		// THUMB_SLOT_*
+};
+
+static inline int EvenDown(int v)
+{
+	return v & ~1;
+}
+
+void ScaleI420(const uint8_t* const src[3], const int srcStride[3], int srcW, int srcH,
+	uint8_t* dst, int dstW, int dstH)
+{
+	std::vector<int> xs(dstW + 1);
+	for (int plane = 0; plane < 3; plane++) {
+		int sw = plane == 0 ? srcW : (srcW + 1) / 2;
+		int sh = plane == 0 ? srcH : (srcH + 1) / 2;
+		int dw = plane == 0 ? dstW : dstW / 2;
+		int dh = plane == 0 ? dstH : dstH / 2;
+
+		// source column span of every destination column, at least one wide
+		for (int x = 0; x <= dw; x++)
+			xs[x] = (int)((int64_t)x * sw / dw);
+		for (int y = 0; y < dh; y++) {
+			int y0 = (int)((int64_t)y * sh / dh);
+			int y1 = (int)((int64_t)(y + 1) * sh / dh);
+			if (y1 <= y0)
+				y1 = y0 + 1;
+			for (int x = 0; x < dw; x++) {
+				int x0 = xs[x];
+				int x1 = xs[x + 1] > x0 ? xs[x + 1] : x0 + 1;
+				unsigned sum = 0;
+				for (int sy = y0; sy < y1; sy++) {
+					const uint8_t* row = src[plane] + (size_t)sy * srcStride[plane];
+					for (int sx = x0; sx < x1; sx++)
+						sum += row[sx];
+				}
+				unsigned area = (unsigned)((y1 - y0) * (x1 - x0));
+				*dst++ = (uint8_t)((sum + area / 2) / area);
+			}
+		}
+	}
+}
+
+static void CALLBACK ThumbDecodeCallBack(LONG nPort, FRAME_DECODE_INFO* pFrameDecodeInfo, FRAME_INFO_EX* pFrameInfo, void* pUserData)
+{
+	ThumbPortState* pState = (ThumbPortState*)pUserData;
+	if (pFrameDecodeInfo == NULL || pFrameDecodeInfo->nType != T_IYUV || pFrameDecodeInfo->pVideoData[0] == NULL)
+		return;
+
+	int srcW = pFrameDecodeInfo->nWidth[0];
+	int srcH = pFrameDecodeInfo->nHeight[0];
+	if (srcW < 2 || srcH < 2)
+		return;
+
+	// The picture goes to the slot fed with the same stamp, as LiveDecoder
+	// matches its pending frames; one that matches none, from the flush
+	// frame or for a slot given up on, is dropped
+	uint16_t stampMs = (uint16_t)(pFrameInfo != NULL ? pFrameInfo->nStamp : pFrameDecodeInfo->nTimeStamp);
+	size_t slot;
+	int w, h;
+	{
+		std::lock_guard<std::mutex> guard(pState->lock);
+		size_t i = 0;
+		while (i < pState->pending.size() && pState->pending[i].stampMs != stampMs)
+			i++;
+		if (i == pState->pending.size())
+			return;
+		// I frames come out in feed order, so the ones fed before this one
+		// were dropped by the decoder
+		for (size_t k = 0; k < i; k++)
+			pState->status[pState->pending[k].slot] = THUMB_SLOT_FAILED;
+		slot = pState->pending[i].slot;
+		pState->pending.erase(pState->pending.begin(), pState->pending.begin() + i + 1);
+		if (i > 0)
+			pState->cv.notify_all();
+
+		if (pState->width == 0) {
+			w = EvenDown(pState->targetWidth < srcW ? pState->targetWidth : srcW);
+			h = EvenDown((int)((int64_t)w * srcH / srcW));
+			pState->width = w < 2 ? 2 : w;
+			pState->height = h < 2 ? 2 : h;
+		}
+		w = pState->width;
+		h = pState->height;
+	}
+
+	// The slot belongs to this thread until it is marked ready
+	std::vector<uint8_t>& thumb = pState->thumbs[slot];
+	thumb.resize((size_t)w * h * 3 / 2);
+	const uint8_t* planes[3] = { (const uint8_t*)pFrameDecodeInfo->pVideoData[0],
+		(const uint8_t*)pFrameDecodeInfo->pVideoData[1], (const uint8_t*)pFrameDecodeInfo->pVideoData[2] };
+	ScaleI420(planes, pFrameDecodeInfo->nStride, srcW, srcH, thumb.data(), w, h);
+
+	std::lock_guard<std::mutex> guard(pState->lock);
+	pState->status[slot] = THUMB_SLOT_READY;
+	pState->cv.notify_all();
+}
+
+void SelectKeyFrames(const std::vector<DavIndexEntry>& keyFrames, int64_t intervalMs, std::vector<size_t>* selected)
+{
+	selected->clear();
+	int64_t next = 0;
+	for (size_t i = 0; i < keyFrames.size(); i++) {
+		if (keyFrames[i].type != DAV_FRAME_I)
+			continue;
+		if (!selected->empty() && keyFrames[i].ptsMs < next)
+			continue;
+		selected->push_back(i);
+		next = keyFrames[i].ptsMs + intervalMs;
+	}
+}
+
+static void FormatVttTime(int64_t ms, char* buf, size_t size)
+{
+	if (ms < 0)
+		ms = 0;
+	snprintf(buf, size, "%02d:%02d:%02d.%03d", (int)(ms / 3600000), (int)(ms / 60000 % 60),
+		(int)(ms / 1000 % 60), (int)(ms % 1000));
+}
+
+ThumbnailExtractor::ThumbnailExtractor(int nWorkers) : m_bExit(false)
+{
+	if (nWorkers < 1)
+		nWorkers = (int)std::thread::hardware_concurrency();
+	if (nWorkers < 1)
+		nWorkers = 1;
+	for (int i = 0; i < nWorkers; i++)
+		m_workers.emplace_back(&ThumbnailExtractor::WorkerLoop, this);
+}
+
+ThumbnailExtractor::~ThumbnailExtractor()
+{
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		m_bExit = true;
+	}
+	m_cvJobs.notify_all();
+	for (std::thread& t : m_workers)
+		t.join();
+
+	for (ThumbnailJob* pJob : m_jobs) {
+		ThumbnailResult result;
+		result.error = THUMB_ERR_CANCELED;
+		pJob->done.set_value(result);
+		delete pJob;
+	}
+	m_jobs.clear();
+}
+
+std::future<ThumbnailResult> ThumbnailExtractor::Submit(const std::string& srcFile, const std::string& outDir,
+	const ThumbnailOptions& options)
+{
+	ThumbnailJob* pJob = new ThumbnailJob;
+	pJob->srcFile = srcFile;
+	pJob->outDir = outDir;
+	pJob->options = options;
+	std::future<ThumbnailResult> result = pJob->done.get_future();
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		m_jobs.push_back(pJob);
+	}
+	m_cvJobs.notify_one();
+	return result;
+}
+
+void ThumbnailExtractor::WorkerLoop()
+{
+	for (;;) {
+		ThumbnailJob* pJob = NULL;
+		{
+			std::unique_lock<std::mutex> lk(m_lock);
+			m_cvJobs.wait(lk, [this] { return m_bExit || !m_jobs.empty(); });
+			if (m_bExit)
+				return;
+			pJob = m_jobs.front();
+			m_jobs.pop_front();
+		}
+		ThumbnailResult result;
+		Run(*pJob, &result);
+		pJob->done.set_value(result);
+		delete pJob;
+	}
+}
+
+void ThumbnailExtractor::Run(ThumbnailJob& job, ThumbnailResult* result)
+{
+	const ThumbnailOptions& opt = job.options;
+	FILE* fp = fopen(job.srcFile.c_str(), "rb");
+	if (fp == NULL) {
+		result->error = THUMB_ERR_OPEN_SRC;
+		return;
+	}
+
+	DavIndex index;
+	DavBuildIndex(fp, &index, DAV_INDEX_KEY_ONLY);
+	std::vector<size_t> selected;
+	SelectKeyFrames(index.frames, (int64_t)(opt.interval * 1000), &selected);
+	if (selected.empty()) {
+		fclose(fp);
+		result->error = THUMB_ERR_NO_KEYFRAME;
+		return;
+	}
+
+	// Room for the in-flight I frames, within the SDK limits
+	uint32_t nMaxFrame = 0;
+	for (size_t i : selected)
+		nMaxFrame = index.frames[i].length > nMaxFrame ? index.frames[i].length : nMaxFrame;
+	DWORD nBufSize = nMaxFrame * (THUMB_MAX_IN_FLIGHT + 2);
+	if (nBufSize < SOURCE_BUF_MIN)
+		nBufSize = SOURCE_BUF_MIN;
+
+	LONG nPort = 0;
+	if (!PLAY_GetFreePort(&nPort)) {
+		fclose(fp);
+		result->error = THUMB_ERR_PORT;
+		return;
+	}
+
+	ThumbPortState state;
+	state.targetWidth = opt.width;
+	state.thumbs.resize(selected.size());
+	state.status.assign(selected.size(), THUMB_SLOT_PENDING);
+
+	PLAY_SetStreamOpenMode(nPort, STREAME_REALTIME);
+	if (!PLAY_OpenStream(nPort, NULL, 0, nBufSize)) {
+		PLAY_ReleasePort(nPort);
+		fclose(fp);
+		result->error = THUMB_ERR_STREAM;
+		return;
+	}
+	PLAY_SetDecCBStream(nPort, 1);
+	PLAY_SetDecodeCallBack(nPort, ThumbDecodeCallBack, &state);
+	if (!PLAY_Play(nPort, NULL)) {
+		PLAY_CloseStream(nPort);
+		PLAY_ReleasePort(nPort);
+		fclose(fp);
+		result->error = THUMB_ERR_STREAM;
+		return;
+	}
+
+	const std::chrono::milliseconds timeout(opt.decodeTimeoutMs);
+	std::vector<uint8_t> frameBuf;
+	std::vector<size_t> written;	// slots that made it to disk
+	size_t nextEncode = 0;
+	char path[512];
+
+	// Encodes finished slots in order while later ones are still decoding
+	auto encodeReady = [&](size_t limit) {
+		for (; nextEncode < limit; nextEncode++) {
+			uint8_t status;
+			{
+				std::lock_guard<std::mutex> guard(state.lock);
+				status = state.status[nextEncode];
+			}
+			if (status == THUMB_SLOT_PENDING)
+				break;
+			if (status != THUMB_SLOT_READY)
+				continue;
+			snprintf(path, sizeof(path), "%s/thumb_%05d.jpg", job.outDir.c_str(), (int)written.size());
+			if (!PLAY_ConvertToJpegFile((char*)state.thumbs[nextEncode].data(), state.width, state.height,
+				T_IYUV, opt.quality, path)) {
+				result->error = THUMB_ERR_WRITE;
+				continue;
+			}
+			written.push_back(nextEncode);
+			result->ptsMs.push_back(index.frames[selected[nextEncode]].ptsMs);
+		}
+	};
+
+	// Gives up on whatever the decoder still holds
+	auto abandonPending = [&]() {
+		for (const ThumbPending& pending : state.pending)
+			state.status[pending.slot] = THUMB_SLOT_FAILED;
+		state.pending.clear();
+	};
+
+	for (size_t slot = 0; slot < selected.size(); slot++) {
+		const DavIndexEntry& entry = index.frames[selected[slot]];
+		frameBuf.resize(entry.length);
+		DavFrame header;
+		bool bRead = DavFileSeek(fp, entry.offset) == 0 && fread(frameBuf.data(), 1, entry.length, fp) == entry.length
+			&& DavParseHeader(frameBuf.data(), entry.length, &header) == DAV_PARSE_OK;
+
+		{
+			std::unique_lock<std::mutex> lk(state.lock);
+			if (!state.cv.wait_for(lk, timeout, [&] { return state.pending.size() < THUMB_MAX_IN_FLIGHT; }))
+				abandonPending();
+			if (bRead)
+				state.pending.push_back(ThumbPending{ slot, header.stampMs });
+			else
+				state.status[slot] = THUMB_SLOT_FAILED;
+		}
+
+		if (bRead && !PLAY_InputData(nPort, frameBuf.data(), entry.length)) {
+			std::lock_guard<std::mutex> guard(state.lock);
+			if (!state.pending.empty() && state.pending.back().slot == slot)
+				state.pending.pop_back();
+			state.status[slot] = THUMB_SLOT_FAILED;
+		}
+		encodeReady(slot);
+	}
+
+	{
+		std::unique_lock<std::mutex> lk(state.lock);
+		if (!state.cv.wait_for(lk, timeout, [&] { return state.pending.empty(); })) {
+			// A decoder holding back its last picture releases it on the next
+			// input, so feed the final I frame once more
+			lk.unlock();
+			PLAY_InputData(nPort, frameBuf.data(), (DWORD)frameBuf.size());
+			lk.lock();
+			if (!state.cv.wait_for(lk, timeout, [&] { return state.pending.empty(); }))
+				abandonPending();
+		}
+	}
+
+	PLAY_Stop(nPort);
+	PLAY_CloseStream(nPort);
+	PLAY_ReleasePort(nPort);
+	fclose(fp);
+
+	encodeReady(selected.size());
+	result->width = state.width;
+	result->height = state.height;
+	if (written.empty()) {
+		if (result->error == THUMB_OK)
+			result->error = THUMB_ERR_NO_KEYFRAME;
+		return;
+	}
+
+	// Sprite sheets: columns x rows thumbnails per JPEG, black background
+	int w = state.width;
+	int h = state.height;
+	int nPerSheet = opt.spriteColumns > 0 && opt.spriteRows > 0 ? opt.spriteColumns * opt.spriteRows : 0;
+	std::vector<uint8_t> sheet;
+	for (size_t first = 0; nPerSheet > 0 && first < written.size(); first += nPerSheet) {
+		int nCount = (int)(written.size() - first < (size_t)nPerSheet ? written.size() - first : nPerSheet);
+		int cols = nCount < opt.spriteColumns ? nCount : opt.spriteColumns;
+		int rows = (nCount + cols - 1) / cols;
+		int sheetW = cols * w;
+		int sheetH = rows * h;
+		size_t ySize = (size_t)sheetW * sheetH;
+		sheet.assign(ySize, 16);
+		sheet.resize(ySize * 3 / 2, 128);
+
+		for (int k = 0; k < nCount; k++) {
+			const uint8_t* thumb = state.thumbs[written[first + k]].data();
+			int x = (k % cols) * w;
+			int y = (k / cols) * h;
+			for (int row = 0; row < h; row++)
+				memcpy(&sheet[(size_t)(y + row) * sheetW + x], thumb + (size_t)row * w, w);
+			for (int plane = 1; plane < 3; plane++) {
+				uint8_t* dst = &sheet[ySize + (plane - 1) * ySize / 4];
+				const uint8_t* src = thumb + (size_t)w * h + (plane - 1) * (size_t)w * h / 4;
+				for (int row = 0; row < h / 2; row++)
+					memcpy(dst + (size_t)(y / 2 + row) * (sheetW / 2) + x / 2, src + (size_t)row * (w / 2), w / 2);
+			}
+		}
+
+		snprintf(path, sizeof(path), "%s/sprite_%d.jpg", job.outDir.c_str(), result->nSprites);
+		if (!PLAY_ConvertToJpegFile((char*)sheet.data(), sheetW, sheetH, T_IYUV, opt.quality, path))
+			result->error = THUMB_ERR_WRITE;
+		result->nSprites++;
+	}
+
+	// WebVTT map for players: each cue covers the time until the next thumbnail
+	snprintf(path, sizeof(path), "%s/thumbnails.vtt", job.outDir.c_str());
+	FILE* vtt = fopen(path, "w");
+	if (vtt == NULL) {
+		result->error = THUMB_ERR_WRITE;
+		return;
+	}
+	fprintf(vtt, "WEBVTT\n");
+	int64_t lastSpan = opt.interval >= 1.0 ? (int64_t)(opt.interval * 1000) : 1000;
+	for (size_t k = 0; k < written.size(); k++) {
+		char begin[16], end[16];
+		int64_t start = result->ptsMs[k];
+		int64_t stop = k + 1 < written.size() ? result->ptsMs[k + 1] : start + lastSpan;
+		FormatVttTime(start, begin, sizeof(begin));
+		FormatVttTime(stop, end, sizeof(end));
+		if (nPerSheet > 0) {
+			int nIndex = (int)(k % nPerSheet);
+			fprintf(vtt, "\n%s --> %s\nsprite_%d.jpg#xywh=%d,%d,%d,%d\n", begin, end, (int)(k / nPerSheet),
+				(nIndex % opt.spriteColumns) * w, (nIndex / opt.spriteColumns) * h, w, h);
+		}
+		else {
+			fprintf(vtt, "\n%s --> %s\nthumb_%05d.jpg\n", begin, end, (int)k);
+		}
+	}
+	if (fclose(vtt) != 0)
+		result->error = THUMB_ERR_WRITE;
+}
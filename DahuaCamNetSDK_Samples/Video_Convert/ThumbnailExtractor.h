@@ -0,0 +1,81 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "DavIndex.h"
+
+// Thumbnail result codes
+#define THUMB_OK				0
+#define THUMB_ERR_OPEN_SRC		1	// source file cannot be opened
+#define THUMB_ERR_PORT			2	// no free play port
+#define THUMB_ERR_STREAM		3	// PLAY_OpenStream / PLAY_Play failed
+#define THUMB_ERR_NO_KEYFRAME	4	// no complete I frame in the file
+#define THUMB_ERR_WRITE			5	// PLAY_ConvertToJpegFile or the WebVTT map failed
+#define THUMB_ERR_CANCELED		6	// extractor destroyed before the job ran
+
+struct ThumbnailOptions
+{
+	double interval = 10.0;		// seconds between thumbnails, 0 for every I frame
+	int width = 160;			// thumbnail width, height follows the aspect ratio
+	int quality = 75;			// JPEG quality (0, 100]
+	int spriteColumns = 10;		// 0: no sprite sheet
+	int spriteRows = 10;		// thumbnails per sheet is columns * rows
+	int decodeTimeoutMs = 2000;	// per I frame
+};
+
+struct ThumbnailResult
+{
+	int error = THUMB_OK;
+	int width = 0;
+	int height = 0;
+	std::vector<int64_t> ptsMs;	// per written thumbnail, from the start of the file
+	int nSprites = 0;
+};
+
+// One queued extraction: thumb_00000.jpg ... plus sprite_0.jpg ... and
+// thumbnails.vtt in outDir, which must exist.
+struct ThumbnailJob
+{
+	std::string srcFile;
+	std::string outDir;
+	ThumbnailOptions options;
+	std::promise<ThumbnailResult> done;
+};
+
+// Timeline preview extraction. The file is indexed by headers only, the I
+// frames at the requested interval are read directly and fed to a play port
+// in decode callback mode, so nothing but the chosen I frames is decoded.
+// Frames are downscaled in the decode callback and encoded to JPEG by the
+// worker while the decoder works on the next one. Each worker owns one port,
+// so files are processed in parallel across cores.
+class ThumbnailExtractor
+{
+public:
+	explicit ThumbnailExtractor(int nWorkers = 0);	// 0: one per core
+	~ThumbnailExtractor();
+
+	std::future<ThumbnailResult> Submit(const std::string& srcFile, const std::string& outDir,
+		const ThumbnailOptions& options = ThumbnailOptions());
+
+private:
+	void WorkerLoop();
+	void Run(ThumbnailJob& job, ThumbnailResult* result);
+
+	std::mutex m_lock;
+	std::condition_variable m_cvJobs;
+	std::deque<ThumbnailJob*> m_jobs;
+	std::vector<std::thread> m_workers;
+	bool m_bExit;
+};
+
+// Picks I frames at least intervalMs apart, starting with the first one.
+void SelectKeyFrames(const std::vector<DavIndexEntry>& keyFrames, int64_t intervalMs, std::vector<size_t>* selected);
+
+// Area-average downscale of one I420 picture into a packed I420 buffer of
+// dstW x dstH (both even).
+void ScaleI420(const uint8_t* const src[3], const int srcStride[3], int srcW, int srcH,
+	uint8_t* dst, int dstW, int dstH);
@@ -0,0 +1,331 @@
+#include <string.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+#include "TsMuxer.h"
+
+#define TS_STREAM_H264		0x1B
+#define TS_STREAM_H265		0x24
+#define TS_STREAM_AAC		0x0F
+#define DAV_AUDIO_AAC		0x1A
+
+// Video PES timestamps start one second in, PCR trails DTS by 100 ms
+#define TS_PTS_OFFSET		90000
+#define TS_PCR_DELAY		9000
+
+static uint32_t s_crcTable[256];
+
+static uint32_t Crc32Mpeg(const uint8_t* p, size_t n)
+{
+	if (s_crcTable[1] == 0) {
+		for (uint32_t i = 0; i < 256; i++) {
+			uint32_t c = i << 24;
+			for (int k = 0; k < 8; k++)
+				c = (c & 0x80000000) ? (c << 1) ^ 0x04C11DB7 : c << 1;
+			s_crcTable[i] = c;
+		}
+	}
+	uint32_t crc = 0xFFFFFFFF;
+	while (n--)
+		crc = (crc << 8) ^ s_crcTable[((crc >> 24) ^ *p++) & 0xFF];
+	return crc;
+}
+
+bool TsFdSink::Write(const uint8_t* p, size_t n)
+{
+	while (n > 0) {
+#ifdef _WIN32
+		int nWritten = _write(m_fd, p, (unsigned int)n);
+#else
+		ssize_t nWritten = write(m_fd, p, n);
+#endif
+		if (nWritten <= 0)
+			return false;
+		p += nWritten;
+		n -= nWritten;
+	}
+	return true;
+}
+
+TsMuxer::TsMuxer(TsSink* sink)
+	: m_sink(sink), m_outLen(0), m_bFailed(false), m_ccPat(0), m_ccPmt(0), m_ccVideo(0), m_ccAudio(0),
+	m_pmtVersion(0), m_bPsiSent(false), m_bHevc(false), m_bAudio(false), m_bStarted(false), m_nPackets(0)
+{
+}
+
+uint8_t* TsMuxer::NextPacket()
+{
+	if (m_outLen == sizeof(m_out)) {
+		if (!m_sink->Write(m_out, m_outLen))
+			m_bFailed = true;
+		m_outLen = 0;
+	}
+	uint8_t* pkt = m_out + m_outLen;
+	m_outLen += TS_PACKET_LEN;
+	m_nPackets++;
+	return pkt;
+}
+
+bool TsMuxer::Flush()
+{
+	if (m_outLen > 0) {
+		if (!m_sink->Write(m_out, m_outLen))
+			m_bFailed = true;
+		m_outLen = 0;
+	}
+	return !m_bFailed;
+}
+
+static void WriteSection(uint8_t* pkt, uint16_t pid, uint8_t& cc, const uint8_t* section, size_t n)
+{
+	pkt[0] = 0x47;
+	pkt[1] = 0x40 | (uint8_t)(pid >> 8);
+	pkt[2] = (uint8_t)pid;
+	pkt[3] = 0x10 | (cc++ & 0x0F);
+	pkt[4] = 0;		// pointer_field
+	memcpy(pkt + 5, section, n);
+	memset(pkt + 5 + n, 0xFF, TS_PACKET_LEN - 5 - n);
+}
+
+bool TsMuxer::WritePsi()
+{
+	uint8_t pat[16];
+	size_t n = 0;
+	pat[n++] = 0x00;						// table_id
+	pat[n++] = 0xB0; pat[n++] = 13;			// section_length
+	pat[n++] = 0x00; pat[n++] = 0x01;		// transport_stream_id
+	pat[n++] = 0xC1;						// version 0, current
+	pat[n++] = 0; pat[n++] = 0;
+	pat[n++] = 0x00; pat[n++] = 0x01;		// program 1
+	pat[n++] = 0xE0 | (TS_PID_PMT >> 8); pat[n++] = TS_PID_PMT & 0xFF;
+	uint32_t crc = Crc32Mpeg(pat, n);
+	pat[n++] = (uint8_t)(crc >> 24); pat[n++] = (uint8_t)(crc >> 16);
+	pat[n++] = (uint8_t)(crc >> 8); pat[n++] = (uint8_t)crc;
+	WriteSection(NextPacket(), 0, m_ccPat, pat, n);
+
+	uint8_t pmt[32];
+	n = 0;
+	size_t nSectionLen = 13 + 5 + (m_bAudio ? 5 : 0);
+	pmt[n++] = 0x02;
+	pmt[n++] = 0xB0 | (uint8_t)(nSectionLen >> 8); pmt[n++] = (uint8_t)nSectionLen;
+	pmt[n++] = 0x00; pmt[n++] = 0x01;		// program_number
+	pmt[n++] = 0xC1 | (uint8_t)((m_pmtVersion & 0x1F) << 1);
+	pmt[n++] = 0; pmt[n++] = 0;
+	pmt[n++] = 0xE0 | (TS_PID_VIDEO >> 8); pmt[n++] = TS_PID_VIDEO & 0xFF;	// PCR_PID
+	pmt[n++] = 0xF0; pmt[n++] = 0;			// program_info_length
+	pmt[n++] = m_bHevc ? TS_STREAM_H265 : TS_STREAM_H264;
+	pmt[n++] = 0xE0 | (TS_PID_VIDEO >> 8); pmt[n++] = TS_PID_VIDEO & 0xFF;
+	pmt[n++] = 0xF0; pmt[n++] = 0;
+	if (m_bAudio) {
+		pmt[n++] = TS_STREAM_AAC;
+		pmt[n++] = 0xE0 | (TS_PID_AUDIO >> 8); pmt[n++] = TS_PID_AUDIO & 0xFF;
+		pmt[n++] = 0xF0; pmt[n++] = 0;
+	}
+	crc = Crc32Mpeg(pmt, n);
+	pmt[n++] = (uint8_t)(crc >> 24); pmt[n++] = (uint8_t)(crc >> 16);
+	pmt[n++] = (uint8_t)(crc >> 8); pmt[n++] = (uint8_t)crc;
+	WriteSection(NextPacket(), TS_PID_PMT, m_ccPmt, pmt, n);
+
+	m_bPsiSent = true;
+	return !m_bFailed;
+}
+
+static void PutTimestamp(uint8_t* p, uint8_t marker, int64_t ts)
+{
+	p[0] = (uint8_t)(marker << 4 | ((ts >> 29) & 0x0E) | 1);
+	p[1] = (uint8_t)(ts >> 22);
+	p[2] = (uint8_t)(((ts >> 14) & 0xFE) | 1);
+	p[3] = (uint8_t)(ts >> 7);
+	p[4] = (uint8_t)(((ts << 1) & 0xFE) | 1);
+}
+
+bool TsMuxer::WritePes(uint16_t pid, uint8_t streamId, int64_t pts, bool bKey, bool bPcr, const Chunk* chunks, int nChunks)
+{
+	size_t nPayload = 0;
+	for (int i = 0; i < nChunks; i++)
+		nPayload += chunks[i].n;
+
+	uint8_t pesHeader[14];
+	size_t nPesHeader = 0;
+	size_t nPesLen = nPayload + 8;
+	pesHeader[nPesHeader++] = 0; pesHeader[nPesHeader++] = 0; pesHeader[nPesHeader++] = 1;
+	pesHeader[nPesHeader++] = streamId;
+	if (streamId == 0xE0 || nPesLen > 0xFFFF)
+		nPesLen = 0;	// unbounded video PES
+	pesHeader[nPesHeader++] = (uint8_t)(nPesLen >> 8);
+	pesHeader[nPesHeader++] = (uint8_t)nPesLen;
+	pesHeader[nPesHeader++] = 0x80;
+	pesHeader[nPesHeader++] = 0x80;			// PTS only, no B frames from these encoders
+	pesHeader[nPesHeader++] = 5;
+	PutTimestamp(pesHeader + nPesHeader, 2, pts & 0x1FFFFFFFFLL);
+	nPesHeader += 5;
+
+	size_t nLeft = nPesHeader + nPayload;
+	size_t nHeaderPos = 0;
+	int chunk = 0;
+	size_t chunkPos = 0;
+	uint8_t& cc = pid == TS_PID_VIDEO ? m_ccVideo : m_ccAudio;
+	bool bFirst = true;
+
+	while (nLeft > 0) {
+		uint8_t* pkt = NextPacket();
+		pkt[0] = 0x47;
+		pkt[1] = (uint8_t)((bFirst ? 0x40 : 0) | (pid >> 8));
+		pkt[2] = (uint8_t)pid;
+
+		size_t nAf = 0;		// adaptation field bytes including its length byte
+		uint8_t afFlags = 0;
+		if (bFirst && bPcr) {
+			nAf = 8;
+			afFlags = 0x10 | (bKey ? 0x40 : 0);
+		}
+		else if (bFirst && bKey) {
+			nAf = 2;
+			afFlags = 0x40;
+		}
+		if (nLeft < 184 - nAf)
+			nAf = 184 - nLeft;	// stuff the last packet
+
+		pkt[3] = (uint8_t)((nAf ? 0x30 : 0x10) | (cc++ & 0x0F));
+		uint8_t* cur = pkt + 4;
+		if (nAf > 0) {
+			cur[0] = (uint8_t)(nAf - 1);
+			if (nAf > 1) {
+				cur[1] = afFlags;
+				size_t nUsed = 2;
+				if (afFlags & 0x10) {
+					int64_t pcr = (pts - TS_PCR_DELAY) & 0x1FFFFFFFFLL;
+					cur[2] = (uint8_t)(pcr >> 25);
+					cur[3] = (uint8_t)(pcr >> 17);
+					cur[4] = (uint8_t)(pcr >> 9);
+					cur[5] = (uint8_t)(pcr >> 1);
+					cur[6] = (uint8_t)((pcr & 1) << 7 | 0x7E);
+					cur[7] = 0;
+					nUsed = 8;
+				}
+				memset(cur + nUsed, 0xFF, nAf - nUsed);
+			}
+			cur += nAf;
+		}
+
+		size_t nSpace = 184 - nAf;
+		while (nSpace > 0 && nHeaderPos < nPesHeader) {
+			*cur++ = pesHeader[nHeaderPos++];
+			nSpace--;
+			nLeft--;
+		}
+		while (nSpace > 0 && chunk < nChunks) {
+			size_t n = chunks[chunk].n - chunkPos;
+			if (n > nSpace)
+				n = nSpace;
+			memcpy(cur, chunks[chunk].p + chunkPos, n);
+			cur += n;
+			chunkPos += n;
+			nSpace -= n;
+			nLeft -= n;
+			if (chunkPos == chunks[chunk].n) {
+				chunk++;
+				chunkPos = 0;
+			}
+		}
+		bFirst = false;
+	}
+	return !m_bFailed;
+}
+
+static bool StartsWithAud(const uint8_t* p, size_t n, bool bHevc)
+{
+	size_t i = 0;
+	while (i < n && i < 4 && p[i] == 0)
+		i++;
+	if (i < 2 || i >= n || p[i] != 1 || i + 1 >= n)
+		return false;
+	uint8_t h = p[i + 1];
+	return bHevc ? ((h >> 1) & 0x3F) == 35 : (h & 0x1F) == 9;
+}
+
+bool TsMuxer::InputFrame(const DavFrame& frame)
+{
+	if (m_bFailed)
+		return false;
+
+	if (frame.IsVideo()) {
+		if (!m_bStarted) {
+			if (!frame.IsKey())
+				return true;	// wait for a decodable start
+			m_bStarted = true;
+		}
+		if (frame.IsKey()) {
+			bool bHevc = frame.videoCodec == DAV_CODEC_H265;
+			if (bHevc != m_bHevc) {
+				m_bHevc = bHevc;
+				m_pmtVersion++;
+			}
+			if (!WritePsi())
+				return false;
+		}
+
+		static const uint8_t audH264[] = { 0, 0, 0, 1, 0x09, 0xF0 };
+		static const uint8_t audH265[] = { 0, 0, 0, 1, 0x46, 0x01, 0x50 };
+		Chunk chunks[2];
+		int nChunks = 0;
+		if (!StartsWithAud(frame.payload, frame.payloadLen, m_bHevc)) {
+			chunks[nChunks].p = m_bHevc ? audH265 : audH264;
+			chunks[nChunks].n = m_bHevc ? sizeof(audH265) : sizeof(audH264);
+			nChunks++;
+		}
+		chunks[nChunks].p = frame.payload;
+		chunks[nChunks].n = frame.payloadLen;
+		nChunks++;
+		return WritePes(TS_PID_VIDEO, 0xE0, frame.ptsMs * 90 + TS_PTS_OFFSET, frame.IsKey(), true, chunks, nChunks);
+	}
+
+	if (frame.type == DAV_FRAME_AUDIO && frame.audioCodec == DAV_AUDIO_AAC) {
+		if (!m_bAudio) {
+			m_bAudio = true;
+			m_pmtVersion++;
+			if (m_bPsiSent && !WritePsi())
+				return false;
+		}
+		if (!m_bStarted)
+			return true;
+		Chunk chunk = { frame.payload, frame.payloadLen };
+		return WritePes(TS_PID_AUDIO, 0xC0, frame.ptsMs * 90 + TS_PTS_OFFSET, false, false, &chunk, 1);
+	}
+	return true;
+}
+
+struct DavToTsContext
+{
+	TsMuxer* muxer;
+	bool bOk;
+};
+
+static void DavToTsFrame(const DavFrame& frame, void* pUser)
+{
+	DavToTsContext* ctx = (DavToTsContext*)pUser;
+	if (ctx->bOk && !ctx->muxer->InputFrame(frame))
+		ctx->bOk = false;
+}
+
+bool DavFileToTs(const char* srcFile, TsSink* sink)
+{
+	FILE* fp = fopen(srcFile, "rb");
+	if (fp == NULL)
+		return false;
+
+	TsMuxer muxer(sink);
+	DavToTsContext ctx = { &muxer, true };
+	DavFrameReader reader(DavToTsFrame, &ctx);
+
+	const int readlen = 64 * 1024;
+	std::vector<uint8_t> readBuffer(readlen);
+	size_t nRead = 0;
+	while (ctx.bOk && (nRead = fread(readBuffer.data(), 1, readlen, fp)) > 0)
+		reader.Input(readBuffer.data(), nRead);
+	fclose(fp);
+
+	return muxer.Flush() && ctx.bOk;
+}
@@ -0,0 +1,95 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include "DavFrame.h"
+
+#define TS_PACKET_LEN			188
+#define TS_PACKETS_PER_WRITE	7		// 1316 bytes, one UDP datagram
+
+#define TS_PID_PMT				0x1000
+#define TS_PID_VIDEO			0x0100
+#define TS_PID_AUDIO			0x0101
+
+// Where muxed packets go. Write always receives whole packets.
+class TsSink
+{
+public:
+	virtual ~TsSink() {}
+	virtual bool Write(const uint8_t* p, size_t n) = 0;
+};
+
+class TsFileSink : public TsSink
+{
+public:
+	explicit TsFileSink(FILE* fp) : m_fp(fp) {}
+	bool Write(const uint8_t* p, size_t n) override { return fwrite(p, 1, n, m_fp) == n; }
+
+private:
+	FILE* m_fp;
+};
+
+// File descriptor sink: regular files, pipes, and sockets on POSIX
+class TsFdSink : public TsSink
+{
+public:
+	explicit TsFdSink(int fd) : m_fd(fd) {}
+	bool Write(const uint8_t* p, size_t n) override;
+
+private:
+	int m_fd;
+};
+
+class TsCallbackSink : public TsSink
+{
+public:
+	typedef bool (*WriteFunc)(const uint8_t* p, size_t n, void* pUser);
+	TsCallbackSink(WriteFunc func, void* pUser) : m_func(func), m_pUser(pUser) {}
+	bool Write(const uint8_t* p, size_t n) override { return m_func(p, n, m_pUser); }
+
+private:
+	WriteFunc m_func;
+	void* m_pUser;
+};
+
+// DAV frames in, 188 byte MPEG-TS packets out. Payloads are packetized
+// straight from the frame buffer into a fixed output block, so memory use
+// does not depend on input length. H.264/H.265 video; AAC audio is carried,
+// other audio codecs have no TS stream type and are dropped.
+class TsMuxer
+{
+public:
+	explicit TsMuxer(TsSink* sink);
+
+	bool InputFrame(const DavFrame& frame);
+	bool Flush();
+
+	uint64_t PacketsWritten() const { return m_nPackets; }
+
+private:
+	struct Chunk
+	{
+		const uint8_t* p;
+		size_t n;
+	};
+
+	bool WritePsi();
+	bool WritePes(uint16_t pid, uint8_t streamId, int64_t pts, bool bKey, bool bPcr, const Chunk* chunks, int nChunks);
+	uint8_t* NextPacket();
+
+	TsSink* m_sink;
+	uint8_t m_out[TS_PACKET_LEN * TS_PACKETS_PER_WRITE];
+	size_t m_outLen;
+	bool m_bFailed;
+
+	uint8_t m_ccPat, m_ccPmt, m_ccVideo, m_ccAudio;
+	uint8_t m_pmtVersion;
+	bool m_bPsiSent;
+	bool m_bHevc;
+	bool m_bAudio;
+	bool m_bStarted;
+	uint64_t m_nPackets;
+};
+
+// Remux a DAV file to TS, reading in fixed-size chunks.
+bool DavFileToTs(const char* srcFile, TsSink* sink);
@@ -1,68 +1,145 @@
 #include <stdio.h>
 #include <string>
 #include "play.h"
-#include "afx.h"
-#include "afxstr.h"
-#include "CharactorTansfer.h"
-
-CFile srcFile;
-CString strsrcFile = "D:/DahuaRecord/record.dav";
-CString strdstFile = "D:/DahuaRecord/record.mp4";
-bool isConverting = false;
-
-bool StartConvert() {
-	if (!srcFile.Open(strsrcFile, CFile::modeRead | CFile::shareDenyNone)) {
-		isConverting = false;
-		return false;
-	}
+#include "VideoConvert.h"
 
-	PLAY_SetStreamOpenMode(0, STREAME_FILE);
-	PLAY_OpenStream(0, NULL, 0, (SOURCE_BUF_MIN + SOURCE_BUF_MAX) / 2);
-	PLAY_Play(0, NULL);
+// Both wake the feeder's drain wait, which then asks the port's buffers
+static void CALLBACK ConvertFileEndCallBack(DWORD nPort, void* pUserData)
+{
+	((PlayFeeder*)pUserData)->Progress();
+}
 
-	BOOL bRet = FALSE;
-	std::string strFileNameA = UnicodeToGbk(strdstFile.GetBuffer(0));
+static void CALLBACK ConvertDisplayCallBack(LONG nPort, char* pBuf, LONG nSize, LONG nWidth, LONG nHeight, LONG nStamp, LONG nType, void* pUserData)
+{
+	((PlayFeeder*)pUserData)->Progress();
+}
 
-	bRet = PLAY_StartDataRecord(0, (char*)strFileNameA.c_str(), DATA_RECORD_MP4);
+VideoConverter::VideoConverter(int nWorkers) : m_bExit(false)
+{
+	if (nWorkers < 1)
+		nWorkers = 1;
+	for (int i = 0; i < nWorkers; i++)
+		m_workers.emplace_back(&VideoConverter::WorkerLoop, this);
+}
 
-	if (!bRet)
+VideoConverter::~VideoConverter()
+{
 	{
-		isConverting = false;
-		PLAY_Stop(0);
-		PLAY_CloseStream(0);
-		srcFile.Close();
-		return false;
+		std::lock_guard<std::mutex> guard(m_lock);
+		m_bExit = true;
 	}
+	m_cvJobs.notify_all();
+	for (std::thread& t : m_workers)
+		t.join();
+
+	for (ConvertJob* pJob : m_jobs) {
+		pJob->done.set_value(CONVERT_ERR_CANCELED);
+		delete pJob;
+	}
+	m_jobs.clear();
 }
 
-void StopConvert() {
-	PLAY_StopDataRecord(0);
-	PLAY_Stop(0);
-	PLAY_CloseStream(0);
-	srcFile.Close();
+std::future<int> VideoConverter::Submit(const std::string& srcFile, const std::string& dstFile, FeederStats* pStats)
+{
+	ConvertJob* pJob = new ConvertJob;
+	pJob->srcFile = srcFile;
+	pJob->dstFile = dstFile;
+	pJob->pStats = pStats;
+	std::future<int> result = pJob->done.get_future();
+	{
+		std::lock_guard<std::mutex> guard(m_lock);
+		m_jobs.push_back(pJob);
+	}
+	m_cvJobs.notify_one();
+	return result;
 }
 
-void videoConvert() {
-	if (!StartConvert())
-		return;
-
-	const int readlen = 8 * 1024;
-	BYTE readBuffer[readlen];
-
-	while (isConverting) {
-		DWORD nRead = srcFile.Read(readBuffer, readlen);
-		if (nRead < 0)
-			break;
-		while (!PLAY_InputData(0, readBuffer, readlen))
-			Sleep(10);
+void VideoConverter::WorkerLoop()
+{
+	for (;;) {
+		ConvertJob* pJob = NULL;
+		{
+			std::unique_lock<std::mutex> lk(m_lock);
+			m_cvJobs.wait(lk, [this] { return m_bExit || !m_jobs.empty(); });
+			if (m_bExit)
+				return;
+			pJob = m_jobs.front();
+			m_jobs.pop_front();
+		}
+		pJob->done.set_value(Run(*pJob));
+		delete pJob;
 	}
+}
 
-	while ((PLAY_GetBufferValue(0, BUF_VIDEO_RENDER) + PLAY_GetSourceBufferRemain(0)) > 0)
-	{
-		Sleep(5);
+int VideoConverter::Run(ConvertJob& job)
+{
+	FILE* fp = fopen(job.srcFile.c_str(), "rb");
+	if (fp == NULL)
+		return CONVERT_ERR_OPEN_SRC;
+
+	LONG nPort = 0;
+	if (!PLAY_GetFreePort(&nPort)) {
+		fclose(fp);
+		return CONVERT_ERR_PORT;
 	}
 
-	StopConvert();
-	srcFile.Close();
-	printf("Convert finished.\n");
-}
\ No newline at end of file
+	const DWORD nBufSize = (SOURCE_BUF_MIN + SOURCE_BUF_MAX) / 2;
+	PLAY_SetStreamOpenMode(nPort, STREAME_FILE);
+	if (!PLAY_OpenStream(nPort, NULL, 0, nBufSize)) {
+		PLAY_ReleasePort(nPort);
+		fclose(fp);
+		return CONVERT_ERR_STREAM;
+	}
+	PlayFeeder feeder(nPort, nBufSize);
+	PLAY_SetFileEndCallBack(nPort, ConvertFileEndCallBack, &feeder);
+	PLAY_SetDisplayCallBack(nPort, ConvertDisplayCallBack, &feeder);
+
+	if (!PLAY_Play(nPort, NULL)) {
+		PLAY_CloseStream(nPort);
+		PLAY_ReleasePort(nPort);
+		fclose(fp);
+		return CONVERT_ERR_STREAM;
+	}
+
+	if (!PLAY_StartDataRecord(nPort, (char*)job.dstFile.c_str(), DATA_RECORD_MP4)) {
+		PLAY_Stop(nPort);
+		PLAY_CloseStream(nPort);
+		PLAY_ReleasePort(nPort);
+		fclose(fp);
+		return CONVERT_ERR_RECORD;
+	}
+
+	bool bFed = feeder.FeedFile(fp);
+	fclose(fp);
+
+	// Done once the source and render buffers are empty; every frame that
+	// leaves either one fires a callback, so the check runs per frame and
+	// the job ends with its last frame
+	int ret = CONVERT_ERR_READ;
+	if (bFed)
+		ret = feeder.WaitDrained(CONVERT_STALL_MS) ? CONVERT_OK : CONVERT_ERR_TIMEOUT;
+	else if (feeder.GetStats().nStalls > 0)
+		ret = CONVERT_ERR_TIMEOUT;
+
+	PLAY_StopDataRecord(nPort);
+	PLAY_Stop(nPort);
+	PLAY_CloseStream(nPort);
+	PLAY_ReleasePort(nPort);
+	if (job.pStats != NULL)
+		*job.pStats = feeder.GetStats();
+	return ret;
+}
+
+void videoConvert() {
+	VideoConverter converter(1);
+	FeederStats stats;
+	std::future<int> result = converter.Submit("D:/DahuaRecord/record.dav", "D:/DahuaRecord/record.mp4", &stats);
+
+	if (result.get() == CONVERT_OK)
+		printf("Convert finished.\n");
+	else
+		printf("Convert failed.\n");
+	printf("Fed %llu bytes in %llu pushes (%u..%u bytes), %llu waits, %.1f ms blocked, %llu stalls, peak buffer %u bytes\n",
+		(unsigned long long)stats.nBytes, (unsigned long long)stats.nPushes, stats.minChunk, stats.maxChunk,
+		(unsigned long long)stats.nWaits, stats.waitMs, (unsigned long long)stats.nStalls, stats.maxFill);
+}
@@ -0,0 +1,59 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "PlayFeeder.h"
+
+// Conversion result codes
+#define CONVERT_OK				0
+#define CONVERT_ERR_OPEN_SRC	1	// source file cannot be opened
+#define CONVERT_ERR_PORT		2	// no free play port
+#define CONVERT_ERR_STREAM		3	// PLAY_OpenStream / PLAY_Play failed
+#define CONVERT_ERR_RECORD		4	// PLAY_StartDataRecord failed
+#define CONVERT_ERR_CANCELED	5	// converter destroyed before the job ran
+#define CONVERT_ERR_READ		6	// source read failed part way
+#define CONVERT_ERR_TIMEOUT		7	// the port stopped making progress with data left
+
+// A conversion is done when the port's source and video render buffers are
+// both empty, checked on every demux, display and file end callback. One
+// whose port calls back nothing for CONVERT_STALL_MS with data left is
+// given up; this is a guard against a hung port, not how jobs end.
+#define CONVERT_STALL_MS		30000
+
+// One queued DAV -> MP4 conversion.
+struct ConvertJob
+{
+	std::string srcFile;
+	std::string dstFile;
+	FeederStats* pStats;		// optional, filled before done is set
+	std::promise<int> done;
+};
+
+// Runs conversions on a fixed number of play ports. Input goes through a
+// PlayFeeder, completion is signalled by the port's callbacks and surfaced
+// through the future returned by Submit; waiting jobs and idle workers block
+// on condition variables, nothing polls.
+class VideoConverter
+{
+public:
+	explicit VideoConverter(int nWorkers = 4);
+	~VideoConverter();
+
+	std::future<int> Submit(const std::string& srcFile, const std::string& dstFile, FeederStats* pStats = NULL);
+
+private:
+	void WorkerLoop();
+	int Run(ConvertJob& job);
+
+	std::mutex m_lock;
+	std::condition_variable m_cvJobs;
+	std::deque<ConvertJob*> m_jobs;
+	std::vector<std::thread> m_workers;
+	bool m_bExit;
+};
+
+void videoConvert();